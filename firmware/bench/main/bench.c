@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "bench.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#define BENCH_UNIT  "ns"
+#else
+#include "esp_cpu.h"
+#define BENCH_UNIT  "cycles"
+#endif
+
+static const char *TAG = "bench";
+
+#define BENCH_WARMUP_ITERATIONS     8
+#define BENCH_OVERHEAD_ITERATIONS   256
+
+static uint32_t s_samples[BENCH_MAX_ITERATIONS];
+static bench_result_t s_results[BENCH_MAX_RESULTS];
+static uint32_t s_result_count;
+static uint32_t s_overhead;
+
+static inline uint32_t bench_now(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+static void empty_iteration(void *arg)
+{
+    (void)arg;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* fills s_samples[0..n), already minus the harness overhead */
+static void sample(bench_fn_t fn, void *arg, uint32_t n)
+{
+    for (uint32_t i = 0; i < BENCH_WARMUP_ITERATIONS; i++) {
+        fn(arg);
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t start = bench_now();
+        fn(arg);
+        uint32_t elapsed = bench_now() - start;
+        s_samples[i] = elapsed > s_overhead ? elapsed - s_overhead : 0;
+    }
+}
+
+void bench_init(void)
+{
+    s_overhead = 0;
+    sample(empty_iteration, NULL, BENCH_OVERHEAD_ITERATIONS);
+    qsort(s_samples, BENCH_OVERHEAD_ITERATIONS, sizeof(uint32_t), compare_u32);
+    s_overhead = s_samples[0];
+    s_result_count = 0;
+}
+
+const bench_result_t *bench_run(const char *name, bench_fn_t fn, void *arg, uint32_t iterations)
+{
+    if (s_result_count >= BENCH_MAX_RESULTS) {
+        ESP_LOGE(TAG, "Too many results, %s skipped", name);
+        return NULL;
+    }
+    if (iterations == 0) return NULL;
+    if (iterations > BENCH_MAX_ITERATIONS) iterations = BENCH_MAX_ITERATIONS;
+
+    sample(fn, arg, iterations);
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        total += s_samples[i];
+    }
+    qsort(s_samples, iterations, sizeof(uint32_t), compare_u32);
+
+    bench_result_t *r = &s_results[s_result_count++];
+    strncpy(r->name, name, BENCH_NAME_MAX_LEN - 1);
+    r->name[BENCH_NAME_MAX_LEN - 1] = '\0';
+    r->iterations = iterations;
+    r->min = s_samples[0];
+    r->mean = (uint32_t)(total / iterations);
+    r->p50 = s_samples[(iterations - 1) * 50 / 100];
+    r->p90 = s_samples[(iterations - 1) * 90 / 100];
+    r->p99 = s_samples[(iterations - 1) * 99 / 100];
+    r->max = s_samples[iterations - 1];
+
+    /* the idle task feeds the task watchdog on the badge */
+    vTaskDelay(1);
+    return r;
+}
+
+uint32_t bench_units_per_ms(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return 1000000;
+#else
+    return CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000;
+#endif
+}
+
+static void write_json(FILE *f)
+{
+    fprintf(f, "{\"target\":\"%s\",\"unit\":\"" BENCH_UNIT "\"", CONFIG_IDF_TARGET);
+#ifdef CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+    fprintf(f, ",\"cpu_mhz\":%d", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#endif
+#ifdef IDF_VER
+    fprintf(f, ",\"idf\":\"%s\"", IDF_VER);
+#endif
+    fprintf(f, ",\"overhead\":%lu,\"results\":[", (unsigned long)s_overhead);
+    for (uint32_t i = 0; i < s_result_count; i++) {
+        const bench_result_t *r = &s_results[i];
+        fprintf(f, "%s{\"name\":\"%s\",\"n\":%lu,\"min\":%lu,\"mean\":%lu,"
+                   "\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}",
+                i ? "," : "", r->name, (unsigned long)r->iterations,
+                (unsigned long)r->min, (unsigned long)r->mean, (unsigned long)r->p50,
+                (unsigned long)r->p90, (unsigned long)r->p99, (unsigned long)r->max);
+    }
+    fprintf(f, "]}");
+}
+
+void bench_report(const char *json_path)
+{
+    printf("\n%-40s %6s %8s %8s %8s %8s %8s  (" BENCH_UNIT ")\n",
+           "name", "n", "min", "p50", "p90", "p99", "max");
+    for (uint32_t i = 0; i < s_result_count; i++) {
+        const bench_result_t *r = &s_results[i];
+        printf("%-40s %6lu %8lu %8lu %8lu %8lu %8lu\n", r->name, (unsigned long)r->iterations,
+               (unsigned long)r->min, (unsigned long)r->p50, (unsigned long)r->p90,
+               (unsigned long)r->p99, (unsigned long)r->max);
+    }
+
+    printf("BENCH_JSON ");
+    write_json(stdout);
+    printf("\n");
+    fflush(stdout);
+
+    if (json_path != NULL) {
+        FILE *f = fopen(json_path, "w");
+        if (f == NULL) {
+            ESP_LOGE(TAG, "Cannot write %s", json_path);
+            return;
+        }
+        write_json(f);
+        fputc('\n', f);
+        fclose(f);
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * bench.h - Minimal per-iteration timing harness
+ *
+ * Every iteration is timed on its own: CPU cycles from
+ * esp_cpu_get_cycle_count() on the badge, nanoseconds from CLOCK_MONOTONIC
+ * on the linux target. The cost of an empty iteration is measured once and
+ * subtracted, so small functions are not swamped by the harness.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BENCH_MAX_ITERATIONS    1000
+#define BENCH_MAX_RESULTS       48
+#define BENCH_NAME_MAX_LEN      48
+
+typedef void (*bench_fn_t)(void *arg);
+
+typedef struct {
+    char name[BENCH_NAME_MAX_LEN];
+    uint32_t iterations;
+    uint32_t min;
+    uint32_t mean;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t max;
+} bench_result_t;
+
+/**
+ * @brief Measure the harness overhead; call once before bench_run()
+ */
+void bench_init(void);
+
+/**
+ * @brief Time fn(arg) iterations times and record the distribution
+ *
+ * @param name       Result name, "function/variant"
+ * @param fn         One iteration
+ * @param arg        Passed to fn unchanged
+ * @param iterations Clamped to BENCH_MAX_ITERATIONS
+ * @return The recorded result, NULL if none was
+ */
+const bench_result_t *bench_run(const char *name, bench_fn_t fn, void *arg, uint32_t iterations);
+
+/**
+ * @brief Result units in a millisecond, to put a cost against a time budget
+ */
+uint32_t bench_units_per_ms(void);
+
+/**
+ * @brief Print a table and the "BENCH_JSON {...}" line
+ *
+ * @param json_path Also write the JSON document here (NULL: console only)
+ */
+void bench_report(const char *json_path);
+
+/* defined per module in bench_<module>.c */
+void bench_pairing(void);
+void bench_neighbor(void);
+void bench_proximity(void);
+void bench_ble_cmd(void);
+void bench_aw9523(void);
+void bench_bus(void);
+void bench_snapshot(void);
+void bench_ota(void);
+void bench_assets(void);
+void bench_crowd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_H */
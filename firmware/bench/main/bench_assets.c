@@ -0,0 +1,225 @@
+/*
+ * bench_assets.c - a table read in place from the assets partition, against
+ * the same bytes from NVS
+ *
+ * The container holds the built-in "zones" table and a 1 KiB "bench" blob,
+ * built here in the layout of assets.h. On the badge it is written to the
+ * "assets" partition unless the partition already holds exactly that (the
+ * bench leaves it there: write the event's assets.bin back afterwards); on
+ * the host it goes to a file for sim_partition.c. The same two blobs are
+ * stored in NVS, and each case reads one of them either way:
+ *
+ *   assets_find/zones     the index lookup alone
+ *   assets_read/<len>     lookup, then every byte summed through the mapping
+ *   nvs_get_blob/<len>    the blob copied out with the handle already open
+ *
+ * After the first iteration the mapping is in the flash cache, as a table
+ * in use would be; max shows what a miss costs. Host NVS is sim_nvs.c's
+ * list in RAM, so only the badge's NVS numbers mean anything.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sdkconfig.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "assets.h"
+#include "bench.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "nvs_flash.h"
+#endif
+
+#define BENCH_ASSETS_BLOB_LEN   1024
+#define BENCH_ASSETS_NAMESPACE  "bench"
+
+typedef struct {
+    const char *name;
+    size_t len;
+} bench_asset_t;
+
+static const asset_zone_t s_zones[] = {
+    { 0, 0, 0 }, { 10, 0, 50 }, { 7, 0, 100 }, { 5, 0, 200 }, { 3, 0, 400 }, { 1, 0, 800 },
+};
+
+static uint8_t s_blob[BENCH_ASSETS_BLOB_LEN];
+static uint8_t s_image[sizeof(assets_header_t) + 2 * sizeof(assets_entry_t) + sizeof(s_zones) +
+                       BENCH_ASSETS_BLOB_LEN];
+static uint8_t s_copy[BENCH_ASSETS_BLOB_LEN];
+static nvs_handle_t s_nvs;
+static volatile uint32_t s_sink;
+
+static const bench_asset_t s_zones_case = { ASSET_ZONES, sizeof(s_zones) };
+static const bench_asset_t s_blob_case = { "bench", BENCH_ASSETS_BLOB_LEN };
+
+/* s_zones then s_blob, both already at 4 byte offsets */
+static size_t build_image(void)
+{
+    assets_header_t *hdr = (assets_header_t *)s_image;
+    assets_entry_t *index = (assets_entry_t *)(s_image + sizeof(*hdr));
+    uint32_t at = sizeof(*hdr) + 2 * sizeof(*index);
+
+    for (int i = 0; i < BENCH_ASSETS_BLOB_LEN; i++) {
+        s_blob[i] = (uint8_t)(i * 7 + 1);
+    }
+
+    memset(index, 0, 2 * sizeof(*index));
+    strcpy(index[0].name, ASSET_ZONES);
+    index[0].offset = at;
+    index[0].len = sizeof(s_zones);
+    memcpy(s_image + at, s_zones, sizeof(s_zones));
+    at += sizeof(s_zones);
+
+    strcpy(index[1].name, s_blob_case.name);
+    index[1].offset = at;
+    index[1].len = BENCH_ASSETS_BLOB_LEN;
+    memcpy(s_image + at, s_blob, BENCH_ASSETS_BLOB_LEN);
+    at += BENCH_ASSETS_BLOB_LEN;
+
+    hdr->magic = ASSETS_MAGIC;
+    hdr->version = ASSETS_VERSION;
+    hdr->count = 2;
+    hdr->size = at;
+    hdr->crc = esp_rom_crc32_le(0, s_image + sizeof(*hdr), at - sizeof(*hdr));
+    return at;
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+
+static bool install_image(size_t len)
+{
+    static char path[64];
+    snprintf(path, sizeof(path), "/tmp/wayside_bench_assets.%d.bin", (int)getpid());
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return false;
+    bool ok = fwrite(s_image, 1, len, f) == len;
+    fclose(f);
+    setenv("WAYSIDE_SIM_ASSETS", path, 1);
+    return ok;
+}
+
+static void remove_image(void)
+{
+    unlink(getenv("WAYSIDE_SIM_ASSETS"));
+}
+
+static esp_err_t open_nvs(void)
+{
+    return nvs_open(BENCH_ASSETS_NAMESPACE, NVS_READWRITE, &s_nvs);
+}
+
+#else
+
+static bool install_image(size_t len)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ASSETS_PARTITION_SUBTYPE,
+                                                            "assets");
+    uint8_t chunk[64];
+
+    if (part == NULL) return false;
+    for (size_t off = 0; off < len; off += sizeof(chunk)) {
+        size_t n = len - off < sizeof(chunk) ? len - off : sizeof(chunk);
+        if (esp_partition_read(part, off, chunk, n) != ESP_OK) break;
+        if (memcmp(chunk, s_image + off, n) != 0) break;
+        if (off + n == len) return true;
+    }
+
+    printf("bench_assets: writing the bench container to the \"assets\" partition\n");
+    return esp_partition_erase_range(part, 0, part->size) == ESP_OK &&
+           esp_partition_write(part, 0, s_image, len) == ESP_OK;
+}
+
+static void remove_image(void)
+{
+}
+
+static esp_err_t open_nvs(void)
+{
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase();
+        err = nvs_flash_init();
+    }
+    if (err != ESP_OK) return err;
+    return nvs_open(BENCH_ASSETS_NAMESPACE, NVS_READWRITE, &s_nvs);
+}
+
+#endif /* CONFIG_IDF_TARGET_LINUX */
+
+static void run_find(void *arg)
+{
+    size_t len;
+    s_sink = (uint32_t)(uintptr_t)assets_find(ASSET_ZONES, &len);
+}
+
+static void run_assets_read(void *arg)
+{
+    const bench_asset_t *a = arg;
+    size_t len;
+    const uint8_t *p = assets_find(a->name, &len);
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    s_sink = sum;
+}
+
+static void run_nvs_read(void *arg)
+{
+    const bench_asset_t *a = arg;
+    size_t len = sizeof(s_copy);
+    uint32_t sum = 0;
+
+    nvs_get_blob(s_nvs, a->name, s_copy, &len);
+    for (size_t i = 0; i < len; i++) {
+        sum += s_copy[i];
+    }
+    s_sink = sum;
+}
+
+void bench_assets(void)
+{
+    size_t len = build_image();
+
+    if (!install_image(len) || assets_init() != ESP_OK) {
+        printf("bench_assets: no usable \"assets\" partition, skipped\n");
+        return;
+    }
+    if (open_nvs() != ESP_OK ||
+        nvs_set_blob(s_nvs, s_zones_case.name, s_zones, sizeof(s_zones)) != ESP_OK ||
+        nvs_set_blob(s_nvs, s_blob_case.name, s_blob, BENCH_ASSETS_BLOB_LEN) != ESP_OK ||
+        nvs_commit(s_nvs) != ESP_OK) {
+        printf("bench_assets: NVS unavailable, skipped\n");
+        remove_image();
+        return;
+    }
+
+    size_t got;
+    const uint8_t *blob = assets_find(s_blob_case.name, &got);
+    if (blob == NULL || got != BENCH_ASSETS_BLOB_LEN || memcmp(blob, s_blob, got) != 0) {
+        printf("bench_assets: \"%s\" doesn't read back, skipped\n", s_blob_case.name);
+        remove_image();
+        return;
+    }
+
+    bench_run("assets_find/zones", run_find, NULL, BENCH_MAX_ITERATIONS);
+    bench_run("assets_read/24B", run_assets_read, (void *)&s_zones_case, BENCH_MAX_ITERATIONS);
+    bench_run("nvs_get_blob/24B", run_nvs_read, (void *)&s_zones_case, BENCH_MAX_ITERATIONS);
+    bench_run("assets_read/1KiB", run_assets_read, (void *)&s_blob_case, BENCH_MAX_ITERATIONS);
+    bench_run("nvs_get_blob/1KiB", run_nvs_read, (void *)&s_blob_case, BENCH_MAX_ITERATIONS);
+
+    nvs_close(s_nvs);
+    remove_image();
+
+    assets_stats_t stats;
+    assets_get_stats(&stats);
+    printf("assets: %u byte container, %lu lookups, %lu missed; NVS reads need a %u byte buffer, the mapping none\n",
+           (unsigned)stats.size, (unsigned long)stats.lookups, (unsigned long)stats.misses,
+           (unsigned)sizeof(s_copy));
+}
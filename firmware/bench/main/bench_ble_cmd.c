@@ -0,0 +1,67 @@
+/*
+ * bench_ble_cmd.c - Phone command path
+ *
+ * ble_cmd.c is included, not linked, so the static hex_to_bytes() can be
+ * timed. ble_cmd_feed() is fed unknown commands, which fall through every
+ * comparison in ble_cmd_handle() and have no side effects: BITMASK/PUBKEY
+ * would write NVS and post to the ESP-NOW task, and a reply would be timed
+ * as ble_send_message().
+ */
+
+#include "ble_cmd.c"
+#include "bench.h"
+
+#define BENCH_BLE_WRITE_LEN     20      /* ATT payload at the default 23 byte MTU */
+#define BENCH_LONG_CMD_LEN      512
+
+static char s_hex_group_key[PAIRING_GROUP_KEY_MAX_LEN * 2 + 1];
+static char s_hex_bitmask[PAIRING_BITMASK_MAX_LEN * 2 + 1];
+static uint8_t s_long_cmd[BENCH_LONG_CMD_LEN];
+static volatile int s_sink;
+
+static void fill_hex(char *out, size_t bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < bytes * 2; i++) {
+        out[i] = digits[(i * 7 + 3) & 0x0f];
+    }
+    out[bytes * 2] = '\0';
+}
+
+static void run_hex_to_bytes(void *arg)
+{
+    const char *hex = arg;
+    uint8_t out[PAIRING_BITMASK_MAX_LEN];
+    s_sink = hex_to_bytes(hex, out, sizeof(out));
+}
+
+static void run_feed_short(void *arg)
+{
+    static const uint8_t cmd[] = "NOOP" BLE_MESSAGE_DELIMITER_STR;
+    ble_cmd_feed(cmd, sizeof(cmd) - 1);
+}
+
+static void run_feed_chunked(void *arg)
+{
+    for (int off = 0; off < BENCH_LONG_CMD_LEN; off += BENCH_BLE_WRITE_LEN) {
+        int n = BENCH_LONG_CMD_LEN - off;
+        ble_cmd_feed(s_long_cmd + off, n < BENCH_BLE_WRITE_LEN ? n : BENCH_BLE_WRITE_LEN);
+    }
+}
+
+void bench_ble_cmd(void)
+{
+    fill_hex(s_hex_group_key, PAIRING_GROUP_KEY_MAX_LEN);
+    fill_hex(s_hex_bitmask, PAIRING_BITMASK_MAX_LEN);
+
+    memset(s_long_cmd, 'x', sizeof(s_long_cmd));
+    memcpy(s_long_cmd, "NOOP:", 5);
+    s_long_cmd[BENCH_LONG_CMD_LEN - 1] = BLE_MESSAGE_DELIMITER_CHAR;
+
+    bench_run("hex_to_bytes/32", run_hex_to_bytes, s_hex_group_key, BENCH_MAX_ITERATIONS);
+    bench_run("hex_to_bytes/256", run_hex_to_bytes, s_hex_bitmask, BENCH_MAX_ITERATIONS);
+
+    ble_cmd_reset();
+    bench_run("ble_cmd_feed/short", run_feed_short, NULL, BENCH_MAX_ITERATIONS);
+    bench_run("ble_cmd_feed/512B_in_20B_writes", run_feed_chunked, NULL, BENCH_MAX_ITERATIONS);
+}
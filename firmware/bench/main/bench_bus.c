@@ -0,0 +1,112 @@
+/*
+ * bench_bus.c - bus.c publish and delivery
+ *
+ * Subscribers here are woken by task notification rather than through the
+ * reactor, which is never started in the bench. In the same-task cases the
+ * notification goes to the bench task itself and is simply discarded; one
+ * iteration is a publish plus draining every ring until bus_receive()
+ * reports it empty, i.e. the whole path a message takes short of the
+ * context switch.
+ *
+ * bus_publish/round_trip adds that switch: an echo task blocked in
+ * ulTaskNotifyTake() takes a MONITOR message and publishes it back on
+ * BUTTON, and the iteration ends when the bench task has it.
+ */
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "bus.h"
+#include "bench.h"
+
+#define BENCH_BUS_FANOUT    4
+#define BENCH_BUS_DEPTH     16
+
+BUS_SUB_DEFINE(s_sub0, BENCH_BUS_DEPTH);
+BUS_SUB_DEFINE(s_sub1, BENCH_BUS_DEPTH);
+BUS_SUB_DEFINE(s_sub2, BENCH_BUS_DEPTH);
+BUS_SUB_DEFINE(s_sub3, BENCH_BUS_DEPTH);
+BUS_SUB_DEFINE(s_echo, BENCH_BUS_DEPTH);
+BUS_SUB_DEFINE(s_reply, BENCH_BUS_DEPTH);
+
+static bus_sub_t *const s_fanout[BENCH_BUS_FANOUT] = { &s_sub0, &s_sub1, &s_sub2, &s_sub3 };
+
+static void drain(bus_sub_t *sub)
+{
+    bus_msg_t msg;
+    while (bus_receive(sub, &msg)) {
+    }
+}
+
+static void run_publish_1(void *arg)
+{
+    bus_msg_t msg = { .rssi = { .mac = { 1, 2, 3, 4, 5, 6 }, .rssi = -60 } };
+    bus_publish(BUS_TOPIC_RSSI, &msg);
+    drain(&s_sub0);
+}
+
+static void run_publish_4(void *arg)
+{
+    bus_msg_t msg = { .ble.event = BUS_BLE_CONNECTED };
+    bus_publish(BUS_TOPIC_BLE, &msg);
+    for (int i = 0; i < BENCH_BUS_FANOUT; i++) {
+        drain(s_fanout[i]);
+    }
+}
+
+static void echo_task(void *arg)
+{
+    bus_msg_t msg;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (bus_receive(&s_echo, &msg)) {
+            bus_msg_t reply = { .button = { .pin = 0, .count = (uint32_t)msg.monitor.voltage_mv } };
+            bus_publish(BUS_TOPIC_BUTTON, &reply);
+        }
+    }
+}
+
+static void run_round_trip(void *arg)
+{
+    bus_msg_t msg = { .monitor = { .voltage_mv = 3700, .temperature_c = 25.0f } };
+    bus_publish(BUS_TOPIC_MONITOR, &msg);
+
+    while (!bus_receive(&s_reply, &msg)) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    drain(&s_reply);
+}
+
+void bench_bus(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    for (int i = 0; i < BENCH_BUS_FANOUT; i++) {
+        s_fanout[i]->task = self;
+        bus_subscribe(BUS_TOPIC_BLE, s_fanout[i]);
+    }
+    bus_subscribe(BUS_TOPIC_RSSI, &s_sub0);
+
+    s_reply.task = self;
+    bus_subscribe(BUS_TOPIC_BUTTON, &s_reply);
+    if (xTaskCreate(echo_task, "bench_echo", 2048, NULL, 5, &s_echo.task) != pdPASS) {
+        printf("bench_bus: no echo task, round trip skipped\n");
+        s_echo.task = NULL;
+    } else {
+        bus_subscribe(BUS_TOPIC_MONITOR, &s_echo);
+    }
+
+    bench_run("bus_publish/1_sub", run_publish_1, NULL, BENCH_MAX_ITERATIONS);
+    bench_run("bus_publish/4_subs", run_publish_4, NULL, BENCH_MAX_ITERATIONS);
+
+    /* notifications the same-task cases sent ourselves */
+    ulTaskNotifyTake(pdTRUE, 0);
+    if (s_echo.task) {
+        bench_run("bus_publish/round_trip", run_round_trip, NULL, BENCH_MAX_ITERATIONS);
+    }
+
+    printf("bus: %lu B per topic, %lu B per subscriber with %d slots\n",
+           (unsigned long)bus_topic_bytes(), (unsigned long)bus_sub_bytes(BENCH_BUS_DEPTH),
+           BENCH_BUS_DEPTH);
+}
@@ -0,0 +1,111 @@
+/*
+ * bench_crowd.c - crowd.c per-frame counting, decay and report
+ *
+ * crowd.c is included, not linked, so the once a second decay() can be
+ * timed without exporting it. Each received frame comes from a new MAC,
+ * as in a crowd passing by, and no group key is set, so the cost is the
+ * counting alone. After the table the distinct-badge estimate is checked
+ * against sender counts past what the simulator can run: the mean error
+ * over BENCH_CROWD_RANGES runs of consecutive MACs, each from its own
+ * prefix.
+ */
+
+#include "crowd.c"
+#include "bench.h"
+
+#define BENCH_CROWD_SHORT_LEN   8       /* 64 bits, the simulator's scenarios */
+#define BENCH_CROWD_SHORT_SET   8
+#define BENCH_CROWD_LONG_LEN    (CROWD_BITS / 8)
+#define BENCH_CROWD_LONG_SET    32
+#define BENCH_CROWD_RANGES      16
+
+typedef struct {
+    uint8_t frame[sizeof(broadcast_header_t) + CROWD_BITS / 8 + sizeof(uint32_t) + 1];
+    int len;
+} bench_crowd_frame_t;
+
+static const uint32_t ESTIMATE_COUNTS[] = { 10, 100, 1000, 10000 };
+
+static pairing_ctx_t s_ctx;
+static bench_crowd_frame_t s_hello_short;
+static bench_crowd_frame_t s_hello_long;
+static bench_crowd_frame_t s_heartbeat;
+static uint8_t s_mac[ESP_NOW_ETH_ALEN] = { 0x02, 0x57, 0x41, 0x59 };
+static uint32_t s_next_mac;
+static char s_report[320];
+static volatile int s_sink;
+
+/* @p set bits spread evenly over @p len bytes */
+static void build_frame(bench_crowd_frame_t *f, uint8_t msg_type, uint16_t len, int set)
+{
+    broadcast_header_t *hdr = (broadcast_header_t *)f->frame;
+
+    memset(f->frame, 0, sizeof(f->frame));
+    hdr->protocol_id = PAIRING_PROTOCOL_ID;
+    hdr->msg_type = msg_type;
+    hdr->bitmask_len = len;
+    for (int i = 0; i < set; i++) {
+        int bit = i * len * 8 / set;
+        f->frame[sizeof(*hdr) + bit / 8] |= 1 << (bit % 8);
+    }
+    f->len = (int)(sizeof(*hdr) + len + sizeof(uint32_t) + 1);
+}
+
+/* from the next MAC, named in the header too as a real sender's is */
+static void recv_from_next(bench_crowd_frame_t *f)
+{
+    s_next_mac++;
+    s_mac[4] = (uint8_t)(s_next_mac >> 8);
+    s_mac[5] = (uint8_t)s_next_mac;
+    memcpy(((broadcast_header_t *)f->frame)->sender_mac, s_mac, ESP_NOW_ETH_ALEN);
+    crowd_handle_recv(&s_ctx, s_mac, f->frame, f->len);
+}
+
+static void run_recv(void *arg)
+{
+    recv_from_next(arg);
+}
+
+static void run_decay(void *arg)
+{
+    decay();
+}
+
+static void run_report(void *arg)
+{
+    s_sink = crowd_report(NULL, 0, s_report, sizeof(s_report));
+}
+
+void bench_crowd(void)
+{
+    crowd_init();
+    build_frame(&s_hello_short, MSG_HELLO, BENCH_CROWD_SHORT_LEN, BENCH_CROWD_SHORT_SET);
+    build_frame(&s_hello_long, MSG_HELLO, BENCH_CROWD_LONG_LEN, BENCH_CROWD_LONG_SET);
+    build_frame(&s_heartbeat, MSG_HEARTBEAT, 0, 0);
+
+    bench_run("crowd_handle_recv/hello_8B", run_recv, &s_hello_short, BENCH_MAX_ITERATIONS);
+    bench_run("crowd_handle_recv/hello_64B", run_recv, &s_hello_long, BENCH_MAX_ITERATIONS);
+    bench_run("crowd_handle_recv/heartbeat", run_recv, &s_heartbeat, BENCH_MAX_ITERATIONS);
+    bench_run("crowd_decay/512", run_decay, NULL, BENCH_MAX_ITERATIONS);
+    bench_run("crowd_report/top8", run_report, NULL, BENCH_MAX_ITERATIONS);
+
+    printf("crowd: %u bytes of counts and registers; distinct senders, mean estimate error:",
+           (unsigned)(sizeof(s_counts) + sizeof(s_badges) + sizeof(s_searching)));
+    for (size_t i = 0; i < sizeof(ESTIMATE_COUNTS) / sizeof(ESTIMATE_COUNTS[0]); i++) {
+        uint32_t n = ESTIMATE_COUNTS[i];
+        uint64_t err = 0;
+        for (int r = 0; r < BENCH_CROWD_RANGES; r++) {
+            crowd_stats_t st;
+            crowd_init();
+            s_mac[3] = (uint8_t)r;
+            s_next_mac = 0;
+            for (uint32_t k = 0; k < n; k++) {
+                recv_from_next(&s_hello_short);
+            }
+            crowd_get_stats(&st);
+            err += st.searching > n ? st.searching - n : n - st.searching;
+        }
+        printf(" %lu: %.1f%%", (unsigned long)n, 100.0 * err / BENCH_CROWD_RANGES / n);
+    }
+    printf("\n");
+}
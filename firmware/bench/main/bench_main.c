@@ -0,0 +1,43 @@
+/*
+ * bench_main.c - Microbenchmarks of the firmware's per-frame and per-command
+ * hot paths
+ *
+ * Runs every case once at boot, prints a table and a single
+ * "BENCH_JSON {...}" line for tools/bench_compare.py. Nothing else runs:
+ * Wi-Fi and BLE are never started, so on the badge the only interrupt left
+ * is the tick and p50 is stable to a few cycles.
+ *
+ * On the linux target the JSON is also written to $WAYSIDE_BENCH_JSON when
+ * set, and the process exits when done.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "bench.h"
+
+void app_main(void)
+{
+    /* ESP_LOGx in the measured code stays compiled in, but must not print */
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    bench_init();
+    bench_pairing();
+    bench_neighbor();
+    bench_proximity();
+    bench_ble_cmd();
+    bench_aw9523();
+    bench_bus();
+    bench_snapshot();
+    bench_ota();
+    bench_assets();
+    bench_crowd();
+
+#if CONFIG_IDF_TARGET_LINUX
+    bench_report(getenv("WAYSIDE_BENCH_JSON"));
+    exit(0);
+#else
+    bench_report(NULL);
+#endif
+}
@@ -0,0 +1,108 @@
+/*
+ * bench_neighbor.c - neighbor_admit(), the check every received frame gets
+ *
+ * neighbor_admit() runs in the receive callback on the WiFi task, before a
+ * frame is copied or queued, so what a flood costs the badge is what a
+ * dropped frame costs there. The cases time one verdict each: a frame
+ * admitted with the buckets full, one dropped for its class rate once a
+ * sender has spent its burst, one dropped as a duplicate, and frames from
+ * 32 senders in turn, the table full. A flood at one frame per millisecond,
+ * as fast as a badge can put them on air, is then priced from the rate and
+ * duplicate drops and printed as a share of the CPU.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pairing.h"
+#include "neighbor.h"
+#include "bench.h"
+
+#define BENCH_NEIGHBOR_SENDERS      NEIGHBOR_TABLE_SIZE
+#define BENCH_NEIGHBOR_FLOOD_FPS    1000
+
+typedef struct {
+    broadcast_header_t hdr;
+    bool advance;               /* a second passes between frames, the buckets refill */
+    bool same_seq;              /* resend the last frame */
+} bench_stream_t;
+
+static uint32_t s_now_ms = 1000;
+static uint32_t s_next_sender;
+static uint32_t s_seq[BENCH_NEIGHBOR_SENDERS];
+static uint32_t s_verdicts[NEIGHBOR_ADMIT_CLAIM + 1];
+
+static void fill_header(broadcast_header_t *hdr, uint32_t sender, uint8_t msg_type)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->protocol_id = PAIRING_PROTOCOL_ID;
+    hdr->msg_type = msg_type;
+    memcpy(hdr->sender_mac, (const uint8_t[]){ 0x02, 0x57, 0x41, 0x59, 0x00, 0x00 }, 6);
+    hdr->sender_mac[5] = (uint8_t)sender;
+}
+
+static void admit(broadcast_header_t *hdr)
+{
+    hdr->uptime_ms = s_now_ms;
+    s_verdicts[neighbor_admit(hdr->sender_mac, (const uint8_t *)hdr, sizeof(*hdr), s_now_ms)]++;
+}
+
+static void run_stream(void *arg)
+{
+    bench_stream_t *st = arg;
+
+    if (st->advance) s_now_ms += 1000;
+    if (!st->same_seq) st->hdr.seq_num++;
+    admit(&st->hdr);
+}
+
+static void run_senders(void *arg)
+{
+    broadcast_header_t *hdr = arg;
+    uint32_t sender = s_next_sender++ % BENCH_NEIGHBOR_SENDERS;
+
+    s_now_ms += 10;
+    fill_header(hdr, sender, MSG_HEARTBEAT);
+    hdr->seq_num = ++s_seq[sender];
+    admit(hdr);
+}
+
+void bench_neighbor(void)
+{
+    bench_stream_t admitted = { .advance = true };
+    bench_stream_t flood = { 0 };
+    bench_stream_t dup = { .same_seq = true };
+    broadcast_header_t sender;
+
+    neighbor_init(s_now_ms);
+    fill_header(&admitted.hdr, 200, MSG_HEARTBEAT);
+    fill_header(&flood.hdr, 201, MSG_HELLO);
+    fill_header(&dup.hdr, 202, MSG_HEARTBEAT);
+
+    /* spend the flood's burst, and give the resent frame its first copy */
+    for (int i = 0; i < 2 * NEIGHBOR_HELLO_RATE; i++) {
+        run_stream(&flood);
+    }
+    dup.hdr.seq_num = 1;
+    admit(&dup.hdr);
+    memset(s_verdicts, 0, sizeof(s_verdicts));
+
+    bench_run("neighbor_admit/admitted", run_stream, &admitted, BENCH_MAX_ITERATIONS);
+    const bench_result_t *rate = bench_run("neighbor_admit/drop_rate", run_stream, &flood, BENCH_MAX_ITERATIONS);
+    const bench_result_t *dups = bench_run("neighbor_admit/drop_dup", run_stream, &dup, BENCH_MAX_ITERATIONS);
+    bench_run("neighbor_admit/32_senders", run_senders, &sender, BENCH_MAX_ITERATIONS);
+
+    printf("neighbor: %lu admitted, %lu dropped for rate, %lu for the global budget, %lu duplicates, %lu claims",
+           (unsigned long)s_verdicts[NEIGHBOR_ADMIT], (unsigned long)s_verdicts[NEIGHBOR_DROP_RATE],
+           (unsigned long)s_verdicts[NEIGHBOR_DROP_GLOBAL], (unsigned long)s_verdicts[NEIGHBOR_DROP_DUP],
+           (unsigned long)s_verdicts[NEIGHBOR_ADMIT_CLAIM]);
+    if (rate != NULL && dups != NULL) {
+        /* thousandths of a percent */
+        uint64_t per_s = 1000ull * bench_units_per_ms();
+        uint64_t rate_share = 100000ull * rate->p50 * BENCH_NEIGHBOR_FLOOD_FPS / per_s;
+        uint64_t dup_share = 100000ull * dups->p50 * BENCH_NEIGHBOR_FLOOD_FPS / per_s;
+        printf("; a %d fps flood costs %lu.%03lu%% of the CPU dropped for rate, %lu.%03lu%% as duplicates",
+               BENCH_NEIGHBOR_FLOOD_FPS, (unsigned long)(rate_share / 1000), (unsigned long)(rate_share % 1000),
+               (unsigned long)(dup_share / 1000), (unsigned long)(dup_share % 1000));
+    }
+    printf("\n");
+}
@@ -0,0 +1,76 @@
+/*
+ * bench_ota.c - ota.c chunk compression
+ *
+ * ota.c is included, not linked, so lz_compress()/lz_decompress() can be
+ * timed without exporting them. The input is the running image, read the
+ * way a holder reads it: the bench app itself on the badge, sim_ota.c's
+ * synthetic image (mostly the bench executable) on the host. The cases
+ * time the chunk at BENCH_OTA_OFFSET; the whole image is then compressed
+ * once, untimed, and the ratio printed after the table. It also provides
+ * the ota_* functions espnow.c calls.
+ */
+
+#include "ota.c"
+#include "bench.h"
+
+#define BENCH_OTA_OFFSET    (16 * OTA_CHUNK_SIZE)   /* past the image header, into code */
+
+static uint8_t s_raw[OTA_CHUNK_SIZE];
+static uint8_t s_packed[OTA_CHUNK_SIZE];
+static uint8_t s_unpacked[OTA_CHUNK_SIZE];
+static size_t s_packed_len;
+static volatile size_t s_sink;
+
+static void run_compress(void *arg)
+{
+    s_sink = lz_compress(s_raw, OTA_CHUNK_SIZE, s_packed, OTA_CHUNK_SIZE);
+}
+
+static void run_decompress(void *arg)
+{
+    s_sink = lz_decompress(s_packed, s_packed_len, s_unpacked, OTA_CHUNK_SIZE);
+}
+
+void bench_ota(void)
+{
+    const esp_partition_t *part = esp_ota_get_running_partition();
+    uint32_t size = part != NULL ? image_size(part) : 0;
+
+    if (size < BENCH_OTA_OFFSET + OTA_CHUNK_SIZE ||
+        esp_partition_read(part, BENCH_OTA_OFFSET, s_raw, OTA_CHUNK_SIZE) != ESP_OK) {
+        printf("bench_ota: running image unreadable, skipped\n");
+        return;
+    }
+
+    s_packed_len = lz_compress(s_raw, OTA_CHUNK_SIZE, s_packed, OTA_CHUNK_SIZE);
+    if (s_packed_len == 0 || !lz_decompress(s_packed, s_packed_len, s_unpacked, OTA_CHUNK_SIZE) ||
+        memcmp(s_raw, s_unpacked, OTA_CHUNK_SIZE) != 0) {
+        printf("bench_ota: chunk at %d does not round trip\n", BENCH_OTA_OFFSET);
+        return;
+    }
+
+    bench_run("lz_compress/512B", run_compress, NULL, BENCH_MAX_ITERATIONS);
+    bench_run("lz_decompress/512B", run_decompress, NULL, BENCH_MAX_ITERATIONS);
+
+    uint32_t packed_total = 0, raw_chunks = 0, bad = 0;
+    for (uint32_t off = 0; off < size; off += OTA_CHUNK_SIZE) {
+        uint32_t len = size - off < OTA_CHUNK_SIZE ? size - off : OTA_CHUNK_SIZE;
+        if (esp_partition_read(part, off, s_raw, len) != ESP_OK) {
+            bad++;
+            continue;
+        }
+        size_t packed = lz_compress(s_raw, len, s_packed, len);
+        if (packed == 0) {
+            raw_chunks++;
+            packed = len;
+        } else if (!lz_decompress(s_packed, packed, s_unpacked, len) || memcmp(s_raw, s_unpacked, len) != 0) {
+            bad++;
+        }
+        packed_total += packed;
+    }
+
+    printf("ota: %lu byte image in %lu chunks, %lu bytes on air (%lu%%), %lu sent raw, %lu bad\n",
+           (unsigned long)size, (unsigned long)((size + OTA_CHUNK_SIZE - 1) / OTA_CHUNK_SIZE),
+           (unsigned long)packed_total, (unsigned long)(100ull * packed_total / size),
+           (unsigned long)raw_chunks, (unsigned long)bad);
+}
@@ -0,0 +1,182 @@
+/*
+ * bench_pairing.c - pairing.c frame handling
+ *
+ * pairing.c is included, not linked, so its static helpers can be timed
+ * without exporting them from pairing.h.
+ */
+
+#include "pairing.c"
+#include "neighbor.h"
+#include "rate.h"
+#include "bench.h"
+
+#define BENCH_PUBKEY_LEN    392     /* base64 body of an RSA-2048 public key */
+#define BENCH_BITMASK_LEN   32
+#define BENCH_X25519_ITERATIONS 20  /* a scalar multiplication each, milliseconds on the C3 */
+#define BENCH_RELAY_URL_LEN     200 /* the sim's link scenario */
+#define BENCH_HELLO_NEIGHBORS   NEIGHBOR_TABLE_SIZE /* tagged HELLOs heard per beacon period */
+
+static const uint16_t SIMILARITY_LENGTHS[] = { 8, 32, 128, PAIRING_BITMASK_MAX_LEN };
+
+typedef struct {
+    uint8_t frame[HEADER_SIZE + PAIRING_BITMASK_MAX_LEN + PAIRING_KEY_MAX_LEN];
+    size_t len;
+} bench_frame_t;
+
+static pairing_ctx_t s_ctx;
+static pairing_ctx_t s_partner;
+static uint8_t s_my_bitmask[PAIRING_BITMASK_MAX_LEN];
+static uint8_t s_peer_bitmask[PAIRING_BITMASK_MAX_LEN];
+static char s_pubkey[BENCH_PUBKEY_LEN + 1];
+static bench_frame_t s_hello;
+static bench_frame_t s_key_exchange;
+static volatile uint32_t s_sink;
+
+static void fill_pattern(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245u + 12345u;
+        buf[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static void run_similarity(void *arg)
+{
+    uint16_t len = *(const uint16_t *)arg;
+    s_sink = calculate_bitmask_similarity(s_my_bitmask, len, s_peer_bitmask, len);
+}
+
+static void run_build_hello(void *arg)
+{
+    bench_frame_t *f = arg;
+    f->len = build_packet_with_bitmask(&s_ctx, f->frame, sizeof(f->frame), MSG_HELLO, NULL);
+}
+
+static void run_build_key_exchange(void *arg)
+{
+    bench_frame_t *f = arg;
+    f->len = build_packet_with_bitmask(&s_ctx, f->frame, sizeof(f->frame), MSG_KEY_EXCHANGE, s_pubkey);
+}
+
+static void run_parse(void *arg)
+{
+    const bench_frame_t *f = arg;
+    uint8_t *bitmask;
+    uint16_t bitmask_len;
+    const char *pubkey;
+
+    s_sink = parse_incoming_packet(f->frame, f->len, &bitmask, &bitmask_len, &pubkey);
+}
+
+static void run_hello_tag(void *arg)
+{
+    bench_frame_t *f = arg;
+    s_sink = hello_tag(f->frame, f->len - PAIRING_HELLO_TAG_LEN, f->frame + f->len - PAIRING_HELLO_TAG_LEN);
+}
+
+static void run_hello_tag_valid(void *arg)
+{
+    const bench_frame_t *f = arg;
+    s_sink = hello_tag_valid(f->frame, f->len, f->len - PAIRING_HELLO_TAG_LEN);
+}
+
+static void run_make_share(void *arg)
+{
+    s_sink = make_share(&s_ctx);
+}
+
+/* one badge's share of a pairing: its key pair, then the shared secret */
+static void run_derive_link_key(void *arg)
+{
+    s_ctx.kex.has_share = false;
+    s_sink = derive_link_key(&s_ctx, s_partner.kex.share);
+}
+
+/*
+ * CCMP runs in the radio, so an encrypted partner frame costs the CPU what a
+ * plaintext one does; what it costs is its header and MIC on air.
+ */
+static void print_link_airtime(const char *what, size_t len)
+{
+    uint8_t fastest = 0;
+
+    while (rate_airtime_us(fastest + 1, len, false) != 0) fastest++;
+    printf("link: %s (%u B)", what, (unsigned)len);
+    for (uint8_t idx = 0;; idx = fastest) {
+        uint32_t plain = rate_airtime_us(idx, len, false);
+        uint32_t ccmp = rate_airtime_us(idx, len, true);
+        printf("%s %s %lu us plaintext, %lu us CCMP (-%lu.%lu%% frames/s)", idx ? "," : "", rate_name(idx), (unsigned long)plain,
+               (unsigned long)ccmp, (unsigned long)(100 * (ccmp - plain) / ccmp),
+               (unsigned long)(1000 * (ccmp - plain) / ccmp % 10));
+        if (idx == fastest) break;
+    }
+    printf("\n");
+}
+
+void bench_pairing(void)
+{
+    char name[BENCH_NAME_MAX_LEN];
+
+    memset(&s_ctx, 0, sizeof(s_ctx));
+    s_ctx.current_state = SEARCHING;
+    s_ctx.bitmask = s_my_bitmask;
+    s_ctx.bitmask_len = BENCH_BITMASK_LEN;
+    fill_pattern(s_my_bitmask, sizeof(s_my_bitmask), 1);
+    fill_pattern(s_peer_bitmask, sizeof(s_peer_bitmask), 2);
+    for (int i = 0; i < BENCH_PUBKEY_LEN; i++) {
+        s_pubkey[i] = 'A' + i % 26;
+    }
+
+    for (size_t i = 0; i < sizeof(SIMILARITY_LENGTHS) / sizeof(SIMILARITY_LENGTHS[0]); i++) {
+        snprintf(name, sizeof(name), "calculate_bitmask_similarity/%u", SIMILARITY_LENGTHS[i]);
+        bench_run(name, run_similarity, (void *)&SIMILARITY_LENGTHS[i], BENCH_MAX_ITERATIONS);
+    }
+
+    bench_run("build_packet_with_bitmask/hello", run_build_hello, &s_hello, BENCH_MAX_ITERATIONS);
+    bench_run("build_packet_with_bitmask/key_exchange", run_build_key_exchange, &s_key_exchange,
+              BENCH_MAX_ITERATIONS);
+    bench_run("parse_incoming_packet/hello", run_parse, &s_hello, BENCH_MAX_ITERATIONS);
+    bench_run("parse_incoming_packet/key_exchange", run_parse, &s_key_exchange, BENCH_MAX_ITERATIONS);
+
+    /* every HELLO that passes the similarity filter at an event with a GROUPKEY */
+    uint8_t group_key[PAIRING_GROUP_KEY_MAX_LEN];
+    fill_pattern(group_key, sizeof(group_key), 3);
+    pairing_set_group_key(&s_ctx, group_key, sizeof(group_key));
+    run_build_hello(&s_hello);
+    if (hello_tag(s_hello.frame, s_hello.len, s_hello.frame + s_hello.len)) {
+        s_hello.len += PAIRING_HELLO_TAG_LEN;
+        const bench_result_t *sign = bench_run("hello_tag/32", run_hello_tag, &s_hello, BENCH_MAX_ITERATIONS);
+        const bench_result_t *verify = bench_run("hello_tag_valid/32", run_hello_tag_valid, &s_hello,
+                                                 BENCH_MAX_ITERATIONS);
+
+        /* one HELLO signed, and one verified from each neighbour, per beacon period */
+        if (sign != NULL && verify != NULL) {
+            uint64_t cost = sign->p50 + (uint64_t)BENCH_HELLO_NEIGHBORS * verify->p50;
+            uint64_t period = (uint64_t)PAIRING_REBROADCAST_MS * bench_units_per_ms();
+            uint64_t share = 100000ull * cost / period;     /* thousandths of a percent */
+
+            printf("hello tag: %llu us per %d ms beacon period signing ours and verifying %d neighbours'"
+                   " (%llu.%03llu%% of it)\n",
+                   (unsigned long long)(1000ull * cost / bench_units_per_ms()), PAIRING_REBROADCAST_MS,
+                   BENCH_HELLO_NEIGHBORS, (unsigned long long)(share / 1000), (unsigned long long)(share % 1000));
+        }
+    }
+
+    /* the link key, once per pairing on each badge */
+    memcpy(s_ctx.my_mac, (const uint8_t[]){ 0x02, 0x57, 0x41, 0x59, 0x00, 0x01 }, ESP_NOW_ETH_ALEN);
+    memcpy(s_ctx.partner_mac, (const uint8_t[]){ 0x02, 0x57, 0x41, 0x59, 0x00, 0x02 }, ESP_NOW_ETH_ALEN);
+    strcpy(s_ctx.my_public_key, s_pubkey);
+    strcpy(s_ctx.partner_public_key, s_pubkey);
+    if (make_share(&s_partner) == ESP_OK) {
+        bench_run("make_share/x25519", run_make_share, NULL, BENCH_X25519_ITERATIONS);
+        bench_run("derive_link_key/x25519", run_derive_link_key, NULL, BENCH_X25519_ITERATIONS);
+    }
+
+    /* what the partner link carries once it is encrypted */
+    char url[BENCH_RELAY_URL_LEN + 1];
+    memset(url, 'u', BENCH_RELAY_URL_LEN);
+    url[BENCH_RELAY_URL_LEN] = '\0';
+    print_link_airtime("heartbeat", sizeof(broadcast_header_t));
+    print_link_airtime("relay URL", build_packet_with_bitmask(&s_ctx, s_key_exchange.frame, sizeof(s_key_exchange.frame),
+                                                               MSG_RELAY_URL, url));
+}
@@ -0,0 +1,42 @@
+/*
+ * bench_port.c - Board and BLE calls for the badge build of the bench
+ *
+ * The measured code references the LEDs, buzzer and BLE notify path but no
+ * case reaches them; these keep the Bluedroid stack and the LEDC/expander
+ * drivers out of the image. The linux build gets the same from sim_port.
+ */
+
+#include <stdbool.h>
+#include "hnr26_badge.h"
+#include "buzzer.h"
+#include "ble_task.h"
+
+esp_err_t hnr26_badge_set_led(const hnr26_badge_dice_t dice_num,
+                              const aw9523_pin_data_digital_t is_on)
+{
+    return ESP_OK;
+}
+
+esp_err_t hnr26_badge_update_virtual_pins_state()
+{
+    return ESP_OK;
+}
+
+esp_err_t buzzer_stop(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t buzzer_beep(uint32_t on_ms, uint32_t off_ms, uint32_t count)
+{
+    return ESP_OK;
+}
+
+void ble_send_message(const char *message)
+{
+}
+
+esp_err_t ble_set_adv_interval(uint32_t interval_min, uint32_t interval_max)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,28 @@
+/*
+ * bench_proximity.c - proximity.c zone mapping
+ *
+ * proximity.c is included, not linked, so the static rssi_to_zone() can be
+ * timed. One iteration is a sweep of 64 RSSI values: a single call is
+ * shorter than the timer's resolution on the host.
+ */
+
+#include "proximity.c"
+#include "bench.h"
+
+#define BENCH_RSSI_SWEEP    64
+
+static volatile uint32_t s_sink;
+
+static void run_rssi_to_zone(void *arg)
+{
+    uint32_t acc = 0;
+    for (int i = 0; i < BENCH_RSSI_SWEEP; i++) {
+        acc += rssi_to_zone((int8_t)(-100 + i));
+    }
+    s_sink = acc;
+}
+
+void bench_proximity(void)
+{
+    bench_run("rssi_to_zone/x64", run_rssi_to_zone, NULL, BENCH_MAX_ITERATIONS);
+}
@@ -0,0 +1,108 @@
+/*
+ * bench_snapshot.c - snapshot.c reads and writes, alone and under contention
+ *
+ * The snapshot is a 32 byte struct whose words all hold the same counter,
+ * so a read that mixed two writes is easy to spot. snapshot_read/contended
+ * runs while a second task writes back to back; on a multi-core host it sits
+ * on another core, which exercises the memory ordering far harder than the
+ * badge's single core can. Every read in that case is checked, followed by
+ * BENCH_SNAPSHOT_CHECK_READS untimed reads against the same writer, and the
+ * number of torn reads (must be 0) and of retries is printed after the
+ * table.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "snapshot.h"
+#include "bench.h"
+
+#define BENCH_SNAPSHOT_WORDS        8
+#define BENCH_SNAPSHOT_CHECK_READS  1000000
+
+typedef struct {
+    uint32_t word[BENCH_SNAPSHOT_WORDS];
+} bench_state_t;
+
+SNAPSHOT_DEFINE(s_snap, bench_state_t);
+
+static volatile bool s_writing;
+static volatile bool s_writer_started;
+static volatile bool s_writer_done;
+static uint32_t s_writes;
+static uint32_t s_torn;
+static uint32_t s_retries;
+
+static void write_value(uint32_t value)
+{
+    bench_state_t state;
+    for (int i = 0; i < BENCH_SNAPSHOT_WORDS; i++) {
+        state.word[i] = value;
+    }
+    SNAPSHOT_WRITE(s_snap, &state);
+}
+
+static void run_write(void *arg)
+{
+    write_value(++s_writes);
+}
+
+static void run_read(void *arg)
+{
+    bench_state_t state;
+    s_retries += SNAPSHOT_READ(s_snap, &state);
+
+    for (int i = 1; i < BENCH_SNAPSHOT_WORDS; i++) {
+        if (state.word[i] != state.word[0]) {
+            s_torn++;
+            break;
+        }
+    }
+}
+
+static void writer_task(void *arg)
+{
+    uint32_t value = 0;
+    s_writer_started = true;
+    while (s_writing) {
+        write_value(++value);
+    }
+    s_writes = value;
+    s_writer_done = true;
+    vTaskDelete(NULL);
+}
+
+void bench_snapshot(void)
+{
+    bench_run("snapshot_write/32B", run_write, NULL, BENCH_MAX_ITERATIONS);
+    bench_run("snapshot_read/32B", run_read, NULL, BENCH_MAX_ITERATIONS);
+
+    s_writing = true;
+    s_writer_started = false;
+    s_writer_done = false;
+    s_retries = 0;
+    s_torn = 0;
+    if (xTaskCreate(writer_task, "bench_writer", 2048, NULL, 5, NULL) != pdPASS) {
+        printf("bench_snapshot: no writer task, contended case skipped\n");
+        return;
+    }
+
+    while (!s_writer_started) {
+        vTaskDelay(1);
+    }
+
+    bench_run("snapshot_read/32B_contended", run_read, NULL, BENCH_MAX_ITERATIONS);
+    for (uint32_t i = 0; i < BENCH_SNAPSHOT_CHECK_READS; i++) {
+        run_read(NULL);
+    }
+
+    s_writing = false;
+    while (!s_writer_done) {
+        vTaskDelay(1);
+    }
+
+    printf("snapshot: %d contended reads against %lu writes, %lu retries, %lu torn\n",
+           BENCH_MAX_ITERATIONS + BENCH_SNAPSHOT_CHECK_READS, (unsigned long)s_writes,
+           (unsigned long)s_retries, (unsigned long)s_torn);
+}
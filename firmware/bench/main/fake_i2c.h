@@ -0,0 +1,32 @@
+/*
+ * fake_i2c.h - In-memory I2C device for driver benchmarks
+ *
+ * One device with a 256-byte register file. Register reads and writes
+ * complete immediately and always succeed.
+ */
+
+#ifndef FAKE_I2C_H
+#define FAKE_I2C_H
+
+#include <stdint.h>
+#include "driver/i2c_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Handle of the fake device, for drivers that take a device handle
+ */
+i2c_master_dev_handle_t fake_i2c_device(void);
+
+/**
+ * @brief Preset a register the driver will read
+ */
+void fake_i2c_set_reg(uint8_t reg, uint8_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FAKE_I2C_H */
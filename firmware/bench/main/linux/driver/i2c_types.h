@@ -0,0 +1,19 @@
+/*
+ * i2c_types.h - I2C handle types for the linux target
+ *
+ * The host has no I2C driver; this is just enough of ESP-IDF's header for
+ * aw9523.h and fake_i2c.c.
+ */
+
+#ifndef BENCH_I2C_TYPES_H
+#define BENCH_I2C_TYPES_H
+
+typedef struct i2c_master_bus_t *i2c_master_bus_handle_t;
+typedef struct i2c_master_dev_t *i2c_master_dev_handle_t;
+
+typedef enum {
+    I2C_ADDR_BIT_LEN_7 = 0,
+    I2C_ADDR_BIT_LEN_10 = 1,
+} i2c_addr_bit_len_t;
+
+#endif /* BENCH_I2C_TYPES_H */
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+bench_compare.py - compare two wayside_bench runs
+
+Each input is either the JSON document (WAYSIDE_BENCH_JSON on linux) or a
+console log containing the "BENCH_JSON {...}" line (idf.py monitor output).
+
+  tools/bench_compare.py baseline.json current.log [--threshold 10] [--metric p50]
+
+Prints every case with its change and exits 1 when any case got slower than
+--threshold percent, so it can gate CI. Only runs of the same target and
+unit are comparable; cycles on the badge and ns on the host are not.
+"""
+
+import argparse
+import json
+import sys
+
+PREFIX = "BENCH_JSON "
+
+
+def load(path):
+    with open(path, errors="replace") as f:
+        text = f.read()
+    for line in text.splitlines():
+        line = line.strip()
+        if line.startswith(PREFIX):
+            return json.loads(line[len(PREFIX):])
+    return json.loads(text)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    ap.add_argument("baseline")
+    ap.add_argument("current")
+    ap.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent")
+    ap.add_argument("--metric", default="p50", choices=["min", "mean", "p50", "p90", "p99", "max"])
+    args = ap.parse_args()
+
+    base = load(args.baseline)
+    cur = load(args.current)
+    if (base.get("target"), base.get("unit")) != (cur.get("target"), cur.get("unit")):
+        sys.exit("not comparable: %s/%s vs %s/%s" % (base.get("target"), base.get("unit"),
+                                                     cur.get("target"), cur.get("unit")))
+
+    base_by_name = {r["name"]: r for r in base["results"]}
+    regressed = []
+    print("%-40s %10s %10s %8s  (%s %s)" % ("name", "baseline", "current", "change", args.metric, cur["unit"]))
+    for r in cur["results"]:
+        b = base_by_name.pop(r["name"], None)
+        if b is None:
+            print("%-40s %10s %10d %8s" % (r["name"], "-", r[args.metric], "new"))
+            continue
+        old, new = b[args.metric], r[args.metric]
+        change = 100.0 * (new - old) / old if old else 0.0
+        flag = ""
+        if change > args.threshold:
+            regressed.append(r["name"])
+            flag = "  <-- slower"
+        print("%-40s %10d %10d %+7.1f%%%s" % (r["name"], old, new, change, flag))
+    for name in base_by_name:
+        print("%-40s %10d %10s %8s" % (name, base_by_name[name][args.metric], "-", "gone"))
+
+    if regressed:
+        print("%d case(s) slower than %.0f%%: %s" % (len(regressed), args.threshold, ", ".join(regressed)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,4 +1,5 @@
 #include "name.h"
+#include "assets.h"
 #include "nvs_flash.h"
 #include "esp_random.h"
 #include <string.h>
@@ -7,7 +8,8 @@
 #define NVS_NAMESPACE "name"
 #define NVS_KEY       "friendly"
 
-// short words for name generation (3-6 chars each)
+// short words for name generation (3-6 chars each), used when the assets
+// partition has no "name_adj"/"name_noun" lists
 static const char *word1[] = {
     "red", "blue", "fast", "cool", "tiny", "bold",
     "warm", "dark", "wild", "calm", "soft", "keen"
@@ -21,16 +23,45 @@ static const char *word2[] = {
 #define WORD1_COUNT  (sizeof(word1) / sizeof(word1[0]))
 #define WORD2_COUNT (sizeof(word2) / sizeof(word2[0]))
 
+// pick word r from the named asset list, or from the built-in one if the
+// list is missing, not whole records, or has an empty word
+static const char *pick_word(const char *asset, const char **builtin, size_t builtin_count,
+                             uint32_t r, int *len)
+{
+    size_t size = 0;
+    const asset_word_t *words = assets_find(asset, &size);
+    size_t count = size / sizeof(asset_word_t);
+
+    if (words && count > 0 && size % sizeof(asset_word_t) == 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (words[i].word[0] == '\0') {
+                count = 0;
+                break;
+            }
+        }
+        if (count > 0) {
+            const char *w = words[r % count].word;
+            *len = (int)strnlen(w, ASSET_WORD_LEN);
+            return w;
+        }
+    }
+
+    const char *w = builtin[r % builtin_count];
+    *len = (int)strlen(w);
+    return w;
+}
+
 // generate a random name 
 static void generate_name(char *buf, size_t buf_len)
 {
     uint32_t r = esp_random();
-    const char *w1 = word1[r % WORD1_COUNT];
-    const char *w2 = word2[(r >> 8) % WORD2_COUNT];
+    int len1, len2;
+    const char *w1 = pick_word(ASSET_NAME_ADJ, word1, WORD1_COUNT, r, &len1);
+    const char *w2 = pick_word(ASSET_NAME_NOUN, word2, WORD2_COUNT, r >> 8, &len2);
     uint8_t num = (r >> 16) % 100;
 
-    // combine into buffer
-    snprintf(buf, buf_len, "%s%s%02d", w1, w2, num);
+    // combine into buffer, at most 8 + 8 + 2 chars
+    snprintf(buf, buf_len, "%.*s%.*s%02d", len1, w1, len2, w2, num);
 }
 
 esp_err_t name_get(nvs_handle_t handle, char *buf, size_t buf_len)
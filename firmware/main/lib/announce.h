@@ -0,0 +1,152 @@
+/**
+ * @file announce.h
+ * @brief Organizer announcements flooded over ESP-NOW
+ *
+ * An organizer's phone hands a signed announcement ("talk starting in hall
+ * B") to its badge with ANNOUNCE:<hex>. The badge broadcasts it, every
+ * badge that hears it passes it on once, and each one shows it on the
+ * phone (ANNOUNCEMENT:<id>:<text>) and plays the buzzer pattern it asks for.
+ *
+ * Announcements are signed with the organizer key, whose public half every
+ * badge gets with ORGKEY:<hex> (DER SubjectPublicKeyInfo, P-256
+ * recommended: 64-72 byte signatures). Badges only verify, so a badge
+ * cannot make one up; relays change nothing but the hop count, which is
+ * outside the signature.
+ *
+ * Flooding is counter based: a badge that accepts a new announcement waits
+ * a random 0..ANNOUNCE_RAD_MS before relaying it, counting the copies it
+ * hears from its neighbours meanwhile. If ANNOUNCE_DUP_THRESHOLD copies
+ * arrive the neighbourhood already has it and the relay is dropped. In a
+ * dense hall most badges stay silent; at the fringes, where few copies
+ * arrive, everyone relays.
+ *
+ * A fixed cache remembers the last ANNOUNCE_SEEN_MAX announcement ids, so
+ * each badge delivers and relays an announcement at most once. Ids must
+ * increase (the organizer tool uses a counter); an id older than anything
+ * evicted from the cache is dropped as stale, which also stops replays of
+ * old announcements. Only verified announcements enter the cache, so
+ * forged frames cannot push real ones out. The newest id accepted is kept
+ * in NVS, and after a reboot or an update everything up to it is stale;
+ * a new organizer key from the phone starts the ids over.
+ *
+ * Everything except announce_key_valid() and announce_get_stats() runs on
+ * espnow_task. mbedtls keeps the parsed key, and the scratch of each
+ * verification, on the heap.
+ */
+
+#ifndef ANNOUNCE_H
+#define ANNOUNCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "pairing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ANNOUNCE_TEXT_MAX           160
+#define ANNOUNCE_SIG_MAX            256     /* RSA-2048; P-256 needs 72 */
+#define ANNOUNCE_ORG_KEY_MAX        320     /* DER public key */
+#define ANNOUNCE_SEEN_MAX           32
+#define ANNOUNCE_PENDING_MAX        4       /* relays waiting out their delay */
+#define ANNOUNCE_MAX_HOPS           16
+
+#ifdef CONFIG_ESPNOW_ANNOUNCE_RAD_MS
+#define ANNOUNCE_RAD_MS             CONFIG_ESPNOW_ANNOUNCE_RAD_MS
+#else
+#define ANNOUNCE_RAD_MS             200
+#endif
+
+/* copies heard before a pending relay is dropped, 0 to always relay */
+#ifdef CONFIG_ESPNOW_ANNOUNCE_DUP_THRESHOLD
+#define ANNOUNCE_DUP_THRESHOLD      CONFIG_ESPNOW_ANNOUNCE_DUP_THRESHOLD
+#else
+#define ANNOUNCE_DUP_THRESHOLD      3
+#endif
+
+typedef enum {
+    ANNOUNCE_BUZZ_NONE = 0,
+    ANNOUNCE_BUZZ_SHORT,        /* one beep */
+    ANNOUNCE_BUZZ_DOUBLE,       /* two beeps */
+    ANNOUNCE_BUZZ_URGENT,       /* three long beeps */
+    ANNOUNCE_BUZZ_MAX
+} announce_buzz_t;
+
+/**
+ * MSG_ANNOUNCE payload, and what ANNOUNCE:<hex> carries (hops 0).
+ *
+ * body is text_len bytes of text, then sig_len bytes of signature. The
+ * signature is over id | buzz | text_len | text with SHA-256: ECDSA in DER
+ * form for an EC key, PKCS#1 v1.5 for RSA.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t hops;               /* relays so far, not signed */
+    uint16_t sig_len;
+    uint32_t id;
+    uint8_t buzz;               /* announce_buzz_t */
+    uint8_t text_len;
+    uint8_t body[0];
+} announce_t;
+
+#define ANNOUNCE_FRAME_MAX          (sizeof(announce_t) + ANNOUNCE_TEXT_MAX + ANNOUNCE_SIG_MAX)
+
+typedef struct {
+    bool has_key;
+    uint32_t delivered;         /* announcements shown, own ones excluded */
+    uint32_t originated;
+    uint32_t relayed;
+    uint32_t suppressed;        /* relays dropped: enough copies heard */
+    uint32_t duplicates;        /* copies of announcements already seen */
+    uint32_t stale;             /* ids older than the cache */
+    uint32_t bad_sig;
+    uint32_t no_key;
+    uint32_t overflow;          /* relays skipped, all pending slots busy */
+    uint32_t last_id;
+    uint8_t last_hops;
+} announce_stats_t;
+
+/**
+ * @brief Load the organizer key from NVS
+ *
+ * Called from espnow_init(). Without a key nothing is delivered or relayed.
+ */
+esp_err_t announce_init(void);
+
+/** @brief True if der is a public key announce can verify with; any task */
+bool announce_key_valid(const uint8_t *der, size_t len);
+
+/** @brief Replace the organizer key; the caller has stored it in NVS. Ids start over */
+void announce_set_org_key(const uint8_t *der, size_t len);
+
+/**
+ * @brief Broadcast an announcement from the organizer's phone
+ *
+ * It is verified like a received one and is not shown back on the phone.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if malformed, ESP_ERR_INVALID_STATE
+ *         without a key, ESP_ERR_INVALID_CRC on a bad signature,
+ *         ESP_ERR_INVALID_VERSION if the id was already used
+ */
+esp_err_t announce_originate(pairing_ctx_t *ctx, const uint8_t *data, size_t len);
+
+/** @brief Look at an admitted frame; anything but MSG_ANNOUNCE is ignored */
+void announce_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr, const uint8_t *data, int len);
+
+/**
+ * @brief Send relays whose delay is up
+ *
+ * @return ms until the next one is due, UINT32_MAX for none
+ */
+uint32_t announce_tick(pairing_ctx_t *ctx);
+
+/** @brief Consistent copy of the counters; any task, never blocks */
+void announce_get_stats(announce_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ANNOUNCE_H */
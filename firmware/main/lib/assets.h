@@ -0,0 +1,131 @@
+/**
+ * @file assets.h
+ * @brief Read-only tables in the "assets" flash partition, used in place
+ *
+ * Constant data the badge only reads (the proximity zone table, the
+ * announcement buzzer patterns, the words friendly names are made of) can live in its own data partition instead
+ * of the app, so an event can retune it without a new image:
+ *
+ *   sim/tools/wayside_assets.py build assets.json -o assets.bin
+ *   parttool.py write_partition --partition-name assets --input assets.bin
+ *
+ * assets_init() maps the partition into the data address space with
+ * esp_partition_mmap() and checks the container once. Lookups then return
+ * pointers into the mapping: nothing is copied and nothing is on the heap,
+ * each read goes through the flash cache like a const array in the app.
+ * Every module keeps its compiled-in table and uses it when the partition,
+ * the container or the asset is missing or the wrong size.
+ *
+ * Container, little endian, at the start of the partition:
+ *
+ *   header   magic "WAST" | version | count | size | crc
+ *   index    count assets_entry_t: name (NUL padded) | offset | len
+ *   data     each asset at a 4 byte aligned offset from the header
+ *
+ * size covers header, index and data; crc is esp_rom_crc32_le(0, ...)
+ * (zlib's CRC-32) over everything after the header up to size.
+ *
+ * assets_init() runs from app_main before any module looks something up;
+ * after that nothing changes, so every other call is safe on any task.
+ */
+
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ASSETS_PARTITION_SUBTYPE    0x41
+#define ASSETS_MAGIC                0x54534157  /* "WAST" */
+#define ASSETS_VERSION              1
+#define ASSETS_NAME_LEN             12
+#define ASSETS_ALIGN                4
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;
+    uint32_t crc;
+} assets_header_t;
+
+typedef struct __attribute__((packed)) {
+    char name[ASSETS_NAME_LEN];
+    uint32_t offset;            /* from the header */
+    uint32_t len;
+} assets_entry_t;
+
+/* one record per proximity_zone_t, PROXIMITY_ZONE_UNKNOWN first */
+#define ASSET_ZONES                 "zones"
+
+typedef struct __attribute__((packed)) {
+    uint8_t led_count;
+    uint8_t reserved;
+    uint16_t blink_period_ms;
+} asset_zone_t;
+
+/* one record per announce_buzz_t, ANNOUNCE_BUZZ_NONE first */
+#define ASSET_BUZZ                  "buzz"
+
+typedef struct __attribute__((packed)) {
+    uint16_t on_ms;
+    uint16_t off_ms;
+    uint8_t count;
+    uint8_t reserved;
+} asset_buzz_t;
+
+/* words a friendly name is made of (drivers/name.c): any number of each */
+#define ASSET_NAME_ADJ              "name_adj"
+#define ASSET_NAME_NOUN             "name_noun"
+#define ASSET_WORD_LEN              8
+
+typedef struct __attribute__((packed)) {
+    char word[ASSET_WORD_LEN];  /* NUL padded; all 8 bytes may be letters */
+} asset_word_t;
+
+typedef struct {
+    uint16_t count;
+    uint32_t size;
+    uint32_t lookups;           /* assets_find() calls */
+    uint32_t misses;            /* of those, no such asset */
+} assets_stats_t;
+
+/**
+ * @brief Map the "assets" partition and check the container
+ *
+ * @return ESP_OK; ESP_ERR_NOT_FOUND without the partition or with nothing
+ *         written to it; ESP_ERR_INVALID_VERSION, ESP_ERR_INVALID_SIZE or
+ *         ESP_ERR_INVALID_CRC for a container that doesn't check out; or
+ *         the error from esp_partition_mmap(). Lookups find nothing after
+ *         any error.
+ */
+esp_err_t assets_init(void);
+
+/**
+ * @brief An asset by name
+ *
+ * @param len  set to its length, may be NULL
+ * @return a pointer into the mapped partition, 4 byte aligned, or NULL
+ */
+const void *assets_find(const char *name, size_t *len);
+
+/**
+ * @brief An asset that must be exactly @p count records of @p record_size
+ *
+ * @return the records, or NULL (and a warning if it exists at another size)
+ */
+const void *assets_table(const char *name, size_t record_size, size_t count);
+
+/** @brief The container and lookup counters; any task, never blocks */
+void assets_get_stats(assets_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ASSETS_H */
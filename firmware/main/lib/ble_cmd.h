@@ -0,0 +1,50 @@
+/*
+ * ble_cmd.h - Text command protocol spoken over the BLE UART service
+ *
+ * Kept apart from ble_task.c so the same handler can be driven by anything
+ * that produces complete lines (the Bluedroid GATT server on the badge, or
+ * stdin in the Linux simulator).
+ */
+
+#ifndef BLE_CMD_H
+#define BLE_CMD_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* longest command, delimiter included, that ble_cmd_feed() can reassemble */
+#define BLE_CMD_BUFFER_SIZE     2048
+
+/**
+ * @brief Handle one complete command from the phone
+ *
+ * Replies are sent with ble_send_message().
+ *
+ * @param message Null-terminated command, delimiter already stripped
+ */
+void ble_cmd_handle(const char *message);
+
+/**
+ * @brief Append raw bytes written by the phone
+ *
+ * Commands can span several writes; every complete one (up to
+ * BLE_MESSAGE_DELIMITER_CHAR) is passed to ble_cmd_handle().
+ *
+ * @param data Bytes as received, not null-terminated
+ * @param len  Number of bytes
+ */
+void ble_cmd_feed(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Drop a partially received command (phone disconnected)
+ */
+void ble_cmd_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLE_CMD_H */
@@ -13,6 +13,10 @@
 #define BLE_MESSAGE_DELIMITER_CHAR '\r'
 #define BLE_MESSAGE_DELIMITER_STR "\r"
 
+// Default advertising interval, 0.625 ms units (20-40 ms)
+#define BLE_ADV_INTERVAL_MIN    0x20
+#define BLE_ADV_INTERVAL_MAX    0x40
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -89,6 +93,13 @@ const char *ble_get_device_name(void);
  */
 esp_err_t ble_set_adv_phy(esp_ble_gap_phy_t primary_phy, esp_ble_gap_phy_t secondary_phy);
 
+/**
+ * @brief Set the advertising interval, in 0.625 ms units
+ *
+ * Restarts advertising with the new interval if it is running.
+ */
+esp_err_t ble_set_adv_interval(uint32_t interval_min, uint32_t interval_max);
+
 /**
  * @brief Enable/disable long range mode (coded PHY)
  */
@@ -0,0 +1,156 @@
+/**
+ * @file bus.h
+ * @brief Static publish/subscribe bus between modules
+ *
+ * A topic is an entry of bus_topic_t with a fixed payload, one member of the
+ * union in bus_msg_t. Each topic has a table of BUS_MAX_SUBSCRIBERS slots
+ * filled by bus_subscribe() during init; nothing is allocated.
+ *
+ * Every subscriber owns a bounded ring (BUS_SUB_DEFINE). bus_publish()
+ * copies the message into the ring of each subscriber of the topic with a
+ * compare-and-swap on the ring head, so any number of tasks (or ISRs, via
+ * bus_publish_from_isr()) can publish without taking a lock. When a ring is
+ * full the message is dropped for that subscriber only and counted.
+ *
+ * A subscriber is woken once per batch, either with a task notification
+ * (task != NULL, consumer blocks in ulTaskNotifyTake) or by posting its
+ * handler to the reactor (fn != NULL). Either way it then calls
+ * bus_receive() until it returns false. Only one task may consume a ring.
+ */
+
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "reactor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Subscribers per topic */
+#define BUS_MAX_SUBSCRIBERS     4
+
+typedef enum {
+    BUS_TOPIC_RSSI = 0,         /**< .rssi: every frame espnow_task handles */
+    BUS_TOPIC_BLE,              /**< .ble: phone link events */
+    BUS_TOPIC_NFC_PAIR,         /**< .nfc_pair: nfc_pair state changes */
+    BUS_TOPIC_MONITOR,          /**< .monitor: battery / temperature sample */
+    BUS_TOPIC_BUTTON,           /**< .button: long press */
+    BUS_TOPIC_MAX
+} bus_topic_t;
+
+typedef enum {
+    BUS_BLE_CONNECTED = 0,
+    BUS_BLE_DISCONNECTED,
+    BUS_BLE_AUTH_OK,
+    BUS_BLE_AUTH_FAILED,
+} bus_ble_event_t;
+
+typedef struct {
+    uint8_t topic;              /**< bus_topic_t, set by bus_publish() */
+    union {
+        struct {
+            uint8_t mac[6];
+            int8_t rssi;
+        } rssi;
+        struct {
+            uint8_t event;      /**< bus_ble_event_t */
+        } ble;
+        struct {
+            uint8_t state;      /**< nfc_pair_state_t */
+        } nfc_pair;
+        struct {
+            int32_t voltage_mv;
+            float temperature_c;
+        } monitor;
+        struct {
+            uint8_t pin;
+            uint32_t count;
+        } button;
+    };
+} bus_msg_t;
+
+typedef struct {
+    atomic_uint seq;
+    bus_msg_t msg;
+} bus_slot_t;
+
+typedef struct {
+    const char *name;
+    bus_slot_t *slots;
+    uint32_t mask;              /**< depth - 1, depth is a power of two */
+    TaskHandle_t task;          /**< notified when the ring becomes non-empty */
+    reactor_fn_t fn;            /**< or: posted to the reactor with arg */
+    void *arg;
+    atomic_uint head;           /**< next publish position */
+    uint32_t tail;              /**< next receive position, consumer only */
+    atomic_bool pending;        /**< a wakeup is on its way */
+    atomic_uint dropped;
+    atomic_uint delivered;
+} bus_sub_t;
+
+/**
+ * @brief Static storage for a subscriber with a ring of depth messages
+ *
+ * depth must be a power of two. Fill in .task or .fn/.arg before
+ * bus_subscribe(), e.g.
+ *
+ *   BUS_SUB_DEFINE(s_rssi_sub, 16);
+ *   s_rssi_sub.fn = on_rssi_ready;
+ *   bus_subscribe(BUS_TOPIC_RSSI, &s_rssi_sub);
+ */
+#define BUS_SUB_DEFINE(var, depth)                                              \
+    _Static_assert(((depth) & ((depth) - 1)) == 0, "bus ring depth must be a power of two"); \
+    static bus_slot_t var##_slots[(depth)];                                     \
+    static bus_sub_t var = { .name = #var, .slots = var##_slots, .mask = (depth) - 1 }
+
+/**
+ * @brief Add sub to a topic's table
+ *
+ * Call during init, before the topic is published. A subscriber may be on
+ * several topics; the ring is shared and bus_msg_t.topic tells them apart.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM when the topic's table is full,
+ *         ESP_ERR_INVALID_ARG for a bad topic or a sub with no wakeup
+ */
+esp_err_t bus_subscribe(bus_topic_t topic, bus_sub_t *sub);
+
+/**
+ * @brief Copy msg to every subscriber of topic; never blocks
+ *
+ * @return Number of subscribers that got it
+ */
+uint32_t bus_publish(bus_topic_t topic, const bus_msg_t *msg);
+
+/**
+ * @brief bus_publish() for ISRs; wakeups use the FromISR calls
+ *
+ * @param woken Set to pdTRUE if a higher priority task was woken
+ */
+uint32_t bus_publish_from_isr(bus_topic_t topic, const bus_msg_t *msg, BaseType_t *woken);
+
+/**
+ * @brief Take the oldest message from sub's ring
+ *
+ * @return false when the ring is empty
+ */
+bool bus_receive(bus_sub_t *sub, bus_msg_t *out);
+
+/**
+ * @brief Bytes of static storage for one topic's table and for one
+ *        subscriber with a ring of depth messages
+ */
+uint32_t bus_topic_bytes(void);
+uint32_t bus_sub_bytes(uint32_t depth);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUS_H */
@@ -1,9 +1,11 @@
 /**
  * @file button_task.h
- * @brief Button monitoring task with long-press detection
+ * @brief Button monitoring with long-press detection
  * 
- * Monitors buttons on the AW9523 GPIO expander and detects long press
- * events. Uses a queue to notify other modules (e.g., buzzer mute toggle).
+ * Polls a button on the AW9523 GPIO expander from a reactor timer
+ * (reactor.h) and detects long press events. Long presses are reported
+ * through a callback run on the reactor (e.g., buzzer mute toggle) and/or
+ * a queue for consumers on other tasks.
  */
 
 #ifndef BUTTON_TASK_H
@@ -29,6 +31,11 @@ extern "C" {
 /** Default polling interval in milliseconds */
 #define BUTTON_TASK_POLL_MS         20
 
+/**
+ * @brief Long press callback, runs on the reactor so it must not block
+ */
+typedef void (*button_task_callback_t)(void *arg);
+
 /**
  * @brief Button task configuration
  */
@@ -37,7 +44,9 @@ typedef struct {
     aw9523_pin_num_t button_pin;    /**< Button pin number (0-15) */
     uint32_t long_press_ms;         /**< Long press threshold in ms */
     uint32_t poll_interval_ms;      /**< Polling interval in ms */
-    QueueHandle_t notify_queue;     /**< Queue to send toggle notifications (length 1) */
+    QueueHandle_t notify_queue;     /**< Queue to send toggle notifications (length 1), or NULL */
+    button_task_callback_t callback; /**< Called on long press, or NULL */
+    void *cb_arg;                   /**< Argument for callback */
 } button_task_config_t;
 
 /**
@@ -48,11 +57,15 @@ typedef struct {
     .button_pin = BUTTON_TASK_DEFAULT_PIN, \
     .long_press_ms = BUTTON_TASK_LONG_PRESS_MS, \
     .poll_interval_ms = BUTTON_TASK_POLL_MS, \
-    .notify_queue = NULL \
+    .notify_queue = NULL, \
+    .callback = NULL, \
+    .cb_arg = NULL \
 }
 
 /**
- * @brief Initialize and start the button monitoring task
+ * @brief Initialize and start polling the button
+ * 
+ * Requires reactor_init() first.
  * 
  * @param config Pointer to configuration structure
  * @return ESP_OK on success, error code otherwise
@@ -60,14 +73,14 @@ typedef struct {
 esp_err_t button_task_init(const button_task_config_t *config);
 
 /**
- * @brief Stop and deinitialize the button task
+ * @brief Stop polling and deinitialize
  * 
  * @return ESP_OK on success
  */
 esp_err_t button_task_deinit(void);
 
 /**
- * @brief Check if button task is running
+ * @brief Check if the button is being polled
  * 
  * @return true if running, false otherwise
  */
@@ -11,6 +11,8 @@
  *   - Max Current: 100mA
  * 
  * Volume control is achieved via PWM duty cycle modulation.
+ * Beep patterns and sequences are played by a state machine on the reactor
+ * (reactor.h); reactor_init() must run before buzzer_init().
  * The buzzer requires a transistor driver circuit (see datasheet section 5).
  */
 
@@ -19,9 +21,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -62,7 +63,7 @@ typedef struct {
 /**
  * @brief Initialize the buzzer driver
  * 
- * Sets up LEDC peripheral for PWM generation and creates the buzzer task.
+ * Sets up LEDC peripheral for PWM generation and the pattern timer.
  * 
  * @param config Pointer to configuration structure, or NULL for defaults
  * @return ESP_OK on success, error code otherwise
@@ -72,7 +73,7 @@ esp_err_t buzzer_init(const buzzer_config_t *config);
 /**
  * @brief Deinitialize the buzzer driver
  * 
- * Stops the buzzer, deletes the task, and releases resources.
+ * Stops the buzzer and releases resources.
  * 
  * @return ESP_OK on success
  */
@@ -152,7 +153,7 @@ uint32_t buzzer_get_frequency(void);
 /**
  * @brief Play a beep pattern
  * 
- * Non-blocking - pattern plays in background task.
+ * Non-blocking - pattern plays on the reactor.
  * 
  * @param on_ms  Duration of tone in milliseconds
  * @param off_ms Duration of silence in milliseconds
@@ -185,8 +186,8 @@ esp_err_t buzzer_play_sequence(const uint32_t *frequencies,
 /**
  * @brief Toggle buzzer mute state
  * 
- * Sends a toggle message to the buzzer task's queue.
- * When muted, all sound commands are silently ignored.
+ * When muted, all sound commands are silently ignored and a pattern
+ * that is playing stops.
  * 
  * @return ESP_OK on success
  */
@@ -207,16 +208,6 @@ esp_err_t buzzer_set_muted(bool muted);
  */
 bool buzzer_is_muted(void);
 
-/**
- * @brief Get the toggle queue handle
- * 
- * External tasks can use this queue to trigger mute toggle.
- * Queue length is 1, use xQueueOverwrite() to send.
- * 
- * @return QueueHandle_t for the toggle queue
- */
-QueueHandle_t buzzer_get_toggle_queue(void);
-
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,135 @@
+/**
+ * @file coex.h
+ * @brief Sharing the one 2.4 GHz radio between ESP-NOW and BLE
+ *
+ * The esp32c3 has a single radio; the coexistence arbiter hands it to Wi-Fi
+ * (ESP-NOW) or BLE slot by slot, and an ESP-NOW frame that arrives while BLE
+ * holds it is simply not heard. With BALANCE, the default, a long run of
+ * notifications to the phone costs the partner link heartbeats, and enough
+ * of them in a row suspend the pairing.
+ *
+ * coex steers the arbiter from what pairing.c knows about the link:
+ *
+ *   - ESPNOW while a handshake is in flight (PROPOSING, key exchange not
+ *     yet confirmed, SUSPENDED trying to resume): losing one of those
+ *     frames costs a timeout, not one heartbeat
+ *   - ESPNOW within COEX_GUARD_MS of a heartbeat, ours or the partner's;
+ *     ours go out PAIRING_HEARTBEAT_MS after the last, the partner's are
+ *     expected PAIRING_HEARTBEAT_MS after the last one heard
+ *   - BLE while a bulk notification (more than one chunk) is going out
+ *   - BALANCE otherwise
+ *
+ * and ble_send_message() holds a bulk chunk back until the heartbeat
+ * windows are clear, at most COEX_BLE_DEFER_MAX_MS per chunk, so the
+ * phone's transfer gives way rather than the arbiter cutting into it.
+ * Chunks sent from espnow_task itself are never held: that would push back
+ * the very heartbeat the window is for.
+ *
+ * Loss is counted per radio. ESP-NOW: partner heartbeats missed, from the
+ * gaps between the ones heard, overall and while a bulk transfer ran, and
+ * unicasts to the partner without an ACK. BLE: chunks the stack refused or
+ * reported failed, and congestion events.
+ *
+ * With the policy off (COEX:off) the arbiter stays at BALANCE and nothing
+ * is held back; the counters keep running, for comparison.
+ *
+ * coex_handle_recv(), coex_handle_send_result() and coex_tick() run on
+ * espnow_task; the rest on any task, never blocking except
+ * coex_ble_chunk_begin().
+ */
+
+#ifndef COEX_H
+#define COEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "pairing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COEX_BLE_EVENT_MS           8       /* a chunk's connection event, 7.5 ms at the shortest interval */
+#define COEX_BLE_DEFER_MAX_MS       (COEX_GUARD_MS * 2 + COEX_BLE_EVENT_MS)
+#define COEX_BULK_IDLE_MS           100     /* a bulk transfer is over this long after its last chunk */
+
+#ifdef CONFIG_ESPNOW_COEX_GUARD_MS
+#define COEX_GUARD_MS               CONFIG_ESPNOW_COEX_GUARD_MS
+#else
+#define COEX_GUARD_MS               20
+#endif
+
+typedef enum {
+    COEX_PREFER_BALANCE = 0,
+    COEX_PREFER_ESPNOW,
+    COEX_PREFER_BLE,
+} coex_pref_t;
+
+typedef struct {
+    bool policy;
+    uint8_t pref;               /* coex_pref_t the arbiter was last given */
+    uint32_t pref_changes;
+    uint32_t handshake_ms;      /* spent preferring ESP-NOW for a handshake */
+    uint32_t hb_heard;          /* partner heartbeats */
+    uint32_t hb_missed;
+    uint32_t bulk_hb_heard;     /* the same, while a BLE bulk transfer ran */
+    uint32_t bulk_hb_missed;
+    uint32_t tx_partner;        /* unicasts to the partner */
+    uint32_t tx_partner_failed; /* no ACK */
+    uint32_t ble_chunks;
+    uint32_t ble_failed;        /* refused by the stack or confirmed with an error */
+    uint32_t ble_congested;
+    uint32_t ble_deferred;      /* bulk chunks held back for a heartbeat */
+    uint32_t ble_deferred_ms;
+    uint32_t bulk_transfers;
+} coex_stats_t;
+
+/** @brief Start at BALANCE with the policy on; called from espnow_init() */
+esp_err_t coex_init(void);
+
+/** @brief Turn the policy on or off; any task, takes effect at the next coex_tick() */
+void coex_set_policy(bool enabled);
+
+/** @brief Look at an admitted frame for partner heartbeats */
+void coex_handle_recv(const pairing_ctx_t *ctx, const uint8_t *mac_addr, const uint8_t *data, int len);
+
+/** @brief Count the outcome of a unicast to the partner */
+void coex_handle_send_result(const pairing_ctx_t *ctx, const uint8_t *mac_addr, bool ok);
+
+/**
+ * @brief Move the arbiter preference to match the link
+ *
+ * @return ms until the next heartbeat window opens or closes, or our next
+ *         heartbeat is due, UINT32_MAX when not paired
+ */
+uint32_t coex_tick(const pairing_ctx_t *ctx);
+
+/**
+ * @brief Before each chunk of a BLE notification
+ *
+ * @param bulk the message takes more than one chunk; only those are held
+ *             back, by up to COEX_BLE_DEFER_MAX_MS
+ */
+void coex_ble_chunk_begin(bool bulk);
+
+/** @brief After handing the chunk to the stack */
+void coex_ble_chunk_end(bool ok);
+
+/** @brief The stack reported a notification failed; GATTS callback */
+void coex_ble_lost(void);
+
+/** @brief The stack ran out of buffers; GATTS callback */
+void coex_ble_congested(void);
+
+/** @brief Consistent copy of the counters; any task, never blocks */
+void coex_get_stats(coex_stats_t *out);
+
+/** @brief "BALANCE", "ESPNOW" or "BLE" */
+const char *coex_pref_name(uint8_t pref);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COEX_H */
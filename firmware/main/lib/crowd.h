@@ -0,0 +1,115 @@
+/**
+ * @file crowd.h
+ * @brief How many badges are around, and what they are interested in
+ *
+ * Every badge already hears the HELLOs of everyone searching within radio
+ * range, bitmask included. crowd folds them into two summaries of fixed
+ * size, so the phone can ask "how busy is it here, and busy with what":
+ *
+ *   - a decayed count per interest bit: each HELLO adds one to every bit
+ *     set in its bitmask, and every count halves each CROWD_HALF_LIFE_S.
+ *     The first CROWD_BITS bits are counted, the rest ignored
+ *   - a HyperLogLog sketch of the sender MACs of every pairing frame, and
+ *     a second one over HELLO senders alone: CROWD_HLL_REGS registers of
+ *     one byte each, about 1.04 / sqrt(CROWD_HLL_REGS) relative error
+ *     (6.5% at 256), exact up to a few dozen badges through linear
+ *     counting. Each pair of sketches rotates every CROWD_WINDOW_S and the
+ *     estimate is over the current and previous window, so a badge counts
+ *     for one to two windows after its last frame
+ *
+ * A HELLO comes every hello interval from each badge still searching, so
+ * the decayed total divided by that interval's count is proportional to
+ * the number of senders; the share of the total a bit holds is the share
+ * of searching badges with it set. The report scales those shares by the
+ * HELLO sender estimate:
+ *
+ *   CROWD:badges=<n>,searching=<n>,hellos=<decayed>,bits=<bit>:<people>/...
+ *
+ * Paired badges stop sending HELLO: they count in badges, not in the bits.
+ * HELLOs that fail the group tag, or whose header names another sender
+ * than the radio, are not counted at all.
+ *
+ * Memory: 4 bytes per bit (2 KiB at 512 bits) and 4 * CROWD_HLL_REGS
+ * bytes of registers, all static. A HELLO costs one pass over its bitmask
+ * 32 bits at a time, touching only the set bits, and one hash of the MAC.
+ *
+ * Everything here runs on espnow_task; the phone's CROWD request reaches it
+ * through espnow_crowd().
+ */
+
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "pairing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_ESPNOW_CROWD_BITS
+#define CROWD_BITS                  ((CONFIG_ESPNOW_CROWD_BITS + 31) / 32 * 32)
+#else
+#define CROWD_BITS                  512
+#endif
+
+#ifdef CONFIG_ESPNOW_CROWD_HALF_LIFE_S
+#define CROWD_HALF_LIFE_S           CONFIG_ESPNOW_CROWD_HALF_LIFE_S
+#else
+#define CROWD_HALF_LIFE_S           60
+#endif
+
+#ifdef CONFIG_ESPNOW_CROWD_WINDOW_S
+#define CROWD_WINDOW_S              CONFIG_ESPNOW_CROWD_WINDOW_S
+#else
+#define CROWD_WINDOW_S              60
+#endif
+
+#define CROWD_HLL_P                 8       /* register index bits */
+#define CROWD_HLL_REGS              (1 << CROWD_HLL_P)
+#define CROWD_ONE                   256     /* one HELLO in a bit count, Q8 */
+#define CROWD_DECAY_MS              1000
+#define CROWD_TOP_N                 8       /* bits in a report that names none */
+#define CROWD_QUERY_MAX             16      /* bits a report can name */
+
+typedef struct {
+    uint32_t badges;            /* distinct senders, any pairing frame */
+    uint32_t searching;         /* distinct HELLO senders */
+    uint32_t hellos;            /* decayed HELLO count, Q8 */
+    uint32_t hellos_total;      /* counted since boot */
+    uint32_t rejected;          /* HELLOs with a bad tag or MAC, or a short bitmask */
+} crowd_stats_t;
+
+/** @brief Empty counts and sketches; called from espnow_init() */
+esp_err_t crowd_init(void);
+
+/** @brief Count a received frame: its sender, and a HELLO's bitmask */
+void crowd_handle_recv(const pairing_ctx_t *ctx, const uint8_t *mac, const uint8_t *data, int len);
+
+/**
+ * @brief Decay the bit counts and rotate the sketches when due
+ *
+ * @return ms until it next wants to run
+ */
+uint32_t crowd_tick(void);
+
+/** @brief The estimates and counters as of now */
+void crowd_get_stats(crowd_stats_t *out);
+
+/**
+ * @brief The CROWD: reply, without the delimiter
+ *
+ * @param bits   the bits to report, or NULL for the CROWD_TOP_N with the
+ *               highest counts (bits never seen are left out)
+ * @param count  entries in @p bits, at most CROWD_QUERY_MAX
+ * @return the length written, truncated to @p size like snprintf
+ */
+int crowd_report(const uint16_t *bits, int count, char *out, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CROWD_H */
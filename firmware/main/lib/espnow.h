@@ -4,6 +4,9 @@
 #include "esp_now.h"
 #include "esp_err.h"
 #include "pairing.h"
+#include "announce.h"
+#include "loadgen.h"
+#include "crowd.h"
 
 /* ESPNOW can work in both station and softap mode. It is configured in menuconfig. */
 #if CONFIG_ESPNOW_WIFI_MODE_STATION
@@ -54,6 +57,14 @@ typedef enum {
     ESPNOW_SET_KEY,
     ESPNOW_SET_BITMASK,
     ESPNOW_SET_RELAY_URL,
+    ESPNOW_SET_GROUP_KEY,
+    ESPNOW_SET_HELLO_INTERVAL,
+    ESPNOW_SET_TX_POWER_CAP,
+    ESPNOW_SET_ORG_KEY,
+    ESPNOW_ANNOUNCE,
+    ESPNOW_LOADGEN,
+    ESPNOW_CROWD,
+    ESPNOW_WAKE,
 } espnow_event_id_t;
 
 typedef struct {
@@ -70,6 +81,31 @@ typedef struct {
     char url[KEY_EXCHANGE_URL_MAX_LEN];
 } espnow_event_set_relay_url_t;
 
+typedef struct {
+    uint8_t key[PAIRING_GROUP_KEY_MAX_LEN];
+    uint8_t len;
+} espnow_event_set_group_key_t;
+
+typedef struct {
+    uint8_t key[ANNOUNCE_ORG_KEY_MAX];
+    uint16_t len;
+} espnow_event_set_org_key_t;
+
+typedef struct {
+    uint8_t data[ANNOUNCE_FRAME_MAX];
+    uint16_t len;
+} espnow_event_announce_t;
+
+typedef struct {
+    bool stop;
+    loadgen_config_t config;
+} espnow_event_loadgen_t;
+
+typedef struct {
+    uint16_t bits[CROWD_QUERY_MAX];
+    uint8_t count;              /* 0 for the top bits */
+} espnow_event_crowd_t;
+
 /* Send callback event data */
 typedef struct {
     uint8_t mac_addr[ESP_NOW_ETH_ALEN];
@@ -83,6 +119,8 @@ typedef struct {
     int data_len;
     int8_t rssi;
     int8_t noise_floor;
+    int64_t rx_us;              /* esp_timer_get_time() in the callback, for timesync */
+    bool claim;                 /* NEIGHBOR_ADMIT_CLAIM: acted on only if the tag checks out */
 } espnow_event_recv_cb_t;
 
 typedef union {
@@ -91,6 +129,13 @@ typedef union {
     espnow_event_set_key_t set_key;
     espnow_event_set_bitmask_t set_bitmask;
     espnow_event_set_relay_url_t set_relay_url;
+    espnow_event_set_group_key_t set_group_key;
+    espnow_event_set_org_key_t set_org_key;
+    espnow_event_announce_t announce;
+    espnow_event_loadgen_t loadgen;
+    espnow_event_crowd_t crowd;
+    uint32_t hello_interval_ms;
+    int8_t tx_power_cap_q;
 } espnow_event_info_t;
 
 /* Event structure posted to ESP-NOW task */
@@ -129,6 +174,26 @@ typedef struct {
     uint8_t dest_mac[ESP_NOW_ETH_ALEN];   // MAC address of destination device.
 } espnow_send_param_t;
 
+/* Receive path counters from the WiFi task, then pairing state from espnow_task */
+typedef struct {
+    uint32_t rx_frames;             // Frames seen by the receive callback
+    uint32_t rx_dropped_foreign;    // Too short or not PAIRING_PROTOCOL_ID
+    uint32_t rx_dropped_rate;       // Sender over its per-class rate or share
+    uint32_t rx_dropped_global;     // Global ingress budget exhausted
+    uint32_t rx_dropped_dup;        // seq_num already seen (retransmit/replay)
+    uint32_t rx_dropped_claim;      // Window reset claimed by a frame whose tag or MAC failed (espnow_task)
+    uint32_t rx_dropped_queue;      // espnow_task queue full
+    uint32_t rx_dropped_nomem;      // Malloc of the frame copy failed
+    uint32_t pairing_resumed;       // Suspended sessions recovered via RESUME
+    uint32_t pairing_last_outage_ms;// Time spent suspended before the last resume
+    int8_t tx_power_q;              // Current TX power limit, 0.25 dBm units
+    int8_t partner_tx_q;            // Closed loop power for frames to the partner
+    uint32_t tx_power_changes;      // esp_wifi_set_max_tx_power() calls
+    uint32_t handshake_ms;          // PROPOSAL or ACCEPT to key confirmed, last pairing
+    uint32_t handshakes;            // Pairings that got that far
+    uint8_t link;                   // Partner link: 0 plaintext, 1 CCMP unverified, 2 CCMP verified
+} espnow_stats_t;
+
 /* Broadcast MAC address - exposed for IS_BROADCAST_ADDR macro */
 extern const uint8_t espnow_broadcast_mac[ESP_NOW_ETH_ALEN];
 
@@ -144,6 +209,24 @@ esp_err_t espnow_init(void);
 void espnow_set_config_key(const char *key);
 void espnow_set_config_bitmask(const uint8_t *data, uint16_t len, uint8_t similarity_threshold);
 void espnow_set_relay_url(const char *url);
+void espnow_set_group_key(const uint8_t *key, uint8_t len);
+void espnow_set_org_key(const uint8_t *der, uint16_t len);
+/* announce_t from the organizer's phone; ANNOUNCE_OK or ANNOUNCE_ERR:<why> goes back over BLE */
+void espnow_announce(const uint8_t *data, uint16_t len);
+/* never blocks; ESP_ERR_NO_MEM when the task's queue is full */
+esp_err_t espnow_set_hello_interval(uint32_t interval_ms);
+/* upper bound for every frame, 0.25 dBm units, 0 for none; never blocks */
+esp_err_t espnow_set_tx_power_cap(int8_t cap_q);
+/* NULL stops the run; LOAD_OK or LOAD_ERR:<err> goes back over BLE */
+void espnow_loadgen(const loadgen_config_t *cfg);
+/* NULL or count 0 for the top bits; CROWD:<report> goes back over BLE */
+void espnow_crowd(const uint16_t *bits, uint8_t count);
+/* run the ticks now rather than at the next timeout; never blocks, any task or callback */
+void espnow_wake(void);
 void espnow_reset_pairing(void);
+/* any task, never blocks: counters as of now, pairing fields as of espnow_task's last tick */
+void espnow_get_stats(espnow_stats_t *out);
+/* true when called from espnow_task */
+bool espnow_in_context(void);
 
 #endif /* ESPNOW_H */
@@ -0,0 +1,122 @@
+/**
+ * @file frag.h
+ * @brief ESP-NOW v2 frames where the peer takes them, v1-sized fragments where it doesn't
+ *
+ * ESP-NOW v2 (ESP-IDF 5.4 and later) carries up to 1470 bytes a frame; a
+ * v1 receiver keeps the first 250 bytes of a longer one, or drops it. A
+ * PROPOSAL or ACCEPT with an RSA public key and a large bitmask runs to
+ * 800 bytes and an OTA chunk to 560, so they either need a v2 receiver or
+ * have to be split.
+ *
+ * Every HELLO carries our capability bits (PAIRING_CAP_*, see pairing.h);
+ * pairing.c hands what it reads from the ones it acts on, past the
+ * similarity and group tag checks, to frag_set_peer_caps(). frag_send()
+ * then sends a frame whole when both sides take v2 frames and it fits, and
+ * otherwise as fragments of at most FRAG_V1_LEN bytes each:
+ *
+ *   header (msg_type MSG_FRAGMENT, its own seq_num) | frag_hdr_t | part
+ *
+ * Broadcasts are always v1-sized, since every badge in range hears them,
+ * and a peer whose HELLO we haven't read is taken to be v1.
+ *
+ * The receiver collects the parts of a frame per sender in one of
+ * FRAG_SLOTS buffers and passes the frame on once all have arrived; a part
+ * lost costs the whole frame, which the sender repeats as it would any
+ * other lost frame. Parts of a frame are sent back to back, so a slot not
+ * completed within FRAG_TIMEOUT_MS is given up on.
+ *
+ * Capabilities come from ESPNOW_V2_FRAMES and esp_now_get_version(): a
+ * badge built against a v1 driver, or with the option off, advertises no
+ * v2 and gets fragments from everyone.
+ *
+ * Everything runs on espnow_task except frag_get_stats().
+ */
+
+#ifndef FRAG_H
+#define FRAG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "pairing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAG_V1_LEN             250     /* ESP_NOW_MAX_DATA_LEN */
+#define FRAG_V2_LEN             1470    /* ESP_NOW_MAX_DATA_LEN_V2 */
+#define FRAG_FRAME_MAX          1024    /* largest frame that is split; PAIRING_FRAME_MAX is 827 */
+#define FRAG_PARTS_MAX          8
+#define FRAG_SLOTS              4       /* frames being reassembled at once */
+#define FRAG_TIMEOUT_MS         250
+#define FRAG_PEERS_MAX          16      /* capabilities remembered, least recently heard forgotten */
+
+/** after the header of a MSG_FRAGMENT */
+typedef struct __attribute__((packed)) {
+    uint32_t frame_seq;         /* seq_num in the header of the frame split */
+    uint16_t frame_len;
+    uint8_t index;
+    uint8_t count;
+} frag_hdr_t;
+
+/** bytes of the frame per fragment; the last may carry fewer */
+#define FRAG_PART_LEN           (FRAG_V1_LEN - sizeof(broadcast_header_t) - sizeof(frag_hdr_t))
+
+typedef struct {
+    uint8_t caps;               /* what we advertise */
+    uint8_t peers;              /* capabilities known */
+    uint8_t peers_v2;
+    uint32_t tx_whole;          /* frames over FRAG_V1_LEN sent as one v2 frame */
+    uint32_t tx_split;          /* frames sent as fragments */
+    uint32_t tx_parts;
+    uint32_t rx_parts;
+    uint32_t rx_joined;         /* frames put back together */
+    uint32_t rx_expired;        /* given up on with parts missing */
+    uint32_t rx_bad;            /* parts that don't fit the frame they claim to be from */
+} frag_stats_t;
+
+/** @brief Work out our capabilities; called from espnow_init() */
+esp_err_t frag_init(void);
+
+/** @brief PAIRING_CAP_* we advertise in HELLO */
+uint8_t frag_local_caps(void);
+
+/** @brief Capabilities from a peer's HELLO */
+void frag_set_peer_caps(const uint8_t *mac, uint8_t caps);
+
+/** @brief Frames a frame of @p len bytes to @p mac goes out as */
+int frag_frames_for(const uint8_t *mac, size_t len);
+
+/**
+ * @brief Send a frame built by pairing.c, whole or in fragments
+ *
+ * The fragments' headers are the frame's with msg_type and seq_num
+ * replaced, so they go out at the power the frame was stamped with. Every
+ * frame pairing.c sends comes through here, so each one the driver takes
+ * is noted with rate_note_send().
+ *
+ * @return ESP_OK when every part was handed to the driver
+ */
+esp_err_t frag_send(pairing_ctx_t *ctx, const uint8_t *mac, const uint8_t *frame, size_t len);
+
+/**
+ * @brief Look at an admitted frame before it is handled
+ *
+ * Frames other than MSG_FRAGMENT come back as they are. A fragment is
+ * stored; when it completes its frame, *data and *len are pointed at the
+ * frame, valid until the next call.
+ *
+ * @return true if there is a frame to handle
+ */
+bool frag_handle_recv(const uint8_t *mac, const uint8_t **data, int *len);
+
+/** @brief Consistent copy of the counters; any task, never blocks */
+void frag_get_stats(frag_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAG_H */
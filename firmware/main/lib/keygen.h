@@ -1,6 +1,7 @@
 #ifndef KEYGEN_H
 #define KEYGEN_H
 
+/* both buffers come from mem_calloc(MEM_TAG_KEYGEN, ...); release with mem_free() */
 typedef struct {
     char *public_key_pem;
     char *private_key_pem;
@@ -0,0 +1,145 @@
+/**
+ * @file loadgen.h
+ * @brief One badge standing in for many, to load another badge's receive path
+ *
+ * Built with CONFIG_ESPNOW_LOADGEN and started over BLE (LOAD:start,...).
+ * While it runs the badge's own pairing is paused and it speaks for
+ * LOADGEN_IDENTITIES_MAX or fewer virtual badges instead, each with its own
+ * MAC, sequence numbers and random interest bitmask:
+ *
+ *   02:4c:47 | last two bytes of our MAC | identity index
+ *
+ * Frames go out at a total rate across all identities, drawn by the mix:
+ * a HELLO broadcast, a PROPOSAL to the target from an identity that is
+ * SEARCHING (a HELLO from one that isn't), or a HEARTBEAT to the target.
+ * Without a target the last two are broadcast, and every SEARCHING badge
+ * in range takes such a PROPOSAL as addressed to it. Identities that pair
+ * also send their partner a heartbeat every PAIRING_HEARTBEAT_MS, outside
+ * the rate.
+ *
+ * ESP-NOW sends from our own MAC only, so the frames are built here as the
+ * driver would (the layout in sniffer.h, one element, v1 sized) and handed
+ * to esp_wifi_80211_tx(). Frames to the identities are picked up the way
+ * the sniffer does, in promiscuous mode; no radio ACKs them, so the target
+ * sees every unicast to one fail, as it would for a badge at the edge of
+ * range. What an identity does with a PROPOSAL follows the script:
+ *
+ *   accept   ACCEPT, then heartbeats until the target goes quiet
+ *   reject   REJECT
+ *   ignore   nothing; the target's proposal times out
+ *
+ * An identity answers a PROPOSAL it can't take (already paired or
+ * proposing) with REJECT, like a badge. It never sends KEY_EXCHANGE: its
+ * frames can't take part in the switch to CCMP, so the target stays paired
+ * with the key unconfirmed and repeats KEY_EXCHANGE every heartbeat. HELLOs
+ * carry no group tag and advertise no v2 frames, so a target with a group
+ * key ignores them once past the similarity check, and a long PROPOSAL or
+ * ACCEPT comes back as fragments; the first fragment tells what it is.
+ *
+ * A run ends after its duration or on LOAD:stop, and LOAD_DONE:<summary>
+ * goes to the phone. Everything runs on espnow_task except the promiscuous
+ * callback (Wi-Fi task), which only queues what it heard and wakes the
+ * task, and loadgen_get_stats().
+ */
+
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOADGEN_IDENTITIES_MAX      64
+#define LOADGEN_RATE_MAX            1000    /* frames per second, all identities */
+#define LOADGEN_BITS_MAX            256     /* interest bitmask length */
+#define LOADGEN_BURST_MAX           8       /* frames sent per wakeup when behind */
+#define LOADGEN_RX_QUEUE            16
+
+#define LOADGEN_DEFAULT_IDENTITIES  16
+#define LOADGEN_DEFAULT_RATE        50
+#define LOADGEN_DEFAULT_SECS        60
+#define LOADGEN_DEFAULT_BITS        64
+
+typedef enum {
+    LOADGEN_ACCEPT = 0,
+    LOADGEN_REJECT,
+    LOADGEN_IGNORE,
+} loadgen_script_t;
+
+typedef struct {
+    uint16_t identities;
+    uint16_t rate;              /* frames per second */
+    uint8_t mix_hello;          /* weights, need not add up to 100 */
+    uint8_t mix_proposal;
+    uint8_t mix_heartbeat;
+    loadgen_script_t script;
+    uint16_t bits;              /* bitmask length, each bit set with probability 1/2 */
+    uint32_t secs;              /* 0: until LOAD:stop */
+    bool has_target;
+    uint8_t target[6];
+} loadgen_config_t;
+
+typedef struct {
+    bool running;
+    uint16_t identities;
+    uint16_t rate;
+    uint32_t elapsed_ms;
+    uint32_t tx_hello;
+    uint32_t tx_proposal;
+    uint32_t tx_heartbeat;      /* unsolicited and to partners */
+    uint32_t tx_accept;
+    uint32_t tx_reject;
+    uint32_t tx_failed;         /* esp_wifi_80211_tx() refused, usually out of buffers */
+    uint32_t rx;                /* frames to an identity, retries included */
+    uint32_t rx_proposal;
+    uint32_t rx_accept;
+    uint32_t rx_reject;
+    uint32_t rx_heartbeat;
+    uint32_t rx_kex;
+    uint32_t rx_dropped;        /* queue full */
+    uint32_t paired;            /* identities the target paired with */
+    uint32_t lost;              /* of those, given up on when the target went quiet */
+    uint32_t accept_ms;         /* PROPOSAL sent to ACCEPT heard, mean */
+} loadgen_stats_t;
+
+/** @brief Set up the receive queue; called from espnow_init() */
+esp_err_t loadgen_init(void);
+
+/**
+ * @brief Start a run with @p cfg, or stop the current one with NULL
+ *
+ * Stopping sends LOAD_DONE:<summary> over BLE.
+ *
+ * A run already going is stopped first.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a config out of range,
+ *         ESP_ERR_INVALID_STATE to stop with no run going, or the Wi-Fi
+ *         driver's error enabling promiscuous mode
+ */
+esp_err_t loadgen_start(const loadgen_config_t *cfg);
+
+/** @brief True while a run is going; espnow_task pauses its own pairing */
+bool loadgen_running(void);
+
+/**
+ * @brief Send what is due and handle what the identities heard
+ *
+ * @return ms until it wants to run again, UINT32_MAX when idle
+ */
+uint32_t loadgen_tick(void);
+
+/** @brief Counters of the current or last run; any task, never blocks */
+void loadgen_get_stats(loadgen_stats_t *out);
+
+/** @brief "accept", "reject", "ignore" or "?" */
+const char *loadgen_script_name(loadgen_script_t script);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOADGEN_H */
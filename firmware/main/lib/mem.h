@@ -0,0 +1,180 @@
+/*
+ * mem.h - Tagged heap allocations and fragmentation history
+ *
+ * Every allocation the firmware makes after boot goes through mem_malloc()
+ * with the tag of the subsystem that owns it, so a badge that degrades after
+ * hours can say who holds the heap. Per tag: live allocations, live bytes,
+ * peak bytes, total allocations and failures. A timer samples free heap,
+ * the all-time minimum and the largest free block every
+ * MEM_SAMPLE_INTERVAL_S into a ring the phone reads with MEM:history.
+ *
+ * Bluedroid, Wi-Fi and mbedtls allocate on their own; they only show up in
+ * the free/largest numbers.
+ *
+ * Each allocation carries an 8 byte header (tag, size, magic), so
+ * mem_free() needs no tag and catches frees of foreign or already freed
+ * pointers.
+ *
+ * With CONFIG_ESPNOW_STATIC_MEM nothing here touches the heap: each tag
+ * owns a pool of fixed-size blocks carved from one .bss arena in
+ * mem_init(), sized by the ESPNOW_STATIC_* options. A request larger than
+ * the tag's block, or with the pool empty, fails like malloc() would. The
+ * build fails if any other file in main references the heap, and once
+ * app_main calls mem_seal() every heap allocation still made (Bluedroid,
+ * Wi-Fi, mbedtls) is counted per task.
+ */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_ESPNOW_MEM_SAMPLE_INTERVAL_S
+#define MEM_SAMPLE_INTERVAL_S       CONFIG_ESPNOW_MEM_SAMPLE_INTERVAL_S
+#else
+#define MEM_SAMPLE_INTERVAL_S       60
+#endif
+
+#ifdef CONFIG_ESPNOW_MEM_HISTORY_LEN
+#define MEM_HISTORY_LEN             CONFIG_ESPNOW_MEM_HISTORY_LEN
+#else
+#define MEM_HISTORY_LEN             60
+#endif
+
+#if CONFIG_ESPNOW_STATIC_MEM
+#define MEM_STATIC                  1
+#else
+#define MEM_STATIC                  0
+#endif
+
+#define MEM_POST_INIT_TASKS         8
+
+typedef enum {
+    MEM_TAG_ESPNOW_RX = 0,      /* frame copies, espnow_recv_cb -> espnow_task */
+    MEM_TAG_ESPNOW_CFG,         /* BITMASK event copies, peer info */
+    MEM_TAG_PAIRING,            /* own and partner interest bitmasks */
+    MEM_TAG_BLE_RX,             /* GATT write copies, GATT callback -> ble_task */
+    MEM_TAG_BLE_CMD,            /* BITMASK command parsing */
+    MEM_TAG_KEYGEN,             /* PEM buffers */
+    MEM_TAG_MAX,
+} mem_tag_t;
+
+typedef struct {
+    uint32_t live;              /* allocations not freed yet */
+    uint32_t bytes;             /* requested bytes in live allocations */
+    uint32_t peak_bytes;
+    uint32_t total;             /* allocations since boot */
+    uint32_t failed;
+} mem_tag_stats_t;
+
+typedef struct {
+    uint32_t t_ms;
+    uint32_t free;              /* 8-bit capable heap, 0 on the linux target */
+    uint32_t min_free;
+    uint32_t largest_free;
+    uint32_t tagged_bytes;      /* sum of mem_tag_stats_t.bytes */
+} mem_sample_t;
+
+typedef struct {
+    uint32_t arena_bytes;       /* static pools in .bss, 0 without MEM_STATIC */
+    uint32_t heap_total;        /* 8-bit capable heap, 0 on the linux target */
+    uint32_t free_at_seal;      /* what init left for Bluedroid, Wi-Fi and mbedtls */
+    uint32_t largest_at_seal;
+    uint32_t post_init_allocs;  /* heap allocations after mem_seal(), all tasks */
+    uint32_t post_init_bytes;
+    bool sealed;
+} mem_budget_t;
+
+typedef struct {
+    char task[16];
+    uint32_t allocs;
+    uint32_t bytes;
+} mem_task_allocs_t;
+
+/**
+ * @brief Create the lock, carve the static pools and start the sampling timer
+ *
+ * Call first thing in app_main. Without MEM_STATIC, allocations made before
+ * still work, they are just counted without locking; with it they fail.
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the lock or timer cannot be created
+ */
+esp_err_t mem_init(void);
+
+/**
+ * @brief Mark the end of init and log the RAM budget
+ *
+ * Call last thing in app_main. From here on, with CONFIG_HEAP_USE_HOOKS
+ * (selected by CONFIG_ESPNOW_STATIC_MEM), every heap allocation is counted
+ * against the task that made it and logged once per task.
+ */
+void mem_seal(void);
+
+/**
+ * @brief Copy the RAM budget recorded by mem_seal()
+ */
+void mem_get_budget(mem_budget_t *out);
+
+/**
+ * @brief Copy the per-task counts of heap allocations made after mem_seal()
+ *
+ * @param out Room for max entries
+ * @param max Capacity of out, MEM_POST_INIT_TASKS is enough
+ * @return Number of tasks copied
+ */
+uint32_t mem_get_post_init(mem_task_allocs_t *out, uint32_t max);
+
+/**
+ * @brief malloc() on behalf of a subsystem
+ *
+ * @return NULL on failure (counted in mem_tag_stats_t.failed)
+ */
+void *mem_malloc(mem_tag_t tag, size_t size);
+
+/**
+ * @brief calloc() on behalf of a subsystem
+ */
+void *mem_calloc(mem_tag_t tag, size_t count, size_t size);
+
+/**
+ * @brief Free memory from mem_malloc()/mem_calloc(); NULL is ignored
+ */
+void mem_free(void *ptr);
+
+/**
+ * @brief Short lowercase name of a tag, as used in the MEM reply
+ */
+const char *mem_tag_name(mem_tag_t tag);
+
+/**
+ * @brief Copy one tag's counters
+ */
+void mem_get_tag_stats(mem_tag_t tag, mem_tag_stats_t *out);
+
+/**
+ * @brief Take a heap sample now (not added to the history)
+ */
+void mem_sample(mem_sample_t *out);
+
+/**
+ * @brief Copy the sample history, oldest first
+ *
+ * @param out Room for max samples
+ * @param max Capacity of out
+ * @return Number of samples copied
+ */
+uint32_t mem_get_history(mem_sample_t *out, uint32_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEM_H */
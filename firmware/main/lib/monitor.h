@@ -17,7 +17,8 @@ typedef struct {
     uint32_t timestamp;  // tick count when sampled
 } monitor_data_t;
 
-// init monitor task (reads voltage and temp every 5 seconds)
+// init monitor (reads voltage and temp every 5 seconds on the reactor,
+// so reactor_init() must run first; samples also go out on BUS_TOPIC_MONITOR)
 // adc_channel: channel to read voltage from (e.g. ADC_CHANNEL_0)
 // returns queue handle for receiving data (queue size 1)
 esp_err_t monitor_init(int adc_channel, QueueHandle_t *out_queue);
@@ -25,7 +26,7 @@ esp_err_t monitor_init(int adc_channel, QueueHandle_t *out_queue);
 // get latest data without blocking (returns false if no data)
 bool monitor_get_latest(monitor_data_t *data);
 
-// stop monitor task
+// stop monitor
 void monitor_deinit(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,209 @@
+/**
+ * @file neighbor.h
+ * @brief Per-sender ingress state for ESP-NOW frames
+ *
+ * A small hashed table keyed by source MAC, checked by espnow_recv_cb()
+ * before a frame is copied and queued. Each entry holds a token bucket per
+ * message class, a bucket capping the sender's share of the global budget,
+ * and a 64-frame seq_num window that drops duplicates and replays; a frame
+ * that would move the window past its own limits is only a claim until
+ * espnow_task confirms its tag. OTA frames may use only the top half of
+ * the global budget. The table is only touched from the WiFi task.
+ */
+
+#ifndef NEIGHBOR_H
+#define NEIGHBOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pairing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of tracked senders (power of two) */
+#define NEIGHBOR_TABLE_SIZE         32
+
+/** Max slots probed per lookup before evicting the stalest entry */
+#define NEIGHBOR_PROBE_MAX          8
+
+/** Width of the duplicate-detection window in frames */
+#define NEIGHBOR_SEQ_WINDOW         64
+
+/** Slack when deciding whether an uptime regression is a reboot */
+#define NEIGHBOR_REBOOT_SLACK_MS    2000
+
+/** seq_num a sender may skip ahead without a claim, plus NEIGHBOR_SEQ_RATE_MAX per second */
+#define NEIGHBOR_SEQ_JUMP           (NEIGHBOR_SEQ_WINDOW / 2)
+
+/** Frames per second a badge can put on air, to everyone: its seq_num can't run faster */
+#define NEIGHBOR_SEQ_RATE_MAX       1000
+
+/** How fast a sender's clock may drift from ours before its frames look like claims */
+#define NEIGHBOR_DRIFT_PPM          1000
+
+/** Silence after which an unconfirmed reference is dropped; below PAIRING_RESUME_GRACE_MS */
+#define NEIGHBOR_IDLE_MS            10000
+
+/** Confirmations from espnow_task waiting for the next received frame */
+#define NEIGHBOR_CONFIRM_QUEUE_LEN  4
+
+#ifdef CONFIG_ESPNOW_RX_GLOBAL_RATE
+#define NEIGHBOR_GLOBAL_RATE        CONFIG_ESPNOW_RX_GLOBAL_RATE
+#else
+#define NEIGHBOR_GLOBAL_RATE        100
+#endif
+
+#ifdef CONFIG_ESPNOW_RX_SENDER_SHARE_PCT
+#define NEIGHBOR_SENDER_SHARE_PCT   CONFIG_ESPNOW_RX_SENDER_SHARE_PCT
+#else
+#define NEIGHBOR_SENDER_SHARE_PCT   25
+#endif
+
+#ifdef CONFIG_ESPNOW_RX_HELLO_RATE
+#define NEIGHBOR_HELLO_RATE         CONFIG_ESPNOW_RX_HELLO_RATE
+#else
+#define NEIGHBOR_HELLO_RATE         4
+#endif
+
+#ifdef CONFIG_ESPNOW_RX_PROPOSAL_RATE
+#define NEIGHBOR_PROPOSAL_RATE      CONFIG_ESPNOW_RX_PROPOSAL_RATE
+#else
+#define NEIGHBOR_PROPOSAL_RATE      1
+#endif
+
+#ifdef CONFIG_ESPNOW_RX_CONTROL_RATE
+#define NEIGHBOR_CONTROL_RATE       CONFIG_ESPNOW_RX_CONTROL_RATE
+#else
+#define NEIGHBOR_CONTROL_RATE       10
+#endif
+
+#ifdef CONFIG_ESPNOW_RX_OTA_RATE
+#define NEIGHBOR_OTA_RATE           CONFIG_ESPNOW_RX_OTA_RATE
+#else
+#define NEIGHBOR_OTA_RATE           20
+#endif
+
+#ifdef CONFIG_ESPNOW_RX_FRAGMENT_RATE
+#define NEIGHBOR_FRAGMENT_RATE      CONFIG_ESPNOW_RX_FRAGMENT_RATE
+#else
+#define NEIGHBOR_FRAGMENT_RATE      20
+#endif
+
+/**
+ * @brief Rate-limit classes; every MSG_TYPE maps onto one of these
+ */
+typedef enum {
+    NEIGHBOR_CLASS_HELLO = 0,   /**< MSG_HELLO, MSG_OTA_ADVERT and MSG_TIMESYNC broadcasts */
+    NEIGHBOR_CLASS_PROPOSAL,    /**< MSG_PROPOSAL unicasts */
+    NEIGHBOR_CLASS_CONTROL,     /**< ACCEPT/REJECT/HEARTBEAT/KEY_EXCHANGE/RELAY_URL/RESUME/ANNOUNCE */
+    NEIGHBOR_CLASS_OTA,         /**< MSG_OTA_REQUEST/MSG_OTA_CHUNK unicasts */
+    NEIGHBOR_CLASS_FRAGMENT,    /**< MSG_FRAGMENT parts after the first */
+    NEIGHBOR_CLASS_MAX
+} neighbor_class_t;
+
+/**
+ * @brief Result of neighbor_admit()
+ */
+typedef enum {
+    NEIGHBOR_ADMIT = 0,         /**< Frame may be queued */
+    NEIGHBOR_DROP_RATE,         /**< Sender exceeded its per-class rate or share */
+    NEIGHBOR_DROP_GLOBAL,       /**< Global ingress budget exhausted */
+    NEIGHBOR_DROP_DUP,          /**< seq_num already seen or older than the window */
+    NEIGHBOR_ADMIT_CLAIM,       /**< Frame may be queued, but only acted on once authenticated */
+} neighbor_verdict_t;
+
+/**
+ * @brief Token bucket, tokens stored in milli-frames
+ */
+typedef struct {
+    uint32_t tokens;
+    uint32_t last_ms;
+} token_bucket_t;
+
+/**
+ * @brief Per-sender entry
+ */
+typedef struct {
+    bool used;
+    uint8_t mac[6];
+    uint32_t last_seen_ms;
+    uint32_t last_admit_ms;                     /**< Local time of the last admitted frame */
+    uint32_t last_uptime_ms;                    /**< Highest sender uptime admitted */
+    uint32_t boot_ms;                           /**< Local time the sender booted, from its uptimes */
+    bool synced;                                /**< seq and boot_ms hold a reference */
+    bool trusted;                               /**< ...set by a group-tagged claim, not a first frame */
+    uint32_t seq_max;                           /**< Highest admitted seq_num */
+    uint64_t seq_window;                        /**< Bit i set = seq_max - i admitted */
+    bool claim_pending;                         /**< Last claim admitted, not yet confirmed */
+    uint32_t claim_seq;
+    uint32_t claim_uptime_ms;
+    uint32_t claim_ms;                          /**< Local time the claim was admitted */
+    bool frag_known;                            /**< A first fragment has come in */
+    bool frag_dropped;                          /**< ...and it, or a part after it, was dropped */
+    uint8_t frag_cls;                           /**< ...the class of the frame it starts */
+    uint32_t frag_seq;                          /**< ...that frame's seq_num */
+    token_bucket_t share;                       /**< Cap on share of global budget */
+    token_bucket_t bucket[NEIGHBOR_CLASS_MAX];  /**< Per message class */
+} neighbor_t;
+
+/**
+ * @brief Clear the table and refill the global bucket
+ *
+ * @param now_ms Current time in milliseconds
+ */
+void neighbor_init(uint32_t now_ms);
+
+/**
+ * @brief Decide whether a frame from @p mac may be processed
+ *
+ * Looks up (or inserts) the sender and rejects frames whose seq_num was
+ * already seen. Otherwise refills its buckets and charges one frame against
+ * the class bucket, the sender share bucket and the global bucket. Nothing
+ * is charged unless all three have a token (OTA frames: unless the global
+ * bucket is at least half full), and the seq_num is only marked as seen
+ * once the frame is admitted. A fragment's first part is charged to the
+ * class of the frame it carries, each later part as a fragment.
+ *
+ * The first frame from a sender sets a provisional reference. After that,
+ * a frame that would reset the window (a reboot, or a seq_num jump faster
+ * than a badge can send) is admitted as NEIGHBOR_ADMIT_CLAIM if it is
+ * HELLO-class and the buckets allow, and dropped as a duplicate otherwise. Confirmations queued by
+ * neighbor_confirm() are applied first.
+ *
+ * @param mac    Source MAC from the radio header
+ * @param data   Frame, starting with the pairing header
+ * @param len    Length of @p data, at least the header's
+ * @param now_ms Current time in milliseconds
+ * @return Verdict
+ */
+neighbor_verdict_t neighbor_admit(const uint8_t *mac, const uint8_t *data, int len, uint32_t now_ms);
+
+/**
+ * @brief A NEIGHBOR_ADMIT_CLAIM frame passed its tag: restart the window there
+ *
+ * Called from espnow_task; applied by the next neighbor_admit(), and only
+ * if it is still the sender's latest claim. Without @p tagged the claim
+ * may only continue the window, never restart it.
+ *
+ * @param mac    Source MAC the frame was admitted under
+ * @param hdr    The frame's header
+ * @param tagged A group tag verified, not just the header MAC
+ */
+void neighbor_confirm(const uint8_t *mac, const broadcast_header_t *hdr, bool tagged);
+
+/**
+ * @brief Keep @p mac's entry, and so its window, when the table is full
+ *
+ * Called from espnow_task when the partner changes.
+ *
+ * @param mac Partner MAC, or NULL when there is none
+ */
+void neighbor_set_partner(const uint8_t *mac);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NEIGHBOR_H */
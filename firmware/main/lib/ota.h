@@ -0,0 +1,166 @@
+/**
+ * @file ota.h
+ * @brief Badge-to-badge firmware updates over ESP-NOW
+ *
+ * Every badge advertises the newest firmware version it can hand out: in
+ * its HELLOs while SEARCHING, otherwise in an OTA_ADVERT broadcast every
+ * OTA_ADVERT_MS. A badge that hears a newer version pulls the image from
+ * that badge and passes it on once it has it, so an update spreads through
+ * the venue the way an epidemic does: one seeded badge, then two, then
+ * four.
+ *
+ * The transfer is pulled by the receiver:
+ *
+ *   receiver                         holder
+ *      │── OTA_REQUEST v, offset, n ──>│   next n chunks, please
+ *      │<──────── OTA_CHUNK ───────────│   one per 1/OTA_CHUNK_RATE s
+ *      │<──────── OTA_CHUNK ───────────│
+ *      │             ...               │
+ *      │── OTA_REQUEST v, offset, n ──>│   when the window is in
+ *
+ * Chunks carry OTA_CHUNK_SIZE bytes of the image, LZ-compressed on the
+ * fly when that makes them smaller. Out-of-order chunks are dropped and
+ * the window is re-requested after OTA_REQUEST_TIMEOUT_MS. A holder
+ * serves one receiver at a time and pauses while it is proposing; a
+ * receiver that keeps timing out moves on to any other badge advertising
+ * the same version and carries on from the same offset.
+ *
+ * Chunks are written straight into the next OTA partition with
+ * esp_ota_write(). esp_ota_end() verifies the image; with signed apps
+ * (sdkconfig.signed) that includes the signature, so only images signed
+ * with the event key are accepted whoever relayed them. Without signed
+ * apps nothing is received unless CONFIG_ESPNOW_OTA_ALLOW_UNSIGNED is set.
+ * A verified image is served from that partition right away, and applied
+ * (boot partition switched, restart) once the badge is back to SEARCHING,
+ * or after OTA_APPLY_DEFER_MS if it never is. The new image is only
+ * confirmed once it has run OTA_CONFIRM_UPTIME_MS and a HELLO from
+ * another badge has passed its checks, so espnow_task, the radio and the
+ * pairing code all work; a reset before that rolls back to the old one.
+ *
+ * A download that writes nothing for OTA_STALL_MS, say because the only
+ * badge advertising the version never sends it, fails like a bad image:
+ * the version is held off for OTA_RETRY_BACKOFF_MS, doubled each time it
+ * fails again, and any other newer one can be fetched meanwhile. The stall
+ * limit is long enough to wait a turn at holders busy serving others.
+ *
+ * Versions are the app's PROJECT_VER as an integer (CONFIG_APP_PROJECT_VER);
+ * a badge whose version doesn't parse serves nothing. An image that
+ * changes PAIRING_PROTOCOL_ID cannot spread to badges on the old protocol,
+ * which drop its frames as foreign; such releases go out over USB.
+ *
+ * Everything except ota_get_stats() runs on espnow_task.
+ */
+
+#ifndef OTA_H
+#define OTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "pairing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_CHUNK_SIZE              512     /* image bytes per chunk, before compression */
+#define OTA_WINDOW_CHUNKS           16      /* chunks asked for per OTA_REQUEST */
+#define OTA_ADVERT_MS               5000
+#define OTA_REQUEST_TIMEOUT_MS      1000
+#define OTA_SOURCE_TIMEOUTS         4       /* in a row before looking for another holder */
+#define OTA_SOURCE_HOLDOFF_MS       10000   /* before going back to a holder that let us down */
+#define OTA_CLIENT_IDLE_MS          3000    /* holder frees its slot after this long without a request */
+#define OTA_RETRY_BACKOFF_MS        60000   /* after an image failed verification or stalled */
+#define OTA_RETRY_BACKOFF_DOUBLINGS 4       /* ...at most, for the same version failing again */
+#define OTA_STALL_MS                300000  /* download given up without a chunk written */
+#define OTA_CONFIRM_UPTIME_MS       30000   /* a new image runs this long before it is kept */
+
+#ifdef CONFIG_ESPNOW_OTA_CHUNK_RATE
+#define OTA_CHUNK_RATE              CONFIG_ESPNOW_OTA_CHUNK_RATE
+#else
+#define OTA_CHUNK_RATE              16
+#endif
+
+#ifdef CONFIG_ESPNOW_OTA_APPLY_DEFER_S
+#define OTA_APPLY_DEFER_MS          (CONFIG_ESPNOW_OTA_APPLY_DEFER_S * 1000)
+#else
+#define OTA_APPLY_DEFER_MS          600000
+#endif
+
+#define OTA_CHUNK_LZ                0x01    /* ota_chunk_t.flags: data is compressed */
+
+/** OTA_REQUEST payload */
+typedef struct __attribute__((packed)) {
+    uint32_t version;
+    uint32_t offset;            /* multiple of OTA_CHUNK_SIZE */
+    uint16_t count;             /* chunks wanted */
+} ota_request_t;
+
+/** OTA_CHUNK payload */
+typedef struct __attribute__((packed)) {
+    uint32_t version;
+    uint32_t image_size;
+    uint32_t offset;
+    uint16_t raw_len;           /* image bytes in this chunk */
+    uint8_t flags;
+    uint8_t data[0];
+} ota_chunk_t;
+
+typedef enum {
+    OTA_IDLE = 0,
+    OTA_DOWNLOADING,
+    OTA_READY,                  /* verified, waiting to be applied */
+} ota_state_t;
+
+typedef struct {
+    ota_state_t state;
+    uint32_t running_version;
+    uint32_t serving_version;   /* what we advertise, 0 for nothing */
+    uint32_t download_version;
+    uint32_t download_bytes;
+    uint32_t download_size;
+    uint32_t updates;           /* images downloaded and verified */
+    uint32_t failures;          /* images that failed to write or verify */
+    uint32_t timeouts;          /* request windows that ran dry */
+    uint32_t served_chunks;
+    uint32_t served_bytes;      /* image bytes, before compression */
+    uint32_t sent_bytes;        /* chunk data on air */
+    uint32_t busy;              /* requests turned away while serving someone else */
+} ota_stats_t;
+
+/**
+ * @brief Find the running image and the update partition
+ *
+ * Called from espnow_init(). Without an update partition (old partition
+ * table) the badge still serves its image but never receives one.
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if the running image can't be read
+ */
+esp_err_t ota_init(void);
+
+/** @brief Version to advertise; pairing_set_fw_version() it after ota_init() */
+uint32_t ota_serving_version(void);
+
+/**
+ * @brief Look at an admitted frame
+ *
+ * Picks up versions from HELLO and OTA_ADVERT and handles OTA_REQUEST and
+ * OTA_CHUNK; everything else is ignored.
+ */
+void ota_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr, const uint8_t *data, int len);
+
+/**
+ * @brief Send due chunks, requests and adverts; apply a ready image
+ *
+ * @return ms until the next call is due
+ */
+uint32_t ota_tick(pairing_ctx_t *ctx);
+
+/** @brief Consistent copy of the counters; any task, never blocks */
+void ota_get_stats(ota_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OTA_H */
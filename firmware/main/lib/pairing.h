@@ -9,11 +9,63 @@
 #define PAIRING_BITMASK_MAX_LEN     256
 #define KEY_EXCHANGE_URL_MAX_LEN    512
 
-#define PAIRING_PROTOCOL_ID     0x42
+#define PAIRING_PROTOCOL_ID     0x43    /* 0x42: header without tx_power_q, HELLO without fw_version and caps */
 #define PAIRING_REBROADCAST_MS  500
 #define PAIRING_TIMEOUT_MS      5000
 #define PAIRING_HEARTBEAT_MS    1000
 #define PAIRING_HEARTBEAT_MISS_MAX 5
+#define PAIRING_LINK_VERIFY_MS  (PAIRING_HEARTBEAT_MS * 3)
+#define PAIRING_LMK_LEN         16
+#define PAIRING_SHARE_LEN       32      /* X25519 public key in KEY_EXCHANGE */
+#define PAIRING_GROUP_KEY_MAX_LEN   32
+#define PAIRING_HELLO_TAG_LEN   8
+#define PAIRING_RESUME_TICKET_LEN   8
+#define PAIRING_RESUME_RETRY_MS     PAIRING_REBROADCAST_MS
+#define PAIRING_PAYLOAD_MAX         544     /* an OTA chunk: 15 byte header and 512 bytes of image, with slack */
+
+/*
+ * HELLO capability bits. A field added to a frame after caps is announced
+ * by a bit here rather than a new PAIRING_PROTOCOL_ID, so badges that don't
+ * know it still pair and ignore the bytes they don't read.
+ */
+#define PAIRING_CAP_V2              0x01    /* takes ESP-NOW v2 frames, see frag.h */
+
+/*
+ * TX power, in the 0.25 dBm units of esp_wifi_set_max_tx_power().
+ *
+ * HELLO goes out at PAIRING_TX_HELLO_Q so only badges close enough to be
+ * worth proposing to hear it. The handshake and RESUME use the full power.
+ * Frames to the partner start at full power and then follow the partner's
+ * last_rssi: the power is set so the partner hears us at
+ * PAIRING_TX_TARGET_RSSI, lowered by at most PAIRING_TX_STEP_DOWN_Q per
+ * heartbeat and raised at once. Every header carries the power it was sent
+ * at and receivers scale the RSSI back to PAIRING_TX_REF_Q
+ * (pairing_rssi_at_ref()), so proximity zones, the proposal RSSI checks and
+ * last_rssi do not depend on what power the sender chose.
+ */
+#define PAIRING_TX_REF_Q            80      /* 20 dBm, what the RSSI zones are calibrated at */
+#define PAIRING_TX_MIN_Q            8       /* 2 dBm, lowest the radio accepts */
+#define PAIRING_TX_MAX_Q            84      /* 21 dBm, highest */
+#define PAIRING_TX_DEADBAND_Q       12      /* ignore last_rssi wobble under 3 dB */
+#define PAIRING_TX_STEP_DOWN_Q      16
+
+#ifdef CONFIG_ESPNOW_TX_HELLO_DBM
+#define PAIRING_TX_HELLO_Q          (CONFIG_ESPNOW_TX_HELLO_DBM * 4)
+#else
+#define PAIRING_TX_HELLO_Q          32
+#endif
+
+#ifdef CONFIG_ESPNOW_TX_TARGET_RSSI
+#define PAIRING_TX_TARGET_RSSI      CONFIG_ESPNOW_TX_TARGET_RSSI
+#else
+#define PAIRING_TX_TARGET_RSSI      (-70)
+#endif
+
+#ifdef CONFIG_ESPNOW_RESUME_GRACE_MS
+#define PAIRING_RESUME_GRACE_MS     CONFIG_ESPNOW_RESUME_GRACE_MS
+#else
+#define PAIRING_RESUME_GRACE_MS     30000
+#endif
 
 typedef enum {
     MSG_HELLO = 1,
@@ -23,14 +75,41 @@ typedef enum {
     MSG_HEARTBEAT,
     MSG_KEY_EXCHANGE,
     MSG_RELAY_URL,
+    MSG_RESUME,
+    MSG_OTA_ADVERT,             /* see ota.h */
+    MSG_OTA_REQUEST,
+    MSG_OTA_CHUNK,
+    MSG_ANNOUNCE,               /* see announce.h */
+    MSG_TIMESYNC,               /* see timesync.h */
+    MSG_FRAGMENT,               /* part of a longer frame, see frag.h */
 } MSG_TYPE;
 
 typedef enum {
     SEARCHING = 0,
     PROPOSING,
-    PAIRED
+    PAIRED,
+    SUSPENDED
 } BROADCAST_STATE;
 
+/*
+ * session resumption:
+ *
+ * when heartbeats lapse after key exchange has completed, the badge moves to
+ * SUSPENDED instead of resetting. partner MAC, public keys, bitmask and the
+ * key exchange state (including the encrypted peer and LMK) are kept for
+ * PAIRING_RESUME_GRACE_MS while RESUME is unicast to the partner every
+ * PAIRING_RESUME_RETRY_MS. RESUME carries a ticket, HMAC-SHA256(LMK,
+ * "wayside-resume" | sender_mac | seq_num)[:8], that only the two badges of
+ * this pairing can produce, so only sessions that derived an LMK suspend.
+ * binding it to seq_num lets the neighbor table's duplicate window reject
+ * replays. a partner that holds the same session answers with its own
+ * RESUME and both go back to PAIRED without re-running
+ * PROPOSAL/ACCEPT/KEY_EXCHANGE. the header state field tells the receiver
+ * whether the sender still needs an answer, so the exchange stops after
+ * one round trip. when the grace period runs out, pairing_reset() runs as
+ * before.
+ */
+
 /*
  * key exchange (runs automatically after pairing):
  *
@@ -63,14 +142,41 @@ typedef enum {
  *        │                │                │                │
  *        │   [Phones decrypt locally using their private keys]
  *
- * no crypto happens on the badges.
- * phones handle all cryptographic operations.
+ * phones handle all end-to-end cryptography. the badges only protect the
+ * radio hop: KEY_EXCHANGE also carries a fresh X25519 public key (bitmask |
+ * partner pubkey | share), made for this pairing. once both KEY_EXCHANGEs
+ * have crossed, each side runs X25519 with its own secret and the partner's
+ * share, derives the ESP-NOW LMK from that secret, both MACs, both shares
+ * and both public keys, and re-registers the partner peer with encrypt =
+ * true so unicast (including RELAY_URL) is sealed by the radio's hardware
+ * CCMP. a listener that captured every frame still lacks the secret. the
+ * shares are not signed, so a badge that sits between the two during the
+ * exchange can still run one with each; the URL itself stays end-to-end
+ * encrypted by the phones. a KEY_EXCHANGE without a share is ignored.
+ * KEY_EXCHANGE is resent every heartbeat until the partner's arrives, then
+ * sent once more so the partner is guaranteed a copy before we switch. the
+ * secret half lives in kex next to the share, so overlapping exchanges in
+ * different contexts never touch each other's. if no heartbeat arrives
+ * within PAIRING_LINK_VERIFY_MS of switching, we fall back to plaintext and
+ * redo the exchange.
  */
 typedef struct {
     bool active;
     bool key_sent;
     bool key_confirmed;
+    bool sent_after_confirm;
     bool notified_phone;
+    uint32_t last_key_sent;
+
+    bool link_encrypted;
+    bool link_verified;
+    bool link_unavailable;      /* no encrypted peer slot, stay plaintext */
+    uint32_t encrypted_at;
+    bool keyed;                 /* lmk derived from the partner's share */
+    bool has_share;             /* share holds our public key for this pairing */
+    uint8_t share[PAIRING_SHARE_LEN];
+    uint8_t secret[PAIRING_SHARE_LEN]; /* its private half, wiped once the lmk is derived */
+    uint8_t lmk[PAIRING_LMK_LEN];
     
     char outgoing_url[KEY_EXCHANGE_URL_MAX_LEN];
     char incoming_url[KEY_EXCHANGE_URL_MAX_LEN];
@@ -87,11 +193,16 @@ typedef struct __attribute__((packed)) {
     uint32_t uptime_ms;        
     uint8_t state;             
     int8_t last_rssi;          
+    int8_t tx_power_q;          /* power this frame was sent at */
     uint32_t seq_num;          
     uint16_t bitmask_len;
     uint8_t payload[0];
 } broadcast_header_t;
 
+/* the largest frame pairing builds: KEY_EXCHANGE, bitmask | public key | share */
+#define PAIRING_FRAME_MAX   (sizeof(broadcast_header_t) + PAIRING_BITMASK_MAX_LEN + PAIRING_KEY_MAX_LEN + \
+                             PAIRING_SHARE_LEN)
+
 typedef struct {
     uint8_t my_mac[6];
     uint8_t partner_mac[6];
@@ -101,12 +212,25 @@ typedef struct {
     uint32_t last_heartbeat_sent;
     uint32_t last_heartbeat_recv;
     
+    uint32_t suspended_at;
+    uint32_t last_resume_sent;
+    uint32_t resume_count;      /* sessions recovered since boot */
+    uint32_t last_outage_ms;    /* suspension time of the last recovery */
+
+    uint32_t tx_seq;            /* seq_num of the last frame sent, never reset */
     uint32_t heartbeat_seq;
     uint32_t partner_seq;
     int missed_heartbeats;
     int8_t partner_rssi;
     int8_t proposal_rssi;
 
+    int8_t tx_power_q;          /* radio's current limit, as it reports it */
+    int8_t tx_power_req_q;      /* what select_tx_power() last asked for */
+    int8_t tx_max_q;            /* boot limit */
+    int8_t tx_cap_q;            /* thermal cap, tx_max_q unless throttled */
+    int8_t partner_tx_q;        /* closed loop power for frames to the partner */
+    uint32_t tx_power_changes;
+
     uint8_t *bitmask;
     uint16_t bitmask_len;
     
@@ -120,6 +244,24 @@ typedef struct {
     bool has_pubkey;
 
     uint8_t similarity_threshold;
+    uint32_t hello_interval_ms; /* SEARCHING rebroadcast, PAIRING_REBROADCAST_MS unless throttled */
+
+    uint32_t fw_version;        /* advertised in HELLO and OTA_ADVERT, 0 if we serve no image */
+
+    uint32_t handshake_started; /* PROPOSAL sent or accepted */
+    uint32_t handshake_ms;      /* from then until the key exchange confirmed, last pairing */
+    uint32_t handshakes;
+
+    /*
+     * per-event group key pushed by the organizer through the app. when set,
+     * every HELLO carries HMAC-SHA256(group_key, header | bitmask |
+     * fw_version | caps)[:8] after the caps, and HELLOs without a valid tag
+     * are ignored. the tag is only checked once a HELLO has passed the
+     * similarity filter. OTA_ADVERT is tagged the same way.
+     */
+    bool has_group_key;
+    uint8_t group_key[PAIRING_GROUP_KEY_MAX_LEN];
+    uint8_t group_key_len;
 
     key_exchange_ctx_t kex;
 } pairing_ctx_t;
@@ -133,11 +275,41 @@ void pairing_set_pubkey(pairing_ctx_t *ctx, const char *pub_key);
 void pairing_set_bitmask(pairing_ctx_t *ctx, const uint8_t *data, uint16_t len);
 
 bool pairing_is_ready(const pairing_ctx_t *ctx);
+/* PROPOSING, SUSPENDED or an unconfirmed key exchange: a lost frame to the partner costs a timeout */
+bool pairing_handshake_active(const pairing_ctx_t *ctx);
 bool pairing_get_partner_key(const pairing_ctx_t *ctx, char *out_key, size_t max_len);
 bool pairing_get_partner_bitmask(const pairing_ctx_t *ctx, uint8_t *out_data, uint16_t *out_len, uint16_t max_len);
 
 void pairing_set_similarity_threshold(pairing_ctx_t *ctx, uint8_t threshold);
+void pairing_set_hello_interval(pairing_ctx_t *ctx, uint32_t interval_ms);
+void pairing_set_tx_power_cap(pairing_ctx_t *ctx, int8_t cap_q);
+void pairing_set_group_key(pairing_ctx_t *ctx, const uint8_t *key, uint8_t len);
 
 void pairing_set_relay_url(pairing_ctx_t *ctx, const char *url);
+void pairing_set_fw_version(pairing_ctx_t *ctx, uint32_t version);
+
+/*
+ * HELLO is header | bitmask | fw_version | caps | [fields caps announces] |
+ * [tag], caps being PAIRING_CAP_* in one byte, the tag closing the frame;
+ * OTA_ADVERT is header | fw_version | [tag].
+ * pairing_frame_version() only parses, so a receiver can skip the HMAC for
+ * versions it doesn't want. TIMESYNC is header | payload |
+ * [tag]. pairing_frame_tag_valid() checks either, after checking the
+ * header's sender MAC is @p mac, the radio source; with no group key set
+ * the MAC is all it checks.
+ */
+bool pairing_frame_version(const uint8_t *data, int len, uint32_t *out_version);
+bool pairing_frame_tag_valid(const pairing_ctx_t *ctx, const uint8_t *mac, const uint8_t *data, int len);
+
+/*
+ * header | payload to mac (broadcast for OTA_ADVERT and TIMESYNC, which get
+ * the tag, and ANNOUNCE); for ota.c, announce.c and timesync.c. Goes out
+ * through frag_send(), so it may leave as several frames
+ */
+esp_err_t pairing_send_payload(pairing_ctx_t *ctx, const uint8_t *mac, uint8_t msg_type,
+                               const void *payload, size_t len);
+
+/* rssi of a frame as if it had been sent at PAIRING_TX_REF_Q; applied on receive */
+int8_t pairing_rssi_at_ref(const broadcast_header_t *hdr, int8_t rssi);
 
 #endif // PAIRING_H
@@ -5,6 +5,8 @@
  * This module monitors RSSI values from ESP-NOW packets and provides
  * visual (LEDs) and auditory (buzzer) feedback based on proximity zones.
  * As devices get closer, more LEDs light up and blink/beep faster.
+ * Runs on the reactor (reactor.h); RSSI samples arrive on BUS_TOPIC_RSSI
+ * (bus.h) and the blink and timeout are reactor timers.
  */
 
 #ifndef PROXIMITY_H
@@ -60,6 +62,15 @@ typedef struct {
     uint8_t buzzer_volume;  /**< Buzzer volume 0-100 (constant) */
 } proximity_config_t;
 
+/**
+ * @brief What the getters report, published by the reactor as one snapshot
+ */
+typedef struct {
+    proximity_zone_t zone;  /**< Zone of the averaged RSSI */
+    int8_t rssi;            /**< Averaged RSSI in dBm, 0 before any sample */
+    bool enabled;           /**< Alerts enabled */
+} proximity_status_t;
+
 /**
  * @brief Default configuration macro
  */
@@ -72,8 +83,8 @@ typedef struct {
 /**
  * @brief Initialize the proximity alert module
  *
- * Creates the proximity task and initializes internal state.
- * Requires buzzer_init() and hnr26_badge_init() to be called first.
+ * Sets up the blink and timeout timers on the reactor.
+ * Requires reactor_init(), buzzer_init() and hnr26_badge_init() first.
  *
  * @param config Pointer to configuration, or NULL for defaults
  * @return ESP_OK on success, error code otherwise
@@ -83,14 +94,26 @@ esp_err_t proximity_init(const proximity_config_t *config);
 /**
  * @brief Update proximity with a new RSSI reading
  *
- * Call this function whenever an ESP-NOW packet is received.
- * The RSSI value is added to the moving average filter.
- * Thread-safe: can be called from any task.
+ * Frames handled by espnow_task already reach the module through
+ * BUS_TOPIC_RSSI; this is for RSSI from anywhere else (e.g. replay).
+ * The RSSI value is posted to the reactor and added to the moving
+ * average filter there. Thread-safe: can be called from any task.
  *
  * @param rssi RSSI value in dBm (typically -100 to 0)
  */
 void proximity_update(int8_t rssi);
 
+/**
+ * @brief Get zone, RSSI and enabled state as of the same moment
+ *
+ * Never blocks; the getters below each read one field of it. Changes made
+ * through proximity_update() and proximity_enable() show up once the
+ * reactor has handled them.
+ *
+ * @param out Filled with the latest status
+ */
+void proximity_get_status(proximity_status_t *out);
+
 /**
  * @brief Get the current proximity zone
  *
@@ -124,7 +147,7 @@ bool proximity_is_enabled(void);
 /**
  * @brief Deinitialize the proximity module
  *
- * Stops the task and releases resources.
+ * Stops the timers and turns the LEDs off.
  *
  * @return ESP_OK on success
  */
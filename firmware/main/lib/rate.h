@@ -0,0 +1,116 @@
+/**
+ * @file rate.h
+ * @brief Per-peer PHY rate for ESP-NOW unicast, in the manner of Minstrel
+ *
+ * Left alone the driver sends every unicast at 1 Mbps DSSS: about 750 us
+ * on air for a heartbeat, where HT20 MCS7 needs 50. A partner across the
+ * table hears MCS7 fine; one across the hall needs 1 Mbps, or LR.
+ *
+ * rate keeps, for each peer we unicast to, a success probability per rate
+ * on the ladder below, fed from the send callback's ACK status, and sets
+ * the peer's rate with esp_now_set_peer_rate_config() after every result:
+ *
+ *   - the rate for the next frame is the one with the least airtime among
+ *     those delivering at least RATE_PROB_MIN; if none does, the one with
+ *     the best probability. 1 Mbps starts out at 1000 permille, since that
+ *     is what every unicast went out at so far
+ *   - every RATE_SAMPLE_EVERY-th frame tries another rate instead: one of
+ *     the next RATE_SAMPLE_REACH up that isn't known to be hopeless, or
+ *     one not tried for RATE_STALE_MS, so the table follows the peer when
+ *     it moves
+ *   - a frame lost at the chosen rate is followed by one at the most
+ *     reliable rate, standing in for Minstrel's retry chain
+ *   - while a handshake with the partner is in flight (PROPOSING, key
+ *     exchange unconfirmed, SUSPENDED) its frames all go at the most
+ *     reliable rate: losing one costs a timeout
+ *
+ * Minstrel's criterion is throughput; here nearly all the traffic is one
+ * heartbeat a second and a lost one counts toward suspending the pairing,
+ * so the probability floor comes first and airtime second. Probabilities
+ * are per-frame EWMAs rather than per 100 ms window: at a frame a second a
+ * window would hold nothing.
+ *
+ * frag_send() notes the rate each unicast went out at, per peer, and the
+ * result a callback reports is credited to the oldest one noted: the
+ * driver reports a peer's frames in the order they were handed to it. So
+ * the parts of a fragmented frame, all sent before the first result
+ * changes the peer's rate, are each credited to the rate they were sent
+ * at. A result with nothing noted goes to the rate the peer is set to; a
+ * full ring drops its oldest note, whose result never came.
+ *
+ * Long Range rates are on the ladder only with ESPNOW_ENABLE_LONG_RANGE:
+ * a badge without WIFI_PROTOCOL_LR can't decode them.
+ *
+ * With control off (RATE:off) every peer goes back to 1 Mbps; probabilities
+ * and counters keep running for it, for comparison.
+ *
+ * rate_note_send() and rate_handle_send_result() run on espnow_task; the
+ * rest on any task.
+ */
+
+#ifndef RATE_H
+#define RATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "pairing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RATE_PEERS_MAX          8       /* least recently used is forgotten */
+#define RATE_PROB_MIN           850     /* permille */
+#define RATE_PROB_DEAD          100     /* not sampled again until stale */
+#define RATE_EWMA_DIV           8       /* each result moves the probability an eighth of the way */
+#define RATE_SAMPLE_EVERY       10      /* frames */
+#define RATE_SAMPLE_REACH       2       /* ladder steps above the chosen rate */
+#define RATE_STALE_MS           30000
+#define RATE_FRAME_OVERHEAD     43      /* vendor action frame around the ESP-NOW payload, FCS included */
+#define RATE_CCMP_OVERHEAD      16      /* CCMP header and MIC around an encrypted unicast's payload */
+#define RATE_INFLIGHT_MAX       16      /* sends noted per peer, twice a fragmented frame's parts */
+
+typedef struct {
+    bool control;
+    uint8_t peers;              /* in the table */
+    uint32_t frames;            /* unicast results seen */
+    uint32_t acked;
+    uint32_t samples;           /* frames sent at a rate other than the chosen one */
+    uint32_t changes;           /* chosen rate moved, any peer */
+    uint64_t airtime_us;        /* those frames' airtime, as if each were a heartbeat */
+    uint64_t airtime_1m_us;     /* the same frames at 1 Mbps */
+    bool partner_known;
+    uint8_t partner_rate;       /* ladder index the partner is set to */
+    uint16_t partner_prob;      /* permille, at that rate */
+    uint32_t partner_frames;
+    uint32_t partner_acked;
+} rate_stats_t;
+
+/** @brief Empty table, control on; called from espnow_init() */
+esp_err_t rate_init(void);
+
+/** @brief Turn control on or off; any task, applies from each peer's next result */
+void rate_set_control(bool enabled);
+
+/** @brief Note the rate a unicast the driver took goes out at; broadcasts are ignored */
+void rate_note_send(const uint8_t *mac_addr);
+
+/** @brief Credit a unicast's ACK status and set the peer's rate for its next frame */
+void rate_handle_send_result(const pairing_ctx_t *ctx, const uint8_t *mac_addr, bool ok);
+
+/** @brief Consistent copy of the counters; any task, never blocks */
+void rate_get_stats(rate_stats_t *out);
+
+/** @brief Airtime of an ESP-NOW frame with @p len bytes of payload at a ladder index; 0 past the ladder */
+uint32_t rate_airtime_us(uint8_t idx, size_t len, bool ccmp);
+
+/** @brief "1M", "MCS5", "LR250K", ... for a ladder index */
+const char *rate_name(uint8_t idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RATE_H */
@@ -0,0 +1,115 @@
+/**
+ * @file reactor.h
+ * @brief Single event loop for the badge's housekeeping work
+ *
+ * Proximity feedback, buzzer patterns, button polling and the battery /
+ * temperature monitor used to run as one FreeRTOS task each, most of them
+ * waking every 20-50 ms to check whether anything had changed. They now run
+ * as callbacks on one reactor task that sleeps until either an event is
+ * posted or the earliest armed timer is due.
+ *
+ * Events are (fn, arg, data) triples posted from any task with
+ * reactor_post(). Timers live in the owning module's static state and are
+ * kept in a hashed timer wheel of REACTOR_WHEEL_SLOTS buckets indexed by
+ * expiry tick, so arming and stopping are O(1). Timers may only be started
+ * and stopped from reactor callbacks; other tasks post an event instead.
+ *
+ * Callbacks must not block: anything that waits (vTaskDelay, a mutex held by
+ * a slow task, flash writes) stalls every other module on the loop.
+ *
+ * REACTOR reports wakeups per second, events, timers fired and the stack
+ * high-water mark over BLE.
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REACTOR_WHEEL_SLOTS     32
+
+typedef void (*reactor_fn_t)(void *arg, uint32_t data);
+
+typedef enum {
+    REACTOR_TIMER_IDLE = 0,
+    REACTOR_TIMER_ARMED,        /* linked into a wheel slot */
+    REACTOR_TIMER_DUE,          /* expired, about to be called */
+} reactor_timer_state_t;
+
+typedef struct reactor_timer {
+    struct reactor_timer *next;
+    struct reactor_timer **pprev;
+    struct reactor_timer *due_next;
+    TickType_t expiry;
+    reactor_fn_t fn;
+    void *arg;
+    reactor_timer_state_t state;
+} reactor_timer_t;
+
+typedef struct {
+    uint32_t uptime_ms;
+    uint32_t wakeups;           /* times the reactor task was scheduled in */
+    uint32_t events;
+    uint32_t timers_fired;
+    uint32_t dropped;           /* reactor_post() with the queue full */
+    uint32_t stack_free;        /* high-water mark, bytes */
+} reactor_stats_t;
+
+/**
+ * @brief Create the event queue and the reactor task
+ *
+ * Call before any module that registers timers or posts events.
+ */
+esp_err_t reactor_init(void);
+
+/**
+ * @brief Queue fn(arg, data) to run on the reactor task
+ *
+ * Safe from any task, never blocks. Returns ESP_ERR_NO_MEM when the queue
+ * is full and ESP_ERR_INVALID_STATE before reactor_init().
+ */
+esp_err_t reactor_post(reactor_fn_t fn, void *arg, uint32_t data);
+
+/**
+ * @brief reactor_post() for ISRs
+ *
+ * @param woken Set to pdTRUE if the reactor task should run next
+ */
+esp_err_t reactor_post_from_isr(reactor_fn_t fn, void *arg, uint32_t data, BaseType_t *woken);
+
+/** @brief True when called from a reactor callback */
+bool reactor_in_context(void);
+
+/**
+ * @brief Bind a timer to its callback; the callback gets data = 0
+ */
+void reactor_timer_init(reactor_timer_t *timer, reactor_fn_t fn, void *arg);
+
+/**
+ * @brief Arm (or re-arm) a timer to fire once after delay_ms
+ *
+ * Reactor context only. A timer that is already armed is moved.
+ */
+void reactor_timer_start(reactor_timer_t *timer, uint32_t delay_ms);
+
+/** @brief Disarm a timer; harmless if it is not armed. Reactor context only. */
+void reactor_timer_stop(reactor_timer_t *timer);
+
+/** @brief True while the timer is armed */
+bool reactor_timer_active(const reactor_timer_t *timer);
+
+/** @brief Snapshot of the loop counters */
+void reactor_get_stats(reactor_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REACTOR_H */
@@ -0,0 +1,79 @@
+/**
+ * @file snapshot.h
+ * @brief Versioned snapshots for state one task writes and others read
+ *
+ * Getters such as proximity_get_zone() or ble_is_connected() used to read
+ * fields of another task's state directly, or take that task's mutex. A
+ * snapshot keeps two copies of the state and a sequence number (a seqlock
+ * in "latch" form): the writer updates one copy while readers use the
+ * other, and a reader retries only if the writer finished a whole update
+ * while it was copying. Readers never block and never see a half-written
+ * struct.
+ *
+ * Because a reader is never sent to the copy being written, a high
+ * priority reader that preempts the writer on the single core does not
+ * spin waiting for it, which a plain seqlock would.
+ *
+ * There must be one writer at a time: the owning task, or callers that
+ * already hold the module's mutex. Keep the state small; a read copies it.
+ *
+ *   typedef struct { int zone; int8_t rssi; } status_t;
+ *   SNAPSHOT_DEFINE(s_status, status_t);
+ *
+ *   status_t st = { .zone = 2, .rssi = -60 };
+ *   SNAPSHOT_WRITE(s_status, &st);        // writer
+ *   SNAPSHOT_READ(s_status, &st);         // any task
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    atomic_uint seq;            /**< even: read copy 0, odd: read copy 1 */
+} snapshot_t;
+
+/**
+ * @brief Static snapshot of type, zero-initialized
+ */
+#define SNAPSHOT_DEFINE(var, type) \
+    static struct { snapshot_t sync; type copy[2]; } var
+
+/* sizeof(char[-1]) fails to compile when *ptr is not the snapshot's type size */
+#define SNAPSHOT_SIZE_OF(var, ptr) \
+    (sizeof((var).copy[0]) + 0 * sizeof(char[sizeof(*(ptr)) == sizeof((var).copy[0]) ? 1 : -1]))
+
+/** @brief Publish *value; single writer */
+#define SNAPSHOT_WRITE(var, value) \
+    snapshot_write(&(var).sync, (var).copy, (value), SNAPSHOT_SIZE_OF(var, value))
+
+/** @brief Copy the latest published value to *out; any task, never blocks */
+#define SNAPSHOT_READ(var, out) \
+    snapshot_read(&(var).sync, (var).copy, (out), SNAPSHOT_SIZE_OF(var, out))
+
+/**
+ * @brief Write size bytes of value to both copies, one at a time
+ *
+ * @param copies Two consecutive copies of size bytes each
+ */
+void snapshot_write(snapshot_t *snap, void *copies, const void *value, size_t size);
+
+/**
+ * @brief Copy the copy not being written to out, retrying if it changed
+ *
+ * @return Number of retries, 0 unless a write completed meanwhile
+ */
+uint32_t snapshot_read(const snapshot_t *snap, const void *copies, void *out, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,92 @@
+/**
+ * @file sniffer.h
+ * @brief Listen-only badge that records every ESP-NOW frame on the channel
+ *
+ * Built with CONFIG_ESPNOW_SNIFFER (which needs the USB trace sink). Such a
+ * badge never pairs and never transmits: espnow_init() hands over to
+ * sniffer_init() before the ESP-NOW driver, its peers or espnow_task exist,
+ * so nothing is there to send with, and the espnow_set_*() calls from BLE
+ * and the thermal governor find no queue and do nothing.
+ *
+ * The ESP-NOW receive callback only sees broadcasts and frames addressed to
+ * us; a venue is mostly unicasts between other badges. The sniffer puts the
+ * Wi-Fi driver in promiscuous mode for management frames instead and takes
+ * the ESP-NOW payload out of each vendor action frame:
+ *
+ *   MAC header | 127 | 18:fe:34 | random (4) | vendor element(s)
+ *   vendor element: 0xdd | len | 18:fe:34 | 4 | version | body (len - 5)
+ *
+ * A v2 frame too long for one element carries the rest of its body in the
+ * elements that follow.
+ *
+ * Every payload goes to trace_record() with the frame's source, destination
+ * and rx_ctrl, whatever its protocol, so the stream is the one a TRACE:on
+ * badge produces, except that TRACE_FLAG_UNICAST means addressed to any one
+ * badge rather than to the listener. Capture starts at boot and logging is
+ * muted with it; sim/tools/wayside_trace.py live decodes the stream.
+ *
+ * The promiscuous callback runs on the Wi-Fi task; sniffer_get_stats() on
+ * any task. sniffer_espnow_body() is shared with the load generator
+ * (loadgen.h), which is built without the rest.
+ */
+
+#ifndef SNIFFER_H
+#define SNIFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNIFFER_MAC_HDR_LEN         24
+#define SNIFFER_FCS_LEN             4
+#define SNIFFER_DST_AT              4       /* addr1 */
+#define SNIFFER_SRC_AT              10      /* addr2 */
+#define SNIFFER_BSSID_AT            16      /* addr3, broadcast for ESP-NOW */
+#define SNIFFER_FC_ACTION           0xd0    /* frame control: management, action */
+#define SNIFFER_CATEGORY_VENDOR     127
+#define SNIFFER_ESPRESSIF_OUI       0x18, 0xfe, 0x34
+#define SNIFFER_ELEMENT_VENDOR      0xdd
+#define SNIFFER_ELEMENT_HDR_LEN     7       /* id, len, OUI, type, version */
+#define SNIFFER_ESPNOW_TYPE         4
+
+/* category, OUI and random values come before the first element */
+#define SNIFFER_BODY_AT             (SNIFFER_MAC_HDR_LEN + 1 + 3 + 4)
+
+typedef struct {
+    uint32_t mgmt;              /* management frames the driver passed up */
+    uint32_t espnow;            /* of those, ESP-NOW action frames */
+    uint32_t ours;              /* of those, PAIRING_PROTOCOL_ID */
+    uint32_t bad;               /* ESP-NOW frames whose elements don't add up */
+} sniffer_stats_t;
+
+/**
+ * @brief ESP-NOW payload of a management frame from the promiscuous callback
+ *
+ * @param src, dst  set to the frame's addresses, inside @p pkt
+ * @param body      receives the payload, all elements joined
+ * @return its length; 0 if the frame isn't an ESP-NOW one, -1 if its
+ *         elements don't add up or the payload is longer than @p size
+ */
+int sniffer_espnow_body(const wifi_promiscuous_pkt_t *pkt, const uint8_t **src, const uint8_t **dst,
+                        uint8_t *body, size_t size);
+
+/**
+ * @brief Start the trace writer and promiscuous capture; called from espnow_init()
+ *
+ * @return ESP_OK, or the error from trace_init() or the Wi-Fi driver
+ */
+esp_err_t sniffer_init(void);
+
+/** @brief Counters since boot; any task, never blocks */
+void sniffer_get_stats(sniffer_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SNIFFER_H */
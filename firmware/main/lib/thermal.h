@@ -0,0 +1,107 @@
+/**
+ * @file thermal.h
+ * @brief Thermal governor: backs the radios off when the die gets hot
+ *
+ * monitor.c samples the on-die temperature every 5 s and publishes it on
+ * BUS_TOPIC_MONITOR. The governor follows those samples on the reactor and
+ * moves between three levels:
+ *
+ *   NORMAL  no TX power cap, HELLO every PAIRING_REBROADCAST_MS, fast BLE
+ *           advertising
+ *   WARM    from THERMAL_WARM_C: TX power capped, HELLO half as often,
+ *           slower advertising
+ *   HOT     from THERMAL_HOT_C: TX power capped at the minimum useful level,
+ *           HELLO a quarter as often, advertising at about 1 s
+ *
+ * A level is only left once the temperature is THERMAL_HYSTERESIS_C below
+ * the threshold that entered it, so a badge sitting on a threshold does
+ * not flap. Heartbeats and key exchange of an existing pairing are not
+ * slowed down.
+ *
+ * The cap bounds pairing's per-frame TX power (pairing.h). Frames carry
+ * the power they were sent at, so peers' proximity zones do not shift, but
+ * a capped badge is heard over a shorter range.
+ *
+ * THERMAL over BLE reports the level and how often and how long the badge
+ * was throttled.
+ */
+
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_ESPNOW_THERMAL_WARM_C
+#define THERMAL_WARM_C          CONFIG_ESPNOW_THERMAL_WARM_C
+#else
+#define THERMAL_WARM_C          55
+#endif
+
+#ifdef CONFIG_ESPNOW_THERMAL_HOT_C
+#define THERMAL_HOT_C           CONFIG_ESPNOW_THERMAL_HOT_C
+#else
+#define THERMAL_HOT_C           70
+#endif
+
+#ifdef CONFIG_ESPNOW_THERMAL_HYSTERESIS_C
+#define THERMAL_HYSTERESIS_C    CONFIG_ESPNOW_THERMAL_HYSTERESIS_C
+#else
+#define THERMAL_HYSTERESIS_C    5
+#endif
+
+#ifdef CONFIG_ESPNOW_THERMAL_WARM_TX_DBM
+#define THERMAL_WARM_TX_DBM     CONFIG_ESPNOW_THERMAL_WARM_TX_DBM
+#else
+#define THERMAL_WARM_TX_DBM     11
+#endif
+
+#ifdef CONFIG_ESPNOW_THERMAL_HOT_TX_DBM
+#define THERMAL_HOT_TX_DBM      CONFIG_ESPNOW_THERMAL_HOT_TX_DBM
+#else
+#define THERMAL_HOT_TX_DBM      2
+#endif
+
+typedef enum {
+    THERMAL_NORMAL = 0,
+    THERMAL_WARM,
+    THERMAL_HOT,
+    THERMAL_LEVEL_MAX
+} thermal_level_t;
+
+typedef struct {
+    thermal_level_t level;
+    float temperature_c;        /* last valid sample */
+    float peak_c;
+    uint32_t samples;
+    uint32_t throttle_events;   /* NORMAL -> WARM or HOT */
+    uint32_t hot_events;        /* entries into HOT */
+    uint32_t throttled_ms;      /* time spent above NORMAL */
+    int8_t tx_power_q;          /* cap, 0.25 dBm units, 0 for none */
+    uint32_t hello_interval_ms;
+} thermal_stats_t;
+
+/**
+ * @brief Subscribe to the monitor's samples
+ *
+ * Call after reactor_init() and espnow_init(). Without
+ * monitor_init() no samples arrive and the badge stays at NORMAL.
+ */
+esp_err_t thermal_init(void);
+
+/** @brief Level name for reports: "NORMAL", "WARM" or "HOT" */
+const char *thermal_level_name(thermal_level_t level);
+
+/** @brief Consistent copy of the governor's counters; any task, never blocks */
+void thermal_get_stats(thermal_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THERMAL_H */
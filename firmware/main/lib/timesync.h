@@ -0,0 +1,149 @@
+/**
+ * @file timesync.h
+ * @brief Shared clock for the badges, gossiped over ESP-NOW
+ *
+ * FTSP-style: the badge with the lowest MAC address in reach becomes the
+ * root and its clock is the shared one. Every synchronized badge
+ * broadcasts a TIMESYNC every TIMESYNC_INTERVAL_MS carrying its estimate
+ * of the root's clock, so the time spreads hop by hop:
+ *
+ *   root ──> A ──> B        A syncs to the root, B to A
+ *
+ * The receive timestamp is taken in the ESP-NOW receive callback, before
+ * the frame waits in espnow_task's queue, and TIMESYNC_RX_DELAY_US is added
+ * to the sender's time for what it cannot see: the sender's TX queue and
+ * about 1 ms on air at ESP-NOW's 1 Mbps. Each badge keeps the last
+ * TIMESYNC_TABLE_MAX (local receive time, sender's time) pairs from its
+ * reference and fits a line through them: the intercept is the offset to
+ * the root's clock, the slope the drift between the two crystals (tens of
+ * ppm). Between samples the badge runs on that line, so it stays close
+ * even when TIMESYNCs are lost. A sample that misses the fit by more than
+ * TIMESYNC_OUTLIER_US is dropped, and TIMESYNC_OUTLIER_MAX in a row start
+ * the table over (the reference jumped).
+ *
+ * Only TIMESYNCs carrying a newer root sequence number are used, so each
+ * round from the root counts once however many neighbours repeat it. A
+ * badge that hears no new round for TIMESYNC_ROOT_TIMEOUT_MS declares
+ * itself root, carrying on from the time it had, and a lower MAC takes
+ * over again as soon as it is heard.
+ *
+ * The error bound timesync_now() returns adds up the sender's bound, the
+ * worst residual of the fit, TIMESYNC_HOP_US for how far the actual delay
+ * may be from TIMESYNC_RX_DELAY_US, and the drift that could have built up since the
+ * last sample (TIMESYNC_DRIFT_FIT_PPM with a fitted slope,
+ * TIMESYNC_DRIFT_FREE_PPM without).
+ *
+ * TIMESYNCs are tagged with the group key like HELLOs, so with GROUPKEY
+ * set a stranger cannot claim to be root. The header's uptime_ms is left
+ * to neighbor.c's reboot detection; it only has the tick's 1 ms resolution.
+ *
+ * Everything except timesync_now() and timesync_get_stats() runs on
+ * espnow_task.
+ */
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "pairing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIMESYNC_TABLE_MAX          8
+#define TIMESYNC_MIN_ENTRIES        3       /* before a badge passes the time on */
+#define TIMESYNC_ROOT_TIMEOUT_MS    (TIMESYNC_INTERVAL_MS * 4)
+#define TIMESYNC_OUTLIER_US         5000
+#define TIMESYNC_OUTLIER_MAX        3
+#define TIMESYNC_HOP_US             500     /* delay uncertainty, per hop */
+#define TIMESYNC_DRIFT_FREE_PPM     40      /* two crystals at +-20 ppm */
+#define TIMESYNC_DRIFT_FIT_PPM      2
+#define TIMESYNC_SKEW_MAX           200e-6  /* fitted slopes beyond this are noise */
+
+#ifdef CONFIG_ESPNOW_TIMESYNC_RX_DELAY_US
+#define TIMESYNC_RX_DELAY_US        CONFIG_ESPNOW_TIMESYNC_RX_DELAY_US
+#else
+#define TIMESYNC_RX_DELAY_US        1000
+#endif
+
+#ifdef CONFIG_ESPNOW_TIMESYNC_INTERVAL_MS
+#define TIMESYNC_INTERVAL_MS        CONFIG_ESPNOW_TIMESYNC_INTERVAL_MS
+#else
+#define TIMESYNC_INTERVAL_MS        5000
+#endif
+
+/** TIMESYNC payload */
+typedef struct __attribute__((packed)) {
+    uint8_t root_mac[6];
+    uint32_t root_seq;          /* round, counted by the root */
+    uint8_t hops;               /* from the root, 0 for the root itself */
+    int64_t time_us;            /* sender's shared time when it built the frame */
+    uint32_t error_us;          /* sender's bound on that */
+} timesync_msg_t;
+
+typedef struct {
+    bool synced;
+    bool is_root;
+    uint8_t root_mac[6];
+    uint8_t hops;
+    uint8_t entries;            /* samples in the fit */
+    int64_t base_local_us;      /* shared = base_time_us + (local - base_local_us) * (1 + skew) */
+    int64_t base_time_us;
+    double skew;
+    uint32_t base_error_us;     /* bound at base_local_us */
+    uint32_t drift_ppm;         /* how fast the bound grows after it */
+    uint32_t root_seq;
+    uint32_t samples;           /* TIMESYNCs used */
+    uint32_t outliers;
+    uint32_t resets;            /* tables started over */
+    uint32_t root_changes;
+    uint32_t sent;
+} timesync_stats_t;
+
+/**
+ * @brief Start out unsynchronized
+ *
+ * Called from espnow_init(). The badge claims root after
+ * TIMESYNC_ROOT_TIMEOUT_MS if it hears nobody.
+ */
+esp_err_t timesync_init(const uint8_t *my_mac);
+
+/**
+ * @brief Look at an admitted frame; anything but MSG_TIMESYNC is ignored
+ *
+ * @param mac   radio source, which the header's sender MAC must match
+ * @param rx_us esp_timer_get_time() in the receive callback
+ */
+void timesync_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac, const uint8_t *data, int len, int64_t rx_us);
+
+/**
+ * @brief Broadcast a TIMESYNC when due; claim root when the root is gone
+ *
+ * @return ms until the next call is due
+ */
+uint32_t timesync_tick(pairing_ctx_t *ctx);
+
+/**
+ * @brief Shared time now
+ *
+ * Any task, never blocks.
+ *
+ * @param out_us shared time in us: the best estimate so far, the local
+ *               clock before any reference was heard
+ * @param out_error_us bound on |out_us - root's clock|, UINT32_MAX until
+ *                     synchronized; may be NULL
+ * @return true if synchronized (or root)
+ */
+bool timesync_now(int64_t *out_us, uint32_t *out_error_us);
+
+/** @brief Consistent copy of the state; any task, never blocks */
+void timesync_get_stats(timesync_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMESYNC_H */
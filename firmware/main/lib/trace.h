@@ -0,0 +1,131 @@
+/**
+ * @file trace.h
+ * @brief Radio trace capture - records every received ESP-NOW frame
+ *
+ * Enabled with CONFIG_ESPNOW_TRACE. While capture is running, espnow_recv_cb
+ * hands every frame to trace_record() before any filtering; in a sniffer
+ * build (sniffer.h) every ESP-NOW frame on the channel comes from sniffer.c. Records are
+ * copied into a ring buffer and a low priority task drains them to the sink
+ * chosen in menuconfig:
+ *
+ *   - flash: the "trace" data partition, used as a ring of 4 KiB sectors.
+ *     Each sector starts with trace_sector_t and a TRACE_FLAG_META record,
+ *     so a partition dump (parttool.py read_partition --partition-name trace)
+ *     can be decoded without knowing where the writer stopped.
+ *   - usb: records are streamed over USB Serial/JTAG. Logging is silenced
+ *     while capturing so the stream is not interleaved with text. A META
+ *     record is repeated every TRACE_USB_META_INTERVAL bytes for resync.
+ *     Records are packed into a TRACE_USB_BATCH buffer and written a batch
+ *     at a time, once it is full or the ring has been empty for
+ *     TRACE_USB_FLUSH_MS; the driver's TX buffer holds two batches, so its
+ *     interrupt drains one while the writer packs the next. At a few
+ *     hundred frames a second that is one driver call per batch rather
+ *     than per frame.
+ *
+ * Both sinks produce the same record stream; sim/tools/wayside_trace.py turns
+ * either into a .wtr file for sim/replay.
+ *
+ * Record layout (little endian, packed):
+ *
+ *   sync  crc   len   flags rssi  nf    chan  t_ms  src      data
+ *   2     2     2     1     1     1     1     4     6        len
+ *
+ * crc is esp_rom_crc16_le(0, ...) over everything after the crc field,
+ * including data. META records have len = 0 and carry the capturing badge's
+ * own MAC in src.
+ *
+ * With ESPNOW_TRACE_SNAPLEN set, data is cut to that many bytes and the
+ * record flagged TRACE_FLAG_SNAPPED: the header alone says who sent what
+ * and keeps a busy hall within what USB can carry. sim/replay needs whole
+ * frames.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+#define TRACE_SYNC                  0x5457      /* "WT" */
+#define TRACE_SECTOR_MAGIC          0x53525457  /* "WTRS" */
+#define TRACE_SECTOR_SIZE           4096
+#define TRACE_USB_META_INTERVAL     4096
+#define TRACE_USB_BATCH             2048
+#define TRACE_USB_FLUSH_MS          20
+
+#define TRACE_FLAG_META             0x01        /* capture start / sector start, no data */
+#define TRACE_FLAG_UNICAST          0x02        /* frame was addressed to us (sniffer: to one badge) */
+#define TRACE_FLAG_SNAPPED          0x04        /* data cut to TRACE_SNAPLEN bytes */
+
+#ifdef CONFIG_ESPNOW_TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE           CONFIG_ESPNOW_TRACE_BUFFER_SIZE
+#else
+#define TRACE_BUFFER_SIZE           8192
+#endif
+
+#ifdef CONFIG_ESPNOW_TRACE_SNAPLEN
+#define TRACE_SNAPLEN               CONFIG_ESPNOW_TRACE_SNAPLEN
+#else
+#define TRACE_SNAPLEN               0           /* whole frames */
+#endif
+
+typedef struct __attribute__((packed)) {
+    uint16_t sync;
+    uint16_t crc;
+    uint16_t len;
+    uint8_t flags;
+    int8_t rssi;
+    int8_t noise_floor;
+    uint8_t channel;
+    uint32_t t_ms;
+    uint8_t src[6];
+    uint8_t data[0];
+} trace_record_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t seq;               /* increases by one per sector written, never wraps in practice */
+} trace_sector_t;
+
+typedef struct {
+    bool running;
+    uint32_t records;           /* records written to the sink */
+    uint32_t bytes;
+    uint32_t dropped;           /* ring buffer full, frame not recorded */
+    uint32_t sectors;           /* flash sectors erased since boot */
+    uint32_t batches;           /* USB writes */
+} trace_stats_t;
+
+/**
+ * @brief Create the ring buffer and writer task, locate the trace partition
+ *
+ * Capture stays stopped until trace_start().
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the flash sink has no partition
+ */
+esp_err_t trace_init(void);
+
+/**
+ * @brief Start or stop recording
+ */
+esp_err_t trace_start(void);
+void trace_stop(void);
+
+/**
+ * @brief Erase the trace partition (flash sink only, capture must be stopped)
+ */
+esp_err_t trace_erase(void);
+
+/**
+ * @brief Record one received frame
+ *
+ * Called from espnow_recv_cb on the WiFi task. Never blocks; if the ring
+ * buffer is full the frame is counted in trace_stats_t.dropped.
+ */
+void trace_record(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
+
+void trace_get_stats(trace_stats_t *out);
+
+#endif /* TRACE_H */
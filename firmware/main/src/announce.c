@@ -0,0 +1,366 @@
+/*
+ * announce.c - signed organizer announcements, flooded with a counter
+ * based relay
+ *
+ * State, all on espnow_task:
+ *
+ *   s_seen     ring of the last ANNOUNCE_SEEN_MAX verified ids; s_floor is
+ *              one past the newest id evicted from it, or after a reboot
+ *              one past the newest id accepted before it (NVS "ann_floor")
+ *   s_pending  accepted announcements waiting out their random delay,
+ *              with the copies heard so far
+ *
+ * A frame whose id is in s_seen only bumps counters, so a duplicate never
+ * costs a signature check. The buzzer runs on the reactor; delivery posts
+ * the pattern there instead of waiting on the buzzer's mutex.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "nvs.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pk.h"
+#include "announce.h"
+#include "espnow.h"
+#include "ble_task.h"
+#include "buzzer.h"
+#include "reactor.h"
+#include "snapshot.h"
+#include "assets.h"
+
+static const char *TAG = "announce";
+
+typedef struct {
+    bool active;
+    uint8_t copies;             /* including the one we accepted */
+    uint32_t id;
+    uint32_t due;
+    uint16_t len;
+    uint8_t frame[ANNOUNCE_FRAME_MAX];
+} announce_pending_t;
+
+/* built in; the "buzz" asset replaces it when there is one */
+static const asset_buzz_t BUZZ_PATTERNS[ANNOUNCE_BUZZ_MAX] = {
+    [ANNOUNCE_BUZZ_SHORT]  = { 150, 0,   1 },
+    [ANNOUNCE_BUZZ_DOUBLE] = { 100, 100, 2 },
+    [ANNOUNCE_BUZZ_URGENT] = { 400, 200, 3 },
+};
+
+/* set by announce_init(), read on the reactor */
+static const asset_buzz_t *s_buzz = BUZZ_PATTERNS;
+
+/* espnow_task only */
+static mbedtls_pk_context s_org_pk;
+static uint32_t s_seen[ANNOUNCE_SEEN_MAX];
+static uint32_t s_seen_count;
+static uint32_t s_seen_next;
+static uint32_t s_floor;
+static uint32_t s_saved_floor;              /* what NVS holds */
+static announce_pending_t s_pending[ANNOUNCE_PENDING_MAX];
+
+static announce_stats_t s_stats;
+static bool s_stats_dirty;
+
+SNAPSHOT_DEFINE(s_stats_snap, announce_stats_t);
+
+static uint32_t get_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+/* the text goes to the phone as is: no delimiter, no NUL */
+static bool well_formed(const announce_t *a, size_t len)
+{
+    if (len < sizeof(announce_t)) return false;
+    if (a->text_len > ANNOUNCE_TEXT_MAX || a->sig_len == 0 || a->sig_len > ANNOUNCE_SIG_MAX) return false;
+    if (len != sizeof(announce_t) + a->text_len + a->sig_len) return false;
+    if (a->buzz >= ANNOUNCE_BUZZ_MAX || a->hops > ANNOUNCE_MAX_HOPS) return false;
+
+    for (int i = 0; i < a->text_len; i++) {
+        if (a->body[i] == '\0' || a->body[i] == BLE_MESSAGE_DELIMITER_CHAR) return false;
+    }
+    return true;
+}
+
+static bool signature_valid(const announce_t *a)
+{
+    uint8_t hash[32];
+    size_t signed_len = sizeof(a->id) + sizeof(a->buzz) + sizeof(a->text_len) + a->text_len;
+
+    if (mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                   (const uint8_t *)&a->id, signed_len, hash) != 0) {
+        return false;
+    }
+    return mbedtls_pk_verify(&s_org_pk, MBEDTLS_MD_SHA256, hash, sizeof(hash),
+                             a->body + a->text_len, a->sig_len) == 0;
+}
+
+static bool seen(uint32_t id)
+{
+    for (uint32_t i = 0; i < s_seen_count; i++) {
+        if (s_seen[i] == id) return true;
+    }
+    return false;
+}
+
+static void save_floor(uint32_t floor)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open("storage", NVS_READWRITE, &handle) != ESP_OK) return;
+    esp_err_t err = nvs_set_u32(handle, "ann_floor", floor);
+    if (err == ESP_OK) err = nvs_commit(handle);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Saving the id floor failed: %s", esp_err_to_name(err));
+        return;
+    }
+    s_saved_floor = floor;
+}
+
+static void remember(uint32_t id)
+{
+    /* announcements are rare: one write each, so none is accepted twice across a reboot */
+    if (id >= s_saved_floor && id != UINT32_MAX) save_floor(id + 1);
+
+    if (s_seen_count == ANNOUNCE_SEEN_MAX) {
+        uint32_t evicted = s_seen[s_seen_next];
+        if (evicted + 1 > s_floor) s_floor = evicted + 1;
+    } else {
+        s_seen_count++;
+    }
+    s_seen[s_seen_next] = id;
+    s_seen_next = (s_seen_next + 1) % ANNOUNCE_SEEN_MAX;
+}
+
+static announce_pending_t *find_pending(uint32_t id)
+{
+    for (int i = 0; i < ANNOUNCE_PENDING_MAX; i++) {
+        if (s_pending[i].active && s_pending[i].id == id) return &s_pending[i];
+    }
+    return NULL;
+}
+
+static void play_buzz(void *arg, uint32_t pattern)
+{
+    const asset_buzz_t *p = &s_buzz[pattern];
+    buzzer_beep(p->on_ms, p->off_ms, p->count);
+}
+
+static void deliver(const announce_t *a)
+{
+    char msg[32 + ANNOUNCE_TEXT_MAX];
+    snprintf(msg, sizeof(msg), "ANNOUNCEMENT:%lu:%.*s" BLE_MESSAGE_DELIMITER_STR,
+             (unsigned long)a->id, a->text_len, (const char *)a->body);
+    ble_send_message(msg);
+
+    if (a->buzz != ANNOUNCE_BUZZ_NONE) {
+        reactor_post(play_buzz, NULL, a->buzz);
+    }
+
+    s_stats.delivered++;
+    s_stats.last_id = a->id;
+    s_stats.last_hops = a->hops;
+    ESP_LOGI(TAG, "Announcement %lu after %d hops", (unsigned long)a->id, a->hops);
+}
+
+static void schedule_relay(const announce_t *a, size_t len, uint32_t now)
+{
+    if (a->hops >= ANNOUNCE_MAX_HOPS) return;
+
+    announce_pending_t *p = NULL;
+    for (int i = 0; i < ANNOUNCE_PENDING_MAX && p == NULL; i++) {
+        if (!s_pending[i].active) p = &s_pending[i];
+    }
+    if (p == NULL) {
+        s_stats.overflow++;
+        return;
+    }
+
+    memcpy(p->frame, a, len);
+    ((announce_t *)p->frame)->hops++;
+    p->len = (uint16_t)len;
+    p->id = a->id;
+    p->copies = 1;
+    p->due = now + esp_random() % (ANNOUNCE_RAD_MS + 1);
+    p->active = true;
+}
+
+static void on_copy(uint32_t id)
+{
+    s_stats.duplicates++;
+
+    announce_pending_t *p = find_pending(id);
+    if (p != NULL && ANNOUNCE_DUP_THRESHOLD > 0 && ++p->copies >= ANNOUNCE_DUP_THRESHOLD) {
+        p->active = false;
+        s_stats.suppressed++;
+    }
+}
+
+void announce_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    if (ctx == NULL || data == NULL || len < (int)sizeof(broadcast_header_t)) return;
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+    if (hdr->msg_type != MSG_ANNOUNCE) return;
+
+    const announce_t *a = (const announce_t *)(data + sizeof(broadcast_header_t));
+    size_t a_len = len - sizeof(broadcast_header_t);
+    if (!well_formed(a, a_len)) return;
+
+    s_stats_dirty = true;
+
+    if (seen(a->id)) {
+        on_copy(a->id);
+        return;
+    }
+    if (a->id < s_floor) {
+        s_stats.stale++;
+        return;
+    }
+    if (!s_stats.has_key) {
+        s_stats.no_key++;
+        return;
+    }
+    if (!signature_valid(a)) {
+        ESP_LOGW(TAG, "Bad signature on %lu from " MACSTR, (unsigned long)a->id, MAC2STR(mac_addr));
+        s_stats.bad_sig++;
+        return;
+    }
+
+    remember(a->id);
+    deliver(a);
+    schedule_relay(a, a_len, get_time_ms());
+}
+
+esp_err_t announce_originate(pairing_ctx_t *ctx, const uint8_t *data, size_t len)
+{
+    static uint8_t frame[ANNOUNCE_FRAME_MAX];
+    const announce_t *a = (const announce_t *)data;
+
+    if (data == NULL || !well_formed(a, len)) return ESP_ERR_INVALID_ARG;
+    if (!s_stats.has_key) return ESP_ERR_INVALID_STATE;
+    if (seen(a->id) || a->id < s_floor) return ESP_ERR_INVALID_VERSION;
+    if (!signature_valid(a)) return ESP_ERR_INVALID_CRC;
+
+    remember(a->id);
+
+    memcpy(frame, data, len);
+    ((announce_t *)frame)->hops = 0;
+    esp_err_t err = pairing_send_payload(ctx, espnow_broadcast_mac, MSG_ANNOUNCE, frame, len);
+    if (err != ESP_OK) return err;
+
+    s_stats.originated++;
+    s_stats.last_id = a->id;
+    s_stats_dirty = true;
+    ESP_LOGW(TAG, "Announcement %lu sent", (unsigned long)a->id);
+    return ESP_OK;
+}
+
+uint32_t announce_tick(pairing_ctx_t *ctx)
+{
+    uint32_t now = get_time_ms();
+    uint32_t wait = UINT32_MAX;
+
+    for (int i = 0; i < ANNOUNCE_PENDING_MAX; i++) {
+        announce_pending_t *p = &s_pending[i];
+        if (!p->active) continue;
+
+        if ((int32_t)(now - p->due) >= 0) {
+            esp_err_t err = pairing_send_payload(ctx, espnow_broadcast_mac, MSG_ANNOUNCE, p->frame, p->len);
+            if (err != ESP_OK) {
+                ESP_LOGD(TAG, "Relay of %lu failed: %s", (unsigned long)p->id, esp_err_to_name(err));
+            } else {
+                s_stats.relayed++;
+            }
+            p->active = false;
+            s_stats_dirty = true;
+        } else if (p->due - now < wait) {
+            wait = p->due - now;
+        }
+    }
+
+    if (s_stats_dirty) {
+        SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+        s_stats_dirty = false;
+    }
+    return wait;
+}
+
+bool announce_key_valid(const uint8_t *der, size_t len)
+{
+    mbedtls_pk_context pk;
+    mbedtls_pk_init(&pk);
+    bool ok = der != NULL && len > 0 && mbedtls_pk_parse_public_key(&pk, der, len) == 0;
+    mbedtls_pk_free(&pk);
+    return ok;
+}
+
+static void parse_key(const uint8_t *der, size_t len)
+{
+    mbedtls_pk_free(&s_org_pk);
+    mbedtls_pk_init(&s_org_pk);
+
+    int ret = mbedtls_pk_parse_public_key(&s_org_pk, der, len);
+    s_stats.has_key = ret == 0;
+    s_stats_dirty = true;
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Organizer key rejected: -0x%04x", -ret);
+        return;
+    }
+    ESP_LOGI(TAG, "Organizer key set (%d bytes)", (int)len);
+}
+
+void announce_set_org_key(const uint8_t *der, size_t len)
+{
+    parse_key(der, len);
+
+    /* another organizer numbers from scratch */
+    memset(s_seen, 0, sizeof(s_seen));
+    s_seen_count = 0;
+    s_seen_next = 0;
+    s_floor = 0;
+    save_floor(0);
+}
+
+esp_err_t announce_init(void)
+{
+    nvs_handle_t handle;
+    uint8_t key[ANNOUNCE_ORG_KEY_MAX];
+    size_t len = sizeof(key);
+
+    mbedtls_pk_init(&s_org_pk);
+
+    const asset_buzz_t *buzz = assets_table(ASSET_BUZZ, sizeof(asset_buzz_t), ANNOUNCE_BUZZ_MAX);
+    if (buzz != NULL) {
+        s_buzz = buzz;
+    }
+
+    if (nvs_open("storage", NVS_READONLY, &handle) == ESP_OK) {
+        esp_err_t err = nvs_get_blob(handle, "org_key", key, &len);
+        if (nvs_get_u32(handle, "ann_floor", &s_saved_floor) == ESP_OK) {
+            s_floor = s_saved_floor;
+        }
+        nvs_close(handle);
+        if (err == ESP_OK && len > 0) {
+            parse_key(key, len);
+        }
+    }
+
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+    s_stats_dirty = false;
+
+    ESP_LOGI(TAG, "Initialized (%s organizer key, ids from %lu, relay delay 0-%d ms, %d copies suppress)",
+             s_stats.has_key ? "with" : "no", (unsigned long)s_floor, ANNOUNCE_RAD_MS, ANNOUNCE_DUP_THRESHOLD);
+    return ESP_OK;
+}
+
+void announce_get_stats(announce_stats_t *out)
+{
+    SNAPSHOT_READ(s_stats_snap, out);
+}
@@ -0,0 +1,122 @@
+/*
+ * assets.c - the "assets" partition, mapped once and read in place
+ *
+ * State: s_header and s_index point into the mapping. assets_init() sets
+ * them last, once the container has checked out, and nothing writes them
+ * after; the lookup counters are atomics.
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "assets.h"
+
+static const char *TAG = "assets";
+
+static const assets_header_t *s_header;
+static const assets_entry_t *s_index;
+
+static atomic_uint s_lookups;
+static atomic_uint s_misses;
+
+static esp_err_t check(const uint8_t *base, uint32_t part_size)
+{
+    const assets_header_t *hdr = (const assets_header_t *)base;
+
+    if (hdr->magic != ASSETS_MAGIC) return ESP_ERR_NOT_FOUND;
+    if (hdr->version != ASSETS_VERSION) return ESP_ERR_INVALID_VERSION;
+
+    uint32_t data_at = sizeof(*hdr) + (uint32_t)hdr->count * sizeof(assets_entry_t);
+    if (hdr->size < data_at || hdr->size > part_size) return ESP_ERR_INVALID_SIZE;
+    if (esp_rom_crc32_le(0, base + sizeof(*hdr), hdr->size - sizeof(*hdr)) != hdr->crc) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    const assets_entry_t *index = (const assets_entry_t *)(base + sizeof(*hdr));
+    for (int i = 0; i < hdr->count; i++) {
+        const assets_entry_t *e = &index[i];
+        if (memchr(e->name, '\0', ASSETS_NAME_LEN) == NULL || e->offset % ASSETS_ALIGN != 0 ||
+            e->offset < data_at || e->offset > hdr->size || e->len > hdr->size - e->offset) {
+            ESP_LOGE(TAG, "Entry %d out of bounds", i);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t assets_init(void)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ASSETS_PARTITION_SUBTYPE,
+                                                            "assets");
+    if (part == NULL) {
+        ESP_LOGW(TAG, "No \"assets\" partition, using built-in tables");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const void *map;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &map, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Mapping failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = check(map, part->size);
+    if (err != ESP_OK) {
+        esp_partition_munmap(handle);
+        if (err == ESP_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "No container in the partition, using built-in tables");
+        } else {
+            ESP_LOGE(TAG, "Container rejected (%s), using built-in tables", esp_err_to_name(err));
+        }
+        return err;
+    }
+
+    /* the mapping stays for good: lookups hand out pointers into it */
+    s_index = (const assets_entry_t *)((const uint8_t *)map + sizeof(assets_header_t));
+    s_header = map;
+
+    ESP_LOGI(TAG, "%d assets, %lu bytes, mapped at %p", s_header->count, (unsigned long)s_header->size, map);
+    return ESP_OK;
+}
+
+const void *assets_find(const char *name, size_t *len)
+{
+    atomic_fetch_add_explicit(&s_lookups, 1, memory_order_relaxed);
+
+    if (s_header != NULL && name != NULL) {
+        for (int i = 0; i < s_header->count; i++) {
+            if (strncmp(s_index[i].name, name, ASSETS_NAME_LEN) != 0) continue;
+            if (len != NULL) *len = s_index[i].len;
+            return (const uint8_t *)s_header + s_index[i].offset;
+        }
+    }
+
+    atomic_fetch_add_explicit(&s_misses, 1, memory_order_relaxed);
+    return NULL;
+}
+
+const void *assets_table(const char *name, size_t record_size, size_t count)
+{
+    size_t len;
+    const void *table = assets_find(name, &len);
+
+    if (table == NULL) return NULL;
+    if (len != record_size * count) {
+        ESP_LOGW(TAG, "\"%s\" is %u bytes, want %u records of %u", name,
+                 (unsigned)len, (unsigned)count, (unsigned)record_size);
+        return NULL;
+    }
+    return table;
+}
+
+void assets_get_stats(assets_stats_t *out)
+{
+    if (out == NULL) return;
+    out->count = s_header != NULL ? s_header->count : 0;
+    out->size = s_header != NULL ? s_header->size : 0;
+    out->lookups = atomic_load_explicit(&s_lookups, memory_order_relaxed);
+    out->misses = atomic_load_explicit(&s_misses, memory_order_relaxed);
+}
@@ -0,0 +1,753 @@
+/*
+ * ble_cmd.c - BLE UART command handling
+ *
+ * Parses the newline-free commands the phone app writes to the RX
+ * characteristic, persists configuration to NVS and forwards it to the
+ * ESP-NOW task.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "nvs.h"
+#include "ble_task.h"
+#include "ble_cmd.h"
+#include "espnow.h"
+#include "trace.h"
+#include "sniffer.h"
+#include "mem.h"
+#include "reactor.h"
+#include "thermal.h"
+#include "ota.h"
+#include "announce.h"
+#include "timesync.h"
+#include "coex.h"
+#include "rate.h"
+#include "frag.h"
+#include "loadgen.h"
+#include "crowd.h"
+
+static const char *TAG = "ble_cmd";
+
+static uint8_t s_rx_buffer[BLE_CMD_BUFFER_SIZE];
+static int s_rx_buffer_len = 0;
+
+static int hex_to_bytes(const char *hex, uint8_t *out, int max_len)
+{
+    int hex_len = strlen(hex);
+    if (hex_len % 2 != 0) return -1;
+    
+    int byte_len = hex_len / 2;
+    if (byte_len > max_len) return -1;
+    
+    for (int i = 0; i < byte_len; i++) {
+        char byte_str[3] = {hex[i * 2], hex[i * 2 + 1], '\0'};
+        char *endptr;
+        long val = strtol(byte_str, &endptr, 16);
+        if (*endptr != '\0') return -1;
+        out[i] = (uint8_t)val;
+    }
+    return byte_len;
+}
+
+/*
+ * MEM:free=..,min=..,largest=..,frag=..
+ * MEM:<tag>=live/bytes/peak/total/failed   (one per tag)
+ * MEM:budget=arena=..,heap=..,free_at_init=..,largest_at_init=..,post_init=<allocs>/<bytes>
+ * MEM:task=<name>,<allocs>,<bytes>         (one per task that allocated after init)
+ */
+static void send_mem_report(void)
+{
+    char reply[128];
+    mem_sample_t s;
+    mem_sample(&s);
+    
+    unsigned frag = s.free ? (unsigned)(100 - (uint64_t)s.largest_free * 100 / s.free) : 0;
+    snprintf(reply, sizeof(reply), "MEM:free=%lu,min=%lu,largest=%lu,frag=%u" BLE_MESSAGE_DELIMITER_STR,
+             (unsigned long)s.free, (unsigned long)s.min_free, (unsigned long)s.largest_free, frag);
+    ble_send_message(reply);
+    
+    for (int tag = 0; tag < MEM_TAG_MAX; tag++) {
+        mem_tag_stats_t st;
+        mem_get_tag_stats(tag, &st);
+        snprintf(reply, sizeof(reply), "MEM:%s=%lu/%lu/%lu/%lu/%lu" BLE_MESSAGE_DELIMITER_STR,
+                 mem_tag_name(tag), (unsigned long)st.live, (unsigned long)st.bytes,
+                 (unsigned long)st.peak_bytes, (unsigned long)st.total, (unsigned long)st.failed);
+        ble_send_message(reply);
+    }
+    
+    mem_budget_t budget;
+    mem_get_budget(&budget);
+    if (!budget.sealed) return;
+    snprintf(reply, sizeof(reply), "MEM:budget=arena=%lu,heap=%lu,free_at_init=%lu,largest_at_init=%lu,post_init=%lu/%lu"
+             BLE_MESSAGE_DELIMITER_STR,
+             (unsigned long)budget.arena_bytes, (unsigned long)budget.heap_total,
+             (unsigned long)budget.free_at_seal, (unsigned long)budget.largest_at_seal,
+             (unsigned long)budget.post_init_allocs, (unsigned long)budget.post_init_bytes);
+    ble_send_message(reply);
+    
+    mem_task_allocs_t tasks[MEM_POST_INIT_TASKS];
+    uint32_t n = mem_get_post_init(tasks, MEM_POST_INIT_TASKS);
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(reply, sizeof(reply), "MEM:task=%s,%lu,%lu" BLE_MESSAGE_DELIMITER_STR,
+                 tasks[i].task, (unsigned long)tasks[i].allocs, (unsigned long)tasks[i].bytes);
+        ble_send_message(reply);
+    }
+}
+
+/* MEMH:<t_s>,<free>,<min>,<largest>,<tagged>;...  oldest first, then MEMH:END */
+static void send_mem_history(void)
+{
+    static mem_sample_t history[MEM_HISTORY_LEN];
+    char reply[200];
+    size_t used = 0;
+    uint32_t n = mem_get_history(history, MEM_HISTORY_LEN);
+    
+    for (uint32_t i = 0; i < n; i++) {
+        char entry[64];
+        int len = snprintf(entry, sizeof(entry), "%lu,%lu,%lu,%lu,%lu",
+                           (unsigned long)(history[i].t_ms / 1000), (unsigned long)history[i].free,
+                           (unsigned long)history[i].min_free, (unsigned long)history[i].largest_free,
+                           (unsigned long)history[i].tagged_bytes);
+        if (used > 0 && used + 1 + len + sizeof(BLE_MESSAGE_DELIMITER_STR) > sizeof(reply)) {
+            strcpy(reply + used, BLE_MESSAGE_DELIMITER_STR);
+            ble_send_message(reply);
+            used = 0;
+        }
+        used += snprintf(reply + used, sizeof(reply) - used, "%s%s", used ? ";" : "MEMH:", entry);
+    }
+    if (used > 0) {
+        strcpy(reply + used, BLE_MESSAGE_DELIMITER_STR);
+        ble_send_message(reply);
+    }
+    ble_send_message("MEMH:END" BLE_MESSAGE_DELIMITER_STR);
+}
+
+#if CONFIG_ESPNOW_CROWD
+/* the comma separated bit numbers after CROWD:; false past CROWD_QUERY_MAX or CROWD_BITS */
+static bool parse_crowd_bits(const char *args, uint16_t *bits, uint8_t *count)
+{
+    *count = 0;
+    while (*args != '\0') {
+        char *end;
+        unsigned long bit = strtoul(args, &end, 10);
+        if (end == args || bit >= CROWD_BITS || *count == CROWD_QUERY_MAX) return false;
+        if (*end != '\0' && *end != ',') return false;
+        bits[(*count)++] = (uint16_t)bit;
+        args = *end == ',' ? end + 1 : end;
+    }
+    return *count > 0;
+}
+#endif
+
+#if CONFIG_ESPNOW_LOADGEN
+/* the comma separated key=value pairs after LOAD:start; what isn't given keeps its default */
+static bool parse_load_args(const char *args, loadgen_config_t *cfg)
+{
+    char buf[128];
+    char *save = NULL;
+
+    *cfg = (loadgen_config_t) {
+        .identities = LOADGEN_DEFAULT_IDENTITIES,
+        .rate = LOADGEN_DEFAULT_RATE,
+        .mix_hello = 60,
+        .mix_proposal = 30,
+        .mix_heartbeat = 10,
+        .script = LOADGEN_ACCEPT,
+        .bits = LOADGEN_DEFAULT_BITS,
+        .secs = LOADGEN_DEFAULT_SECS,
+    };
+    if (strlen(args) >= sizeof(buf)) return false;
+    strcpy(buf, args);
+
+    for (char *kv = strtok_r(buf, ",", &save); kv != NULL; kv = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(kv, '=');
+        if (val == NULL) return false;
+        *val++ = '\0';
+
+        char *end = NULL;
+        unsigned long n = strtoul(val, &end, 10);
+        bool number = end != val && *end == '\0';
+
+        if (strcmp(kv, "n") == 0 && number) {
+            cfg->identities = n > UINT16_MAX ? UINT16_MAX : (uint16_t)n;
+        } else if (strcmp(kv, "rate") == 0 && number) {
+            cfg->rate = n > UINT16_MAX ? UINT16_MAX : (uint16_t)n;
+        } else if (strcmp(kv, "secs") == 0 && number) {
+            cfg->secs = (uint32_t)n;
+        } else if (strcmp(kv, "bits") == 0 && number) {
+            cfg->bits = n > UINT16_MAX ? UINT16_MAX : (uint16_t)n;
+        } else if (strcmp(kv, "mix") == 0) {
+            unsigned h, p, b;
+            char tail;
+            if (sscanf(val, "%u/%u/%u%c", &h, &p, &b, &tail) != 3 || h > 255 || p > 255 || b > 255) return false;
+            cfg->mix_hello = (uint8_t)h;
+            cfg->mix_proposal = (uint8_t)p;
+            cfg->mix_heartbeat = (uint8_t)b;
+        } else if (strcmp(kv, "script") == 0) {
+            int i = LOADGEN_ACCEPT;
+            while (i <= LOADGEN_IGNORE && strcmp(val, loadgen_script_name(i)) != 0) i++;
+            if (i > LOADGEN_IGNORE) return false;
+            cfg->script = i;
+        } else if (strcmp(kv, "target") == 0) {
+            if (hex_to_bytes(val, cfg->target, sizeof(cfg->target)) != sizeof(cfg->target)) return false;
+            cfg->has_target = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+/**
+ * Handle a complete message from the phone
+ * 
+ * Message protocol (after BLE pairing is complete):
+ * - PUBKEY:<base64_key> - Store RSA public key
+ * - BITMASK:<bits>:<hex>[:threshold] - Store interest bitmask
+ * - ENC_URL:<data> - Encrypted URL to relay
+ * - GROUPKEY:<hex> - Per-event group key for HELLO authentication (16-32 bytes)
+ * - STATS - Report ESP-NOW receive counters, session resumes, TX power and partner link
+ * - TRACE[:on|off|erase] - Radio trace capture control / status
+ * - SNIFF - Frames a sniffer build has seen: management, ESP-NOW, ours, malformed
+ * - MEM[:history] - Heap usage per subsystem / heap sample history
+ * - REACTOR - Event loop wakeups per second, events, timers, stack left
+ * - THERMAL - Governor level, temperatures, throttle count and time
+ * - OTA - Firmware versions, download progress and what this badge served
+ * - ORGKEY:<hex> - Organizer public key (DER) announcements are checked with
+ * - ANNOUNCE:<hex> - Signed announcement to broadcast (organizers' phones)
+ * - ANNOUNCE - Announcement counters: delivered, relayed, suppressed, ...
+ * - TIME - Shared clock: time, error bound, root, drift and sample counters
+ * - FRAG - Frames sent whole to v2 peers, split for v1 ones, and put back together
+ * - LOAD[:start[,n=..][,rate=..][,mix=h/p/b][,script=..][,secs=..][,bits=..][,target=<hex>]|:stop]
+ *   - Load generator (CONFIG_ESPNOW_LOADGEN) control / counters
+ * - CROWD[:<bit>,<bit>...] - Badges around, and how many searching ones have each
+ *   bit (the busiest bits without a list)
+ * - ping - Respond with pong
+ */
+void ble_cmd_handle(const char *message)
+{
+    ESP_LOGI(TAG, "RX: %s", message);
+    
+    // PUBKEY command - store RSA public key
+    if (strncmp(message, "PUBKEY:", 7) == 0) {
+        const char *public_key = message + 7;
+        ESP_LOGI(TAG, "Received public key (%d bytes)", (int)strlen(public_key));
+        
+        // Store in NVS
+        nvs_handle_t handle;
+        if (nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK) {
+            nvs_set_str(handle, "pubkey", public_key);
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+        
+        espnow_set_config_key(public_key);
+        ble_send_message("PUBKEY_OK" BLE_MESSAGE_DELIMITER_STR);
+        return;
+    }
+    
+    // BITMASK command - store interest bitmask  
+    if (strncmp(message, "BITMASK:", 8) == 0) {
+        const char *after_prefix = message + 8;
+        const char *colon = strchr(after_prefix, ':');
+        if (!colon) {
+            ble_send_message("BITMASK_ERR:FORMAT" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        int bits = atoi(after_prefix);
+        if (bits <= 0 || bits > 2048) {
+            ble_send_message("BITMASK_ERR:LEN" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        int expected_bytes = (bits + 7) / 8;
+        const char *hex_data = colon + 1;
+        
+        // Parse optional threshold
+        uint8_t threshold = 50;
+        int hex_len = strlen(hex_data);
+        const char *threshold_colon = strrchr(hex_data, ':');
+        if (threshold_colon) {
+            int thresh = atoi(threshold_colon + 1);
+            if (thresh >= 0 && thresh <= 100) {
+                threshold = (uint8_t)thresh;
+            }
+            hex_len = threshold_colon - hex_data;
+        }
+        
+        /* hex_to_bytes() would reject it anyway; checking first keeps the copy small */
+        if (hex_len > expected_bytes * 2) {
+            ble_send_message("BITMASK_ERR:DATA" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        uint8_t *binary = mem_malloc(MEM_TAG_BLE_CMD, expected_bytes);
+        if (!binary) {
+            ble_send_message("BITMASK_ERR:MEM" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        char *hex_copy = mem_malloc(MEM_TAG_BLE_CMD, hex_len + 1);
+        if (!hex_copy) {
+            mem_free(binary);
+            ble_send_message("BITMASK_ERR:MEM" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        memcpy(hex_copy, hex_data, hex_len);
+        hex_copy[hex_len] = '\0';
+        
+        int actual_bytes = hex_to_bytes(hex_copy, binary, expected_bytes);
+        mem_free(hex_copy);
+        
+        if (actual_bytes != expected_bytes) {
+            mem_free(binary);
+            ble_send_message("BITMASK_ERR:DATA" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        // Store in NVS
+        nvs_handle_t handle;
+        if (nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK) {
+            nvs_set_blob(handle, "bitmask", binary, actual_bytes);
+            nvs_set_u8(handle, "bitmask_thr", threshold);
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+        
+        espnow_set_config_bitmask(binary, actual_bytes, threshold);
+        mem_free(binary);
+        ble_send_message("BITMASK_OK" BLE_MESSAGE_DELIMITER_STR);
+        return;
+    }
+    
+    // ENC_URL command
+    if (strncmp(message, "ENC_URL:", 8) == 0) {
+        ESP_LOGI(TAG, "Received encrypted URL");
+        espnow_set_relay_url(message + 8);
+        ble_send_message("ENC_URL_OK" BLE_MESSAGE_DELIMITER_STR);
+        return;
+    }
+    
+    // GROUPKEY command - organizer's per-event HELLO authentication key
+    if (strncmp(message, "GROUPKEY:", 9) == 0) {
+        uint8_t key[PAIRING_GROUP_KEY_MAX_LEN];
+        int key_len = hex_to_bytes(message + 9, key, sizeof(key));
+        if (key_len < 16) {
+            ble_send_message("GROUPKEY_ERR:DATA" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        nvs_handle_t handle;
+        if (nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK) {
+            nvs_set_blob(handle, "group_key", key, key_len);
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+        
+        espnow_set_group_key(key, (uint8_t)key_len);
+        memset(key, 0, sizeof(key));
+        ble_send_message("GROUPKEY_OK" BLE_MESSAGE_DELIMITER_STR);
+        return;
+    }
+    
+    // ORGKEY command - public half of the key organizer announcements are signed with
+    if (strncmp(message, "ORGKEY:", 7) == 0) {
+        uint8_t key[ANNOUNCE_ORG_KEY_MAX];
+        int key_len = hex_to_bytes(message + 7, key, sizeof(key));
+        if (key_len <= 0 || !announce_key_valid(key, key_len)) {
+            ble_send_message("ORGKEY_ERR:DATA" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        nvs_handle_t handle;
+        if (nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK) {
+            nvs_set_blob(handle, "org_key", key, key_len);
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+        
+        espnow_set_org_key(key, (uint16_t)key_len);
+        ble_send_message("ORGKEY_OK" BLE_MESSAGE_DELIMITER_STR);
+        return;
+    }
+    
+    // ANNOUNCE:<hex> - organizer's phone hands over a signed announcement
+    if (strncmp(message, "ANNOUNCE:", 9) == 0) {
+        static uint8_t frame[ANNOUNCE_FRAME_MAX];
+        int len = hex_to_bytes(message + 9, frame, sizeof(frame));
+        if (len <= 0) {
+            ble_send_message("ANNOUNCE_ERR:FORMAT" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        // espnow_task checks it and replies ANNOUNCE_OK or ANNOUNCE_ERR
+        espnow_announce(frame, (uint16_t)len);
+        return;
+    }
+    
+    // ANNOUNCE command - how the flood went on this badge
+    if (strcmp(message, "ANNOUNCE") == 0) {
+        announce_stats_t st;
+        announce_get_stats(&st);
+        
+        char reply[224];
+        snprintf(reply, sizeof(reply),
+                 "ANNOUNCE:key=%d,delivered=%lu,originated=%lu,relayed=%lu,suppressed=%lu,dups=%lu,"
+                 "stale=%lu,bad_sig=%lu,no_key=%lu,overflow=%lu,last_id=%lu,last_hops=%d"
+                 BLE_MESSAGE_DELIMITER_STR,
+                 st.has_key, (unsigned long)st.delivered, (unsigned long)st.originated,
+                 (unsigned long)st.relayed, (unsigned long)st.suppressed,
+                 (unsigned long)st.duplicates, (unsigned long)st.stale,
+                 (unsigned long)st.bad_sig, (unsigned long)st.no_key,
+                 (unsigned long)st.overflow, (unsigned long)st.last_id, st.last_hops);
+        ble_send_message(reply);
+        return;
+    }
+    
+    // TIME command - shared clock and how well it is held
+    if (strcmp(message, "TIME") == 0) {
+        timesync_stats_t st;
+        int64_t now_us;
+        uint32_t err_us;
+        bool synced = timesync_now(&now_us, &err_us);
+        timesync_get_stats(&st);
+        
+        char reply[256];
+        snprintf(reply, sizeof(reply),
+                 "TIME:synced=%d,root=" MACSTR ",is_root=%d,hops=%d,now_us=%lld,err_us=%lu,skew_ppb=%ld,"
+                 "entries=%d,samples=%lu,outliers=%lu,resets=%lu,root_changes=%lu,sent=%lu"
+                 BLE_MESSAGE_DELIMITER_STR,
+                 synced, MAC2STR(st.root_mac), st.is_root, st.hops, (long long)now_us,
+                 (unsigned long)err_us, (long)(st.skew * 1e9), st.entries,
+                 (unsigned long)st.samples, (unsigned long)st.outliers, (unsigned long)st.resets,
+                 (unsigned long)st.root_changes, (unsigned long)st.sent);
+        ble_send_message(reply);
+        return;
+    }
+    
+    // COEX command - who gets the radio, and what each side loses
+    if (strncmp(message, "COEX", 4) == 0 && (message[4] == '\0' || message[4] == ':')) {
+        const char *arg = message[4] == ':' ? message + 5 : "";
+        
+        if (strcmp(arg, "on") == 0) {
+            coex_set_policy(true);
+        } else if (strcmp(arg, "off") == 0) {
+            coex_set_policy(false);
+        } else if (arg[0] != '\0') {
+            ble_send_message("COEX_ERR:ESP_ERR_INVALID_ARG" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        coex_stats_t st;
+        coex_get_stats(&st);
+        
+        char reply[320];
+        snprintf(reply, sizeof(reply),
+                 "COEX:policy=%d,pref=%s,pref_changes=%lu,handshake_ms=%lu,hb=%lu,hb_missed=%lu,"
+                 "bulk_hb=%lu,bulk_missed=%lu,tx=%lu,tx_failed=%lu,ble_chunks=%lu,ble_failed=%lu,"
+                 "ble_congested=%lu,deferred=%lu,deferred_ms=%lu,bulks=%lu" BLE_MESSAGE_DELIMITER_STR,
+                 st.policy, coex_pref_name(st.pref), (unsigned long)st.pref_changes,
+                 (unsigned long)st.handshake_ms, (unsigned long)st.hb_heard, (unsigned long)st.hb_missed,
+                 (unsigned long)st.bulk_hb_heard, (unsigned long)st.bulk_hb_missed,
+                 (unsigned long)st.tx_partner, (unsigned long)st.tx_partner_failed,
+                 (unsigned long)st.ble_chunks, (unsigned long)st.ble_failed,
+                 (unsigned long)st.ble_congested, (unsigned long)st.ble_deferred,
+                 (unsigned long)st.ble_deferred_ms, (unsigned long)st.bulk_transfers);
+        ble_send_message(reply);
+        return;
+    }
+    
+    // RATE command - what the partner's unicasts go out at, and their airtime
+    if (strncmp(message, "RATE", 4) == 0 && (message[4] == '\0' || message[4] == ':')) {
+        const char *arg = message[4] == ':' ? message + 5 : "";
+        
+        if (strcmp(arg, "on") == 0) {
+            rate_set_control(true);
+        } else if (strcmp(arg, "off") == 0) {
+            rate_set_control(false);
+        } else if (arg[0] != '\0') {
+            ble_send_message("RATE_ERR:ESP_ERR_INVALID_ARG" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        rate_stats_t st;
+        rate_get_stats(&st);
+        
+        char reply[256];
+        snprintf(reply, sizeof(reply),
+                 "RATE:control=%d,partner=%s,prob=%u,partner_tx=%lu,partner_acked=%lu,tx=%lu,acked=%lu,"
+                 "samples=%lu,changes=%lu,peers=%u,airtime_ms=%lu,airtime_1m_ms=%lu" BLE_MESSAGE_DELIMITER_STR,
+                 st.control, st.partner_known ? rate_name(st.partner_rate) : "-", st.partner_prob,
+                 (unsigned long)st.partner_frames, (unsigned long)st.partner_acked,
+                 (unsigned long)st.frames, (unsigned long)st.acked,
+                 (unsigned long)st.samples, (unsigned long)st.changes, st.peers,
+                 (unsigned long)(st.airtime_us / 1000), (unsigned long)(st.airtime_1m_us / 1000));
+        ble_send_message(reply);
+        return;
+    }
+    
+    // STATS command - ESP-NOW receive/drop counters
+    if (strcmp(message, "STATS") == 0) {
+        espnow_stats_t st;
+        espnow_get_stats(&st);
+        
+        char reply[320];
+        snprintf(reply, sizeof(reply),
+                 "STATS:rx=%lu,foreign=%lu,rate=%lu,global=%lu,dup=%lu,claim=%lu,queue=%lu,nomem=%lu,"
+                 "resumed=%lu,outage_ms=%lu,tx_q=%d,partner_tx_q=%d,tx_changes=%lu,hs_ms=%lu,hs=%lu,link=%u"
+                 BLE_MESSAGE_DELIMITER_STR,
+                 (unsigned long)st.rx_frames, (unsigned long)st.rx_dropped_foreign,
+                 (unsigned long)st.rx_dropped_rate, (unsigned long)st.rx_dropped_global,
+                 (unsigned long)st.rx_dropped_dup, (unsigned long)st.rx_dropped_claim,
+                 (unsigned long)st.rx_dropped_queue, (unsigned long)st.rx_dropped_nomem,
+                 (unsigned long)st.pairing_resumed, (unsigned long)st.pairing_last_outage_ms,
+                 st.tx_power_q, st.partner_tx_q, (unsigned long)st.tx_power_changes,
+                 (unsigned long)st.handshake_ms, (unsigned long)st.handshakes, st.link);
+        ble_send_message(reply);
+        return;
+    }
+    
+    // FRAG command - v2 frames and v1 fragments
+    if (strcmp(message, "FRAG") == 0) {
+        frag_stats_t st;
+        frag_get_stats(&st);
+        
+        char reply[224];
+        snprintf(reply, sizeof(reply),
+                 "FRAG:caps=%u,peers=%u,peers_v2=%u,tx_whole=%lu,tx_split=%lu,tx_parts=%lu,"
+                 "rx_parts=%lu,rx_joined=%lu,rx_expired=%lu,rx_bad=%lu" BLE_MESSAGE_DELIMITER_STR,
+                 st.caps, st.peers, st.peers_v2,
+                 (unsigned long)st.tx_whole, (unsigned long)st.tx_split, (unsigned long)st.tx_parts,
+                 (unsigned long)st.rx_parts, (unsigned long)st.rx_joined,
+                 (unsigned long)st.rx_expired, (unsigned long)st.rx_bad);
+        ble_send_message(reply);
+        return;
+    }
+    
+    // LOAD command - one badge standing in for many (CONFIG_ESPNOW_LOADGEN)
+    if (strncmp(message, "LOAD", 4) == 0 && (message[4] == '\0' || message[4] == ':')) {
+#if CONFIG_ESPNOW_LOADGEN
+        const char *arg = message[4] == ':' ? message + 5 : "";
+        
+        if (strcmp(arg, "stop") == 0) {
+            espnow_loadgen(NULL);
+            return;
+        }
+        if (strncmp(arg, "start", 5) == 0 && (arg[5] == '\0' || arg[5] == ',')) {
+            loadgen_config_t cfg;
+            if (!parse_load_args(arg[5] == ',' ? arg + 6 : "", &cfg)) {
+                ble_send_message("LOAD_ERR:FORMAT" BLE_MESSAGE_DELIMITER_STR);
+                return;
+            }
+            espnow_loadgen(&cfg);
+            return;
+        }
+        if (arg[0] != '\0') {
+            ble_send_message("LOAD_ERR:FORMAT" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        
+        loadgen_stats_t st;
+        loadgen_get_stats(&st);
+        
+        char reply[384];
+        snprintf(reply, sizeof(reply),
+                 "LOAD:running=%d,n=%u,rate=%u,elapsed_ms=%lu,hello=%lu,proposal=%lu,heartbeat=%lu,"
+                 "accept=%lu,reject=%lu,tx_failed=%lu,rx=%lu,rx_proposal=%lu,rx_accept=%lu,rx_reject=%lu,"
+                 "rx_heartbeat=%lu,rx_kex=%lu,rx_dropped=%lu,paired=%lu,lost=%lu,accept_ms=%lu"
+                 BLE_MESSAGE_DELIMITER_STR,
+                 st.running, st.identities, st.rate, (unsigned long)st.elapsed_ms,
+                 (unsigned long)st.tx_hello, (unsigned long)st.tx_proposal, (unsigned long)st.tx_heartbeat,
+                 (unsigned long)st.tx_accept, (unsigned long)st.tx_reject, (unsigned long)st.tx_failed,
+                 (unsigned long)st.rx, (unsigned long)st.rx_proposal, (unsigned long)st.rx_accept,
+                 (unsigned long)st.rx_reject, (unsigned long)st.rx_heartbeat, (unsigned long)st.rx_kex,
+                 (unsigned long)st.rx_dropped, (unsigned long)st.paired, (unsigned long)st.lost,
+                 (unsigned long)st.accept_ms);
+        ble_send_message(reply);
+#else
+        ble_send_message("LOAD_ERR:DISABLED" BLE_MESSAGE_DELIMITER_STR);
+#endif
+        return;
+    }
+    
+    // CROWD command - density and interests around; answered from espnow_task
+    if (strncmp(message, "CROWD", 5) == 0 && (message[5] == '\0' || message[5] == ':')) {
+#if CONFIG_ESPNOW_CROWD
+        uint16_t bits[CROWD_QUERY_MAX];
+        uint8_t count = 0;
+        
+        if (message[5] == ':' && !parse_crowd_bits(message + 6, bits, &count)) {
+            ble_send_message("CROWD_ERR:FORMAT" BLE_MESSAGE_DELIMITER_STR);
+            return;
+        }
+        espnow_crowd(bits, count);
+#else
+        ble_send_message("CROWD_ERR:DISABLED" BLE_MESSAGE_DELIMITER_STR);
+#endif
+        return;
+    }
+    
+    // TRACE command - radio capture for host replay (CONFIG_ESPNOW_TRACE)
+    if (strncmp(message, "TRACE", 5) == 0) {
+#if CONFIG_ESPNOW_TRACE
+        const char *arg = message[5] == ':' ? message + 6 : "";
+        esp_err_t err = ESP_OK;
+        
+        if (strcmp(arg, "on") == 0) {
+            err = trace_start();
+        } else if (strcmp(arg, "off") == 0) {
+            trace_stop();
+        } else if (strcmp(arg, "erase") == 0) {
+            err = trace_erase();
+        } else if (arg[0] != '\0') {
+            err = ESP_ERR_INVALID_ARG;
+        }
+        
+        char reply[128];
+        if (err != ESP_OK) {
+            snprintf(reply, sizeof(reply), "TRACE_ERR:%s" BLE_MESSAGE_DELIMITER_STR, esp_err_to_name(err));
+        } else {
+            trace_stats_t st;
+            trace_get_stats(&st);
+            snprintf(reply, sizeof(reply),
+                     "TRACE:running=%d,records=%lu,bytes=%lu,dropped=%lu,sectors=%lu,batches=%lu"
+                     BLE_MESSAGE_DELIMITER_STR,
+                     st.running, (unsigned long)st.records, (unsigned long)st.bytes,
+                     (unsigned long)st.dropped, (unsigned long)st.sectors, (unsigned long)st.batches);
+        }
+        ble_send_message(reply);
+#else
+        ble_send_message("TRACE_ERR:DISABLED" BLE_MESSAGE_DELIMITER_STR);
+#endif
+        return;
+    }
+    
+    // SNIFF command - listen-only capture counters (CONFIG_ESPNOW_SNIFFER)
+    if (strcmp(message, "SNIFF") == 0) {
+#if CONFIG_ESPNOW_SNIFFER
+        sniffer_stats_t st;
+        sniffer_get_stats(&st);
+        
+        char reply[96];
+        snprintf(reply, sizeof(reply), "SNIFF:mgmt=%lu,espnow=%lu,ours=%lu,bad=%lu" BLE_MESSAGE_DELIMITER_STR,
+                 (unsigned long)st.mgmt, (unsigned long)st.espnow,
+                 (unsigned long)st.ours, (unsigned long)st.bad);
+        ble_send_message(reply);
+#else
+        ble_send_message("SNIFF_ERR:DISABLED" BLE_MESSAGE_DELIMITER_STR);
+#endif
+        return;
+    }
+    
+    // MEM command - heap report, one reply per line
+    if (strcmp(message, "MEM") == 0) {
+        send_mem_report();
+        return;
+    }
+    if (strcmp(message, "MEM:history") == 0) {
+        send_mem_history();
+        return;
+    }
+    
+    // REACTOR command - how often the housekeeping loop wakes up
+    if (strcmp(message, "REACTOR") == 0) {
+        reactor_stats_t st;
+        reactor_get_stats(&st);
+        
+        uint32_t per_s_x100 = st.uptime_ms ? (uint32_t)((uint64_t)st.wakeups * 100000 / st.uptime_ms) : 0;
+        char reply[160];
+        snprintf(reply, sizeof(reply),
+                 "REACTOR:wakeups=%lu,per_s=%lu.%02lu,events=%lu,timers=%lu,dropped=%lu,stack_free=%lu"
+                 BLE_MESSAGE_DELIMITER_STR,
+                 (unsigned long)st.wakeups, (unsigned long)(per_s_x100 / 100), (unsigned long)(per_s_x100 % 100),
+                 (unsigned long)st.events, (unsigned long)st.timers_fired, (unsigned long)st.dropped,
+                 (unsigned long)st.stack_free);
+        ble_send_message(reply);
+        return;
+    }
+    
+    // THERMAL command - is the governor holding the radios back
+    if (strcmp(message, "THERMAL") == 0) {
+        thermal_stats_t st;
+        thermal_get_stats(&st);
+        
+        char reply[192];
+        snprintf(reply, sizeof(reply),
+                 "THERMAL:level=%s,temp_c=%d,peak_c=%d,throttles=%lu,hot=%lu,throttled_s=%lu,"
+                 "tx_q=%d,hello_ms=%lu,samples=%lu" BLE_MESSAGE_DELIMITER_STR,
+                 thermal_level_name(st.level), (int)st.temperature_c, (int)st.peak_c,
+                 (unsigned long)st.throttle_events, (unsigned long)st.hot_events,
+                 (unsigned long)(st.throttled_ms / 1000), st.tx_power_q,
+                 (unsigned long)st.hello_interval_ms, (unsigned long)st.samples);
+        ble_send_message(reply);
+        return;
+    }
+    
+    // OTA command - where is this badge in the update epidemic
+    if (strcmp(message, "OTA") == 0) {
+        static const char *const states[] = { "IDLE", "DOWNLOADING", "READY" };
+        ota_stats_t st;
+        ota_get_stats(&st);
+
+        char reply[256];
+        snprintf(reply, sizeof(reply),
+                 "OTA:state=%s,running=%lu,serving=%lu,dl=%lu,bytes=%lu,size=%lu,updates=%lu,"
+                 "failures=%lu,timeouts=%lu,served=%lu,served_bytes=%lu,sent_bytes=%lu,busy=%lu"
+                 BLE_MESSAGE_DELIMITER_STR,
+                 st.state <= OTA_READY ? states[st.state] : "?",
+                 (unsigned long)st.running_version, (unsigned long)st.serving_version,
+                 (unsigned long)st.download_version, (unsigned long)st.download_bytes,
+                 (unsigned long)st.download_size, (unsigned long)st.updates,
+                 (unsigned long)st.failures, (unsigned long)st.timeouts,
+                 (unsigned long)st.served_chunks, (unsigned long)st.served_bytes,
+                 (unsigned long)st.sent_bytes, (unsigned long)st.busy);
+        ble_send_message(reply);
+        return;
+    }
+    
+    // ping command
+    if (strcmp(message, "ping") == 0) {
+        ble_send_message("pong" BLE_MESSAGE_DELIMITER_STR);
+        return;
+    }
+    
+    ESP_LOGW(TAG, "Unknown command: %s", message);
+}
+
+void ble_cmd_feed(const uint8_t *data, uint16_t len)
+{
+    if (s_rx_buffer_len + len > BLE_CMD_BUFFER_SIZE) {
+        ESP_LOGE(TAG, "Buffer overflow, resetting");
+        s_rx_buffer_len = 0;
+        return;
+    }
+    
+    memcpy(s_rx_buffer + s_rx_buffer_len, data, len);
+    s_rx_buffer_len += len;
+    
+    // Scan for delimiter
+    for (int i = 0; i < s_rx_buffer_len; i++) {
+        if (s_rx_buffer[i] == BLE_MESSAGE_DELIMITER_CHAR) {
+            s_rx_buffer[i] = '\0';
+            ble_cmd_handle((char *)s_rx_buffer);
+            
+            int leftover = s_rx_buffer_len - (i + 1);
+            if (leftover > 0) {
+                memmove(s_rx_buffer, s_rx_buffer + i + 1, leftover);
+                s_rx_buffer_len = leftover;
+                i = -1;
+            } else {
+                s_rx_buffer_len = 0;
+            }
+        }
+    }
+}
+
+void ble_cmd_reset(void)
+{
+    s_rx_buffer_len = 0;
+}
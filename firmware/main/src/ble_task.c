@@ -25,9 +25,13 @@
 #include "esp_bt_defs.h"
 #include "esp_bt_main.h"
 #include "ble_task.h"
+#include "ble_cmd.h"
+#include "mem.h"
+#include "bus.h"
+#include "snapshot.h"
 #include "nvs_flash.h"
-#include "nvs.h"
 #include "name.h"
+#include "coex.h"
 
 static const char *TAG = "ble_task";
 
@@ -45,12 +49,8 @@ static char s_device_name[NAME_MAX_LEN] = {0};
 #define PROFILE_APP_ID          0
 #define SVC_INST_ID             0
 
-// RX buffer for incoming messages
-#define RX_BUFFER_SIZE          2048
-static uint8_t s_rx_buffer[RX_BUFFER_SIZE];
-static int s_rx_buffer_len = 0;
-
-static const char DELIMITER = BLE_MESSAGE_DELIMITER_CHAR;
+// Largest RX/TX characteristic value; writes are reassembled in ble_cmd.c
+#define RX_BUFFER_SIZE          BLE_CMD_BUFFER_SIZE
 
 // Nordic UART Service UUIDs (Little Endian)
 static const uint8_t service_uuid[16] = {
@@ -101,14 +101,20 @@ typedef struct {
     } info;
 } ble_event_t;
 
+// Link state, written by ble_task only and read from any task
+typedef struct {
+    bool connected;
+    bool paired;
+    uint16_t conn_id;
+    uint16_t mtu;
+} ble_link_t;
+
 // State variables
 static uint16_t s_handle_table[BLE_IDX_NB];
-static uint16_t s_conn_id = 0;
 static esp_gatt_if_t s_gatts_if = 0;
-static bool s_is_connected = false;
-static bool s_is_paired = false;
+static ble_link_t s_link = { .mtu = 23 };   // ble_task's working copy
+SNAPSHOT_DEFINE(s_link_snap, ble_link_t);
 static bool s_is_advertising = false;
-static uint16_t s_current_mtu = 23;
 static QueueHandle_t s_ble_queue = NULL;
 static TimerHandle_t s_adv_timeout_timer = NULL;
 
@@ -125,8 +131,8 @@ static void *s_auth_cb_arg = NULL;
 // Extended advertising parameters
 static esp_ble_gap_ext_adv_params_t s_ext_adv_params = {
     .type = ESP_BLE_GAP_SET_EXT_ADV_PROP_CONNECTABLE,
-    .interval_min = 0x20,
-    .interval_max = 0x40,
+    .interval_min = BLE_ADV_INTERVAL_MIN,
+    .interval_max = BLE_ADV_INTERVAL_MAX,
     .channel_map = ADV_CHNL_ALL,
     .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
     .filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
@@ -144,8 +150,6 @@ static size_t s_ext_adv_data_len = 0;
 // Forward declarations
 static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
-static void handle_complete_message(const char *message);
-static void process_incoming_data(uint8_t *data, uint16_t len);
 static esp_err_t start_ext_advertising(void);
 static void stop_ext_advertising(void);
 static void adv_timeout_callback(TimerHandle_t timer);
@@ -193,169 +197,6 @@ static const esp_gatts_attr_db_t s_gatt_db[BLE_IDX_NB] = {
     },
 };
 
-// === Message Handling ===
-
-static int hex_to_bytes(const char *hex, uint8_t *out, int max_len)
-{
-    int hex_len = strlen(hex);
-    if (hex_len % 2 != 0) return -1;
-    
-    int byte_len = hex_len / 2;
-    if (byte_len > max_len) return -1;
-    
-    for (int i = 0; i < byte_len; i++) {
-        char byte_str[3] = {hex[i * 2], hex[i * 2 + 1], '\0'};
-        char *endptr;
-        long val = strtol(byte_str, &endptr, 16);
-        if (*endptr != '\0') return -1;
-        out[i] = (uint8_t)val;
-    }
-    return byte_len;
-}
-
-/**
- * Handle a complete message from the phone
- * 
- * Message protocol (after BLE pairing is complete):
- * - PUBKEY:<base64_key> - Store RSA public key
- * - BITMASK:<bits>:<hex>[:threshold] - Store interest bitmask
- * - ENC_URL:<data> - Encrypted URL to relay
- * - ping - Respond with pong
- */
-static void handle_complete_message(const char *message)
-{
-    ESP_LOGI(TAG, "RX: %s", message);
-    
-    // PUBKEY command - store RSA public key
-    if (strncmp(message, "PUBKEY:", 7) == 0) {
-        const char *public_key = message + 7;
-        ESP_LOGI(TAG, "Received public key (%d bytes)", strlen(public_key));
-        
-        // Store in NVS
-        nvs_handle_t handle;
-        if (nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK) {
-            nvs_set_str(handle, "pubkey", public_key);
-            nvs_commit(handle);
-            nvs_close(handle);
-        }
-        
-        ble_send_message("PUBKEY_OK" BLE_MESSAGE_DELIMITER_STR);
-        return;
-    }
-    
-    // BITMASK command - store interest bitmask  
-    if (strncmp(message, "BITMASK:", 8) == 0) {
-        const char *after_prefix = message + 8;
-        const char *colon = strchr(after_prefix, ':');
-        if (!colon) {
-            ble_send_message("BITMASK_ERR:FORMAT" BLE_MESSAGE_DELIMITER_STR);
-            return;
-        }
-        
-        int bits = atoi(after_prefix);
-        if (bits <= 0 || bits > 2048) {
-            ble_send_message("BITMASK_ERR:LEN" BLE_MESSAGE_DELIMITER_STR);
-            return;
-        }
-        
-        int expected_bytes = (bits + 7) / 8;
-        const char *hex_data = colon + 1;
-        
-        // Parse optional threshold
-        uint8_t threshold = 50;
-        int hex_len = strlen(hex_data);
-        const char *threshold_colon = strrchr(hex_data, ':');
-        if (threshold_colon) {
-            int thresh = atoi(threshold_colon + 1);
-            if (thresh >= 0 && thresh <= 100) {
-                threshold = (uint8_t)thresh;
-            }
-            hex_len = threshold_colon - hex_data;
-        }
-        
-        uint8_t *binary = malloc(expected_bytes);
-        if (!binary) {
-            ble_send_message("BITMASK_ERR:MEM" BLE_MESSAGE_DELIMITER_STR);
-            return;
-        }
-        
-        char *hex_copy = malloc(hex_len + 1);
-        if (!hex_copy) {
-            free(binary);
-            ble_send_message("BITMASK_ERR:MEM" BLE_MESSAGE_DELIMITER_STR);
-            return;
-        }
-        memcpy(hex_copy, hex_data, hex_len);
-        hex_copy[hex_len] = '\0';
-        
-        int actual_bytes = hex_to_bytes(hex_copy, binary, expected_bytes);
-        free(hex_copy);
-        
-        if (actual_bytes != expected_bytes) {
-            free(binary);
-            ble_send_message("BITMASK_ERR:DATA" BLE_MESSAGE_DELIMITER_STR);
-            return;
-        }
-        
-        // Store in NVS
-        nvs_handle_t handle;
-        if (nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK) {
-            nvs_set_blob(handle, "bitmask", binary, actual_bytes);
-            nvs_set_u8(handle, "bitmask_thr", threshold);
-            nvs_commit(handle);
-            nvs_close(handle);
-        }
-        
-        free(binary);
-        ble_send_message("BITMASK_OK" BLE_MESSAGE_DELIMITER_STR);
-        return;
-    }
-    
-    // ENC_URL command
-    if (strncmp(message, "ENC_URL:", 8) == 0) {
-        ESP_LOGI(TAG, "Received encrypted URL");
-        ble_send_message("ENC_URL_OK" BLE_MESSAGE_DELIMITER_STR);
-        return;
-    }
-    
-    // ping command
-    if (strcmp(message, "ping") == 0) {
-        ble_send_message("pong" BLE_MESSAGE_DELIMITER_STR);
-        return;
-    }
-    
-    ESP_LOGW(TAG, "Unknown command: %s", message);
-}
-
-static void process_incoming_data(uint8_t *data, uint16_t len)
-{
-    if (s_rx_buffer_len + len > RX_BUFFER_SIZE) {
-        ESP_LOGE(TAG, "Buffer overflow, resetting");
-        s_rx_buffer_len = 0;
-        return;
-    }
-    
-    memcpy(s_rx_buffer + s_rx_buffer_len, data, len);
-    s_rx_buffer_len += len;
-    
-    // Scan for delimiter
-    for (int i = 0; i < s_rx_buffer_len; i++) {
-        if (s_rx_buffer[i] == DELIMITER) {
-            s_rx_buffer[i] = '\0';
-            handle_complete_message((char *)s_rx_buffer);
-            
-            int leftover = s_rx_buffer_len - (i + 1);
-            if (leftover > 0) {
-                memmove(s_rx_buffer, s_rx_buffer + i + 1, leftover);
-                s_rx_buffer_len = leftover;
-                i = -1;
-            } else {
-                s_rx_buffer_len = 0;
-            }
-        }
-    }
-}
-
 // === Advertising ===
 
 static void build_ext_adv_data(void)
@@ -515,7 +356,6 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
             
             if (param->ble_security.auth_cmpl.success) {
                 ESP_LOGI(TAG, "Authentication SUCCESS");
-                s_is_paired = true;
                 
                 // Queue event
                 ble_event_t evt = {
@@ -526,7 +366,6 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
             } else {
                 ESP_LOGW(TAG, "Authentication FAILED (reason=%d)", 
                          param->ble_security.auth_cmpl.fail_reason);
-                s_is_paired = false;
                 
                 ble_event_t evt = {
                     .id = BLE_EVT_AUTH_COMPLETE,
@@ -603,14 +442,14 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
             
         case ESP_GATTS_WRITE_EVT:
             if (param->write.handle == s_handle_table[IDX_CHAR_VAL_RX]) {
-                uint8_t *data_copy = malloc(param->write.len);
+                uint8_t *data_copy = mem_malloc(MEM_TAG_BLE_RX, param->write.len);
                 if (data_copy) {
                     memcpy(data_copy, param->write.value, param->write.len);
                     evt.id = BLE_EVT_DATA_RECV;
                     evt.info.recv.data = data_copy;
                     evt.info.recv.len = param->write.len;
                     if (xQueueSend(s_ble_queue, &evt, BLE_QUEUE_TIMEOUT) != pdTRUE) {
-                        free(data_copy);
+                        mem_free(data_copy);
                     }
                 }
             }
@@ -620,6 +459,20 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
             }
             break;
             
+#if CONFIG_ESPNOW_COEX
+        case ESP_GATTS_CONF_EVT:
+            if (param->conf.status != ESP_GATT_OK) {
+                coex_ble_lost();
+            }
+            break;
+            
+        case ESP_GATTS_CONGEST_EVT:
+            if (param->congest.congested) {
+                coex_ble_congested();
+            }
+            break;
+#endif
+            
         default:
             break;
     }
@@ -627,40 +480,60 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
 
 // === BLE Task ===
 
+static void publish_link(void)
+{
+    SNAPSHOT_WRITE(s_link_snap, &s_link);
+}
+
+static void publish_ble_event(bus_ble_event_t event)
+{
+    bus_msg_t msg = { .ble.event = event };
+    bus_publish(BUS_TOPIC_BLE, &msg);
+}
+
 static void ble_task(void *pvParameter)
 {
     ble_event_t evt;
     
     ESP_LOGI(TAG, "BLE task started");
+    publish_link();
     
     while (1) {
         if (xQueueReceive(s_ble_queue, &evt, portMAX_DELAY) == pdTRUE) {
             switch (evt.id) {
                 case BLE_EVT_CONNECT:
-                    s_conn_id = evt.info.conn_id;
-                    s_is_connected = true;
-                    s_is_paired = false;
+                    s_link.conn_id = evt.info.conn_id;
+                    s_link.connected = true;
+                    s_link.paired = false;
+                    publish_link();
+                    publish_ble_event(BUS_BLE_CONNECTED);
                     if (s_conn_cb) s_conn_cb(true, s_conn_cb_arg);
                     break;
                     
                 case BLE_EVT_DISCONNECT:
-                    s_is_connected = false;
-                    s_is_paired = false;
-                    s_rx_buffer_len = 0;
+                    s_link.connected = false;
+                    s_link.paired = false;
+                    publish_link();
+                    ble_cmd_reset();
+                    publish_ble_event(BUS_BLE_DISCONNECTED);
                     if (s_conn_cb) s_conn_cb(false, s_conn_cb_arg);
                     break;
                     
                 case BLE_EVT_MTU_UPDATE:
-                    s_current_mtu = evt.info.mtu;
+                    s_link.mtu = evt.info.mtu;
+                    publish_link();
                     ESP_LOGI(TAG, "MTU updated to %d", evt.info.mtu);
                     break;
                     
                 case BLE_EVT_DATA_RECV:
-                    process_incoming_data(evt.info.recv.data, evt.info.recv.len);
-                    free(evt.info.recv.data);
+                    ble_cmd_feed(evt.info.recv.data, evt.info.recv.len);
+                    mem_free(evt.info.recv.data);
                     break;
                     
                 case BLE_EVT_AUTH_COMPLETE:
+                    s_link.paired = evt.info.auth_success;
+                    publish_link();
+                    publish_ble_event(evt.info.auth_success ? BUS_BLE_AUTH_OK : BUS_BLE_AUTH_FAILED);
                     if (s_auth_cb) s_auth_cb(evt.info.auth_success, s_auth_cb_arg);
                     break;
                     
@@ -803,12 +676,14 @@ void ble_stop_advertising(void)
 
 void ble_send_message(const char *message)
 {
-    if (!s_is_connected || !message) return;
+    ble_link_t link;
+    SNAPSHOT_READ(s_link_snap, &link);
+    if (!link.connected || !message) return;
     
     size_t len = strlen(message);
     if (len == 0) return;
     
-    uint16_t max_chunk = s_current_mtu - 3;
+    uint16_t max_chunk = link.mtu - 3;
     if (max_chunk < 20) max_chunk = 20;
     
     size_t offset = 0;
@@ -816,13 +691,20 @@ void ble_send_message(const char *message)
         size_t chunk_len = len - offset;
         if (chunk_len > max_chunk) chunk_len = max_chunk;
         
+#if CONFIG_ESPNOW_COEX
+        // bulk chunks wait out the partner's heartbeat
+        coex_ble_chunk_begin(len > max_chunk);
+#endif
         esp_err_t ret = esp_ble_gatts_send_indicate(
-            s_gatts_if, s_conn_id,
+            s_gatts_if, link.conn_id,
             s_handle_table[IDX_CHAR_VAL_TX],
             chunk_len,
             (uint8_t *)(message + offset),
             false
         );
+#if CONFIG_ESPNOW_COEX
+        coex_ble_chunk_end(ret == ESP_OK);
+#endif
         
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Send failed: %s", esp_err_to_name(ret));
@@ -838,12 +720,16 @@ void ble_send_message(const char *message)
 
 bool ble_is_connected(void)
 {
-    return s_is_connected;
+    ble_link_t link;
+    SNAPSHOT_READ(s_link_snap, &link);
+    return link.connected;
 }
 
 bool ble_is_paired(void)
 {
-    return s_is_paired;
+    ble_link_t link;
+    SNAPSHOT_READ(s_link_snap, &link);
+    return link.paired;
 }
 
 esp_err_t ble_get_mac(uint8_t *mac)
@@ -867,6 +753,21 @@ esp_err_t ble_set_adv_phy(esp_ble_gap_phy_t primary_phy, esp_ble_gap_phy_t secon
     return ESP_OK;
 }
 
+esp_err_t ble_set_adv_interval(uint32_t interval_min, uint32_t interval_max)
+{
+    if (interval_min > interval_max) return ESP_ERR_INVALID_ARG;
+    if (s_ext_adv_params.interval_min == interval_min && s_ext_adv_params.interval_max == interval_max) {
+        return ESP_OK;
+    }
+    
+    s_ext_adv_params.interval_min = interval_min;
+    s_ext_adv_params.interval_max = interval_max;
+    
+    if (!s_is_advertising) return ESP_OK;
+    stop_ext_advertising();
+    return start_ext_advertising();
+}
+
 esp_err_t ble_enable_long_range(bool enable)
 {
     if (enable) {
@@ -877,8 +778,10 @@ esp_err_t ble_enable_long_range(bool enable)
 
 esp_err_t ble_disconnect(void)
 {
-    if (!s_is_connected) return ESP_OK;
-    return esp_ble_gatts_close(s_gatts_if, s_conn_id);
+    ble_link_t link;
+    SNAPSHOT_READ(s_link_snap, &link);
+    if (!link.connected) return ESP_OK;
+    return esp_ble_gatts_close(s_gatts_if, link.conn_id);
 }
 
 void ble_set_connection_callback(ble_connection_cb_t cb, void *arg)
@@ -0,0 +1,187 @@
+/*
+ * bus.c - lock-free rings behind the publish/subscribe bus
+ *
+ * Each ring is a bounded multi-producer, single-consumer queue with one
+ * sequence number per slot (D. Vyukov's bounded queue):
+ *
+ *   - slot i starts with seq = i
+ *   - a publisher at position pos owns the slot once seq == pos and it
+ *     wins the CAS of head from pos to pos + 1; it copies the message and
+ *     releases the slot with seq = pos + 1
+ *   - the consumer at tail reads the slot once seq == tail + 1 and hands
+ *     it back to publishers with seq = tail + depth
+ *
+ * seq < pos means the consumer has not freed the slot yet: the ring is
+ * full and the message is dropped for this subscriber.
+ *
+ * The esp32c3 has no atomic instructions; the toolchain routes the C11
+ * atomics to short interrupt-masked sequences, which is still safe from
+ * ISRs and never blocks.
+ */
+
+#include "bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "bus";
+
+static bus_sub_t *s_subs[BUS_TOPIC_MAX][BUS_MAX_SUBSCRIBERS];
+
+static void ring_init(bus_sub_t *sub)
+{
+    for (uint32_t i = 0; i <= sub->mask; i++) {
+        atomic_init(&sub->slots[i].seq, i);
+    }
+    atomic_init(&sub->head, 0);
+    atomic_init(&sub->pending, false);
+    atomic_init(&sub->dropped, 0);
+    atomic_init(&sub->delivered, 0);
+    sub->tail = 0;
+}
+
+static bool ring_push(bus_sub_t *sub, const bus_msg_t *msg)
+{
+    unsigned pos = atomic_load_explicit(&sub->head, memory_order_relaxed);
+    bus_slot_t *slot;
+
+    while (1) {
+        slot = &sub->slots[pos & sub->mask];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&sub->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&sub->dropped, 1, memory_order_relaxed);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&sub->head, memory_order_relaxed);
+        }
+    }
+
+    slot->msg = *msg;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+/* one wakeup per batch: only the publisher that flips pending sends it */
+static void wake(bus_sub_t *sub, bool from_isr, BaseType_t *woken)
+{
+    if (atomic_exchange_explicit(&sub->pending, true, memory_order_acq_rel)) {
+        return;
+    }
+
+    if (sub->task) {
+        if (from_isr) {
+            vTaskNotifyGiveFromISR(sub->task, woken);
+        } else {
+            xTaskNotifyGive(sub->task);
+        }
+    } else if (from_isr) {
+        reactor_post_from_isr(sub->fn, sub->arg, 0, woken);
+    } else if (reactor_post(sub->fn, sub->arg, 0) != ESP_OK) {
+        /* queue full: let the next publish try again */
+        atomic_store_explicit(&sub->pending, false, memory_order_release);
+    }
+}
+
+static uint32_t publish(bus_topic_t topic, const bus_msg_t *msg, bool from_isr, BaseType_t *woken)
+{
+    if ((unsigned)topic >= BUS_TOPIC_MAX) {
+        return 0;
+    }
+
+    bus_msg_t copy = *msg;
+    copy.topic = (uint8_t)topic;
+
+    uint32_t delivered = 0;
+    for (int i = 0; i < BUS_MAX_SUBSCRIBERS; i++) {
+        bus_sub_t *sub = __atomic_load_n(&s_subs[topic][i], __ATOMIC_ACQUIRE);
+        if (sub == NULL) break;
+        if (ring_push(sub, &copy)) {
+            delivered++;
+            wake(sub, from_isr, woken);
+        }
+    }
+    return delivered;
+}
+
+esp_err_t bus_subscribe(bus_topic_t topic, bus_sub_t *sub)
+{
+    if ((unsigned)topic >= BUS_TOPIC_MAX || sub == NULL || (sub->task == NULL && sub->fn == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool first = true;
+    for (int t = 0; t < BUS_TOPIC_MAX; t++) {
+        for (int i = 0; i < BUS_MAX_SUBSCRIBERS; i++) {
+            if (s_subs[t][i] == sub) first = false;
+        }
+    }
+    if (first) {
+        ring_init(sub);
+    }
+
+    for (int i = 0; i < BUS_MAX_SUBSCRIBERS; i++) {
+        if (s_subs[topic][i] == sub) {
+            return ESP_OK;
+        }
+        if (s_subs[topic][i] == NULL) {
+            __atomic_store_n(&s_subs[topic][i], sub, __ATOMIC_RELEASE);
+            ESP_LOGI(TAG, "%s subscribed to topic %d (%lu slots)",
+                     sub->name, topic, (unsigned long)(sub->mask + 1));
+            return ESP_OK;
+        }
+    }
+
+    ESP_LOGE(TAG, "Topic %d full, %s not subscribed", topic, sub->name);
+    return ESP_ERR_NO_MEM;
+}
+
+uint32_t bus_publish(bus_topic_t topic, const bus_msg_t *msg)
+{
+    return publish(topic, msg, false, NULL);
+}
+
+uint32_t bus_publish_from_isr(bus_topic_t topic, const bus_msg_t *msg, BaseType_t *woken)
+{
+    return publish(topic, msg, true, woken);
+}
+
+bool bus_receive(bus_sub_t *sub, bus_msg_t *out)
+{
+    bus_slot_t *slot = &sub->slots[sub->tail & sub->mask];
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if ((int)(seq - (sub->tail + 1)) < 0) {
+        /* empty: re-arm the wakeup, then look once more so a publish that
+         * saw pending still set is not left sitting in the ring */
+        atomic_store_explicit(&sub->pending, false, memory_order_release);
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if ((int)(seq - (sub->tail + 1)) < 0) {
+            return false;
+        }
+        atomic_store_explicit(&sub->pending, true, memory_order_relaxed);
+    }
+
+    *out = slot->msg;
+    atomic_store_explicit(&slot->seq, sub->tail + sub->mask + 1, memory_order_release);
+    sub->tail++;
+    atomic_fetch_add_explicit(&sub->delivered, 1, memory_order_relaxed);
+    return true;
+}
+
+uint32_t bus_topic_bytes(void)
+{
+    return sizeof(s_subs[0]);
+}
+
+uint32_t bus_sub_bytes(uint32_t depth)
+{
+    return sizeof(bus_sub_t) + depth * sizeof(bus_slot_t);
+}
@@ -1,22 +1,22 @@
 /**
  * @file button_task.c
- * @brief Button monitoring task with long-press detection
+ * @brief Button monitoring with long-press detection
  * 
- * Polls a button on the AW9523 GPIO expander and detects long press events.
- * When a long press is detected, sends a notification to the configured queue.
+ * Polls a button on the AW9523 GPIO expander from a reactor timer and
+ * detects long press events. When a long press is detected, publishes
+ * BUS_TOPIC_BUTTON, calls the configured callback and sends a notification
+ * to the configured queue.
  */
 
 #include "button_task.h"
+#include "reactor.h"
+#include "bus.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 
 static const char *TAG = "button_task";
 
-#define BUTTON_TASK_STACK_SIZE  2048
-#define BUTTON_TASK_PRIORITY    4
-#define BUTTON_TASK_NAME        "button_task"
-
 typedef enum {
     BTN_STATE_IDLE,         /* Button not pressed */
     BTN_STATE_PRESSED,      /* Button pressed, timing */
@@ -26,7 +26,7 @@ typedef enum {
 typedef struct {
     bool initialized;
     bool running;
-    TaskHandle_t task_handle;
+    reactor_timer_t poll_timer;
     
     /* Configuration (copied) */
     aw9523_t *gpio_expander;
@@ -34,6 +34,8 @@ typedef struct {
     uint32_t long_press_ms;
     uint32_t poll_interval_ms;
     QueueHandle_t notify_queue;
+    button_task_callback_t callback;
+    void *cb_arg;
     
     /* State */
     button_state_t state;
@@ -72,12 +74,18 @@ static bool read_button(void)
 }
 
 /**
- * @brief Send toggle notification to queue
+ * @brief Run the callback and send toggle notification to queue
  */
 static void send_toggle_notification(void)
 {
+    bus_msg_t evt = { .button = { .pin = s_btn.button_pin, .count = s_btn.press_count } };
+    bus_publish(BUS_TOPIC_BUTTON, &evt);
+    
+    if (s_btn.callback) {
+        s_btn.callback(s_btn.cb_arg);
+    }
+    
     if (s_btn.notify_queue == NULL) {
-        ESP_LOGW(TAG, "No notify queue configured");
         return;
     }
     
@@ -89,67 +97,66 @@ static void send_toggle_notification(void)
 }
 
 /**
- * @brief Button monitoring task
+ * @brief One poll of the button state machine, re-arms itself
  */
-static void button_task(void *arg)
+static void on_poll(void *arg, uint32_t data)
 {
-    ESP_LOGI(TAG, "Button task started (pin %d, long press %lu ms)",
-             s_btn.button_pin, (unsigned long)s_btn.long_press_ms);
-    
-    s_btn.running = true;
-    s_btn.state = BTN_STATE_IDLE;
+    if (!s_btn.running) {
+        return;
+    }
     
-    TickType_t poll_ticks = pdMS_TO_TICKS(s_btn.poll_interval_ms);
-    TickType_t long_press_ticks = pdMS_TO_TICKS(s_btn.long_press_ms);
-    
-    while (s_btn.running) {
-        bool pressed = read_button();
-        TickType_t now = xTaskGetTickCount();
-        
-        switch (s_btn.state) {
-            case BTN_STATE_IDLE:
-                if (pressed) {
-                    /* Button just pressed - start timing */
-                    s_btn.state = BTN_STATE_PRESSED;
-                    s_btn.press_start_tick = now;
-                    ESP_LOGD(TAG, "Button pressed, timing...");
-                }
-                break;
-                
-            case BTN_STATE_PRESSED:
-                if (!pressed) {
-                    /* Button released before long press threshold */
-                    s_btn.state = BTN_STATE_IDLE;
-                    ESP_LOGD(TAG, "Button released (short press)");
-                } else {
-                    /* Check if long press threshold reached */
-                    TickType_t elapsed = now - s_btn.press_start_tick;
-                    if (elapsed >= long_press_ticks) {
-                        /* Long press detected! */
-                        s_btn.state = BTN_STATE_LONG_FIRED;
-                        s_btn.press_count++;
-                        ESP_LOGI(TAG, "Long press detected! (count: %lu)",
-                                 (unsigned long)s_btn.press_count);
-                        send_toggle_notification();
-                    }
-                }
-                break;
-                
-            case BTN_STATE_LONG_FIRED:
-                if (!pressed) {
-                    /* Button released after long press */
-                    s_btn.state = BTN_STATE_IDLE;
-                    ESP_LOGD(TAG, "Button released (after long press)");
-                }
-                /* While held after long press, do nothing (debounce) */
-                break;
-        }
-        
-        vTaskDelay(poll_ticks);
+    bool pressed = read_button();
+    TickType_t now = xTaskGetTickCount();
+    
+    switch (s_btn.state) {
+        case BTN_STATE_IDLE:
+            if (pressed) {
+                /* Button just pressed - start timing */
+                s_btn.state = BTN_STATE_PRESSED;
+                s_btn.press_start_tick = now;
+                ESP_LOGD(TAG, "Button pressed, timing...");
+            }
+            break;
+            
+        case BTN_STATE_PRESSED:
+            if (!pressed) {
+                /* Button released before long press threshold */
+                s_btn.state = BTN_STATE_IDLE;
+                ESP_LOGD(TAG, "Button released (short press)");
+            } else if (now - s_btn.press_start_tick >= pdMS_TO_TICKS(s_btn.long_press_ms)) {
+                /* Long press detected! */
+                s_btn.state = BTN_STATE_LONG_FIRED;
+                s_btn.press_count++;
+                ESP_LOGI(TAG, "Long press detected! (count: %lu)",
+                         (unsigned long)s_btn.press_count);
+                send_toggle_notification();
+            }
+            break;
+            
+        case BTN_STATE_LONG_FIRED:
+            if (!pressed) {
+                /* Button released after long press */
+                s_btn.state = BTN_STATE_IDLE;
+                ESP_LOGD(TAG, "Button released (after long press)");
+            }
+            /* While held after long press, do nothing (debounce) */
+            break;
     }
     
-    ESP_LOGI(TAG, "Button task stopped");
-    vTaskDelete(NULL);
+    reactor_timer_start(&s_btn.poll_timer, s_btn.poll_interval_ms);
+}
+
+static void on_start(void *arg, uint32_t data)
+{
+    ESP_LOGI(TAG, "Button polling started (pin %d, long press %lu ms)",
+             s_btn.button_pin, (unsigned long)s_btn.long_press_ms);
+    on_poll(NULL, 0);
+}
+
+static void on_stop(void *arg, uint32_t data)
+{
+    reactor_timer_stop(&s_btn.poll_timer);
+    ESP_LOGI(TAG, "Button polling stopped");
 }
 
 esp_err_t button_task_init(const button_task_config_t *config)
@@ -169,8 +176,8 @@ esp_err_t button_task_init(const button_task_config_t *config)
         return ESP_ERR_INVALID_ARG;
     }
     
-    if (config->notify_queue == NULL) {
-        ESP_LOGW(TAG, "No notify queue configured - long press will only log");
+    if (config->notify_queue == NULL && config->callback == NULL) {
+        ESP_LOGW(TAG, "No notify queue or callback configured - long press will only log");
     }
     
     /* Copy configuration */
@@ -181,10 +188,13 @@ esp_err_t button_task_init(const button_task_config_t *config)
     s_btn.poll_interval_ms = config->poll_interval_ms > 0 ?
                              config->poll_interval_ms : BUTTON_TASK_POLL_MS;
     s_btn.notify_queue = config->notify_queue;
+    s_btn.callback = config->callback;
+    s_btn.cb_arg = config->cb_arg;
     
     s_btn.state = BTN_STATE_IDLE;
     s_btn.press_count = 0;
     s_btn.running = false;
+    reactor_timer_init(&s_btn.poll_timer, on_poll, NULL);
     
     /* Ensure button pin is configured as input */
     esp_err_t ret = aw9523_set_pin(s_btn.gpio_expander, s_btn.button_pin,
@@ -194,19 +204,13 @@ esp_err_t button_task_init(const button_task_config_t *config)
         return ret;
     }
     
-    /* Create task */
-    BaseType_t task_ret = xTaskCreate(
-        button_task,
-        BUTTON_TASK_NAME,
-        BUTTON_TASK_STACK_SIZE,
-        NULL,
-        BUTTON_TASK_PRIORITY,
-        &s_btn.task_handle
-    );
-    
-    if (task_ret != pdPASS) {
-        ESP_LOGE(TAG, "Task creation failed");
-        return ESP_ERR_NO_MEM;
+    /* Start polling */
+    s_btn.running = true;
+    ret = reactor_post(on_start, NULL, 0);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start polling: %s", esp_err_to_name(ret));
+        s_btn.running = false;
+        return ret;
     }
     
     s_btn.initialized = true;
@@ -221,17 +225,9 @@ esp_err_t button_task_deinit(void)
         return ESP_ERR_INVALID_STATE;
     }
     
-    /* Signal task to stop */
+    /* A poll already queued sees running == false and does not re-arm */
     s_btn.running = false;
-    
-    /* Give task time to exit */
-    vTaskDelay(pdMS_TO_TICKS(s_btn.poll_interval_ms * 3));
-    
-    /* If task still exists, delete it */
-    if (s_btn.task_handle != NULL) {
-        vTaskDelete(s_btn.task_handle);
-        s_btn.task_handle = NULL;
-    }
+    reactor_post(on_stop, NULL, 0);
     
     s_btn.initialized = false;
     ESP_LOGI(TAG, "Deinitialized");
@@ -4,11 +4,11 @@
  */
 
 #include "buzzer.h"
+#include "reactor.h"
+#include "snapshot.h"
 #include "driver/ledc.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 #include "freertos/semphr.h"
-#include "freertos/queue.h"
 #include "esp_log.h"
 #include <string.h>
 
@@ -20,10 +20,6 @@ static const char *TAG = "buzzer";
 #define LEDC_DUTY_RES       LEDC_TIMER_10_BIT  /* 10-bit resolution: 0-1023 */
 #define LEDC_MAX_DUTY       ((1 << LEDC_DUTY_RES) - 1)  /* 1023 */
 
-#define BUZZER_TASK_STACK_SIZE  2048
-#define BUZZER_TASK_PRIORITY    5
-#define BUZZER_TASK_NAME        "buzzer_task"
-
 typedef enum {
     BUZZER_CMD_NONE = 0,
     BUZZER_CMD_START,
@@ -45,6 +41,20 @@ typedef struct {
     size_t current_index;
 } sequence_t;
 
+typedef enum {
+    BUZZER_PHASE_IDLE = 0,
+    BUZZER_PHASE_CONTINUOUS,    /* buzzer_start() */
+    BUZZER_PHASE_TONE,          /* beep: on_ms running */
+    BUZZER_PHASE_GAP,           /* beep: off_ms running */
+    BUZZER_PHASE_NOTE,          /* sequence: current note running */
+} buzzer_phase_t;
+
+/*
+ * The public calls only record the requested command under the mutex and
+ * post on_command() to the reactor. Patterns then play as a state machine
+ * driven by step_timer; phase, remaining and the sequence index belong to
+ * the reactor task alone.
+ */
 typedef struct {
     bool initialized;
     bool playing;
@@ -54,18 +64,31 @@ typedef struct {
     uint8_t volume;             /* 0-100 */
     uint32_t current_duty;      /* Actual PWM duty */
     
-    TaskHandle_t task_handle;
     SemaphoreHandle_t mutex;
-    QueueHandle_t toggle_queue; /* Queue for mute toggle (length 1) */
     
+    /* pending request, written by any task */
     buzzer_cmd_t cmd;
     beep_pattern_t beep;
     sequence_t sequence;
+    
+    /* what is playing, reactor only */
+    buzzer_phase_t phase;
+    beep_pattern_t active_beep;
+    sequence_t active_sequence;
+    uint32_t remaining;
+    reactor_timer_t step_timer;
 } buzzer_state_t;
 
+/* what the getters report; written with the mutex held, read without it */
+typedef struct {
+    bool muted;
+    uint8_t volume;
+    uint32_t frequency;
+} buzzer_settings_t;
+
 static buzzer_state_t s_buzzer = {0};
+SNAPSHOT_DEFINE(s_settings, buzzer_settings_t);
 
-static void buzzer_task(void *arg);
 static uint32_t volume_to_duty(uint8_t volume);
 static esp_err_t pwm_set_duty(uint32_t duty);
 static esp_err_t pwm_set_frequency(uint32_t freq_hz);
@@ -105,177 +128,149 @@ static esp_err_t pwm_set_frequency(uint32_t freq_hz)
     return ledc_set_freq(LEDC_MODE, LEDC_TIMER, freq_hz);
 }
 
-/**
- * @brief Buzzer background task
- */
-static void buzzer_task(void *arg)
+static void tone_on(void)
 {
-    ESP_LOGI(TAG, "Buzzer task started");
-    uint8_t toggle_msg;
-    
-    while (1) {
-        /* Check for mute toggle message (non-blocking) */
-        if (xQueueReceive(s_buzzer.toggle_queue, &toggle_msg, 0) == pdTRUE) {
-            if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-                s_buzzer.muted = !s_buzzer.muted;
-                ESP_LOGI(TAG, "Buzzer %s", s_buzzer.muted ? "MUTED" : "UNMUTED");
-                
-                /* If we just muted and buzzer is playing, stop it immediately */
-                if (s_buzzer.muted && s_buzzer.playing) {
-                    pwm_set_duty(0);
-                    s_buzzer.playing = false;
-                }
-                xSemaphoreGive(s_buzzer.mutex);
-            }
-        }
-        
-        buzzer_cmd_t cmd;
-        beep_pattern_t beep = {0};
-        bool muted = false;
-        
-        /* Get current command with mutex protection */
-        if (xSemaphoreTake(s_buzzer.mutex, portMAX_DELAY) == pdTRUE) {
-            cmd = s_buzzer.cmd;
-            muted = s_buzzer.muted;
-            if (cmd == BUZZER_CMD_BEEP) {
-                memcpy(&beep, &s_buzzer.beep, sizeof(beep_pattern_t));
-            }
-            xSemaphoreGive(s_buzzer.mutex);
-        } else {
-            vTaskDelay(pdMS_TO_TICKS(10));
-            continue;
-        }
-        
-        /* Skip sound commands if muted */
-        if (muted && (cmd == BUZZER_CMD_START || cmd == BUZZER_CMD_BEEP || cmd == BUZZER_CMD_SEQUENCE)) {
-            /* Clear the command so we don't keep trying */
-            if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-                s_buzzer.cmd = BUZZER_CMD_NONE;
-                xSemaphoreGive(s_buzzer.mutex);
-            }
-            vTaskDelay(pdMS_TO_TICKS(50));
-            continue;
-        }
-        
-        switch (cmd) {
-            case BUZZER_CMD_START:
-                /* Continuous tone - just maintain duty cycle */
-                if (!s_buzzer.playing) {
-                    pwm_set_duty(s_buzzer.current_duty);
-                    s_buzzer.playing = true;
-                    ESP_LOGD(TAG, "Started continuous tone");
-                }
-                vTaskDelay(pdMS_TO_TICKS(50));
-                break;
-                
-            case BUZZER_CMD_STOP:
-                if (s_buzzer.playing) {
-                    pwm_set_duty(0);
-                    s_buzzer.playing = false;
-                    ESP_LOGD(TAG, "Stopped");
-                }
-                /* Clear command after processing */
-                if (xSemaphoreTake(s_buzzer.mutex, portMAX_DELAY) == pdTRUE) {
-                    if (s_buzzer.cmd == BUZZER_CMD_STOP) {
-                        s_buzzer.cmd = BUZZER_CMD_NONE;
-                    }
-                    xSemaphoreGive(s_buzzer.mutex);
-                }
-                vTaskDelay(pdMS_TO_TICKS(50));
-                break;
-                
-            case BUZZER_CMD_BEEP: {
-                uint32_t remaining = beep.count;
-                bool infinite = (beep.count == 0);
-                
-                while (infinite || remaining > 0) {
-                    /* Check if command changed */
-                    if (xSemaphoreTake(s_buzzer.mutex, 0) == pdTRUE) {
-                        if (s_buzzer.cmd != BUZZER_CMD_BEEP) {
-                            xSemaphoreGive(s_buzzer.mutex);
-                            break;
-                        }
-                        xSemaphoreGive(s_buzzer.mutex);
-                    }
-                    
-                    /* Tone ON */
-                    pwm_set_duty(s_buzzer.current_duty);
-                    s_buzzer.playing = true;
-                    vTaskDelay(pdMS_TO_TICKS(beep.on_ms));
-                    
-                    /* Tone OFF */
-                    pwm_set_duty(0);
-                    s_buzzer.playing = false;
-                    
-                    if (!infinite) remaining--;
-                    
-                    if (remaining > 0 || infinite) {
-                        vTaskDelay(pdMS_TO_TICKS(beep.off_ms));
-                    }
-                }
-                
-                /* Clear command after beep sequence completes */
-                if (xSemaphoreTake(s_buzzer.mutex, portMAX_DELAY) == pdTRUE) {
-                    if (s_buzzer.cmd == BUZZER_CMD_BEEP) {
-                        s_buzzer.cmd = BUZZER_CMD_NONE;
-                    }
-                    xSemaphoreGive(s_buzzer.mutex);
-                }
+    pwm_set_duty(s_buzzer.current_duty);
+    s_buzzer.playing = true;
+}
+
+static void tone_off(void)
+{
+    pwm_set_duty(0);
+    s_buzzer.playing = false;
+}
+
+/* silence whatever is playing and forget it */
+static void go_idle(void)
+{
+    reactor_timer_stop(&s_buzzer.step_timer);
+    if (s_buzzer.phase == BUZZER_PHASE_NOTE) {
+        pwm_set_frequency(s_buzzer.frequency);
+    }
+    tone_off();
+    s_buzzer.phase = BUZZER_PHASE_IDLE;
+}
+
+static void play_note(void)
+{
+    sequence_t *seq = &s_buzzer.active_sequence;
+    uint32_t freq = seq->frequencies[seq->current_index];
+    
+    if (freq > 0) {
+        pwm_set_frequency(freq);
+        tone_on();
+    } else {
+        /* Rest (frequency = 0) */
+        tone_off();
+    }
+    s_buzzer.phase = BUZZER_PHASE_NOTE;
+    reactor_timer_start(&s_buzzer.step_timer, seq->durations[seq->current_index]);
+}
+
+static void on_step(void *arg, uint32_t data)
+{
+    switch (s_buzzer.phase) {
+        case BUZZER_PHASE_TONE:
+            tone_off();
+            if (s_buzzer.active_beep.count != 0 && --s_buzzer.remaining == 0) {
+                s_buzzer.phase = BUZZER_PHASE_IDLE;
                 break;
             }
+            s_buzzer.phase = BUZZER_PHASE_GAP;
+            reactor_timer_start(&s_buzzer.step_timer, s_buzzer.active_beep.off_ms);
+            break;
             
-            case BUZZER_CMD_SEQUENCE: {
-                size_t len = 0;
-                
-                if (xSemaphoreTake(s_buzzer.mutex, portMAX_DELAY) == pdTRUE) {
-                    len = s_buzzer.sequence.length;
-                    xSemaphoreGive(s_buzzer.mutex);
-                }
-                
-                for (size_t i = 0; i < len; i++) {
-                    /* Check if command changed */
-                    if (xSemaphoreTake(s_buzzer.mutex, 0) == pdTRUE) {
-                        if (s_buzzer.cmd != BUZZER_CMD_SEQUENCE) {
-                            xSemaphoreGive(s_buzzer.mutex);
-                            break;
-                        }
-                        xSemaphoreGive(s_buzzer.mutex);
-                    }
-                    
-                    uint32_t freq = s_buzzer.sequence.frequencies[i];
-                    uint32_t dur = s_buzzer.sequence.durations[i];
-                    
-                    if (freq > 0) {
-                        pwm_set_frequency(freq);
-                        pwm_set_duty(s_buzzer.current_duty);
-                        s_buzzer.playing = true;
-                    } else {
-                        /* Rest (frequency = 0) */
-                        pwm_set_duty(0);
-                        s_buzzer.playing = false;
-                    }
-                    
-                    vTaskDelay(pdMS_TO_TICKS(dur));
-                }
-                
-                pwm_set_frequency(s_buzzer.frequency);
-                pwm_set_duty(0);
-                s_buzzer.playing = false;
-                
-                if (xSemaphoreTake(s_buzzer.mutex, portMAX_DELAY) == pdTRUE) {
-                    if (s_buzzer.cmd == BUZZER_CMD_SEQUENCE) {
-                        s_buzzer.cmd = BUZZER_CMD_NONE;
-                    }
-                    xSemaphoreGive(s_buzzer.mutex);
-                }
-                break;
+        case BUZZER_PHASE_GAP:
+            tone_on();
+            s_buzzer.phase = BUZZER_PHASE_TONE;
+            reactor_timer_start(&s_buzzer.step_timer, s_buzzer.active_beep.on_ms);
+            break;
+            
+        case BUZZER_PHASE_NOTE:
+            if (++s_buzzer.active_sequence.current_index < s_buzzer.active_sequence.length) {
+                play_note();
+            } else {
+                go_idle();
             }
-                
-            case BUZZER_CMD_NONE:
-            default:
-                vTaskDelay(pdMS_TO_TICKS(50));
-                break;
-        }
+            break;
+            
+        default:
+            break;
+    }
+}
+
+/* picks up the latest request; a new one cuts off whatever is playing */
+static void on_command(void *arg, uint32_t data)
+{
+    buzzer_cmd_t cmd;
+    bool muted;
+    
+    if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(10)) != pdTRUE) {
+        return;
+    }
+    cmd = s_buzzer.cmd;
+    muted = s_buzzer.muted;
+    s_buzzer.cmd = BUZZER_CMD_NONE;
+    s_buzzer.active_beep = s_buzzer.beep;
+    s_buzzer.active_sequence = s_buzzer.sequence;
+    xSemaphoreGive(s_buzzer.mutex);
+    
+    if (cmd == BUZZER_CMD_NONE) {
+        return;
+    }
+    
+    /* Skip sound commands if muted */
+    if (muted && cmd != BUZZER_CMD_STOP) {
+        return;
+    }
+    
+    go_idle();
+    
+    switch (cmd) {
+        case BUZZER_CMD_START:
+            /* Continuous tone until buzzer_stop() */
+            tone_on();
+            s_buzzer.phase = BUZZER_PHASE_CONTINUOUS;
+            ESP_LOGD(TAG, "Started continuous tone");
+            break;
+            
+        case BUZZER_CMD_BEEP:
+            s_buzzer.remaining = s_buzzer.active_beep.count;
+            tone_on();
+            s_buzzer.phase = BUZZER_PHASE_TONE;
+            reactor_timer_start(&s_buzzer.step_timer, s_buzzer.active_beep.on_ms);
+            break;
+            
+        case BUZZER_CMD_SEQUENCE:
+            s_buzzer.active_sequence.current_index = 0;
+            play_note();
+            break;
+            
+        case BUZZER_CMD_STOP:
+        default:
+            ESP_LOGD(TAG, "Stopped");
+            break;
+    }
+}
+
+static void publish_settings(void)
+{
+    buzzer_settings_t settings = {
+        .muted = s_buzzer.muted,
+        .volume = s_buzzer.volume,
+        .frequency = s_buzzer.frequency,
+    };
+    SNAPSHOT_WRITE(s_settings, &settings);
+}
+
+/* the mute flag is already set; stop the sound if it was just muted */
+static void on_mute_changed(void *arg, uint32_t data)
+{
+    bool muted = buzzer_is_muted();
+    
+    ESP_LOGI(TAG, "Buzzer %s", muted ? "MUTED" : "UNMUTED");
+    if (muted && s_buzzer.phase != BUZZER_PHASE_IDLE) {
+        go_idle();
     }
 }
 
@@ -336,68 +331,40 @@ esp_err_t buzzer_init(const buzzer_config_t *config)
         return ESP_ERR_NO_MEM;
     }
     
-    /* Create toggle queue with length 1 (only care about latest toggle) */
-    s_buzzer.toggle_queue = xQueueCreate(1, sizeof(uint8_t));
-    if (s_buzzer.toggle_queue == NULL) {
-        ESP_LOGE(TAG, "Toggle queue creation failed");
-        vSemaphoreDelete(s_buzzer.mutex);
-        return ESP_ERR_NO_MEM;
-    }
-    
-    BaseType_t task_ret = xTaskCreate(
-        buzzer_task,
-        BUZZER_TASK_NAME,
-        BUZZER_TASK_STACK_SIZE,
-        NULL,
-        BUZZER_TASK_PRIORITY,
-        &s_buzzer.task_handle
-    );
-    if (task_ret != pdPASS) {
-        ESP_LOGE(TAG, "Task creation failed");
-        vQueueDelete(s_buzzer.toggle_queue);
-        vSemaphoreDelete(s_buzzer.mutex);
-        return ESP_ERR_NO_MEM;
-    }
+    reactor_timer_init(&s_buzzer.step_timer, on_step, NULL);
+    s_buzzer.phase = BUZZER_PHASE_IDLE;
     
     s_buzzer.initialized = true;
     s_buzzer.playing = false;
     s_buzzer.muted = false;
     s_buzzer.cmd = BUZZER_CMD_NONE;
+    publish_settings();
     
     ESP_LOGI(TAG, "Initialized successfully");
     return ESP_OK;
 }
 
-esp_err_t buzzer_deinit(void)
+/* runs after any on_command() already queued, so nothing touches the mutex later */
+static void on_deinit(void *arg, uint32_t data)
 {
-    if (!s_buzzer.initialized) {
-        return ESP_ERR_INVALID_STATE;
-    }
-    
-    buzzer_stop();
-    vTaskDelay(pdMS_TO_TICKS(100));
-    
-    if (s_buzzer.task_handle) {
-        vTaskDelete(s_buzzer.task_handle);
-        s_buzzer.task_handle = NULL;
-    }
-    
-    if (s_buzzer.toggle_queue) {
-        vQueueDelete(s_buzzer.toggle_queue);
-        s_buzzer.toggle_queue = NULL;
-    }
+    go_idle();
+    ledc_stop(LEDC_MODE, LEDC_CHANNEL, 0);
     
     if (s_buzzer.mutex) {
         vSemaphoreDelete(s_buzzer.mutex);
         s_buzzer.mutex = NULL;
     }
-    
-    ledc_stop(LEDC_MODE, LEDC_CHANNEL, 0);
-    
-    s_buzzer.initialized = false;
     ESP_LOGI(TAG, "Deinitialized");
+}
+
+esp_err_t buzzer_deinit(void)
+{
+    if (!s_buzzer.initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
     
-    return ESP_OK;
+    s_buzzer.initialized = false;
+    return reactor_post(on_deinit, NULL, 0);
 }
 
 esp_err_t buzzer_start(void)
@@ -409,7 +376,7 @@ esp_err_t buzzer_start(void)
     if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
         s_buzzer.cmd = BUZZER_CMD_START;
         xSemaphoreGive(s_buzzer.mutex);
-        return ESP_OK;
+        return reactor_post(on_command, NULL, 0);
     }
     
     return ESP_ERR_TIMEOUT;
@@ -424,7 +391,7 @@ esp_err_t buzzer_stop(void)
     if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
         s_buzzer.cmd = BUZZER_CMD_STOP;
         xSemaphoreGive(s_buzzer.mutex);
-        return ESP_OK;
+        return reactor_post(on_command, NULL, 0);
     }
     
     return ESP_ERR_TIMEOUT;
@@ -448,6 +415,7 @@ esp_err_t buzzer_set_volume(uint8_t volume)
     if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
         s_buzzer.volume = volume;
         s_buzzer.current_duty = volume_to_duty(volume);
+        publish_settings();
         
         if (s_buzzer.playing) {
             pwm_set_duty(s_buzzer.current_duty);
@@ -463,12 +431,14 @@ esp_err_t buzzer_set_volume(uint8_t volume)
 
 uint8_t buzzer_get_volume(void)
 {
-    return s_buzzer.volume;
+    buzzer_settings_t settings;
+    SNAPSHOT_READ(s_settings, &settings);
+    return settings.volume;
 }
 
 esp_err_t buzzer_volume_up(void)
 {
-    uint8_t new_vol = s_buzzer.volume + BUZZER_VOLUME_STEP;
+    uint8_t new_vol = buzzer_get_volume() + BUZZER_VOLUME_STEP;
     if (new_vol > BUZZER_VOLUME_MAX) {
         new_vol = BUZZER_VOLUME_MAX;
     }
@@ -477,11 +447,12 @@ esp_err_t buzzer_volume_up(void)
 
 esp_err_t buzzer_volume_down(void)
 {
+    uint8_t volume = buzzer_get_volume();
     uint8_t new_vol;
-    if (s_buzzer.volume < BUZZER_VOLUME_STEP) {
+    if (volume < BUZZER_VOLUME_STEP) {
         new_vol = BUZZER_VOLUME_MIN;
     } else {
-        new_vol = s_buzzer.volume - BUZZER_VOLUME_STEP;
+        new_vol = volume - BUZZER_VOLUME_STEP;
     }
     return buzzer_set_volume(new_vol);
 }
@@ -499,6 +470,7 @@ esp_err_t buzzer_set_frequency(uint32_t freq_hz)
     if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
         s_buzzer.frequency = freq_hz;
         pwm_set_frequency(freq_hz);
+        publish_settings();
         xSemaphoreGive(s_buzzer.mutex);
         ESP_LOGD(TAG, "Frequency set to %lu Hz", (unsigned long)freq_hz);
         return ESP_OK;
@@ -509,7 +481,9 @@ esp_err_t buzzer_set_frequency(uint32_t freq_hz)
 
 uint32_t buzzer_get_frequency(void)
 {
-    return s_buzzer.frequency;
+    buzzer_settings_t settings;
+    SNAPSHOT_READ(s_settings, &settings);
+    return settings.frequency;
 }
 
 esp_err_t buzzer_beep(uint32_t on_ms, uint32_t off_ms, uint32_t count)
@@ -524,7 +498,7 @@ esp_err_t buzzer_beep(uint32_t on_ms, uint32_t off_ms, uint32_t count)
         s_buzzer.beep.count = count;
         s_buzzer.cmd = BUZZER_CMD_BEEP;
         xSemaphoreGive(s_buzzer.mutex);
-        return ESP_OK;
+        return reactor_post(on_command, NULL, 0);
     }
     
     return ESP_ERR_TIMEOUT;
@@ -553,7 +527,7 @@ esp_err_t buzzer_play_sequence(const uint32_t *frequencies,
         s_buzzer.sequence.length = length;
         s_buzzer.cmd = BUZZER_CMD_SEQUENCE;
         xSemaphoreGive(s_buzzer.mutex);
-        return ESP_OK;
+        return reactor_post(on_command, NULL, 0);
     }
     
     return ESP_ERR_TIMEOUT;
@@ -565,11 +539,14 @@ esp_err_t buzzer_toggle_mute(void)
         return ESP_ERR_INVALID_STATE;
     }
     
-    uint8_t msg = 1;  /* Value doesn't matter, presence triggers toggle */
-    /* Use xQueueOverwrite to ensure we always succeed (queue length 1) */
-    xQueueOverwrite(s_buzzer.toggle_queue, &msg);
+    if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+        s_buzzer.muted = !s_buzzer.muted;
+        publish_settings();
+        xSemaphoreGive(s_buzzer.mutex);
+        return reactor_post(on_mute_changed, NULL, 0);
+    }
     
-    return ESP_OK;
+    return ESP_ERR_TIMEOUT;
 }
 
 esp_err_t buzzer_set_muted(bool muted)
@@ -581,15 +558,12 @@ esp_err_t buzzer_set_muted(bool muted)
     if (xSemaphoreTake(s_buzzer.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
         bool was_muted = s_buzzer.muted;
         s_buzzer.muted = muted;
+        publish_settings();
+        xSemaphoreGive(s_buzzer.mutex);
         
-        /* If we just muted and buzzer is playing, stop it immediately */
-        if (muted && !was_muted && s_buzzer.playing) {
-            pwm_set_duty(0);
-            s_buzzer.playing = false;
+        if (muted != was_muted) {
+            return reactor_post(on_mute_changed, NULL, 0);
         }
-        
-        ESP_LOGI(TAG, "Buzzer %s", muted ? "MUTED" : "UNMUTED");
-        xSemaphoreGive(s_buzzer.mutex);
         return ESP_OK;
     }
     
@@ -598,10 +572,7 @@ esp_err_t buzzer_set_muted(bool muted)
 
 bool buzzer_is_muted(void)
 {
-    return s_buzzer.muted;
-}
-
-QueueHandle_t buzzer_get_toggle_queue(void)
-{
-    return s_buzzer.toggle_queue;
+    buzzer_settings_t settings;
+    SNAPSHOT_READ(s_settings, &settings);
+    return settings.muted;
 }
@@ -0,0 +1,314 @@
+/*
+ * coex.c - arbiter preference, BLE deferral and per-radio loss counters
+ *
+ * State:
+ *
+ *   s_stats    ESP-NOW side counters and the preference, espnow_task only,
+ *              published through s_stats_snap
+ *   s_sched    when the next heartbeats are due, written by coex_tick()
+ *              and read through s_sched_snap by coex_ble_chunk_begin()
+ *   s_ble_*    BLE side counters and the end of the current bulk transfer;
+ *              bumped from whichever task notifies and from the GATTS
+ *              callback, so they are atomics
+ *
+ * Times are tick milliseconds, compared with wrapping differences.
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_coexist.h"
+#include "coex.h"
+#include "espnow.h"
+#include "snapshot.h"
+
+static const char *TAG = "coex";
+
+typedef struct {
+    bool policy;
+    bool paired;
+    uint32_t own_due;           /* our next heartbeat */
+    uint32_t partner_due;       /* the partner's, expected */
+} coex_sched_t;
+
+/* espnow_task only */
+static coex_stats_t s_stats;
+static bool s_stats_dirty;
+static coex_sched_t s_sched;
+static bool s_hb_valid;
+static uint32_t s_last_hb_ms;           /* last partner heartbeat heard */
+static uint32_t s_last_tick_ms;
+
+static atomic_bool s_policy;
+static atomic_uint s_bulk_until;        /* tick ms, 0 when no bulk transfer has run */
+static atomic_uint s_ble_chunks;
+static atomic_uint s_ble_failed;
+static atomic_uint s_ble_congested;
+static atomic_uint s_ble_deferred;
+static atomic_uint s_ble_deferred_ms;
+static atomic_uint s_bulk_transfers;
+
+SNAPSHOT_DEFINE(s_stats_snap, coex_stats_t);
+SNAPSHOT_DEFINE(s_sched_snap, coex_sched_t);
+
+static uint32_t get_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+static bool bulk_active(uint32_t now)
+{
+    uint32_t until = atomic_load_explicit(&s_bulk_until, memory_order_relaxed);
+    return until != 0 && (int32_t)(until - now) > 0;
+}
+
+/* next time due - COEX_GUARD_MS .. due + COEX_GUARD_MS ends after now */
+static uint32_t next_due(uint32_t due, uint32_t now)
+{
+    if ((int32_t)(now - (due + COEX_GUARD_MS)) > 0) {
+        due += ((now - (due + COEX_GUARD_MS)) / PAIRING_HEARTBEAT_MS + 1) * PAIRING_HEARTBEAT_MS;
+    }
+    return due;
+}
+
+static bool in_window(uint32_t due, uint32_t from, uint32_t to)
+{
+    return (int32_t)(to - (due - COEX_GUARD_MS)) >= 0 && (int32_t)((due + COEX_GUARD_MS) - from) >= 0;
+}
+
+static esp_coex_prefer_t to_arbiter(coex_pref_t pref)
+{
+    switch (pref) {
+        case COEX_PREFER_ESPNOW: return ESP_COEX_PREFER_WIFI;
+        case COEX_PREFER_BLE:    return ESP_COEX_PREFER_BT;
+        default:                 return ESP_COEX_PREFER_BALANCE;
+    }
+}
+
+static void set_pref(coex_pref_t pref)
+{
+    if (pref == s_stats.pref) return;
+
+    esp_err_t err = esp_coex_preference_set(to_arbiter(pref));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Preference %s failed: %s", coex_pref_name(pref), esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGD(TAG, "Prefer %s", coex_pref_name(pref));
+    s_stats.pref = pref;
+    s_stats.pref_changes++;
+    s_stats_dirty = true;
+}
+
+void coex_handle_recv(const pairing_ctx_t *ctx, const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    if (ctx == NULL || data == NULL || len < (int)sizeof(broadcast_header_t)) return;
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+    if (hdr->msg_type != MSG_HEARTBEAT || ctx->current_state != PAIRED) return;
+    if (memcmp(mac_addr, ctx->partner_mac, ESP_NOW_ETH_ALEN) != 0) return;
+
+    uint32_t now = get_time_ms();
+    if (s_hb_valid) {
+        /* heartbeats come every PAIRING_HEARTBEAT_MS; a gap of two means one lost */
+        uint32_t missed = (now - s_last_hb_ms + PAIRING_HEARTBEAT_MS / 2) / PAIRING_HEARTBEAT_MS;
+        missed = missed > 0 ? missed - 1 : 0;
+        s_stats.hb_missed += missed;
+        if (bulk_active(now)) {
+            s_stats.bulk_hb_heard++;
+            s_stats.bulk_hb_missed += missed;
+        }
+    }
+    s_stats.hb_heard++;
+    s_hb_valid = true;
+    s_last_hb_ms = now;
+    s_stats_dirty = true;
+}
+
+void coex_handle_send_result(const pairing_ctx_t *ctx, const uint8_t *mac_addr, bool ok)
+{
+    if (ctx == NULL || ctx->current_state == SEARCHING) return;
+    if (memcmp(mac_addr, ctx->partner_mac, ESP_NOW_ETH_ALEN) != 0) return;
+
+    s_stats.tx_partner++;
+    if (!ok) s_stats.tx_partner_failed++;
+    s_stats_dirty = true;
+}
+
+uint32_t coex_tick(const pairing_ctx_t *ctx)
+{
+    uint32_t now = get_time_ms();
+    bool policy = atomic_load_explicit(&s_policy, memory_order_relaxed);
+    bool paired = ctx->current_state == PAIRED;
+    bool handshake = pairing_handshake_active(ctx);
+
+    /* heartbeats that never came before the link went */
+    if (s_hb_valid && !paired) {
+        s_stats.hb_missed += (now - s_last_hb_ms) / PAIRING_HEARTBEAT_MS;
+        s_hb_valid = false;
+        s_stats_dirty = true;
+    }
+
+    coex_sched_t sched = {
+        .policy = policy,
+        .paired = paired,
+        .own_due = ctx->last_heartbeat_sent + PAIRING_HEARTBEAT_MS + 1,
+        .partner_due = next_due(ctx->last_heartbeat_recv + PAIRING_HEARTBEAT_MS, now),
+    };
+    if (sched.policy != s_sched.policy || sched.paired != s_sched.paired ||
+        sched.own_due != s_sched.own_due || sched.partner_due != s_sched.partner_due) {
+        s_sched = sched;
+        SNAPSHOT_WRITE(s_sched_snap, &s_sched);
+    }
+
+    bool window = paired && (in_window(sched.own_due, now, now) || in_window(sched.partner_due, now, now));
+    coex_pref_t pref = COEX_PREFER_BALANCE;
+    if (policy) {
+        if (handshake || window) {
+            pref = COEX_PREFER_ESPNOW;
+        } else if (bulk_active(now)) {
+            pref = COEX_PREFER_BLE;
+        }
+    }
+    if (policy && handshake && s_stats.pref == COEX_PREFER_ESPNOW) {
+        s_stats.handshake_ms += now - s_last_tick_ms;
+    }
+    set_pref(pref);
+    s_last_tick_ms = now;
+
+    if (s_stats.policy != policy) {
+        s_stats.policy = policy;
+        s_stats_dirty = true;
+    }
+    if (s_stats_dirty) {
+        SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+        s_stats_dirty = false;
+    }
+
+    uint32_t wait = UINT32_MAX;
+    if (pref == COEX_PREFER_BLE) {
+        wait = atomic_load_explicit(&s_bulk_until, memory_order_relaxed) - now;
+    }
+    if (!paired) return wait;
+
+    /* wake for our own heartbeat too, so pairing_tick() sends it on time */
+    uint32_t edges[] = {
+        sched.own_due - COEX_GUARD_MS, sched.own_due, sched.own_due + COEX_GUARD_MS + 1,
+        sched.partner_due - COEX_GUARD_MS, sched.partner_due + COEX_GUARD_MS + 1,
+    };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        if ((int32_t)(edges[i] - now) > 0 && edges[i] - now < wait) wait = edges[i] - now;
+    }
+    return wait;
+}
+
+void coex_ble_chunk_begin(bool bulk)
+{
+    if (!bulk) return;
+
+    uint32_t now = get_time_ms();
+    if (!bulk_active(now)) {
+        atomic_fetch_add_explicit(&s_bulk_transfers, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&s_bulk_until, now + COEX_BULK_IDLE_MS, memory_order_relaxed);
+
+    if (espnow_in_context()) return;
+
+    coex_sched_t sched;
+    SNAPSHOT_READ(s_sched_snap, &sched);
+    if (!sched.policy || !sched.paired) return;
+
+    /* the chunk's connection event must not touch a window */
+    uint32_t start = now;
+    uint32_t wait = 0;
+    for (int i = 0; i < 2 && wait < COEX_BLE_DEFER_MAX_MS; i++) {
+        uint32_t t = start + wait;
+        uint32_t own = next_due(sched.own_due, t);
+        uint32_t partner = next_due(sched.partner_due, t);
+        if (in_window(own, t, t + COEX_BLE_EVENT_MS)) {
+            wait = own + COEX_GUARD_MS + 1 - start;
+        } else if (in_window(partner, t, t + COEX_BLE_EVENT_MS)) {
+            wait = partner + COEX_GUARD_MS + 1 - start;
+        } else {
+            break;
+        }
+    }
+    if (wait == 0) return;
+    if (wait > COEX_BLE_DEFER_MAX_MS) wait = COEX_BLE_DEFER_MAX_MS;
+
+    atomic_fetch_add_explicit(&s_ble_deferred, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_ble_deferred_ms, wait, memory_order_relaxed);
+    vTaskDelay(pdMS_TO_TICKS(wait));
+    atomic_store_explicit(&s_bulk_until, get_time_ms() + COEX_BULK_IDLE_MS, memory_order_relaxed);
+}
+
+void coex_ble_chunk_end(bool ok)
+{
+    atomic_fetch_add_explicit(&s_ble_chunks, 1, memory_order_relaxed);
+    if (!ok) atomic_fetch_add_explicit(&s_ble_failed, 1, memory_order_relaxed);
+}
+
+void coex_ble_lost(void)
+{
+    atomic_fetch_add_explicit(&s_ble_failed, 1, memory_order_relaxed);
+}
+
+void coex_ble_congested(void)
+{
+    atomic_fetch_add_explicit(&s_ble_congested, 1, memory_order_relaxed);
+}
+
+void coex_set_policy(bool enabled)
+{
+    atomic_store_explicit(&s_policy, enabled, memory_order_relaxed);
+    ESP_LOGI(TAG, "Policy %s", enabled ? "on" : "off");
+}
+
+esp_err_t coex_init(void)
+{
+    atomic_init(&s_policy, true);
+    atomic_init(&s_bulk_until, 0);
+    atomic_init(&s_ble_chunks, 0);
+    atomic_init(&s_ble_failed, 0);
+    atomic_init(&s_ble_congested, 0);
+    atomic_init(&s_ble_deferred, 0);
+    atomic_init(&s_ble_deferred_ms, 0);
+    atomic_init(&s_bulk_transfers, 0);
+
+    s_stats.policy = true;
+    s_stats.pref = COEX_PREFER_BALANCE;
+    s_last_tick_ms = get_time_ms();
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+    SNAPSHOT_WRITE(s_sched_snap, &s_sched);
+
+    esp_err_t err = esp_coex_preference_set(ESP_COEX_PREFER_BALANCE);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Arbiter not available: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Initialized (heartbeat guard %d ms)", COEX_GUARD_MS);
+    return ESP_OK;
+}
+
+void coex_get_stats(coex_stats_t *out)
+{
+    SNAPSHOT_READ(s_stats_snap, out);
+    out->policy = atomic_load_explicit(&s_policy, memory_order_relaxed);
+    out->ble_chunks = atomic_load_explicit(&s_ble_chunks, memory_order_relaxed);
+    out->ble_failed = atomic_load_explicit(&s_ble_failed, memory_order_relaxed);
+    out->ble_congested = atomic_load_explicit(&s_ble_congested, memory_order_relaxed);
+    out->ble_deferred = atomic_load_explicit(&s_ble_deferred, memory_order_relaxed);
+    out->ble_deferred_ms = atomic_load_explicit(&s_ble_deferred_ms, memory_order_relaxed);
+    out->bulk_transfers = atomic_load_explicit(&s_bulk_transfers, memory_order_relaxed);
+}
+
+const char *coex_pref_name(uint8_t pref)
+{
+    switch (pref) {
+        case COEX_PREFER_ESPNOW: return "ESPNOW";
+        case COEX_PREFER_BLE:    return "BLE";
+        default:                 return "BALANCE";
+    }
+}
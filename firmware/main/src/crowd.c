@@ -0,0 +1,230 @@
+/*
+ * crowd.c - decayed interest counts and distinct-badge sketches from HELLOs
+ *
+ * State, all on espnow_task:
+ *
+ *   s_counts     per bit, Q8 HELLOs, decayed every CROWD_DECAY_MS by
+ *                s_decay_q16; s_total the same for HELLOs themselves
+ *   s_badges     HyperLogLog registers over every sender, [0] the current
+ *                window and [1] the previous; s_searching over HELLO senders
+ *
+ * Times are tick milliseconds, compared with wrapping differences.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "crowd.h"
+
+static const char *TAG = "crowd";
+
+#define CROWD_WINDOW_MS     (CROWD_WINDOW_S * 1000u)
+
+static uint32_t s_counts[CROWD_BITS];
+static uint32_t s_total;
+static uint32_t s_decay_q16;
+static uint8_t s_badges[2][CROWD_HLL_REGS];
+static uint8_t s_searching[2][CROWD_HLL_REGS];
+
+static uint32_t s_last_decay_ms;
+static uint32_t s_window_start_ms;
+static uint32_t s_hellos_total;
+static uint32_t s_rejected;
+
+static uint32_t get_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+/* murmur3's 64 bit finalizer: MACs from one vendor differ in a few low bytes */
+static uint32_t mac_hash(const uint8_t *mac)
+{
+    uint64_t x = 0;
+    memcpy(&x, mac, ESP_NOW_ETH_ALEN);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (uint32_t)(x >> 32);
+}
+
+/* top CROWD_HLL_P bits pick the register, the rest give the run of zeros */
+static void hll_add(uint8_t *regs, uint32_t h)
+{
+    uint32_t idx = h >> (32 - CROWD_HLL_P);
+    uint32_t rest = (h << CROWD_HLL_P) | (1u << (CROWD_HLL_P - 1));
+    uint8_t rank = (uint8_t)(__builtin_clz(rest) + 1);
+
+    if (rank > regs[idx]) regs[idx] = rank;
+}
+
+/* over both windows: the register-wise max is the sketch of the union */
+static uint32_t hll_estimate(const uint8_t regs[2][CROWD_HLL_REGS])
+{
+    const float m = CROWD_HLL_REGS;
+    float sum = 0.0f;
+    int zeros = 0;
+
+    for (int i = 0; i < CROWD_HLL_REGS; i++) {
+        uint8_t r = regs[0][i] > regs[1][i] ? regs[0][i] : regs[1][i];
+        sum += ldexpf(1.0f, -r);
+        if (r == 0) zeros++;
+    }
+
+    float e = 0.7213f / (1.0f + 1.079f / m) * m * m / sum;
+    /* small range: linear counting is exact-ish where the raw estimate is biased */
+    if (e <= 2.5f * m && zeros > 0) e = m * logf(m / zeros);
+    return (uint32_t)(e + 0.5f);
+}
+
+/*
+ * Bit b of the bitmask is bit b % 8 of byte b / 8, so a little-endian load
+ * puts it at bit b % 32 of word b / 32. Only set bits cost anything.
+ */
+static void count_bits(const uint8_t *mask, size_t len)
+{
+    if (len > CROWD_BITS / 8) len = CROWD_BITS / 8;
+
+    for (size_t at = 0; at < len; at += sizeof(uint32_t)) {
+        uint32_t word = 0;
+        memcpy(&word, mask + at, len - at < sizeof(word) ? len - at : sizeof(word));
+        uint32_t *c = &s_counts[at * 8];
+        while (word != 0) {
+            c[__builtin_ctz(word)] += CROWD_ONE;
+            word &= word - 1;
+        }
+    }
+}
+
+static void decay(void)
+{
+    for (int i = 0; i < CROWD_BITS; i++) {
+        s_counts[i] = (uint32_t)(((uint64_t)s_counts[i] * s_decay_q16) >> 16);
+    }
+    s_total = (uint32_t)(((uint64_t)s_total * s_decay_q16) >> 16);
+}
+
+esp_err_t crowd_init(void)
+{
+    memset(s_counts, 0, sizeof(s_counts));
+    memset(s_badges, 0, sizeof(s_badges));
+    memset(s_searching, 0, sizeof(s_searching));
+    s_total = 0;
+    s_hellos_total = 0;
+    s_rejected = 0;
+    s_decay_q16 = (uint32_t)(65536.0f * exp2f(-(float)CROWD_DECAY_MS / (CROWD_HALF_LIFE_S * 1000.0f)) + 0.5f);
+    s_last_decay_ms = s_window_start_ms = get_time_ms();
+
+    ESP_LOGI(TAG, "%d bits, half-life %d s, %d registers over %d s windows",
+             CROWD_BITS, CROWD_HALF_LIFE_S, CROWD_HLL_REGS, CROWD_WINDOW_S);
+    return ESP_OK;
+}
+
+void crowd_handle_recv(const pairing_ctx_t *ctx, const uint8_t *mac, const uint8_t *data, int len)
+{
+    if (ctx == NULL || mac == NULL || data == NULL || len < (int)sizeof(broadcast_header_t)) return;
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+    if (hdr->msg_type != MSG_HELLO) {
+        hll_add(s_badges[0], mac_hash(mac));
+        return;
+    }
+
+    /* bitmask | fw_version | caps must all be there */
+    if (len < (int)(sizeof(broadcast_header_t) + hdr->bitmask_len + sizeof(uint32_t) + 1) ||
+        !pairing_frame_tag_valid(ctx, mac, data, len)) {
+        s_rejected++;
+        return;
+    }
+
+    uint32_t h = mac_hash(mac);
+    hll_add(s_badges[0], h);
+    hll_add(s_searching[0], h);
+    count_bits(data + sizeof(broadcast_header_t), hdr->bitmask_len);
+    s_total += CROWD_ONE;
+    s_hellos_total++;
+}
+
+uint32_t crowd_tick(void)
+{
+    uint32_t now = get_time_ms();
+
+    while (now - s_last_decay_ms >= CROWD_DECAY_MS) {
+        decay();
+        s_last_decay_ms += CROWD_DECAY_MS;
+    }
+    if (now - s_window_start_ms >= CROWD_WINDOW_MS) {
+        memcpy(s_badges[1], s_badges[0], CROWD_HLL_REGS);
+        memset(s_badges[0], 0, CROWD_HLL_REGS);
+        memcpy(s_searching[1], s_searching[0], CROWD_HLL_REGS);
+        memset(s_searching[0], 0, CROWD_HLL_REGS);
+        s_window_start_ms = now;
+    }
+
+    uint32_t decay_ms = CROWD_DECAY_MS - (now - s_last_decay_ms);
+    uint32_t window_ms = CROWD_WINDOW_MS - (now - s_window_start_ms);
+    return decay_ms < window_ms ? decay_ms : window_ms;
+}
+
+void crowd_get_stats(crowd_stats_t *out)
+{
+    if (out == NULL) return;
+    out->badges = hll_estimate(s_badges);
+    out->searching = hll_estimate(s_searching);
+    out->hellos = s_total;
+    out->hellos_total = s_hellos_total;
+    out->rejected = s_rejected;
+}
+
+/* searching badges with the bit set: their share of the HELLOs, scaled */
+static uint32_t people(uint16_t bit, uint32_t searching)
+{
+    if (bit >= CROWD_BITS || s_total == 0) return 0;
+    return (uint32_t)(((uint64_t)s_counts[bit] * searching + s_total / 2) / s_total);
+}
+
+/* the CROWD_TOP_N highest counts, highest first; returns how many are nonzero */
+static int top_bits(uint16_t *out)
+{
+    int n = 0;
+
+    for (int b = 0; b < CROWD_BITS; b++) {
+        if (s_counts[b] == 0) continue;
+        if (n == CROWD_TOP_N && s_counts[b] <= s_counts[out[n - 1]]) continue;
+        int i = n < CROWD_TOP_N ? n++ : n - 1;
+        while (i > 0 && s_counts[out[i - 1]] < s_counts[b]) {
+            out[i] = out[i - 1];
+            i--;
+        }
+        out[i] = (uint16_t)b;
+    }
+    return n;
+}
+
+int crowd_report(const uint16_t *bits, int count, char *out, size_t size)
+{
+    uint16_t top[CROWD_TOP_N];
+    crowd_stats_t st;
+
+    crowd_get_stats(&st);
+    if (bits == NULL) {
+        count = top_bits(top);
+        bits = top;
+    } else if (count > CROWD_QUERY_MAX) {
+        count = CROWD_QUERY_MAX;
+    }
+
+    int n = snprintf(out, size, "CROWD:badges=%lu,searching=%lu,hellos=%lu,bits=",
+                     (unsigned long)st.badges, (unsigned long)st.searching,
+                     (unsigned long)((st.hellos + CROWD_ONE / 2) / CROWD_ONE));
+    for (int i = 0; i < count && n >= 0 && (size_t)n < size; i++) {
+        n += snprintf(out + n, size - n, "%s%u:%lu", i > 0 ? "/" : "", bits[i],
+                      (unsigned long)people(bits[i], st.searching));
+    }
+    return n;
+}
@@ -1,25 +1,59 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_now.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "espnow.h"
 #include "pairing.h"
-#include "proximity.h"
+#include "bus.h"
+#include "neighbor.h"
+#include "ota.h"
+#include "announce.h"
+#include "timesync.h"
+#include "coex.h"
+#include "rate.h"
+#include "frag.h"
+#include "ble_task.h"
+#include "trace.h"
+#include "sniffer.h"
+#include "loadgen.h"
+#include "crowd.h"
+#include "mem.h"
+#include "snapshot.h"
 
 #define ESPNOW_MAXDELAY 512
 
 static const char *TAG = "espnow";
 
 static QueueHandle_t s_espnow_queue = NULL;
+static TaskHandle_t s_espnow_task = NULL;
 
 const uint8_t espnow_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 
 static pairing_ctx_t s_pairing_ctx;
 
+/* receive path counters: the WiFi task bumps them, espnow_task the claims */
+static atomic_uint s_rx_frames;
+static atomic_uint s_rx_dropped_foreign;
+static atomic_uint s_rx_dropped_rate;
+static atomic_uint s_rx_dropped_global;
+static atomic_uint s_rx_dropped_dup;
+static atomic_uint s_rx_dropped_claim;
+static atomic_uint s_rx_dropped_queue;
+static atomic_uint s_rx_dropped_nomem;
+
+/* espnow_task only; the pairing fields, republished when they change */
+static espnow_stats_t s_stats;
+
+SNAPSHOT_DEFINE(s_stats_snap, espnow_stats_t);
+
 void espnow_set_config_key(const char *key) {
     if (s_espnow_queue == NULL || key == NULL) return;
 
@@ -38,12 +72,12 @@ void espnow_set_config_bitmask(const uint8_t *data, uint16_t len, uint8_t simila
     evt.id = ESPNOW_SET_BITMASK;
     evt.info.set_bitmask.len = len;
     evt.info.set_bitmask.similarity_threshold = similarity_threshold;
-    evt.info.set_bitmask.data = malloc(len);
+    evt.info.set_bitmask.data = mem_malloc(MEM_TAG_ESPNOW_CFG, len);
     if (evt.info.set_bitmask.data == NULL) return;
     memcpy(evt.info.set_bitmask.data, data, len);
     
     if (xQueueSend(s_espnow_queue, &evt, portMAX_DELAY) != pdTRUE) {
-        free(evt.info.set_bitmask.data);
+        mem_free(evt.info.set_bitmask.data);
     }
 }
 
@@ -58,10 +92,113 @@ void espnow_set_relay_url(const char *url) {
     xQueueSend(s_espnow_queue, &evt, portMAX_DELAY);
 }
 
+void espnow_set_group_key(const uint8_t *key, uint8_t len) {
+    if (s_espnow_queue == NULL || key == NULL || len == 0 || len > PAIRING_GROUP_KEY_MAX_LEN) return;
+
+    espnow_event_t evt;
+    evt.id = ESPNOW_SET_GROUP_KEY;
+    memcpy(evt.info.set_group_key.key, key, len);
+    evt.info.set_group_key.len = len;
+
+    xQueueSend(s_espnow_queue, &evt, portMAX_DELAY);
+}
+
+void espnow_set_org_key(const uint8_t *der, uint16_t len) {
+    if (s_espnow_queue == NULL || der == NULL || len == 0 || len > ANNOUNCE_ORG_KEY_MAX) return;
+
+    espnow_event_t evt;
+    evt.id = ESPNOW_SET_ORG_KEY;
+    memcpy(evt.info.set_org_key.key, der, len);
+    evt.info.set_org_key.len = len;
+
+    xQueueSend(s_espnow_queue, &evt, portMAX_DELAY);
+}
+
+void espnow_announce(const uint8_t *data, uint16_t len) {
+    if (s_espnow_queue == NULL || data == NULL || len == 0 || len > ANNOUNCE_FRAME_MAX) return;
+
+    espnow_event_t evt;
+    evt.id = ESPNOW_ANNOUNCE;
+    memcpy(evt.info.announce.data, data, len);
+    evt.info.announce.len = len;
+
+    xQueueSend(s_espnow_queue, &evt, portMAX_DELAY);
+}
+
+void espnow_loadgen(const loadgen_config_t *cfg) {
+    if (s_espnow_queue == NULL) return;
+
+    espnow_event_t evt;
+    evt.id = ESPNOW_LOADGEN;
+    evt.info.loadgen.stop = cfg == NULL;
+    if (cfg != NULL) evt.info.loadgen.config = *cfg;
+
+    xQueueSend(s_espnow_queue, &evt, portMAX_DELAY);
+}
+
+void espnow_crowd(const uint16_t *bits, uint8_t count) {
+    if (s_espnow_queue == NULL) return;
+
+    espnow_event_t evt;
+    evt.id = ESPNOW_CROWD;
+    evt.info.crowd.count = bits == NULL ? 0 : count > CROWD_QUERY_MAX ? CROWD_QUERY_MAX : count;
+    if (evt.info.crowd.count > 0) memcpy(evt.info.crowd.bits, bits, evt.info.crowd.count * sizeof(uint16_t));
+
+    xQueueSend(s_espnow_queue, &evt, portMAX_DELAY);
+}
+
+void espnow_wake(void) {
+    if (s_espnow_queue == NULL) return;
+
+    espnow_event_t evt;
+    evt.id = ESPNOW_WAKE;
+
+    /* full queue: the task has plenty to wake up for already */
+    xQueueSend(s_espnow_queue, &evt, 0);
+}
+
+esp_err_t espnow_set_hello_interval(uint32_t interval_ms) {
+    if (s_espnow_queue == NULL) return ESP_ERR_INVALID_STATE;
+
+    espnow_event_t evt;
+    evt.id = ESPNOW_SET_HELLO_INTERVAL;
+    evt.info.hello_interval_ms = interval_ms;
+
+    return xQueueSend(s_espnow_queue, &evt, 0) == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t espnow_set_tx_power_cap(int8_t cap_q) {
+    if (s_espnow_queue == NULL) return ESP_ERR_INVALID_STATE;
+
+    espnow_event_t evt;
+    evt.id = ESPNOW_SET_TX_POWER_CAP;
+    evt.info.tx_power_cap_q = cap_q;
+
+    return xQueueSend(s_espnow_queue, &evt, 0) == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
 void espnow_reset_pairing(void) {
     pairing_reset(&s_pairing_ctx);
 }
 
+void espnow_get_stats(espnow_stats_t *out) {
+    if (out == NULL) return;
+    SNAPSHOT_READ(s_stats_snap, out);
+    out->rx_frames = atomic_load_explicit(&s_rx_frames, memory_order_relaxed);
+    out->rx_dropped_foreign = atomic_load_explicit(&s_rx_dropped_foreign, memory_order_relaxed);
+    out->rx_dropped_rate = atomic_load_explicit(&s_rx_dropped_rate, memory_order_relaxed);
+    out->rx_dropped_global = atomic_load_explicit(&s_rx_dropped_global, memory_order_relaxed);
+    out->rx_dropped_dup = atomic_load_explicit(&s_rx_dropped_dup, memory_order_relaxed);
+    out->rx_dropped_claim = atomic_load_explicit(&s_rx_dropped_claim, memory_order_relaxed);
+    out->rx_dropped_queue = atomic_load_explicit(&s_rx_dropped_queue, memory_order_relaxed);
+    out->rx_dropped_nomem = atomic_load_explicit(&s_rx_dropped_nomem, memory_order_relaxed);
+}
+
+bool espnow_in_context(void)
+{
+    return s_espnow_task != NULL && xTaskGetCurrentTaskHandle() == s_espnow_task;
+}
+
 /* ESPNOW sending callback function is called in WiFi task.
  * Users should not do lengthy operations from this task. Instead, post
  * necessary data to a queue and handle it from a lower priority task. */
@@ -86,6 +223,8 @@ static void espnow_send_cb(const esp_now_send_info_t *tx_info, esp_now_send_stat
 /* ESPNOW receiving callback function is called in WiFi task. */
 static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
 {
+    /* first thing, so timesync sees as little of our own latency as possible */
+    int64_t rx_us = esp_timer_get_time();
     espnow_event_t evt;
     espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
     uint8_t *mac_addr = recv_info->src_addr;
@@ -96,7 +235,37 @@ static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *
         return;
     }
 
-    int8_t rssi = recv_info->rx_ctrl->rssi;
+#if CONFIG_ESPNOW_TRACE
+    /* before any filtering: floods and foreign frames are what we want to see */
+    trace_record(recv_info, data, len);
+#endif
+
+    atomic_fetch_add_explicit(&s_rx_frames, 1, memory_order_relaxed);
+
+    /* Cheap filters first so floods and replays never reach malloc or the queue */
+    if (len < sizeof(broadcast_header_t) || data[0] != PAIRING_PROTOCOL_ID) {
+        atomic_fetch_add_explicit(&s_rx_dropped_foreign, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint32_t now_ms = (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+    neighbor_verdict_t verdict = neighbor_admit(mac_addr, data, len, now_ms);
+    switch (verdict) {
+        case NEIGHBOR_DROP_RATE:
+            atomic_fetch_add_explicit(&s_rx_dropped_rate, 1, memory_order_relaxed);
+            return;
+        case NEIGHBOR_DROP_GLOBAL:
+            atomic_fetch_add_explicit(&s_rx_dropped_global, 1, memory_order_relaxed);
+            return;
+        case NEIGHBOR_DROP_DUP:
+            atomic_fetch_add_explicit(&s_rx_dropped_dup, 1, memory_order_relaxed);
+            return;
+        default:
+            break;
+    }
+
+    /* senders pick their TX power per frame; everything downstream wants one scale */
+    int8_t rssi = pairing_rssi_at_ref((const broadcast_header_t *)data, recv_info->rx_ctrl->rssi);
     int8_t noise_floor = recv_info->rx_ctrl->noise_floor;
 
     float distance_m = powf(10.0f, (float)(ESPNOW_TX_POWER_DBM - rssi) / (10.0f * ESPNOW_PATH_LOSS_EXP));
@@ -126,17 +295,84 @@ static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *
     memcpy(recv_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
     recv_cb->rssi = rssi;
     recv_cb->noise_floor = noise_floor;
-    recv_cb->data = malloc(len);
+    recv_cb->rx_us = rx_us;
+    recv_cb->claim = verdict == NEIGHBOR_ADMIT_CLAIM;
+    recv_cb->data = mem_malloc(MEM_TAG_ESPNOW_RX, len);
     if (recv_cb->data == NULL) {
         ESP_LOGE(TAG, "Malloc receive data fail");
+        atomic_fetch_add_explicit(&s_rx_dropped_nomem, 1, memory_order_relaxed);
         return;
     }
     memcpy(recv_cb->data, data, len);
     recv_cb->data_len = len;
     if (xQueueSend(s_espnow_queue, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
         ESP_LOGW(TAG, "Send receive queue fail");
-        free(recv_cb->data);
+        atomic_fetch_add_explicit(&s_rx_dropped_queue, 1, memory_order_relaxed);
+        mem_free(recv_cb->data);
+    }
+}
+
+/* the group key survives reboots so badges keep authenticating HELLOs */
+static void load_group_key(void)
+{
+    nvs_handle_t handle;
+    uint8_t key[PAIRING_GROUP_KEY_MAX_LEN];
+    size_t len = sizeof(key);
+
+    if (nvs_open("storage", NVS_READONLY, &handle) != ESP_OK) return;
+    esp_err_t err = nvs_get_blob(handle, "group_key", key, &len);
+    nvs_close(handle);
+
+    if (err == ESP_OK && len > 0) {
+        pairing_set_group_key(&s_pairing_ctx, key, (uint8_t)len);
     }
+    memset(key, 0, sizeof(key));
+}
+
+/* a load generator run speaks for its identities; the badge's own pairing waits */
+static bool pairing_paused(void)
+{
+#if CONFIG_ESPNOW_LOADGEN
+    return loadgen_running();
+#else
+    return false;
+#endif
+}
+
+/* the partner's ingress entry, and with it its seq window, survives a full table */
+static void publish_partner(void)
+{
+    static uint8_t published[ESP_NOW_ETH_ALEN];
+    static bool has_published;
+    bool has = s_pairing_ctx.current_state != SEARCHING;
+
+    if (has == has_published && (!has || memcmp(published, s_pairing_ctx.partner_mac, ESP_NOW_ETH_ALEN) == 0)) {
+        return;
+    }
+    neighbor_set_partner(has ? s_pairing_ctx.partner_mac : NULL);
+    memcpy(published, s_pairing_ctx.partner_mac, ESP_NOW_ETH_ALEN);
+    has_published = has;
+}
+
+/* the pairing fields of espnow_get_stats(), copied out whenever one moved */
+static void publish_stats(void)
+{
+    espnow_stats_t next;
+
+    memcpy(&next, &s_stats, sizeof(next));
+
+    next.pairing_resumed = s_pairing_ctx.resume_count;
+    next.pairing_last_outage_ms = s_pairing_ctx.last_outage_ms;
+    next.tx_power_q = s_pairing_ctx.tx_power_q;
+    next.partner_tx_q = s_pairing_ctx.partner_tx_q;
+    next.tx_power_changes = s_pairing_ctx.tx_power_changes;
+    next.handshake_ms = s_pairing_ctx.handshake_ms;
+    next.handshakes = s_pairing_ctx.handshakes;
+    next.link = s_pairing_ctx.kex.link_encrypted ? (s_pairing_ctx.kex.link_verified ? 2 : 1) : 0;
+
+    if (memcmp(&next, &s_stats, sizeof(next)) == 0) return;
+    memcpy(&s_stats, &next, sizeof(s_stats));
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
 }
 
 static void espnow_task(void *pvParameter)
@@ -145,8 +381,10 @@ static void espnow_task(void *pvParameter)
 
     ESP_LOGI(TAG, "ESP-NOW task started. Broadcasting DISABLED until key received.");
 
+    uint32_t wait_ms = PAIRING_REBROADCAST_MS;
+
     while (1) {
-        if (xQueueReceive(s_espnow_queue, &evt, pdMS_TO_TICKS(PAIRING_REBROADCAST_MS)) == pdTRUE) {
+        if (xQueueReceive(s_espnow_queue, &evt, pdMS_TO_TICKS(wait_ms)) == pdTRUE) {
             switch (evt.id) {
                 case ESPNOW_SEND_CB:
                 {
@@ -154,18 +392,65 @@ static void espnow_task(void *pvParameter)
                     ESP_LOGD(TAG, "Send to " MACSTR " status: %s", 
                              MAC2STR(send_cb->mac_addr),
                              send_cb->status == ESP_NOW_SEND_SUCCESS ? "OK" : "FAIL");
+#if CONFIG_ESPNOW_COEX
+                    coex_handle_send_result(&s_pairing_ctx, send_cb->mac_addr,
+                                            send_cb->status == ESP_NOW_SEND_SUCCESS);
+#endif
+#if CONFIG_ESPNOW_RATE_CONTROL
+                    rate_handle_send_result(&s_pairing_ctx, send_cb->mac_addr,
+                                            send_cb->status == ESP_NOW_SEND_SUCCESS);
+#endif
                     break;
                 }
                 case ESPNOW_RECV_CB:
                 {
                     espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
+                    const uint8_t *data = recv_cb->data;
+                    int len = recv_cb->data_len;
+
+                    /* a fragment is handled once its frame is complete, as that frame */
+                    if (!frag_handle_recv(recv_cb->mac_addr, &data, &len)) {
+                        mem_free(recv_cb->data);
+                        break;
+                    }
+
+                    /* a reboot or a window gone wrong is only believed from a frame that
+                     * proves it. without a group key nothing does, and the frame can only
+                     * continue the window it claims against */
+                    if (recv_cb->claim) {
+                        if (!pairing_frame_tag_valid(&s_pairing_ctx, recv_cb->mac_addr, data, len)) {
+                            atomic_fetch_add_explicit(&s_rx_dropped_claim, 1, memory_order_relaxed);
+                            mem_free(recv_cb->data);
+                            break;
+                        }
+                        neighbor_confirm(recv_cb->mac_addr, (const broadcast_header_t *)data,
+                                         s_pairing_ctx.has_group_key);
+                    }
+
+                    if (!pairing_paused()) {
+                        pairing_handle_recv(&s_pairing_ctx, recv_cb->mac_addr, data, len, recv_cb->rssi);
+                    }
+#if CONFIG_ESPNOW_OTA
+                    ota_handle_recv(&s_pairing_ctx, recv_cb->mac_addr, data, len);
+#endif
+#if CONFIG_ESPNOW_ANNOUNCE
+                    announce_handle_recv(&s_pairing_ctx, recv_cb->mac_addr, data, len);
+#endif
+#if CONFIG_ESPNOW_TIMESYNC
+                    timesync_handle_recv(&s_pairing_ctx, recv_cb->mac_addr, data, len, recv_cb->rx_us);
+#endif
+#if CONFIG_ESPNOW_COEX
+                    coex_handle_recv(&s_pairing_ctx, recv_cb->mac_addr, data, len);
+#endif
+#if CONFIG_ESPNOW_CROWD
+                    crowd_handle_recv(&s_pairing_ctx, recv_cb->mac_addr, data, len);
+#endif
 
-                    pairing_handle_recv(&s_pairing_ctx, recv_cb->mac_addr, 
-                                        recv_cb->data, recv_cb->data_len, recv_cb->rssi);
-
-                    proximity_update(recv_cb->rssi); // led, buzzer
+                    bus_msg_t msg = { .rssi.rssi = recv_cb->rssi };
+                    memcpy(msg.rssi.mac, recv_cb->mac_addr, ESP_NOW_ETH_ALEN);
+                    bus_publish(BUS_TOPIC_RSSI, &msg); // proximity: led, buzzer
 
-                    free(recv_cb->data);
+                    mem_free(recv_cb->data);
                     break;
                 }
                 case ESPNOW_SET_KEY:
@@ -177,30 +462,127 @@ static void espnow_task(void *pvParameter)
                              evt.info.set_bitmask.len, evt.info.set_bitmask.similarity_threshold);
                     pairing_set_bitmask(&s_pairing_ctx, evt.info.set_bitmask.data, evt.info.set_bitmask.len);
                     pairing_set_similarity_threshold(&s_pairing_ctx, evt.info.set_bitmask.similarity_threshold);
-                    free(evt.info.set_bitmask.data);
+                    mem_free(evt.info.set_bitmask.data);
                     break;
                 case ESPNOW_SET_RELAY_URL:
                     ESP_LOGI(TAG, "Setting relay URL for key exchange");
                     pairing_set_relay_url(&s_pairing_ctx, evt.info.set_relay_url.url);
                     break;
+                case ESPNOW_SET_GROUP_KEY:
+                    pairing_set_group_key(&s_pairing_ctx, evt.info.set_group_key.key, evt.info.set_group_key.len);
+                    memset(&evt.info.set_group_key, 0, sizeof(evt.info.set_group_key));
+                    break;
+                case ESPNOW_SET_HELLO_INTERVAL:
+                    pairing_set_hello_interval(&s_pairing_ctx, evt.info.hello_interval_ms);
+                    break;
+                case ESPNOW_SET_TX_POWER_CAP:
+                    pairing_set_tx_power_cap(&s_pairing_ctx, evt.info.tx_power_cap_q);
+                    break;
+#if CONFIG_ESPNOW_ANNOUNCE
+                case ESPNOW_SET_ORG_KEY:
+                    announce_set_org_key(evt.info.set_org_key.key, evt.info.set_org_key.len);
+                    break;
+                case ESPNOW_ANNOUNCE:
+                {
+                    esp_err_t err = announce_originate(&s_pairing_ctx, evt.info.announce.data, evt.info.announce.len);
+                    ble_send_message(err == ESP_OK ? "ANNOUNCE_OK" BLE_MESSAGE_DELIMITER_STR :
+                                     err == ESP_ERR_INVALID_STATE ? "ANNOUNCE_ERR:NO_KEY" BLE_MESSAGE_DELIMITER_STR :
+                                     err == ESP_ERR_INVALID_CRC ? "ANNOUNCE_ERR:SIG" BLE_MESSAGE_DELIMITER_STR :
+                                     err == ESP_ERR_INVALID_VERSION ? "ANNOUNCE_ERR:ID" BLE_MESSAGE_DELIMITER_STR :
+                                     "ANNOUNCE_ERR:FORMAT" BLE_MESSAGE_DELIMITER_STR);
+                    break;
+                }
+#endif
+#if CONFIG_ESPNOW_LOADGEN
+                case ESPNOW_LOADGEN:
+                {
+                    if (!evt.info.loadgen.stop && !loadgen_running()) pairing_reset(&s_pairing_ctx);
+                    esp_err_t err = loadgen_start(evt.info.loadgen.stop ? NULL : &evt.info.loadgen.config);
+                    char reply[48];
+                    if (err == ESP_OK) {
+                        snprintf(reply, sizeof(reply), "LOAD_OK" BLE_MESSAGE_DELIMITER_STR);
+                    } else {
+                        snprintf(reply, sizeof(reply), "LOAD_ERR:%s" BLE_MESSAGE_DELIMITER_STR, esp_err_to_name(err));
+                    }
+                    ble_send_message(reply);
+                    break;
+                }
+#endif
+#if CONFIG_ESPNOW_CROWD
+                case ESPNOW_CROWD:
+                {
+                    char reply[320];
+                    /* room left for the delimiter */
+                    crowd_report(evt.info.crowd.count > 0 ? evt.info.crowd.bits : NULL, evt.info.crowd.count,
+                                 reply, sizeof(reply) - strlen(BLE_MESSAGE_DELIMITER_STR));
+                    strcat(reply, BLE_MESSAGE_DELIMITER_STR);
+                    ble_send_message(reply);
+                    break;
+                }
+#endif
+                case ESPNOW_WAKE:
+                    break;
                 default:
                     ESP_LOGE(TAG, "Unknown event id: %d", evt.id);
                     break;
             }
         }
 
-        pairing_tick(&s_pairing_ctx);
+        if (!pairing_paused()) pairing_tick(&s_pairing_ctx);
+        publish_partner();
+        publish_stats();
+
+        wait_ms = PAIRING_REBROADCAST_MS;
+#if CONFIG_ESPNOW_LOADGEN
+        uint32_t loadgen_ms = loadgen_tick();
+        if (loadgen_ms < wait_ms) wait_ms = loadgen_ms;
+#endif
+#if CONFIG_ESPNOW_OTA
+        /* chunks go out every 1000/OTA_CHUNK_RATE ms while serving */
+        uint32_t ota_ms = ota_tick(&s_pairing_ctx);
+        if (ota_ms < wait_ms) wait_ms = ota_ms;
+#endif
+#if CONFIG_ESPNOW_ANNOUNCE
+        uint32_t announce_ms = announce_tick(&s_pairing_ctx);
+        if (announce_ms < wait_ms) wait_ms = announce_ms;
+#endif
+#if CONFIG_ESPNOW_TIMESYNC
+        uint32_t timesync_ms = timesync_tick(&s_pairing_ctx);
+        if (timesync_ms < wait_ms) wait_ms = timesync_ms;
+#endif
+#if CONFIG_ESPNOW_COEX
+        /* also wakes us for the heartbeat, so the partner can predict it */
+        uint32_t coex_ms = coex_tick(&s_pairing_ctx);
+        if (coex_ms < wait_ms) wait_ms = coex_ms;
+#endif
+#if CONFIG_ESPNOW_CROWD
+        uint32_t crowd_ms = crowd_tick();
+        if (crowd_ms < wait_ms) wait_ms = crowd_ms;
+#endif
     }
 }
 
 esp_err_t espnow_init(void)
 {
+#if CONFIG_ESPNOW_SNIFFER
+    /* no driver, peers, queue or task: nothing here can transmit, and the setters find no queue */
+    return sniffer_init();
+#endif
+
     s_espnow_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(espnow_event_t));
     if (s_espnow_queue == NULL) {
         ESP_LOGE(TAG, "Create queue fail");
         return ESP_FAIL;
     }
 
+    neighbor_init((uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS));
+
+#if CONFIG_ESPNOW_TRACE
+    if (trace_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Trace capture unavailable");
+    }
+#endif
+
     ESP_ERROR_CHECK( esp_now_init() );
     ESP_ERROR_CHECK( esp_now_register_send_cb(espnow_send_cb) );
     ESP_ERROR_CHECK( esp_now_register_recv_cb(espnow_recv_cb) );
@@ -210,7 +592,7 @@ esp_err_t espnow_init(void)
 #endif
     ESP_ERROR_CHECK( esp_now_set_pmk((uint8_t *)CONFIG_ESPNOW_PMK) );
 
-    esp_now_peer_info_t *peer = malloc(sizeof(esp_now_peer_info_t));
+    esp_now_peer_info_t *peer = mem_malloc(MEM_TAG_ESPNOW_CFG, sizeof(esp_now_peer_info_t));
     if (peer == NULL) {
         ESP_LOGE(TAG, "Malloc peer information fail");
         vQueueDelete(s_espnow_queue);
@@ -224,15 +606,49 @@ esp_err_t espnow_init(void)
     peer->encrypt = false;
     memcpy(peer->peer_addr, espnow_broadcast_mac, ESP_NOW_ETH_ALEN);
     ESP_ERROR_CHECK( esp_now_add_peer(peer) );
-    free(peer);
+    mem_free(peer);
 
     esp_err_t pairing_ret = pairing_init(&s_pairing_ctx);
     if (pairing_ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize pairing: %s", esp_err_to_name(pairing_ret));
         return pairing_ret;
     }
+    load_group_key();
+    frag_init();
+    publish_stats();
+
+#if CONFIG_ESPNOW_OTA
+    if (ota_init() == ESP_OK) {
+        pairing_set_fw_version(&s_pairing_ctx, ota_serving_version());
+    }
+#endif
+#if CONFIG_ESPNOW_ANNOUNCE
+    announce_init();
+#endif
+#if CONFIG_ESPNOW_TIMESYNC
+    timesync_init(s_pairing_ctx.my_mac);
+#endif
+#if CONFIG_ESPNOW_COEX
+    coex_init();
+#endif
+#if CONFIG_ESPNOW_RATE_CONTROL
+    rate_init();
+#endif
+#if CONFIG_ESPNOW_CROWD
+    crowd_init();
+#endif
+#if CONFIG_ESPNOW_LOADGEN
+    if (loadgen_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Load generator unavailable");
+    }
+#endif
 
-    xTaskCreate(espnow_task, "espnow_task", 4096, NULL, 4, NULL);
+#if CONFIG_ESPNOW_ANNOUNCE
+    /* mbedtls' signature check of an announcement needs about 2 KB more */
+    xTaskCreate(espnow_task, "espnow_task", 6144, NULL, 4, &s_espnow_task);
+#else
+    xTaskCreate(espnow_task, "espnow_task", 4096, NULL, 4, &s_espnow_task);
+#endif
 
     ESP_LOGI(TAG, "ESP-NOW initialized");
     return ESP_OK;
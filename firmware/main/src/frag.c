@@ -0,0 +1,291 @@
+/*
+ * frag.c - v2 frames and v1 fragments
+ *
+ * State, all on espnow_task:
+ *
+ *   s_peers    capabilities per MAC, from HELLOs
+ *   s_slots    frames being put back together, one buffer each
+ *   s_stats    the counters, published through s_stats_snap whenever they
+ *              change
+ *
+ * Times are tick milliseconds, compared with wrapping differences.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "frag.h"
+#include "espnow.h"
+#include "rate.h"
+#include "snapshot.h"
+
+static const char *TAG = "frag";
+
+#define HEADER_SIZE (sizeof(broadcast_header_t))
+
+_Static_assert(PAIRING_FRAME_MAX <= FRAG_FRAME_MAX, "every pairing frame must fit a fragment slot");
+
+typedef struct {
+    bool used;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t caps;
+    uint32_t heard_ms;
+} frag_peer_t;
+
+typedef struct {
+    bool used;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t frame_seq;
+    uint16_t frame_len;
+    uint8_t count;
+    uint8_t have;               /* bit per part */
+    uint32_t started_ms;
+    uint8_t frame[FRAG_FRAME_MAX];
+} frag_slot_t;
+
+/* espnow_task only */
+static frag_peer_t s_peers[FRAG_PEERS_MAX];
+static frag_slot_t s_slots[FRAG_SLOTS];
+static frag_stats_t s_stats;
+
+SNAPSHOT_DEFINE(s_stats_snap, frag_stats_t);
+
+static uint32_t get_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+static void publish(void)
+{
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+}
+
+static frag_peer_t *find_peer(const uint8_t *mac)
+{
+    for (int i = 0; i < FRAG_PEERS_MAX; i++) {
+        if (s_peers[i].used && memcmp(s_peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) return &s_peers[i];
+    }
+    return NULL;
+}
+
+void frag_set_peer_caps(const uint8_t *mac, uint8_t caps)
+{
+    if (mac == NULL) return;
+
+    uint32_t now = get_time_ms();
+    frag_peer_t *p = find_peer(mac);
+
+    if (p == NULL) {
+        p = &s_peers[0];
+        for (int i = 0; i < FRAG_PEERS_MAX && p->used; i++) {
+            if (!s_peers[i].used || (int32_t)(s_peers[i].heard_ms - p->heard_ms) < 0) p = &s_peers[i];
+        }
+        if (p->used) {
+            if (p->caps & PAIRING_CAP_V2) s_stats.peers_v2--;
+        } else {
+            s_stats.peers++;
+        }
+        p->used = true;
+        memcpy(p->mac, mac, ESP_NOW_ETH_ALEN);
+        p->caps = 0;
+    }
+
+    if ((p->caps ^ caps) & PAIRING_CAP_V2) {
+        if (caps & PAIRING_CAP_V2) s_stats.peers_v2++;
+        else s_stats.peers_v2--;
+        ESP_LOGD(TAG, MACSTR " takes %s frames", MAC2STR(mac), (caps & PAIRING_CAP_V2) ? "v2" : "v1");
+        publish();
+    }
+    p->caps = caps;
+    p->heard_ms = now;
+}
+
+static size_t frame_max(const uint8_t *mac)
+{
+    if (!(s_stats.caps & PAIRING_CAP_V2) || IS_BROADCAST_ADDR(mac)) return FRAG_V1_LEN;
+
+    const frag_peer_t *p = find_peer(mac);
+    return p != NULL && (p->caps & PAIRING_CAP_V2) ? FRAG_V2_LEN : FRAG_V1_LEN;
+}
+
+int frag_frames_for(const uint8_t *mac, size_t len)
+{
+    if (mac == NULL || len <= frame_max(mac)) return 1;
+    return (int)((len + FRAG_PART_LEN - 1) / FRAG_PART_LEN);
+}
+
+esp_err_t frag_send(pairing_ctx_t *ctx, const uint8_t *mac, const uint8_t *frame, size_t len)
+{
+    if (ctx == NULL || mac == NULL || frame == NULL || len < HEADER_SIZE) return ESP_ERR_INVALID_ARG;
+
+    if (len <= frame_max(mac)) {
+        esp_err_t err = esp_now_send(mac, frame, len);
+        if (err == ESP_OK) rate_note_send(mac);
+        if (err == ESP_OK && len > FRAG_V1_LEN) {
+            s_stats.tx_whole++;
+            publish();
+        }
+        return err;
+    }
+    if (len > FRAG_FRAME_MAX) return ESP_ERR_INVALID_SIZE;
+
+    uint8_t buf[FRAG_V1_LEN];
+    broadcast_header_t *hdr = (broadcast_header_t *)buf;
+    frag_hdr_t *fh = (frag_hdr_t *)(buf + HEADER_SIZE);
+    int count = frag_frames_for(mac, len);
+
+    /* uptime, state and power as the frame was stamped, so it reads the same in every part */
+    memcpy(hdr, frame, HEADER_SIZE);
+    hdr->msg_type = MSG_FRAGMENT;
+    hdr->bitmask_len = 0;
+    fh->frame_seq = ((const broadcast_header_t *)frame)->seq_num;
+    fh->frame_len = (uint16_t)len;
+    fh->count = (uint8_t)count;
+
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < count && err == ESP_OK; i++) {
+        size_t off = (size_t)i * FRAG_PART_LEN;
+        size_t part = len - off < FRAG_PART_LEN ? len - off : FRAG_PART_LEN;
+
+        hdr->seq_num = ++ctx->tx_seq;
+        fh->index = (uint8_t)i;
+        memcpy(buf + HEADER_SIZE + sizeof(frag_hdr_t), frame + off, part);
+        err = esp_now_send(mac, buf, HEADER_SIZE + sizeof(frag_hdr_t) + part);
+        if (err == ESP_OK) {
+            rate_note_send(mac);
+            s_stats.tx_parts++;
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "Part to " MACSTR " failed: %s", MAC2STR(mac), esp_err_to_name(err));
+    }
+
+    s_stats.tx_split++;
+    publish();
+    return err;
+}
+
+static frag_slot_t *slot_for(const uint8_t *mac, uint32_t frame_seq, uint32_t now)
+{
+    frag_slot_t *oldest = &s_slots[0];
+
+    for (int i = 0; i < FRAG_SLOTS; i++) {
+        frag_slot_t *s = &s_slots[i];
+        if (s->used && s->frame_seq == frame_seq && memcmp(s->mac, mac, ESP_NOW_ETH_ALEN) == 0) return s;
+    }
+
+    for (int i = 0; i < FRAG_SLOTS; i++) {
+        frag_slot_t *s = &s_slots[i];
+        if (s->used && now - s->started_ms >= FRAG_TIMEOUT_MS) {
+            s->used = false;
+            s_stats.rx_expired++;
+        }
+        if (!oldest->used) continue;
+        if (!s->used || (int32_t)(s->started_ms - oldest->started_ms) < 0) oldest = s;
+    }
+
+    /* all busy and none stale: the oldest has had the most time to finish */
+    if (oldest->used) s_stats.rx_expired++;
+
+    oldest->used = true;
+    memcpy(oldest->mac, mac, ESP_NOW_ETH_ALEN);
+    oldest->frame_seq = frame_seq;
+    oldest->have = 0;
+    oldest->started_ms = now;
+    return oldest;
+}
+
+bool frag_handle_recv(const uint8_t *mac, const uint8_t **data, int *len)
+{
+    if (mac == NULL || data == NULL || *data == NULL || len == NULL) return false;
+    if (*len < (int)HEADER_SIZE) return true;
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)*data;
+    if (hdr->msg_type != MSG_FRAGMENT) return true;
+
+    s_stats.rx_parts++;
+
+    frag_hdr_t fh;
+    int part = *len - (int)(HEADER_SIZE + sizeof(fh));
+    if (part <= 0) {
+        s_stats.rx_bad++;
+        publish();
+        return false;
+    }
+    memcpy(&fh, *data + HEADER_SIZE, sizeof(fh));
+
+    size_t off = (size_t)fh.index * FRAG_PART_LEN;
+    size_t want = fh.frame_len - off < FRAG_PART_LEN ? fh.frame_len - off : FRAG_PART_LEN;
+    bool sane = fh.frame_len > FRAG_V1_LEN && fh.frame_len <= FRAG_FRAME_MAX &&
+                fh.count == (fh.frame_len + FRAG_PART_LEN - 1) / FRAG_PART_LEN &&
+                fh.count <= FRAG_PARTS_MAX && fh.index < fh.count && (size_t)part == want;
+    if (!sane) {
+        s_stats.rx_bad++;
+        publish();
+        return false;
+    }
+
+    frag_slot_t *s = slot_for(mac, fh.frame_seq, get_time_ms());
+    if (s->have == 0) {
+        s->frame_len = fh.frame_len;
+        s->count = fh.count;
+    } else if (s->frame_len != fh.frame_len) {
+        s->used = false;
+        s_stats.rx_bad++;
+        publish();
+        return false;
+    }
+
+    memcpy(s->frame + off, *data + HEADER_SIZE + sizeof(fh), want);
+    s->have |= 1u << fh.index;
+    if (s->have != (1u << s->count) - 1) {
+        publish();
+        return false;
+    }
+
+    s->used = false;
+    const broadcast_header_t *inner = (const broadcast_header_t *)s->frame;
+    if (inner->protocol_id != PAIRING_PROTOCOL_ID || inner->msg_type == MSG_FRAGMENT ||
+        inner->seq_num != fh.frame_seq) {
+        s_stats.rx_bad++;
+        publish();
+        return false;
+    }
+
+    s_stats.rx_joined++;
+    publish();
+    *data = s->frame;
+    *len = s->frame_len;
+    return true;
+}
+
+uint8_t frag_local_caps(void)
+{
+    return s_stats.caps;
+}
+
+esp_err_t frag_init(void)
+{
+    uint32_t version = 1;
+
+#if CONFIG_ESPNOW_V2_FRAMES
+    esp_err_t err = esp_now_get_version(&version);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "ESP-NOW version unknown (%s), sending v1 frames", esp_err_to_name(err));
+        version = 1;
+    }
+#endif
+    s_stats.caps = version >= 2 ? PAIRING_CAP_V2 : 0;
+    publish();
+
+    ESP_LOGI(TAG, "Initialized (ESP-NOW v%lu, %d byte fragments)", (unsigned long)version, (int)FRAG_PART_LEN);
+    return ESP_OK;
+}
+
+void frag_get_stats(frag_stats_t *out)
+{
+    SNAPSHOT_READ(s_stats_snap, out);
+}
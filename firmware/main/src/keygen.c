@@ -3,6 +3,7 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/error.h"
 #include "keygen.h"
+#include "mem.h"
 #include <string.h>
 #include "esp_log.h"
 #include "nvs.h"
@@ -46,8 +47,8 @@ int generate_rsa_keypair(rsa_key_pair_t *out_keys)
         goto cleanup;
     }
 
-    out_keys->public_key_pem = calloc(1, KEY_BUFFER_SIZE);
-    out_keys->private_key_pem = calloc(1, KEY_BUFFER_SIZE);
+    out_keys->public_key_pem = mem_calloc(MEM_TAG_KEYGEN, 1, KEY_BUFFER_SIZE);
+    out_keys->private_key_pem = mem_calloc(MEM_TAG_KEYGEN, 1, KEY_BUFFER_SIZE);
 
     if (!out_keys->public_key_pem || !out_keys->private_key_pem) {
         ESP_LOGE(TAG, "Failed to allocate memory for keys");
@@ -73,8 +74,8 @@ cleanup:
     mbedtls_entropy_free(&entropy);
 
     if (ret != 0) {
-        if (out_keys->public_key_pem) free(out_keys->public_key_pem);
-        if (out_keys->private_key_pem) free(out_keys->private_key_pem);
+        mem_free(out_keys->public_key_pem);
+        mem_free(out_keys->private_key_pem);
         out_keys->public_key_pem = NULL;
         out_keys->private_key_pem = NULL;
         return -1;
@@ -112,8 +113,8 @@ static int load_keypair_from_nvs(rsa_key_pair_t *out_keys)
     }
 
     /* Allocate and read */
-    out_keys->public_key_pem = calloc(1, pub_len);
-    out_keys->private_key_pem = calloc(1, priv_len);
+    out_keys->public_key_pem = mem_calloc(MEM_TAG_KEYGEN, 1, pub_len);
+    out_keys->private_key_pem = mem_calloc(MEM_TAG_KEYGEN, 1, priv_len);
 
     if (!out_keys->public_key_pem || !out_keys->private_key_pem) {
         ESP_LOGE(TAG, "Failed to allocate memory for keys from NVS");
@@ -136,8 +137,8 @@ static int load_keypair_from_nvs(rsa_key_pair_t *out_keys)
     return 0;
 
 nvs_load_error:
-    if (out_keys->public_key_pem) free(out_keys->public_key_pem);
-    if (out_keys->private_key_pem) free(out_keys->private_key_pem);
+    mem_free(out_keys->public_key_pem);
+    mem_free(out_keys->private_key_pem);
     out_keys->public_key_pem = NULL;
     out_keys->private_key_pem = NULL;
     nvs_close(handle);
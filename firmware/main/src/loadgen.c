@@ -0,0 +1,543 @@
+/*
+ * loadgen.c - one badge speaking for many, to load another one's receive path
+ *
+ * State, all on espnow_task except where noted:
+ *
+ *   s_ids      the identities: pairing state, partner, sequence numbers
+ *              and bitmask each
+ *   s_cfg      the run's configuration, s_running while it lasts
+ *   s_credit   frames owed at the configured rate, in thousandths
+ *   s_stats    the counters, published through s_stats_snap every tick
+ *   s_rx_queue what the promiscuous callback (Wi-Fi task) heard for an
+ *              identity; s_rx_body and s_rx_dropped are that callback's,
+ *              s_listen_ids what it filters with
+ *
+ * Times are tick milliseconds, compared with wrapping differences.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "esp_random.h"
+#include "loadgen.h"
+#include "sniffer.h"
+#include "espnow.h"
+#include "pairing.h"
+#include "frag.h"
+#include "ble_task.h"
+#include "snapshot.h"
+
+#if CONFIG_ESPNOW_LOADGEN
+
+static const char *TAG = "loadgen";
+
+#define HEADER_SIZE (sizeof(broadcast_header_t))
+
+/* enough of a frame to tell what it is, through the first fragment's header */
+#define LOADGEN_RX_KEEP     (HEADER_SIZE + sizeof(frag_hdr_t) + HEADER_SIZE)
+#define LOADGEN_KEY_LEN     24
+#define LOADGEN_FRAME_MAX   (SNIFFER_BODY_AT + SNIFFER_ELEMENT_HDR_LEN + ESP_NOW_MAX_DATA_LEN)
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    BROADCAST_STATE state;
+    uint8_t partner[ESP_NOW_ETH_ALEN];
+    int8_t partner_rssi;
+    uint32_t tx_seq;
+    bool heard;                 /* rx_src and rx_seq are set */
+    uint8_t rx_src[ESP_NOW_ETH_ALEN];
+    uint32_t rx_seq;            /* the driver retries unACKed unicasts with the same one */
+    uint32_t proposed_ms;
+    uint32_t heartbeat_sent_ms;
+    uint32_t heard_ms;          /* partner, last frame */
+    uint8_t bitmask[LOADGEN_BITS_MAX / 8];
+} loadgen_identity_t;
+
+typedef struct {
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t index;
+    int8_t rssi;
+    uint8_t len;
+    uint8_t data[LOADGEN_RX_KEEP];
+} loadgen_rx_t;
+
+/* espnow_task only */
+static loadgen_identity_t s_ids[LOADGEN_IDENTITIES_MAX];
+static loadgen_config_t s_cfg;
+static bool s_running;
+static uint16_t s_bitmask_len;
+static int8_t s_tx_q;
+static uint32_t s_started_ms;
+static uint32_t s_last_ms;
+static uint32_t s_credit;
+static uint32_t s_accept_sum_ms;
+static uint32_t s_accepts;
+static loadgen_stats_t s_stats;
+
+SNAPSHOT_DEFINE(s_stats_snap, loadgen_stats_t);
+
+static QueueHandle_t s_rx_queue;
+static uint8_t s_prefix[ESP_NOW_ETH_ALEN - 1];
+static atomic_uint s_listen_ids;
+static atomic_uint s_rx_dropped;
+
+/* Wi-Fi task only */
+static uint8_t s_rx_body[ESP_NOW_MAX_DATA_LEN_V2];
+
+static const uint8_t s_broadcast[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint8_t s_espressif_oui[3] = { SNIFFER_ESPRESSIF_OUI };
+
+static const char *const s_script_names[] = { "accept", "reject", "ignore" };
+
+static uint32_t get_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+static void publish(uint32_t now)
+{
+    s_stats.running = s_running;
+    if (s_running) s_stats.elapsed_ms = now - s_started_ms;
+    s_stats.accept_ms = s_accepts > 0 ? s_accept_sum_ms / s_accepts : 0;
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+}
+
+static void promiscuous_cb(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+    if (type != WIFI_PKT_MGMT) return;
+
+    const wifi_promiscuous_pkt_t *pkt = buf;
+    const uint8_t *src, *dst;
+    int len = sniffer_espnow_body(pkt, &src, &dst, s_rx_body, sizeof(s_rx_body));
+    if (len <= 0 || memcmp(dst, s_prefix, sizeof(s_prefix)) != 0) return;
+    if (dst[ESP_NOW_ETH_ALEN - 1] >= atomic_load_explicit(&s_listen_ids, memory_order_relaxed)) return;
+
+    loadgen_rx_t rx = {
+        .index = dst[ESP_NOW_ETH_ALEN - 1],
+        .rssi = pkt->rx_ctrl.rssi,
+        .len = len < (int)LOADGEN_RX_KEEP ? (uint8_t)len : LOADGEN_RX_KEEP,
+    };
+    memcpy(rx.src, src, ESP_NOW_ETH_ALEN);
+    memcpy(rx.data, s_rx_body, rx.len);
+
+    if (xQueueSend(s_rx_queue, &rx, 0) != pdTRUE) {
+        atomic_fetch_add_explicit(&s_rx_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    espnow_wake();
+}
+
+/* the action frame esp_now_send() would have put on the air, from the identity */
+static void send_frame(loadgen_identity_t *id, const uint8_t *dst, const uint8_t *body, size_t len)
+{
+    uint8_t frame[LOADGEN_FRAME_MAX];
+    uint32_t random = esp_random();
+    size_t at = 0;
+
+    memset(frame, 0, SNIFFER_MAC_HDR_LEN);
+    frame[0] = SNIFFER_FC_ACTION;
+    memcpy(frame + SNIFFER_DST_AT, dst, ESP_NOW_ETH_ALEN);
+    memcpy(frame + SNIFFER_SRC_AT, id->mac, ESP_NOW_ETH_ALEN);
+    memcpy(frame + SNIFFER_BSSID_AT, s_broadcast, ESP_NOW_ETH_ALEN);
+    at = SNIFFER_MAC_HDR_LEN;
+
+    frame[at++] = SNIFFER_CATEGORY_VENDOR;
+    memcpy(frame + at, s_espressif_oui, sizeof(s_espressif_oui));
+    at += sizeof(s_espressif_oui);
+    memcpy(frame + at, &random, sizeof(random));
+    at += sizeof(random);
+
+    frame[at++] = SNIFFER_ELEMENT_VENDOR;
+    frame[at++] = (uint8_t)(len + SNIFFER_ELEMENT_HDR_LEN - 2);
+    memcpy(frame + at, s_espressif_oui, sizeof(s_espressif_oui));
+    at += sizeof(s_espressif_oui);
+    frame[at++] = SNIFFER_ESPNOW_TYPE;
+    frame[at++] = 1;            /* version */
+    memcpy(frame + at, body, len);
+    at += len;
+
+    esp_err_t err = esp_wifi_80211_tx(ESPNOW_WIFI_IF, frame, (int)at, true);
+    if (err != ESP_OK) {
+        s_stats.tx_failed++;
+        ESP_LOGD(TAG, "TX from " MACSTR " failed: %s", MAC2STR(id->mac), esp_err_to_name(err));
+    }
+}
+
+static size_t fill_header(loadgen_identity_t *id, uint8_t *buf, uint8_t msg_type, uint16_t bitmask_len)
+{
+    broadcast_header_t *hdr = (broadcast_header_t *)buf;
+
+    memset(hdr, 0, HEADER_SIZE);
+    hdr->protocol_id = PAIRING_PROTOCOL_ID;
+    hdr->msg_type = msg_type;
+    memcpy(hdr->sender_mac, id->mac, ESP_NOW_ETH_ALEN);
+    if (id->state != SEARCHING) memcpy(hdr->partner_mac, id->partner, ESP_NOW_ETH_ALEN);
+    hdr->uptime_ms = get_time_ms();
+    hdr->state = id->state;
+    hdr->last_rssi = id->partner_rssi;
+    hdr->tx_power_q = s_tx_q;
+    hdr->seq_num = ++id->tx_seq;
+    hdr->bitmask_len = bitmask_len;
+
+    if (bitmask_len > 0) memcpy(buf + HEADER_SIZE, id->bitmask, bitmask_len);
+    return HEADER_SIZE + bitmask_len;
+}
+
+static void send_hello(loadgen_identity_t *id)
+{
+    uint8_t buf[HEADER_SIZE + LOADGEN_BITS_MAX / 8 + sizeof(uint32_t) + 1];
+    size_t len = fill_header(id, buf, MSG_HELLO, s_bitmask_len);
+
+    /* fw_version 0, caps 0 */
+    memset(buf + len, 0, sizeof(uint32_t) + 1);
+    len += sizeof(uint32_t) + 1;
+
+    send_frame(id, s_broadcast, buf, len);
+    s_stats.tx_hello++;
+}
+
+/* PROPOSAL or ACCEPT: bitmask and a stand-in for the public key */
+static void send_offer(loadgen_identity_t *id, const uint8_t *dst, uint8_t msg_type)
+{
+    uint8_t buf[HEADER_SIZE + LOADGEN_BITS_MAX / 8 + LOADGEN_KEY_LEN];
+    size_t len = fill_header(id, buf, msg_type, s_bitmask_len);
+
+    len += snprintf((char *)buf + len, LOADGEN_KEY_LEN, "LOADGEN-%02x%02x%02x",
+                    id->mac[3], id->mac[4], id->mac[5]) + 1;
+
+    send_frame(id, dst, buf, len);
+    if (msg_type == MSG_PROPOSAL) s_stats.tx_proposal++;
+    else s_stats.tx_accept++;
+}
+
+static void send_bare(loadgen_identity_t *id, const uint8_t *dst, uint8_t msg_type)
+{
+    uint8_t buf[HEADER_SIZE];
+
+    fill_header(id, buf, msg_type, 0);
+    send_frame(id, dst, buf, sizeof(buf));
+    if (msg_type == MSG_HEARTBEAT) s_stats.tx_heartbeat++;
+    else s_stats.tx_reject++;
+}
+
+static void pair(loadgen_identity_t *id, const uint8_t *partner, uint32_t now)
+{
+    id->state = PAIRED;
+    memcpy(id->partner, partner, ESP_NOW_ETH_ALEN);
+    id->partner_rssi = 0;
+    id->heartbeat_sent_ms = now;
+    id->heard_ms = now;
+    s_stats.paired++;
+    ESP_LOGD(TAG, MACSTR " paired with " MACSTR, MAC2STR(id->mac), MAC2STR(partner));
+}
+
+static void handle_proposal(loadgen_identity_t *id, const uint8_t *src, uint32_t now)
+{
+    s_stats.rx_proposal++;
+
+    /* the partner proposing again has forgotten us */
+    if (id->state == PAIRED && memcmp(id->partner, src, ESP_NOW_ETH_ALEN) == 0) id->state = SEARCHING;
+
+    if (id->state != SEARCHING) {
+        send_bare(id, src, MSG_REJECT);
+        return;
+    }
+
+    switch (s_cfg.script) {
+        case LOADGEN_ACCEPT:
+            pair(id, src, now);
+            send_offer(id, src, MSG_ACCEPT);
+            break;
+        case LOADGEN_REJECT:
+            send_bare(id, src, MSG_REJECT);
+            break;
+        default:
+            break;
+    }
+}
+
+static void handle_rx(const loadgen_rx_t *rx, uint32_t now)
+{
+    s_stats.rx++;
+    if (rx->len < HEADER_SIZE || rx->index >= s_cfg.identities) return;
+
+    loadgen_identity_t *id = &s_ids[rx->index];
+    const broadcast_header_t *hdr = (const broadcast_header_t *)rx->data;
+    if (hdr->protocol_id != PAIRING_PROTOCOL_ID) return;
+
+    if (id->heard && hdr->seq_num == id->rx_seq && memcmp(id->rx_src, rx->src, ESP_NOW_ETH_ALEN) == 0) return;
+    id->heard = true;
+    id->rx_seq = hdr->seq_num;
+    memcpy(id->rx_src, rx->src, ESP_NOW_ETH_ALEN);
+
+    uint8_t msg_type = hdr->msg_type;
+    if (msg_type == MSG_FRAGMENT) {
+        frag_hdr_t fh;
+        if (rx->len < LOADGEN_RX_KEEP) return;
+        memcpy(&fh, rx->data + HEADER_SIZE, sizeof(fh));
+        if (fh.index != 0) return;
+        msg_type = ((const broadcast_header_t *)(rx->data + HEADER_SIZE + sizeof(fh)))->msg_type;
+    }
+
+    bool from_partner = id->state != SEARCHING &&
+                        (memcmp(id->partner, rx->src, ESP_NOW_ETH_ALEN) == 0 ||
+                         (id->state == PROPOSING && memcmp(id->partner, s_broadcast, ESP_NOW_ETH_ALEN) == 0));
+
+    switch (msg_type) {
+        case MSG_PROPOSAL:
+            handle_proposal(id, rx->src, now);
+            break;
+        case MSG_ACCEPT:
+            s_stats.rx_accept++;
+            if (id->state == PROPOSING && from_partner) {
+                s_accept_sum_ms += now - id->proposed_ms;
+                s_accepts++;
+                pair(id, rx->src, now);
+            }
+            break;
+        case MSG_REJECT:
+            s_stats.rx_reject++;
+            if (id->state == PROPOSING && from_partner) id->state = SEARCHING;
+            break;
+        case MSG_HEARTBEAT:
+            s_stats.rx_heartbeat++;
+            if (id->state == PAIRED && from_partner) {
+                id->heard_ms = now;
+                id->partner_rssi = rx->rssi;
+            }
+            break;
+        case MSG_KEY_EXCHANGE:
+            s_stats.rx_kex++;
+            if (id->state == PAIRED && from_partner) id->heard_ms = now;
+            break;
+        default:
+            break;
+    }
+}
+
+static void send_drawn(uint32_t now)
+{
+    loadgen_identity_t *id = &s_ids[esp_random() % s_cfg.identities];
+    const uint8_t *dst = s_cfg.has_target ? s_cfg.target : s_broadcast;
+    uint32_t total = (uint32_t)s_cfg.mix_hello + s_cfg.mix_proposal + s_cfg.mix_heartbeat;
+    uint32_t pick = esp_random() % total;
+
+    if (pick < s_cfg.mix_hello) {
+        send_hello(id);
+    } else if (pick < (uint32_t)s_cfg.mix_hello + s_cfg.mix_proposal) {
+        if (id->state != SEARCHING) {
+            send_hello(id);
+            return;
+        }
+        id->state = PROPOSING;
+        memcpy(id->partner, dst, ESP_NOW_ETH_ALEN);
+        id->proposed_ms = now;
+        send_offer(id, dst, MSG_PROPOSAL);
+    } else {
+        send_bare(id, dst, MSG_HEARTBEAT);
+    }
+}
+
+/* proposals that timed out, partners that went quiet, heartbeats due; ms until the next one */
+static uint32_t tend_identities(uint32_t now)
+{
+    uint32_t wait = PAIRING_HEARTBEAT_MS;
+
+    for (int i = 0; i < s_cfg.identities; i++) {
+        loadgen_identity_t *id = &s_ids[i];
+
+        if (id->state == PROPOSING && now - id->proposed_ms >= PAIRING_TIMEOUT_MS) {
+            id->state = SEARCHING;
+        }
+        if (id->state != PAIRED) continue;
+
+        if (now - id->heard_ms >= PAIRING_HEARTBEAT_MS * PAIRING_HEARTBEAT_MISS_MAX) {
+            id->state = SEARCHING;
+            s_stats.lost++;
+            ESP_LOGD(TAG, MACSTR " lost " MACSTR, MAC2STR(id->mac), MAC2STR(id->partner));
+            continue;
+        }
+        if (now - id->heartbeat_sent_ms >= PAIRING_HEARTBEAT_MS) {
+            send_bare(id, id->partner, MSG_HEARTBEAT);
+            id->heartbeat_sent_ms = now;
+        }
+        uint32_t due = PAIRING_HEARTBEAT_MS - (now - id->heartbeat_sent_ms);
+        if (due < wait) wait = due;
+    }
+    return wait;
+}
+
+static void stop(uint32_t now)
+{
+    esp_wifi_set_promiscuous(false);
+    atomic_store_explicit(&s_listen_ids, 0, memory_order_relaxed);
+
+    s_stats.elapsed_ms = now - s_started_ms;
+    s_running = false;
+    publish(now);
+
+    loadgen_stats_t st;
+    loadgen_get_stats(&st);
+    ESP_LOGI(TAG, "Run over after %lu ms: %lu paired, %lu lost",
+             (unsigned long)st.elapsed_ms, (unsigned long)st.paired, (unsigned long)st.lost);
+
+    char msg[192];
+    snprintf(msg, sizeof(msg),
+             "LOAD_DONE:elapsed_ms=%lu,tx=%lu,tx_failed=%lu,rx=%lu,rx_dropped=%lu,paired=%lu,lost=%lu,accept_ms=%lu"
+             BLE_MESSAGE_DELIMITER_STR,
+             (unsigned long)st.elapsed_ms,
+             (unsigned long)(st.tx_hello + st.tx_proposal + st.tx_heartbeat + st.tx_accept + st.tx_reject),
+             (unsigned long)st.tx_failed, (unsigned long)st.rx, (unsigned long)st.rx_dropped,
+             (unsigned long)st.paired, (unsigned long)st.lost, (unsigned long)st.accept_ms);
+    ble_send_message(msg);
+}
+
+static bool config_valid(const loadgen_config_t *cfg)
+{
+    return cfg->identities > 0 && cfg->identities <= LOADGEN_IDENTITIES_MAX &&
+           cfg->rate > 0 && cfg->rate <= LOADGEN_RATE_MAX &&
+           cfg->mix_hello + cfg->mix_proposal + cfg->mix_heartbeat > 0 &&
+           cfg->script <= LOADGEN_IGNORE &&
+           cfg->bits > 0 && cfg->bits <= LOADGEN_BITS_MAX;
+}
+
+esp_err_t loadgen_start(const loadgen_config_t *cfg)
+{
+    uint32_t now = get_time_ms();
+
+    if (cfg == NULL) {
+        if (!s_running) return ESP_ERR_INVALID_STATE;
+        stop(now);
+        return ESP_OK;
+    }
+    if (!config_valid(cfg)) return ESP_ERR_INVALID_ARG;
+    if (s_running) stop(now);
+
+    /* queued for the run before, or before the one before */
+    xQueueReset(s_rx_queue);
+
+    s_cfg = *cfg;
+    s_bitmask_len = (cfg->bits + 7) / 8;
+    memset(s_ids, 0, sizeof(s_ids));
+    for (int i = 0; i < cfg->identities; i++) {
+        loadgen_identity_t *id = &s_ids[i];
+        memcpy(id->mac, s_prefix, sizeof(s_prefix));
+        id->mac[ESP_NOW_ETH_ALEN - 1] = (uint8_t)i;
+        id->state = SEARCHING;
+        for (int b = 0; b < s_bitmask_len; b++) id->bitmask[b] = (uint8_t)esp_random();
+        if (cfg->bits % 8) id->bitmask[s_bitmask_len - 1] &= (uint8_t)((1u << (cfg->bits % 8)) - 1);
+    }
+
+    if (esp_wifi_get_max_tx_power(&s_tx_q) != ESP_OK) s_tx_q = PAIRING_TX_REF_Q;
+
+    atomic_store_explicit(&s_listen_ids, cfg->identities, memory_order_relaxed);
+    wifi_promiscuous_filter_t filter = { .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT };
+    esp_err_t err = esp_wifi_set_promiscuous_filter(&filter);
+    if (err == ESP_OK) err = esp_wifi_set_promiscuous_rx_cb(promiscuous_cb);
+    if (err == ESP_OK) err = esp_wifi_set_promiscuous(true);
+    if (err != ESP_OK) {
+        atomic_store_explicit(&s_listen_ids, 0, memory_order_relaxed);
+        ESP_LOGE(TAG, "Promiscuous mode failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    atomic_store_explicit(&s_rx_dropped, 0, memory_order_relaxed);
+    s_stats.identities = cfg->identities;
+    s_stats.rate = cfg->rate;
+    s_accept_sum_ms = 0;
+    s_accepts = 0;
+    s_credit = 0;
+    s_started_ms = now;
+    s_last_ms = now;
+    s_running = true;
+    publish(now);
+
+    ESP_LOGI(TAG, "%u identities, %u frames/s (mix %u/%u/%u), script %s, %lu s, target " MACSTR,
+             cfg->identities, cfg->rate, cfg->mix_hello, cfg->mix_proposal, cfg->mix_heartbeat,
+             loadgen_script_name(cfg->script), (unsigned long)cfg->secs,
+             MAC2STR(cfg->has_target ? cfg->target : s_broadcast));
+    return ESP_OK;
+}
+
+bool loadgen_running(void)
+{
+    return s_running;
+}
+
+uint32_t loadgen_tick(void)
+{
+    if (!s_running) return UINT32_MAX;
+
+    uint32_t now = get_time_ms();
+    loadgen_rx_t rx;
+    while (xQueueReceive(s_rx_queue, &rx, 0) == pdTRUE) {
+        handle_rx(&rx, now);
+    }
+
+    uint32_t elapsed = now - s_started_ms;
+    if (s_cfg.secs > 0 && elapsed >= s_cfg.secs * 1000) {
+        stop(now);
+        return UINT32_MAX;
+    }
+
+    uint32_t wait = tend_identities(now);
+
+    /* behind by more than a burst (a long event, a slow tick): the rest is dropped, not caught up */
+    s_credit += (now - s_last_ms) * s_cfg.rate;
+    s_last_ms = now;
+    if (s_credit > LOADGEN_BURST_MAX * 1000) s_credit = LOADGEN_BURST_MAX * 1000;
+    for (int i = 0; i < LOADGEN_BURST_MAX && s_credit >= 1000; i++) {
+        send_drawn(now);
+        s_credit -= 1000;
+    }
+
+    uint32_t due = (1000 - s_credit + s_cfg.rate - 1) / s_cfg.rate;
+    if (due < wait) wait = due;
+    if (s_cfg.secs > 0 && s_cfg.secs * 1000 - elapsed < wait) wait = s_cfg.secs * 1000 - elapsed;
+
+    publish(now);
+    return wait;
+}
+
+esp_err_t loadgen_init(void)
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    esp_err_t err = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    if (err != ESP_OK) return err;
+
+    s_rx_queue = xQueueCreate(LOADGEN_RX_QUEUE, sizeof(loadgen_rx_t));
+    if (s_rx_queue == NULL) return ESP_ERR_NO_MEM;
+
+    s_prefix[0] = 0x02;         /* locally administered */
+    s_prefix[1] = 0x4c;
+    s_prefix[2] = 0x47;
+    s_prefix[3] = mac[4];
+    s_prefix[4] = mac[5];
+    publish(get_time_ms());
+
+    ESP_LOGI(TAG, "Initialized, identities %02x:%02x:%02x:%02x:%02x:00 and up",
+             s_prefix[0], s_prefix[1], s_prefix[2], s_prefix[3], s_prefix[4]);
+    return ESP_OK;
+}
+
+void loadgen_get_stats(loadgen_stats_t *out)
+{
+    if (out == NULL) return;
+    SNAPSHOT_READ(s_stats_snap, out);
+    out->rx_dropped = atomic_load_explicit(&s_rx_dropped, memory_order_relaxed);
+}
+
+const char *loadgen_script_name(loadgen_script_t script)
+{
+    return (unsigned)script < sizeof(s_script_names) / sizeof(s_script_names[0]) ? s_script_names[script] : "?";
+}
+
+#endif /* CONFIG_ESPNOW_LOADGEN */
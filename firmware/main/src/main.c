@@ -26,6 +26,10 @@
 #include "hnr26_badge.h"
 #include "proximity.h"
 #include "monitor.h"
+#include "thermal.h"
+#include "mem.h"
+#include "assets.h"
+#include "reactor.h"
 #include "nfc.h"
 #include "nfc_pair.h"
 
@@ -166,6 +170,9 @@ void app_main(void)
 {
     esp_err_t ret;
     
+    // before anything allocates, so every tagged block is counted under the lock
+    mem_init();
+    
     // === Power on NFC ===
     gpio_config_t pwr_cfg = {
         .pin_bit_mask = (1ULL << NFC_PWR_PIN),
@@ -184,7 +191,14 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
     
+    // before proximity, espnow and ble look up their tables; they fall back
+    // to the built-in ones without it, so a failure is only logged
+    assets_init();
+    
     // === Initialize peripherals ===
+    // buzzer, proximity and monitor run as timers on the reactor task
+    ESP_ERROR_CHECK(reactor_init());
+    
     buzzer_config_t buzz_cfg = {
         .gpio_num = 3,
         .frequency = 2700,
@@ -207,6 +221,12 @@ void app_main(void)
         return;
     }
     
+    // after wifi, espnow and ble: it adjusts all three
+    ret = thermal_init();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Thermal governor not running: %s", esp_err_to_name(ret));
+    }
+    
     // Set BLE callbacks
     ble_set_connection_callback(ble_connection_callback, NULL);
     ble_set_auth_callback(ble_auth_callback, NULL);
@@ -226,4 +246,7 @@ void app_main(void)
     
     ESP_LOGI(TAG, "=== Ready ===");
     ESP_LOGI(TAG, "Tap phone on NFC tag to pair via BLE");
+    
+    // everything is up; log the RAM budget and count heap use from here on
+    mem_seal();
 }
@@ -5,7 +5,7 @@
  * Demonstrates:
  * - Buzzer initialization with mute support
  * - Button task monitoring P1_4 for 1-second hold
- * - Mute toggle via queue notification
+ * - Mute toggle via long press callback
  */
 
 #include <stdio.h>
@@ -14,6 +14,7 @@
 #include "esp_log.h"
 
 #include "hnr26_badge.h"
+#include "reactor.h"
 #include "buzzer.h"
 #include "button_task.h"
 
@@ -25,12 +26,21 @@ extern i2c_master_bus_handle_t hnr26_badge_bus_handle;
 /* AW9523 device handle - we'll need to get this or create our own */
 static aw9523_t s_gpio_expander;
 
+/* runs on the reactor */
+static void on_long_press(void *arg)
+{
+    buzzer_toggle_mute();
+}
+
 void app_main(void)
 {
     esp_err_t ret;
     
     ESP_LOGI(TAG, "=== Buzzer Mute Toggle Example ===");
     
+    /* buzzer patterns and button polling run on the reactor */
+    reactor_init();
+    
     /* ========================================
      * 1. Initialize badge (GPIO expander + I2C)
      * ======================================== */
@@ -65,14 +75,16 @@ void app_main(void)
      * 3. Initialize button task
      *    - Monitors P1_4 (pin 12)
      *    - 1 second hold triggers toggle
-     *    - Sends to buzzer's toggle queue
+     *    - Toggles the buzzer mute from the reactor
      * ======================================== */
     button_task_config_t btn_cfg = {
         .gpio_expander = &s_gpio_expander,
         .button_pin = 12,                        /* P1_4 = pin 12 */
         .long_press_ms = 1000,                   /* 1 second hold */
         .poll_interval_ms = 20,                  /* 20ms polling */
-        .notify_queue = buzzer_get_toggle_queue() /* Direct to buzzer */
+        .notify_queue = NULL,
+        .callback = on_long_press,               /* Direct to buzzer */
+        .cb_arg = NULL
     };
     
     ret = button_task_init(&btn_cfg);
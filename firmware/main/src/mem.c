@@ -0,0 +1,415 @@
+/*
+ * mem.c - tagged allocations, static pools and the heap sample history
+ *
+ * State: s_stats, s_history and, without CONFIG_ESPNOW_STATIC_MEM, the heap
+ * itself are shared by every task that allocates, and s_lock guards them;
+ * the sample timer skips a sample rather than wait for it. With static
+ * pools the free lists sit under the same lock. The post-init counters are
+ * written from the heap hooks, on any task, under s_hook_mux.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "mem.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#endif
+
+#if MEM_STATIC
+#include "esp_now.h"
+#include "pairing.h"
+#include "keygen.h"
+#endif
+
+static const char *TAG = "mem";
+
+#define MEM_MAGIC   0xA110
+
+typedef struct {
+    uint16_t magic;             /* MEM_MAGIC while allocated, 0 once freed */
+    uint8_t tag;
+    uint8_t reserved;
+    uint32_t size;
+} mem_header_t;
+
+static const char *TAG_NAMES[MEM_TAG_MAX] = {
+    [MEM_TAG_ESPNOW_RX] = "espnow_rx",
+    [MEM_TAG_ESPNOW_CFG] = "espnow_cfg",
+    [MEM_TAG_PAIRING] = "pairing",
+    [MEM_TAG_BLE_RX] = "ble_rx",
+    [MEM_TAG_BLE_CMD] = "ble_cmd",
+    [MEM_TAG_KEYGEN] = "keygen",
+};
+
+static SemaphoreHandle_t s_lock;
+static mem_tag_stats_t s_stats[MEM_TAG_MAX];
+static mem_sample_t s_history[MEM_HISTORY_LEN];
+static uint32_t s_history_count;
+static uint32_t s_history_next;
+static mem_budget_t s_budget;
+
+#if MEM_STATIC
+
+/*
+ * The static memory plan: one pool of fixed-size blocks per tag. Block
+ * sizes follow the largest request each caller can make; counts come from
+ * Kconfig. Blocks are 8-byte aligned and keep the usual header, a free
+ * block holds the next free block where its payload would be.
+ */
+#define MEM_ALIGN(n)            (((n) + 7u) & ~7u)
+#define MEM_STRIDE(size)        (sizeof(mem_header_t) + MEM_ALIGN(size))
+
+#define RX_BLOCK_SIZE           CONFIG_ESPNOW_STATIC_RX_FRAME_MAX
+#define CFG_BLOCK_SIZE          PAIRING_BITMASK_MAX_LEN         /* BITMASK event copy */
+#define PAIRING_BLOCK_SIZE      PAIRING_BITMASK_MAX_LEN         /* own and partner bitmask */
+#define BLE_RX_BLOCK_SIZE       CONFIG_ESPNOW_STATIC_BLE_WRITE_MAX
+#define BLE_CMD_BLOCK_SIZE      (PAIRING_BITMASK_MAX_LEN * 2 + 1)   /* BITMASK hex + NUL */
+#define KEYGEN_BLOCK_SIZE       KEY_BUFFER_SIZE
+
+_Static_assert(sizeof(esp_now_peer_info_t) <= CFG_BLOCK_SIZE, "espnow_init peer info must fit a cfg block");
+_Static_assert(RX_BLOCK_SIZE >= PAIRING_FRAME_MAX, "ESPNOW_STATIC_RX_FRAME_MAX must hold a KEY_EXCHANGE");
+
+#define ARENA_SIZE ( \
+    MEM_STRIDE(RX_BLOCK_SIZE) * CONFIG_ESPNOW_STATIC_RX_BLOCKS + \
+    MEM_STRIDE(CFG_BLOCK_SIZE) * CONFIG_ESPNOW_STATIC_CFG_BLOCKS + \
+    MEM_STRIDE(PAIRING_BLOCK_SIZE) * CONFIG_ESPNOW_STATIC_PAIRING_BLOCKS + \
+    MEM_STRIDE(BLE_RX_BLOCK_SIZE) * CONFIG_ESPNOW_STATIC_BLE_RX_BLOCKS + \
+    MEM_STRIDE(BLE_CMD_BLOCK_SIZE) * CONFIG_ESPNOW_STATIC_BLE_CMD_BLOCKS + \
+    MEM_STRIDE(KEYGEN_BLOCK_SIZE) * CONFIG_ESPNOW_STATIC_KEYGEN_BLOCKS)
+
+typedef struct {
+    uint32_t block_size;
+    uint32_t blocks;
+} mem_pool_cfg_t;
+
+static const mem_pool_cfg_t POOLS[MEM_TAG_MAX] = {
+    [MEM_TAG_ESPNOW_RX] = { RX_BLOCK_SIZE, CONFIG_ESPNOW_STATIC_RX_BLOCKS },
+    [MEM_TAG_ESPNOW_CFG] = { CFG_BLOCK_SIZE, CONFIG_ESPNOW_STATIC_CFG_BLOCKS },
+    [MEM_TAG_PAIRING] = { PAIRING_BLOCK_SIZE, CONFIG_ESPNOW_STATIC_PAIRING_BLOCKS },
+    [MEM_TAG_BLE_RX] = { BLE_RX_BLOCK_SIZE, CONFIG_ESPNOW_STATIC_BLE_RX_BLOCKS },
+    [MEM_TAG_BLE_CMD] = { BLE_CMD_BLOCK_SIZE, CONFIG_ESPNOW_STATIC_BLE_CMD_BLOCKS },
+    [MEM_TAG_KEYGEN] = { KEYGEN_BLOCK_SIZE, CONFIG_ESPNOW_STATIC_KEYGEN_BLOCKS },
+};
+
+static uint8_t s_arena[ARENA_SIZE] __attribute__((aligned(8)));
+static mem_header_t *s_free_list[MEM_TAG_MAX];
+
+static void carve_pools(void)
+{
+    uint8_t *p = s_arena;
+
+    for (int tag = 0; tag < MEM_TAG_MAX; tag++) {
+        for (uint32_t i = 0; i < POOLS[tag].blocks; i++) {
+            mem_header_t *hdr = (mem_header_t *)p;
+            hdr->magic = 0;
+            hdr->tag = tag;
+            *(mem_header_t **)(hdr + 1) = s_free_list[tag];
+            s_free_list[tag] = hdr;
+            p += MEM_STRIDE(POOLS[tag].block_size);
+        }
+    }
+    s_budget.arena_bytes = sizeof(s_arena);
+}
+
+static mem_header_t *block_get(mem_tag_t tag, size_t size)
+{
+    mem_header_t *hdr = s_free_list[tag];
+    if (hdr == NULL || size > POOLS[tag].block_size) return NULL;
+    s_free_list[tag] = *(mem_header_t **)(hdr + 1);
+    return hdr;
+}
+
+static bool block_put(mem_header_t *hdr)
+{
+    if ((uint8_t *)hdr < s_arena || (uint8_t *)hdr >= s_arena + sizeof(s_arena)) return false;
+    *(mem_header_t **)(hdr + 1) = s_free_list[hdr->tag];
+    s_free_list[hdr->tag] = hdr;
+    return true;
+}
+
+#endif /* MEM_STATIC */
+
+#if CONFIG_HEAP_USE_HOOKS
+
+/*
+ * heap_caps calls this after every successful allocation. It can run in any
+ * task, so it only counts under a spinlock: no logging, no allocation.
+ */
+static portMUX_TYPE s_hook_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool s_sealed;
+static mem_task_allocs_t s_post_init[MEM_POST_INIT_TASKS];
+static uint32_t s_post_init_count;
+static uint32_t s_post_init_logged;
+
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (!s_sealed || xPortInIsrContext()) return;
+
+    const char *name = pcTaskGetName(NULL);
+
+    portENTER_CRITICAL(&s_hook_mux);
+    s_budget.post_init_allocs++;
+    s_budget.post_init_bytes += size;
+
+    uint32_t i;
+    for (i = 0; i < s_post_init_count; i++) {
+        if (strncmp(s_post_init[i].task, name, sizeof(s_post_init[i].task) - 1) == 0) break;
+    }
+    if (i == s_post_init_count && i < MEM_POST_INIT_TASKS) {
+        strncpy(s_post_init[i].task, name, sizeof(s_post_init[i].task) - 1);
+        s_post_init_count++;
+    }
+    if (i < s_post_init_count) {
+        s_post_init[i].allocs++;
+        s_post_init[i].bytes += size;
+    }
+    portEXIT_CRITICAL(&s_hook_mux);
+}
+
+/* heap_caps needs both hooks once CONFIG_HEAP_USE_HOOKS is set */
+void IRAM_ATTR esp_heap_trace_free_hook(void *ptr)
+{
+}
+
+/* from the sample timer, where logging is safe */
+static void log_new_post_init_tasks(void)
+{
+    while (s_post_init_logged < s_post_init_count) {
+        const mem_task_allocs_t *t = &s_post_init[s_post_init_logged++];
+        ESP_LOGW(TAG, "Heap allocation after init from task \"%s\"", t->task);
+    }
+}
+
+#endif /* CONFIG_HEAP_USE_HOOKS */
+
+static void lock(void)
+{
+    if (s_lock != NULL) xSemaphoreTake(s_lock, portMAX_DELAY);
+}
+
+static void unlock(void)
+{
+    if (s_lock != NULL) xSemaphoreGive(s_lock);
+}
+
+static void *tagged_alloc(mem_tag_t tag, size_t size, bool zero)
+{
+    if (tag >= MEM_TAG_MAX) tag = MEM_TAG_ESPNOW_CFG;
+
+    mem_header_t *hdr = NULL;
+#if !MEM_STATIC
+    if (size <= UINT32_MAX - sizeof(mem_header_t)) {
+        hdr = zero ? calloc(1, sizeof(mem_header_t) + size) : malloc(sizeof(mem_header_t) + size);
+    }
+#endif
+
+    lock();
+#if MEM_STATIC
+    hdr = block_get(tag, size);
+#endif
+    mem_tag_stats_t *st = &s_stats[tag];
+    if (hdr == NULL) {
+        st->failed++;
+    } else {
+        st->live++;
+        st->total++;
+        st->bytes += size;
+        if (st->bytes > st->peak_bytes) st->peak_bytes = st->bytes;
+    }
+    unlock();
+
+    if (hdr == NULL) {
+        ESP_LOGE(TAG, "%s: %u bytes failed", TAG_NAMES[tag], (unsigned)size);
+        return NULL;
+    }
+
+#if MEM_STATIC
+    if (zero) memset(hdr + 1, 0, size);
+#endif
+    hdr->magic = MEM_MAGIC;
+    hdr->tag = tag;
+    hdr->reserved = 0;
+    hdr->size = size;
+    return hdr + 1;
+}
+
+void *mem_malloc(mem_tag_t tag, size_t size)
+{
+    return tagged_alloc(tag, size, false);
+}
+
+void *mem_calloc(mem_tag_t tag, size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size) return NULL;
+    return tagged_alloc(tag, count * size, true);
+}
+
+void mem_free(void *ptr)
+{
+    if (ptr == NULL) return;
+
+    mem_header_t *hdr = (mem_header_t *)ptr - 1;
+    if (hdr->magic != MEM_MAGIC || hdr->tag >= MEM_TAG_MAX) {
+        /* leaking is safer than handing the allocator a bad pointer */
+        ESP_LOGE(TAG, "Free of %p: not a mem_malloc block or already freed", ptr);
+        return;
+    }
+
+    lock();
+    mem_tag_stats_t *st = &s_stats[hdr->tag];
+    st->live--;
+    st->bytes -= hdr->size;
+    hdr->magic = 0;
+#if MEM_STATIC
+    bool ours = block_put(hdr);
+#endif
+    unlock();
+
+#if MEM_STATIC
+    if (!ours) ESP_LOGE(TAG, "Free of %p: outside the static arena", ptr);
+#else
+    free(hdr);
+#endif
+}
+
+const char *mem_tag_name(mem_tag_t tag)
+{
+    return tag < MEM_TAG_MAX ? TAG_NAMES[tag] : "?";
+}
+
+void mem_get_tag_stats(mem_tag_t tag, mem_tag_stats_t *out)
+{
+    if (out == NULL) return;
+    if (tag >= MEM_TAG_MAX) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    lock();
+    *out = s_stats[tag];
+    unlock();
+}
+
+void mem_sample(mem_sample_t *out)
+{
+    if (out == NULL) return;
+    memset(out, 0, sizeof(*out));
+    out->t_ms = (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+#if !CONFIG_IDF_TARGET_LINUX
+    out->free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    out->min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    out->largest_free = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#endif
+    /* word reads, no lock: the timer task must not block */
+    for (int i = 0; i < MEM_TAG_MAX; i++) {
+        out->tagged_bytes += s_stats[i].bytes;
+    }
+}
+
+uint32_t mem_get_history(mem_sample_t *out, uint32_t max)
+{
+    if (out == NULL) return 0;
+
+    lock();
+    uint32_t n = s_history_count < max ? s_history_count : max;
+    uint32_t first = (s_history_next + MEM_HISTORY_LEN - s_history_count) % MEM_HISTORY_LEN;
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = s_history[(first + i) % MEM_HISTORY_LEN];
+    }
+    unlock();
+    return n;
+}
+
+void mem_seal(void)
+{
+    mem_sample_t s;
+    mem_sample(&s);
+
+#if !CONFIG_IDF_TARGET_LINUX
+    s_budget.heap_total = heap_caps_get_total_size(MALLOC_CAP_8BIT);
+#endif
+    s_budget.free_at_seal = s.free;
+    s_budget.largest_at_seal = s.largest_free;
+    s_budget.sealed = true;
+#if CONFIG_HEAP_USE_HOOKS
+    s_sealed = true;
+#endif
+
+    ESP_LOGI(TAG, "Init done: static pools %lu B, heap %lu B of which %lu B free (largest %lu B) for Bluedroid/Wi-Fi",
+             (unsigned long)s_budget.arena_bytes, (unsigned long)s_budget.heap_total,
+             (unsigned long)s_budget.free_at_seal, (unsigned long)s_budget.largest_at_seal);
+}
+
+void mem_get_budget(mem_budget_t *out)
+{
+    if (out == NULL) return;
+#if CONFIG_HEAP_USE_HOOKS
+    portENTER_CRITICAL(&s_hook_mux);
+    *out = s_budget;
+    portEXIT_CRITICAL(&s_hook_mux);
+#else
+    *out = s_budget;
+#endif
+}
+
+uint32_t mem_get_post_init(mem_task_allocs_t *out, uint32_t max)
+{
+    if (out == NULL) return 0;
+#if CONFIG_HEAP_USE_HOOKS
+    portENTER_CRITICAL(&s_hook_mux);
+    uint32_t n = s_post_init_count < max ? s_post_init_count : max;
+    memcpy(out, s_post_init, n * sizeof(mem_task_allocs_t));
+    portEXIT_CRITICAL(&s_hook_mux);
+    return n;
+#else
+    return 0;
+#endif
+}
+
+static void sample_timer_cb(TimerHandle_t timer)
+{
+    mem_sample_t s;
+    mem_sample(&s);
+
+    if (xSemaphoreTake(s_lock, 0) != pdTRUE) return;
+    s_history[s_history_next] = s;
+    s_history_next = (s_history_next + 1) % MEM_HISTORY_LEN;
+    if (s_history_count < MEM_HISTORY_LEN) s_history_count++;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "free=%lu min=%lu largest=%lu tagged=%lu",
+             (unsigned long)s.free, (unsigned long)s.min_free,
+             (unsigned long)s.largest_free, (unsigned long)s.tagged_bytes);
+#if CONFIG_HEAP_USE_HOOKS
+    log_new_post_init_tasks();
+#endif
+}
+
+esp_err_t mem_init(void)
+{
+    if (s_lock != NULL) return ESP_OK;
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) return ESP_ERR_NO_MEM;
+
+#if MEM_STATIC
+    carve_pools();
+    ESP_LOGI(TAG, "Static pools: %lu B in .bss", (unsigned long)s_budget.arena_bytes);
+#endif
+
+    TimerHandle_t timer = xTimerCreate("mem", pdMS_TO_TICKS(MEM_SAMPLE_INTERVAL_S * 1000), pdTRUE,
+                                       NULL, sample_timer_cb);
+    if (timer == NULL || xTimerStart(timer, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Create sample timer fail");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
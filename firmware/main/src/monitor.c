@@ -1,5 +1,8 @@
 #include "monitor.h"
 #include "adc.h"
+#include "reactor.h"
+#include "bus.h"
+#include "snapshot.h"
 #include "esp_log.h"
 #include "freertos/task.h"
 #include <string.h>
@@ -7,55 +10,83 @@
 static const char *TAG = "monitor";
 
 #define MONITOR_INTERVAL_MS    5000
-#define MONITOR_STACK_SIZE     4096
-#define MONITOR_PRIORITY       3
 
 static adc_ctx_t s_adc_ctx;
 static temp_sensor_ctx_t s_temp_ctx;
 static QueueHandle_t s_data_queue = NULL;
-static TaskHandle_t s_task_handle = NULL;
+static reactor_timer_t s_sample_timer;
 static int s_adc_channel = 0;
-static monitor_data_t s_latest_data;
 static bool s_running = false;
 
-// monitor task
-static void monitor_task(void *arg)
+// latest sample for monitor_get_latest, written on the reactor only
+typedef struct {
+    bool valid;
+    monitor_data_t data;
+} monitor_latest_t;
+
+SNAPSHOT_DEFINE(s_latest, monitor_latest_t);
+
+// one sample on the reactor, re-arms itself
+static void on_sample(void *arg, uint32_t unused)
 {
     monitor_data_t data;
     
-    while (s_running) {
-        // read voltage
-        int voltage = 0;
-        esp_err_t err = adc_read_voltage(&s_adc_ctx, s_adc_channel, &voltage);
-        if (err != ESP_OK) {
-            ESP_LOGW(TAG, "adc read failed: %s", esp_err_to_name(err));
-            voltage = -1;
-        }
-        data.voltage_mv = voltage;
-        
-        // read temperature
-        float temp = 0;
-        err = temp_sensor_read(&s_temp_ctx, &temp);
-        if (err != ESP_OK) {
-            ESP_LOGW(TAG, "temp read failed: %s", esp_err_to_name(err));
-            temp = -999.0f;
-        }
-        data.temperature_c = temp;
-        data.timestamp = xTaskGetTickCount();
-        
-        // log the values
-        ESP_LOGI(TAG, "voltage: %dmV, temp: %.1fC", data.voltage_mv, data.temperature_c);
-        
-        // update queue (overwrite if full since size is 1)
-        xQueueOverwrite(s_data_queue, &data);
-        
-        // update latest cache
-        s_latest_data = data;
-        
-        vTaskDelay(pdMS_TO_TICKS(MONITOR_INTERVAL_MS));
+    if (!s_running) {
+        return;
+    }
+    
+    // read voltage
+    int voltage = 0;
+    esp_err_t err = adc_read_voltage(&s_adc_ctx, s_adc_channel, &voltage);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "adc read failed: %s", esp_err_to_name(err));
+        voltage = -1;
+    }
+    data.voltage_mv = voltage;
+    
+    // read temperature
+    float temp = 0;
+    err = temp_sensor_read(&s_temp_ctx, &temp);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "temp read failed: %s", esp_err_to_name(err));
+        temp = -999.0f;
+    }
+    data.temperature_c = temp;
+    data.timestamp = xTaskGetTickCount();
+    
+    // log the values
+    ESP_LOGI(TAG, "voltage: %dmV, temp: %.1fC", data.voltage_mv, data.temperature_c);
+    
+    // update queue (overwrite if full since size is 1)
+    xQueueOverwrite(s_data_queue, &data);
+    
+    // update latest cache
+    monitor_latest_t latest = { .valid = true, .data = data };
+    SNAPSHOT_WRITE(s_latest, &latest);
+    
+    bus_msg_t msg = { .monitor = { .voltage_mv = data.voltage_mv, .temperature_c = data.temperature_c } };
+    bus_publish(BUS_TOPIC_MONITOR, &msg);
+    
+    reactor_timer_start(&s_sample_timer, MONITOR_INTERVAL_MS);
+}
+
+// runs after any queued sample, so the sensors are idle when released
+static void on_stop(void *arg, uint32_t unused)
+{
+    reactor_timer_stop(&s_sample_timer);
+    
+    monitor_latest_t latest = { .valid = false };
+    SNAPSHOT_WRITE(s_latest, &latest);
+    
+    if (s_data_queue) {
+        vQueueDelete(s_data_queue);
+        s_data_queue = NULL;
     }
     
-    vTaskDelete(NULL);
+    temp_sensor_deinit(&s_temp_ctx);
+    adc_deinit(&s_adc_ctx);
+    
+    ESP_LOGI(TAG, "monitor stopped");
 }
 
 esp_err_t monitor_init(int adc_channel, QueueHandle_t *out_queue)
@@ -67,7 +98,6 @@ esp_err_t monitor_init(int adc_channel, QueueHandle_t *out_queue)
     }
     
     s_adc_channel = adc_channel;
-    memset(&s_latest_data, 0, sizeof(s_latest_data));
     
     // init adc
     ret = adc_init(&s_adc_ctx, ADC_UNIT_1);
@@ -105,18 +135,18 @@ esp_err_t monitor_init(int adc_channel, QueueHandle_t *out_queue)
         *out_queue = s_data_queue;
     }
     
-    // start task
+    // first sample right away, then every MONITOR_INTERVAL_MS
     s_running = true;
-    BaseType_t xret = xTaskCreate(monitor_task, "monitor", MONITOR_STACK_SIZE, 
-                                   NULL, MONITOR_PRIORITY, &s_task_handle);
-    if (xret != pdPASS) {
-        ESP_LOGE(TAG, "task create failed");
+    reactor_timer_init(&s_sample_timer, on_sample, NULL);
+    ret = reactor_post(on_sample, NULL, 0);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "reactor post failed: %s", esp_err_to_name(ret));
         s_running = false;
         vQueueDelete(s_data_queue);
         s_data_queue = NULL;
         temp_sensor_deinit(&s_temp_ctx);
         adc_deinit(&s_adc_ctx);
-        return ESP_FAIL;
+        return ret;
     }
     
     ESP_LOGI(TAG, "monitor started (adc ch%d, interval %dms)", adc_channel, MONITOR_INTERVAL_MS);
@@ -129,12 +159,15 @@ bool monitor_get_latest(monitor_data_t *data)
         return false;
     }
     
-    // try to peek from queue without removing
-    if (xQueuePeek(s_data_queue, data, 0) == pdTRUE) {
-        return true;
+    // the queue may be deleted under us by on_stop; the snapshot never is
+    monitor_latest_t latest;
+    SNAPSHOT_READ(s_latest, &latest);
+    if (!latest.valid) {
+        return false;
     }
     
-    return false;
+    *data = latest.data;
+    return true;
 }
 
 void monitor_deinit(void)
@@ -144,17 +177,5 @@ void monitor_deinit(void)
     }
     
     s_running = false;
-    
-    // wait for task to exit
-    vTaskDelay(pdMS_TO_TICKS(100));
-    
-    if (s_data_queue) {
-        vQueueDelete(s_data_queue);
-        s_data_queue = NULL;
-    }
-    
-    temp_sensor_deinit(&s_temp_ctx);
-    adc_deinit(&s_adc_ctx);
-    
-    ESP_LOGI(TAG, "monitor stopped");
+    reactor_post(on_stop, NULL, 0);
 }
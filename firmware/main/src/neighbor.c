@@ -0,0 +1,412 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "snapshot.h"
+#include "frag.h"
+#include "neighbor.h"
+
+static const char *TAG = "neighbor";
+
+#define TOKEN_COST      1000    /* one frame, in milli-frames */
+
+/* rates are frames/s == milli-frames/ms, bursts are one second's worth */
+#define SENDER_SHARE_RATE   ((NEIGHBOR_GLOBAL_RATE * NEIGHBOR_SENDER_SHARE_PCT) / 100)
+
+static const uint32_t CLASS_RATE[NEIGHBOR_CLASS_MAX] = {
+    [NEIGHBOR_CLASS_HELLO]    = NEIGHBOR_HELLO_RATE,
+    [NEIGHBOR_CLASS_PROPOSAL] = NEIGHBOR_PROPOSAL_RATE,
+    [NEIGHBOR_CLASS_CONTROL]  = NEIGHBOR_CONTROL_RATE,
+    [NEIGHBOR_CLASS_OTA]      = NEIGHBOR_OTA_RATE,
+    [NEIGHBOR_CLASS_FRAGMENT] = NEIGHBOR_FRAGMENT_RATE,
+};
+
+typedef enum {
+    SEQ_FRESH,
+    SEQ_DUP,
+    SEQ_CLAIM,
+} seq_check_t;
+
+typedef struct {
+    uint8_t mac[6];
+    uint32_t seq;
+    uint32_t uptime_ms;
+    bool tagged;                        /* a group tag verified, not just the header MAC */
+} confirm_t;
+
+typedef struct {
+    bool set;
+    uint8_t mac[6];
+} partner_t;
+
+static neighbor_t s_table[NEIGHBOR_TABLE_SIZE];
+static token_bucket_t s_global;
+static QueueHandle_t s_confirms;        /* espnow_task -> WiFi task */
+SNAPSHOT_DEFINE(s_partner, partner_t);
+
+static uint32_t bucket_cap(uint32_t rate)
+{
+    return (rate > 0 ? rate : 1) * TOKEN_COST;
+}
+
+static void bucket_fill(token_bucket_t *b, uint32_t rate, uint32_t now_ms)
+{
+    b->tokens = bucket_cap(rate);
+    b->last_ms = now_ms;
+}
+
+static void bucket_refill(token_bucket_t *b, uint32_t rate, uint32_t now_ms)
+{
+    uint32_t cap = bucket_cap(rate);
+    uint32_t elapsed = now_ms - b->last_ms;
+    b->last_ms = now_ms;
+
+    /* avoid overflow after a long quiet period */
+    if (elapsed >= 1000 || b->tokens + elapsed * rate >= cap) {
+        b->tokens = cap;
+    } else {
+        b->tokens += elapsed * rate;
+    }
+}
+
+static neighbor_class_t class_of(uint8_t msg_type)
+{
+    switch (msg_type) {
+        case MSG_HELLO:
+        case MSG_OTA_ADVERT:
+        case MSG_TIMESYNC:      return NEIGHBOR_CLASS_HELLO;
+        case MSG_PROPOSAL:      return NEIGHBOR_CLASS_PROPOSAL;
+        case MSG_OTA_REQUEST:
+        case MSG_OTA_CHUNK:     return NEIGHBOR_CLASS_OTA;
+        case MSG_FRAGMENT:      return NEIGHBOR_CLASS_FRAGMENT;
+        default:                return NEIGHBOR_CLASS_CONTROL;
+    }
+}
+
+/*
+ * the class a fragment is charged to: its frame's, read from the header the
+ * first part carries, or remembered from it for the rest. a part whose
+ * first part never came in can't be told apart, and stays a fragment
+ */
+static neighbor_class_t frame_class_of(const neighbor_t *n, const uint8_t *data, int len, frag_hdr_t *fh)
+{
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+
+    if (hdr->msg_type != MSG_FRAGMENT || len < (int)(sizeof(*hdr) + sizeof(*fh))) {
+        return class_of(hdr->msg_type);
+    }
+    memcpy(fh, data + sizeof(*hdr), sizeof(*fh));
+    if (fh->index == 0 && len >= (int)(2 * sizeof(*hdr) + sizeof(*fh))) {
+        return class_of(((const broadcast_header_t *)(data + sizeof(*hdr) + sizeof(*fh)))->msg_type);
+    }
+    if (fh->index != 0 && n->frag_known && n->frag_seq == fh->frame_seq) {
+        return (neighbor_class_t)n->frag_cls;
+    }
+    return NEIGHBOR_CLASS_FRAGMENT;
+}
+
+/* a dropped part costs the whole frame, so the parts after it are dropped free */
+static void frag_note(neighbor_t *n, const frag_hdr_t *fh, neighbor_class_t frame_cls, bool dropped)
+{
+    if (fh->index == 0) {
+        n->frag_known = true;
+        n->frag_seq = fh->frame_seq;
+        n->frag_cls = (uint8_t)frame_cls;
+        n->frag_dropped = dropped;
+    } else if (dropped && n->frag_known && n->frag_seq == fh->frame_seq) {
+        n->frag_dropped = true;
+    }
+}
+
+/* FNV-1a over the MAC */
+static uint32_t mac_hash(const uint8_t *mac)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        h ^= mac[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * linear probing without deletion: lookups stop at the first empty slot.
+ * when the probe window is full the stalest entry in it is recycled, which
+ * never creates a hole in another sender's chain. the partner's entry is
+ * never the one recycled.
+ */
+static neighbor_t *lookup(const uint8_t *mac, neighbor_t **out_free, uint32_t now_ms)
+{
+    uint32_t idx = mac_hash(mac) & (NEIGHBOR_TABLE_SIZE - 1);
+    neighbor_t *stalest = NULL;
+    partner_t partner = { 0 };
+    bool partner_read = false;
+
+    for (int probe = 0; probe < NEIGHBOR_PROBE_MAX; probe++) {
+        neighbor_t *n = &s_table[(idx + probe) & (NEIGHBOR_TABLE_SIZE - 1)];
+
+        if (!n->used) {
+            stalest = n;
+            break;
+        }
+        if (memcmp(n->mac, mac, 6) == 0) {
+            return n;
+        }
+        if (stalest == NULL || (now_ms - n->last_seen_ms) > (now_ms - stalest->last_seen_ms)) {
+            if (!partner_read) {
+                SNAPSHOT_READ(s_partner, &partner);
+                partner_read = true;
+            }
+            if (partner.set && memcmp(n->mac, partner.mac, 6) == 0) continue;
+            stalest = n;
+        }
+    }
+
+    if (out_free != NULL) *out_free = stalest;
+    return NULL;
+}
+
+static neighbor_t *lookup_or_insert(const uint8_t *mac, uint32_t now_ms)
+{
+    neighbor_t *stalest;
+    neighbor_t *n = lookup(mac, &stalest, now_ms);
+    if (n != NULL) return n;
+
+    if (stalest->used) {
+        ESP_LOGD(TAG, "Evicting " MACSTR, MAC2STR(stalest->mac));
+    }
+
+    memset(stalest, 0, sizeof(*stalest));
+    stalest->used = true;
+    memcpy(stalest->mac, mac, 6);
+    bucket_fill(&stalest->share, SENDER_SHARE_RATE, now_ms);
+    for (int c = 0; c < NEIGHBOR_CLASS_MAX; c++) {
+        bucket_fill(&stalest->bucket[c], CLASS_RATE[c], now_ms);
+    }
+    return stalest;
+}
+
+/* how far past seq_max the sender can have got since its last admitted frame */
+static uint32_t seq_allowance(const neighbor_t *n, uint32_t now_ms)
+{
+    uint64_t elapsed = now_ms - n->last_admit_ms;
+    return NEIGHBOR_SEQ_JUMP + (uint32_t)(elapsed * NEIGHBOR_SEQ_RATE_MAX / 1000);
+}
+
+static seq_check_t seq_check(const neighbor_t *n, const broadcast_header_t *hdr, uint32_t now_ms)
+{
+    if (!n->synced) return SEQ_FRESH;
+    seq_check_t fresh = n->trusted || class_of(hdr->msg_type) != NEIGHBOR_CLASS_HELLO ? SEQ_FRESH : SEQ_CLAIM;
+
+    /* where this frame puts the sender's boot against where its frames have so far */
+    uint32_t boot_ms = now_ms - hdr->uptime_ms;
+    int32_t later = (int32_t)(boot_ms - n->boot_ms);
+
+    if (later > NEIGHBOR_REBOOT_SLACK_MS) {
+        /* a fresh boot can't be older than our silence from that sender;
+         * a replayed frame from the same boot is */
+        return (int32_t)(boot_ms - n->last_admit_ms) >= -NEIGHBOR_REBOOT_SLACK_MS ? SEQ_CLAIM : SEQ_DUP;
+    }
+    /* a replay from before a reboot looks like this too, so only against a guess */
+    if (later < -NEIGHBOR_REBOOT_SLACK_MS) {
+        return n->trusted ? SEQ_DUP : SEQ_CLAIM;
+    }
+
+    uint32_t seq = hdr->seq_num;
+    if (seq > n->seq_max) {
+        return seq - n->seq_max > seq_allowance(n, now_ms) ? SEQ_CLAIM : fresh;
+    }
+
+    uint32_t offset = n->seq_max - seq;
+    if (offset >= NEIGHBOR_SEQ_WINDOW) {
+        /* behind the window but newer than anything admitted: the window is what's wrong */
+        return (int32_t)(hdr->uptime_ms - n->last_uptime_ms) > 0 ? SEQ_CLAIM : SEQ_DUP;
+    }
+    return (n->seq_window >> offset) & 1 ? SEQ_DUP : fresh;
+}
+
+static void seq_mark(neighbor_t *n, uint32_t seq)
+{
+    if (seq > n->seq_max) {
+        uint32_t shift = seq - n->seq_max;
+        n->seq_window = shift >= NEIGHBOR_SEQ_WINDOW ? 0 : n->seq_window << shift;
+        n->seq_window |= 1;
+        n->seq_max = seq;
+    } else {
+        n->seq_window |= (uint64_t)1 << (n->seq_max - seq);
+    }
+}
+
+/* the sender's clock runs at its own rate; follow it, but no faster than it can drift */
+static void track_boot(neighbor_t *n, uint32_t boot_ms, uint32_t now_ms)
+{
+    int32_t diff = (int32_t)(boot_ms - n->boot_ms);
+    int32_t step = 1 + (int32_t)((uint64_t)(now_ms - n->last_admit_ms) * NEIGHBOR_DRIFT_PPM / 1000000);
+
+    if (diff > step) diff = step;
+    if (diff < -step) diff = -step;
+    n->boot_ms += diff;
+}
+
+static void sync_to(neighbor_t *n, uint32_t seq, uint32_t uptime_ms, uint32_t at_ms, bool trusted)
+{
+    n->synced = true;
+    n->trusted = trusted;
+    n->seq_max = seq;
+    n->seq_window = 1;
+    n->boot_ms = at_ms - uptime_ms;
+    n->last_uptime_ms = uptime_ms;
+    n->last_admit_ms = at_ms;
+}
+
+static void apply_confirms(void)
+{
+    confirm_t c;
+
+    while (xQueueReceive(s_confirms, &c, 0) == pdTRUE) {
+        neighbor_t *n = lookup(c.mac, NULL, 0);
+        if (n == NULL || !n->claim_pending || n->claim_seq != c.seq || n->claim_uptime_ms != c.uptime_ms) {
+            continue;
+        }
+        n->claim_pending = false;
+
+        /* the first confirmation from a sender usually just continues its window;
+         * without a group key every one does, however far the seq_num got */
+        int32_t later = (int32_t)((n->claim_ms - c.uptime_ms) - n->boot_ms);
+        if (n->synced && c.seq > n->seq_max && (!c.tagged || c.seq - n->seq_max < NEIGHBOR_SEQ_WINDOW) &&
+            later <= NEIGHBOR_REBOOT_SLACK_MS && later >= -NEIGHBOR_REBOOT_SLACK_MS) {
+            seq_mark(n, c.seq);
+            if ((int32_t)(c.uptime_ms - n->last_uptime_ms) > 0) n->last_uptime_ms = c.uptime_ms;
+            n->last_admit_ms = n->claim_ms;
+            if (c.tagged) n->trusted = true;
+            continue;
+        }
+        /* anyone can put a MAC in a header; only the group key can move a window */
+        if (!c.tagged) {
+            ESP_LOGD(TAG, MACSTR " claimed a restart at %lu without a group tag",
+                     MAC2STR(n->mac), (unsigned long)c.seq);
+            continue;
+        }
+        ESP_LOGI(TAG, MACSTR " restarted its seq at %lu (uptime %lu ms)",
+                 MAC2STR(n->mac), (unsigned long)c.seq, (unsigned long)c.uptime_ms);
+        sync_to(n, c.seq, c.uptime_ms, n->claim_ms, true);
+    }
+}
+
+void neighbor_init(uint32_t now_ms)
+{
+    partner_t none = { 0 };
+
+    memset(s_table, 0, sizeof(s_table));
+    bucket_fill(&s_global, NEIGHBOR_GLOBAL_RATE, now_ms);
+    SNAPSHOT_WRITE(s_partner, &none);
+    if (s_confirms == NULL) {
+        s_confirms = xQueueCreate(NEIGHBOR_CONFIRM_QUEUE_LEN, sizeof(confirm_t));
+    } else {
+        xQueueReset(s_confirms);
+    }
+
+    ESP_LOGI(TAG, "Ingress budget %d fps, max %d%% per sender (hello %d, proposal %d, control %d, ota %d, "
+             "fragment %d fps)", NEIGHBOR_GLOBAL_RATE, NEIGHBOR_SENDER_SHARE_PCT, NEIGHBOR_HELLO_RATE,
+             NEIGHBOR_PROPOSAL_RATE, NEIGHBOR_CONTROL_RATE, NEIGHBOR_OTA_RATE, NEIGHBOR_FRAGMENT_RATE);
+}
+
+neighbor_verdict_t neighbor_admit(const uint8_t *mac, const uint8_t *data, int len, uint32_t now_ms)
+{
+    if (s_confirms != NULL) apply_confirms();
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+    neighbor_t *n = lookup_or_insert(mac, now_ms);
+    neighbor_class_t cls = class_of(hdr->msg_type);
+    frag_hdr_t fh = { 0 };
+    neighbor_class_t frame_cls = frame_class_of(n, data, len, &fh);
+    bool part = cls == NEIGHBOR_CLASS_FRAGMENT && len >= (int)(sizeof(*hdr) + sizeof(fh));
+    /* the first part costs one of its frame's class, the rest a fragment each */
+    neighbor_class_t charge = part && fh.index == 0 ? frame_cls : cls;
+    token_bucket_t *b = &n->bucket[charge];
+
+    n->last_seen_ms = now_ms;
+
+    /* a reference no claim ever confirmed is let go once the sender goes
+     * quiet, which is how a reboot gets through without a group key */
+    if (n->synced && !n->trusted && now_ms - n->last_admit_ms >= NEIGHBOR_IDLE_MS) {
+        n->synced = false;
+    }
+
+    seq_check_t check = seq_check(n, hdr, now_ms);
+    if (check == SEQ_DUP) {
+        return NEIGHBOR_DROP_DUP;
+    }
+    /* only frames that carry the group tag can back a claim; one is enough */
+    if (check == SEQ_CLAIM &&
+        (cls != NEIGHBOR_CLASS_HELLO ||
+         (n->claim_pending && n->claim_seq == hdr->seq_num && n->claim_uptime_ms == hdr->uptime_ms))) {
+        return NEIGHBOR_DROP_DUP;
+    }
+    if (part && fh.index != 0 && n->frag_known && n->frag_seq == fh.frame_seq && n->frag_dropped) {
+        return NEIGHBOR_DROP_RATE;
+    }
+
+    bucket_refill(b, CLASS_RATE[charge], now_ms);
+    bucket_refill(&n->share, SENDER_SHARE_RATE, now_ms);
+    bucket_refill(&s_global, NEIGHBOR_GLOBAL_RATE, now_ms);
+
+    /* firmware transfers only get the top half of the budget. a split chunk
+     * has to fit there whole when its first part comes in, the rest of it
+     * only needs a token */
+    uint32_t ota_floor = bucket_cap(NEIGHBOR_GLOBAL_RATE) / 2;
+    if (part) ota_floor = fh.index == 0 && fh.count > 1 ? ota_floor + (fh.count - 1u) * TOKEN_COST : 0;
+
+    neighbor_verdict_t drop = NEIGHBOR_ADMIT;
+    if (b->tokens < TOKEN_COST || n->share.tokens < TOKEN_COST) {
+        drop = NEIGHBOR_DROP_RATE;
+    } else if (s_global.tokens < TOKEN_COST) {
+        drop = NEIGHBOR_DROP_GLOBAL;
+    } else if (frame_cls == NEIGHBOR_CLASS_OTA && s_global.tokens < ota_floor) {
+        drop = NEIGHBOR_DROP_GLOBAL;
+    }
+    if (part) frag_note(n, &fh, frame_cls, drop != NEIGHBOR_ADMIT);
+    if (drop != NEIGHBOR_ADMIT) {
+        return drop;
+    }
+
+    b->tokens -= TOKEN_COST;
+    n->share.tokens -= TOKEN_COST;
+    s_global.tokens -= TOKEN_COST;
+
+    if (check == SEQ_CLAIM) {
+        n->claim_pending = true;
+        n->claim_seq = hdr->seq_num;
+        n->claim_uptime_ms = hdr->uptime_ms;
+        n->claim_ms = now_ms;
+        return NEIGHBOR_ADMIT_CLAIM;
+    }
+
+    if (!n->synced) {
+        sync_to(n, hdr->seq_num, hdr->uptime_ms, now_ms, false);
+        return NEIGHBOR_ADMIT;
+    }
+    seq_mark(n, hdr->seq_num);
+    track_boot(n, now_ms - hdr->uptime_ms, now_ms);
+    if ((int32_t)(hdr->uptime_ms - n->last_uptime_ms) > 0) n->last_uptime_ms = hdr->uptime_ms;
+    n->last_admit_ms = now_ms;
+    return NEIGHBOR_ADMIT;
+}
+
+void neighbor_confirm(const uint8_t *mac, const broadcast_header_t *hdr, bool tagged)
+{
+    if (s_confirms == NULL) return;
+
+    confirm_t c = { .seq = hdr->seq_num, .uptime_ms = hdr->uptime_ms, .tagged = tagged };
+    memcpy(c.mac, mac, 6);
+    /* full: the sender's next claim gets another chance */
+    xQueueSend(s_confirms, &c, 0);
+}
+
+void neighbor_set_partner(const uint8_t *mac)
+{
+    partner_t p = { .set = mac != NULL };
+    if (mac != NULL) memcpy(p.mac, mac, 6);
+    SNAPSHOT_WRITE(s_partner, &p);
+}
@@ -1,6 +1,7 @@
 #include "nfc_pair.h"
 #include "name.h"
 #include "esp_log.h"
+#include "bus.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
@@ -102,6 +103,8 @@ static void set_state(nfc_pair_state_t new_state)
 {
     if (s_state != new_state) {
         s_state = new_state;
+        bus_msg_t msg = { .nfc_pair.state = new_state };
+        bus_publish(BUS_TOPIC_NFC_PAIR, &msg);
         if (s_config.callback) {
             s_config.callback(new_state, s_config.cb_arg);
         }
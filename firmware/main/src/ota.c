@@ -0,0 +1,680 @@
+/*
+ * ota.c - epidemic firmware updates over ESP-NOW
+ *
+ * Two roles, both on espnow_task and both possibly active at once:
+ *
+ *   holder    serves s_serve_part (the running image, or a verified
+ *             download not applied yet) to one client at a time, paced by
+ *             ota_tick()
+ *   receiver  s_dl: pulls a newer version window by window from whichever
+ *             badge advertised it, writing into s_update
+ *
+ * Chunks are compressed with a small LZSS: a flag byte per eight items,
+ * each item a literal byte or a 16 bit match (9 bits distance - 1, 7 bits
+ * length - 3). A chunk is compressed on its own, so matches never reach
+ * outside it and a lost chunk costs nothing but itself. Code compresses to
+ * about two thirds; the 0xFF padding at the end of an image to almost
+ * nothing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_image_format.h"
+#include "ota.h"
+#include "espnow.h"
+#include "frag.h"
+#include "ble_task.h"
+#include "snapshot.h"
+
+static const char *TAG = "ota";
+
+#define LZ_MIN_MATCH        3
+#define LZ_MAX_MATCH        (LZ_MIN_MATCH + 127)
+#define LZ_MAX_DIST         512
+#define LZ_HASH_BITS        10
+
+#define OTA_REQUEST_MAX_CHUNKS  64
+
+typedef struct {
+    bool active;
+    bool has_source;            /* false: lost the holder, waiting for another */
+    bool begun;                 /* esp_ota_begin() done, handle open */
+    uint8_t source[ESP_NOW_ETH_ALEN];
+    uint32_t version;
+    uint32_t size;              /* from the first chunk */
+    uint32_t next;              /* next offset to write */
+    uint32_t window_end;
+    uint32_t last_activity;     /* request sent or chunk written */
+    uint32_t last_progress;     /* started, or chunk written */
+    int timeouts;
+    esp_ota_handle_t handle;
+} ota_download_t;
+
+typedef struct {
+    bool active;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t next;
+    uint32_t end;
+    uint32_t last_request;
+    uint32_t last_sent;
+} ota_client_t;
+
+/* espnow_task only */
+static const esp_partition_t *s_running;
+static const esp_partition_t *s_update;     /* NULL: never receive */
+static uint32_t s_running_size;
+static const esp_partition_t *s_serve_part;
+static uint32_t s_serve_size;
+
+static ota_download_t s_dl;
+static ota_client_t s_client;
+static uint8_t s_bad_source[ESP_NOW_ETH_ALEN];
+static uint32_t s_bad_source_at;
+static uint32_t s_failed_version;
+static uint32_t s_failed_at;
+static int s_failed_count;                  /* the same version in a row, less one */
+static bool s_apply_pending;
+static uint32_t s_ready_at;
+static uint32_t s_last_advert;
+static bool s_confirm_pending;              /* first boot of a received image */
+static bool s_heard_peer;                   /* ...and a HELLO passed its checks since */
+
+static ota_stats_t s_stats;
+static bool s_stats_dirty;
+
+SNAPSHOT_DEFINE(s_stats_snap, ota_stats_t);
+
+static uint32_t get_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+/* PROJECT_VER must be a plain integer for the badge to take part */
+static uint32_t parse_version(const char *s)
+{
+    char *end;
+    unsigned long v = strtoul(s, &end, 10);
+    return (end != s && *end == '\0') ? (uint32_t)v : 0;
+}
+
+/* bytes of the image in part, signature included; 0 if it can't be read */
+static uint32_t image_size(const esp_partition_t *part)
+{
+    esp_partition_pos_t pos = { .offset = part->address, .size = part->size };
+    esp_image_metadata_t meta;
+
+    if (esp_image_get_metadata(&pos, &meta) != ESP_OK) return 0;
+
+    uint32_t size = meta.image_len;
+#if CONFIG_SECURE_SIGNED_APPS_NO_SECURE_BOOT || CONFIG_SECURE_BOOT
+    /* the signature block sits in the next 4 KiB sector, outside image_len */
+    size = ((size + 4095) & ~4095u) + 4096;
+#endif
+    return size <= part->size ? size : 0;
+}
+
+static uint32_t lz_hash(const uint8_t *p)
+{
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* 0 when the result would not be smaller than cap */
+static size_t lz_compress(const uint8_t *in, size_t n, uint8_t *out, size_t cap)
+{
+    static uint16_t head[1 << LZ_HASH_BITS];    /* position + 1, 0 = none */
+    size_t ip = 0, op = 0;
+
+    memset(head, 0, sizeof(head));
+
+    while (ip < n) {
+        /* room for a flag byte and eight matches */
+        if (op + 1 + 8 * 2 >= cap) return 0;
+
+        size_t flag_pos = op++;
+        uint8_t flags = 0;
+
+        for (int bit = 0; bit < 8 && ip < n; bit++) {
+            size_t best_len = 0, best_dist = 0;
+
+            if (ip + LZ_MIN_MATCH <= n) {
+                uint32_t h = lz_hash(in + ip);
+                size_t cand = head[h];
+                head[h] = (uint16_t)(ip + 1);
+
+                if (cand > 0 && ip - (cand - 1) <= LZ_MAX_DIST) {
+                    cand--;
+                    size_t max = n - ip < LZ_MAX_MATCH ? n - ip : LZ_MAX_MATCH;
+                    size_t len = 0;
+                    while (len < max && in[cand + len] == in[ip + len]) len++;
+                    if (len >= LZ_MIN_MATCH) {
+                        best_len = len;
+                        best_dist = ip - cand;
+                    }
+                }
+            }
+
+            if (best_len > 0) {
+                uint16_t token = (uint16_t)(((best_len - LZ_MIN_MATCH) << 9) | (best_dist - 1));
+                flags |= 1 << bit;
+                out[op++] = token & 0xFF;
+                out[op++] = token >> 8;
+                for (size_t k = 1; k < best_len; k++) {
+                    if (ip + k + LZ_MIN_MATCH <= n) head[lz_hash(in + ip + k)] = (uint16_t)(ip + k + 1);
+                }
+                ip += best_len;
+            } else {
+                out[op++] = in[ip++];
+            }
+        }
+        out[flag_pos] = flags;
+    }
+
+    return op < cap ? op : 0;
+}
+
+/* the input comes off the air: every length and distance is checked */
+static bool lz_decompress(const uint8_t *in, size_t n, uint8_t *out, size_t raw_len)
+{
+    size_t ip = 0, op = 0;
+
+    while (op < raw_len) {
+        if (ip >= n) return false;
+        uint8_t flags = in[ip++];
+
+        for (int bit = 0; bit < 8 && op < raw_len; bit++) {
+            if (flags & (1 << bit)) {
+                if (ip + 2 > n) return false;
+                uint16_t token = in[ip] | (in[ip + 1] << 8);
+                ip += 2;
+                size_t dist = (token & 0x1FF) + 1;
+                size_t len = (token >> 9) + LZ_MIN_MATCH;
+                if (dist > op || len > raw_len - op) return false;
+                /* byte by byte: runs overlap their source */
+                for (; len > 0; len--, op++) out[op] = out[op - dist];
+            } else {
+                if (ip >= n) return false;
+                out[op++] = in[ip++];
+            }
+        }
+    }
+    return ip == n;
+}
+
+static void serve(pairing_ctx_t *ctx, const esp_partition_t *part, uint32_t size, uint32_t version)
+{
+    s_serve_part = part;
+    s_serve_size = size;
+    s_stats.serving_version = version;
+    s_client.active = false;
+    pairing_set_fw_version(ctx, version);
+    s_stats_dirty = true;
+}
+
+static void send_request(pairing_ctx_t *ctx, uint32_t now)
+{
+    ota_request_t req = {
+        .version = s_dl.version,
+        .offset = s_dl.next,
+        .count = OTA_WINDOW_CHUNKS,
+    };
+
+    s_dl.window_end = s_dl.next + OTA_WINDOW_CHUNKS * OTA_CHUNK_SIZE;
+    s_dl.last_activity = now;
+
+    esp_err_t err = pairing_send_payload(ctx, s_dl.source, MSG_OTA_REQUEST, &req, sizeof(req));
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "Request failed: %s", esp_err_to_name(err));
+    }
+}
+
+static void end_download(void)
+{
+    if (s_dl.begun) {
+        esp_ota_abort(s_dl.handle);
+    }
+    memset(&s_dl, 0, sizeof(s_dl));
+    s_stats.state = s_apply_pending ? OTA_READY : OTA_IDLE;
+    s_stats_dirty = true;
+}
+
+static void fail_download(esp_err_t err, uint32_t now)
+{
+    ESP_LOGE(TAG, "Version %lu failed at %lu/%lu: %s", (unsigned long)s_dl.version,
+             (unsigned long)s_dl.next, (unsigned long)s_dl.size, esp_err_to_name(err));
+    if (s_dl.version == s_failed_version) {
+        if (s_failed_count < OTA_RETRY_BACKOFF_DOUBLINGS) s_failed_count++;
+    } else {
+        s_failed_count = 0;
+    }
+    s_failed_version = s_dl.version;
+    s_failed_at = now;
+    s_stats.failures++;
+    end_download();
+}
+
+static void adopt_source(pairing_ctx_t *ctx, const uint8_t *mac, uint32_t now)
+{
+    memcpy(s_dl.source, mac, ESP_NOW_ETH_ALEN);
+    s_dl.has_source = true;
+    s_dl.timeouts = 0;
+    ESP_LOGI(TAG, "Fetching version %lu from " MACSTR " at offset %lu",
+             (unsigned long)s_dl.version, MAC2STR(mac), (unsigned long)s_dl.next);
+    send_request(ctx, now);
+}
+
+static void on_version(pairing_ctx_t *ctx, const uint8_t *mac, uint32_t version,
+                       const uint8_t *data, int len)
+{
+    uint32_t now = get_time_ms();
+
+    if (s_update == NULL || version <= s_stats.serving_version) return;
+    if (version == s_failed_version && now - s_failed_at < ((uint32_t)OTA_RETRY_BACKOFF_MS << s_failed_count)) return;
+
+    if (s_dl.active) {
+        if (version < s_dl.version) return;
+        if (version == s_dl.version) {
+            if (s_dl.has_source) return;
+            if (memcmp(mac, s_bad_source, ESP_NOW_ETH_ALEN) == 0 &&
+                now - s_bad_source_at < OTA_SOURCE_HOLDOFF_MS) return;
+        }
+    }
+
+    /* the HMAC only for versions we'd act on */
+    if (!pairing_frame_tag_valid(ctx, mac, data, len)) return;
+
+    if (s_dl.active && version == s_dl.version) {
+        adopt_source(ctx, mac, now);
+        return;
+    }
+
+    if (s_dl.active) {
+        ESP_LOGI(TAG, "Version %lu superseded by %lu", (unsigned long)s_dl.version, (unsigned long)version);
+        end_download();
+    }
+
+    /* the download overwrites s_update: stop handing out what's in it */
+    if (s_serve_part == s_update) {
+        s_apply_pending = false;
+        serve(ctx, s_running, s_running_size, s_running_size ? s_stats.running_version : 0);
+    }
+
+    memset(&s_dl, 0, sizeof(s_dl));
+    s_dl.active = true;
+    s_dl.version = version;
+    s_dl.last_progress = now;
+    s_stats.state = OTA_DOWNLOADING;
+    s_stats.download_version = version;
+    s_stats.download_bytes = 0;
+    s_stats.download_size = 0;
+    s_stats_dirty = true;
+    adopt_source(ctx, mac, now);
+}
+
+static void on_request(const uint8_t *mac, const ota_request_t *req)
+{
+    uint32_t now = get_time_ms();
+    bool same = s_client.active && memcmp(mac, s_client.mac, ESP_NOW_ETH_ALEN) == 0;
+
+    if (s_stats.serving_version == 0 || req->version != s_stats.serving_version) return;
+    if (req->offset >= s_serve_size || req->offset % OTA_CHUNK_SIZE != 0 || req->count == 0) return;
+
+    if (s_client.active && !same && now - s_client.last_request < OTA_CLIENT_IDLE_MS) {
+        s_stats.busy++;
+        s_stats_dirty = true;
+        return;
+    }
+
+    if (!same) {
+        ESP_LOGI(TAG, "Serving version %lu to " MACSTR " from offset %lu",
+                 (unsigned long)req->version, MAC2STR(mac), (unsigned long)req->offset);
+        s_client.last_sent = now - 1000 / OTA_CHUNK_RATE;
+    }
+
+    uint32_t count = req->count < OTA_REQUEST_MAX_CHUNKS ? req->count : OTA_REQUEST_MAX_CHUNKS;
+    uint32_t end = req->offset + count * OTA_CHUNK_SIZE;
+
+    s_client.active = true;
+    memcpy(s_client.mac, mac, ESP_NOW_ETH_ALEN);
+    s_client.next = req->offset;
+    s_client.end = end < s_serve_size ? end : s_serve_size;
+    s_client.last_request = now;
+}
+
+static void finish_download(pairing_ctx_t *ctx, uint32_t now)
+{
+    esp_err_t err = esp_ota_end(s_dl.handle);
+    s_dl.begun = false;
+
+    /* the image verified, but is it the version we were promised? */
+    if (err == ESP_OK) {
+        esp_app_desc_t desc;
+        err = esp_ota_get_partition_description(s_update, &desc);
+        if (err == ESP_OK && parse_version(desc.version) != s_dl.version) {
+            err = ESP_ERR_INVALID_VERSION;
+        }
+    }
+    if (err != ESP_OK) {
+        fail_download(err, now);
+        return;
+    }
+
+    ESP_LOGW(TAG, "Version %lu received and verified (%lu bytes)",
+             (unsigned long)s_dl.version, (unsigned long)s_dl.size);
+
+    serve(ctx, s_update, s_dl.size, s_dl.version);
+    s_apply_pending = true;
+    s_ready_at = now;
+    s_stats.updates++;
+
+    char msg[32];
+    snprintf(msg, sizeof(msg), "OTA_READY:%lu" BLE_MESSAGE_DELIMITER_STR, (unsigned long)s_dl.version);
+    ble_send_message(msg);
+
+    end_download();
+}
+
+static void on_chunk(pairing_ctx_t *ctx, const uint8_t *mac, const ota_chunk_t *chunk, size_t data_len)
+{
+    static uint8_t raw[OTA_CHUNK_SIZE];
+    uint32_t now = get_time_ms();
+
+    if (!s_dl.active || !s_dl.has_source) return;
+    if (memcmp(mac, s_dl.source, ESP_NOW_ETH_ALEN) != 0 || chunk->version != s_dl.version) return;
+    if (chunk->offset != s_dl.next) return;     /* re-requested on timeout */
+
+    esp_err_t err;
+    if (!s_dl.begun) {
+        if (chunk->image_size == 0 || chunk->image_size > s_update->size) {
+            fail_download(ESP_ERR_INVALID_SIZE, now);
+            return;
+        }
+        err = esp_ota_begin(s_update, OTA_WITH_SEQUENTIAL_WRITES, &s_dl.handle);
+        if (err != ESP_OK) {
+            fail_download(err, now);
+            return;
+        }
+        s_dl.begun = true;
+        s_dl.size = chunk->image_size;
+        s_stats.download_size = s_dl.size;
+    } else if (chunk->image_size != s_dl.size) {
+        return;
+    }
+
+    uint32_t want = s_dl.size - s_dl.next < OTA_CHUNK_SIZE ? s_dl.size - s_dl.next : OTA_CHUNK_SIZE;
+    if (chunk->raw_len != want) return;
+
+    const uint8_t *bytes = chunk->data;
+    if (chunk->flags & OTA_CHUNK_LZ) {
+        if (!lz_decompress(chunk->data, data_len, raw, want)) {
+            ESP_LOGW(TAG, "Bad chunk at %lu from " MACSTR, (unsigned long)chunk->offset, MAC2STR(mac));
+            return;
+        }
+        bytes = raw;
+    } else if (data_len != want) {
+        return;
+    }
+
+    err = esp_ota_write(s_dl.handle, bytes, want);
+    if (err != ESP_OK) {
+        fail_download(err, now);
+        return;
+    }
+
+    s_dl.next += want;
+    s_dl.last_activity = now;
+    s_dl.last_progress = now;
+    s_dl.timeouts = 0;
+    s_stats.download_bytes = s_dl.next;
+    s_stats_dirty = true;
+
+    if (s_dl.next == s_dl.size) {
+        finish_download(ctx, now);
+    } else if (s_dl.next >= s_dl.window_end) {
+        send_request(ctx, now);
+    }
+}
+
+static void send_chunk(pairing_ctx_t *ctx)
+{
+    static uint8_t raw[OTA_CHUNK_SIZE];
+    static uint8_t frame[sizeof(ota_chunk_t) + OTA_CHUNK_SIZE];
+    ota_chunk_t *chunk = (ota_chunk_t *)frame;
+
+    uint32_t len = s_serve_size - s_client.next < OTA_CHUNK_SIZE ? s_serve_size - s_client.next : OTA_CHUNK_SIZE;
+    esp_err_t err = esp_partition_read(s_serve_part, s_client.next, raw, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Read at %lu failed: %s", (unsigned long)s_client.next, esp_err_to_name(err));
+        s_client.active = false;
+        return;
+    }
+
+    size_t packed = lz_compress(raw, len, chunk->data, len);
+    chunk->flags = packed > 0 ? OTA_CHUNK_LZ : 0;
+    if (packed == 0) {
+        memcpy(chunk->data, raw, len);
+        packed = len;
+    }
+    chunk->version = s_stats.serving_version;
+    chunk->image_size = s_serve_size;
+    chunk->offset = s_client.next;
+    chunk->raw_len = (uint16_t)len;
+
+    err = pairing_send_payload(ctx, s_client.mac, MSG_OTA_CHUNK, frame, sizeof(ota_chunk_t) + packed);
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "Chunk send failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+    s_client.next += len;
+    s_stats.served_chunks++;
+    s_stats.served_bytes += len;
+    s_stats.sent_bytes += packed;
+    s_stats_dirty = true;
+}
+
+static void apply_update(void)
+{
+    esp_err_t err = esp_ota_set_boot_partition(s_update);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Boot partition switch failed: %s", esp_err_to_name(err));
+        s_apply_pending = false;
+        return;
+    }
+
+    ESP_LOGW(TAG, "Restarting into version %lu", (unsigned long)s_stats.serving_version);
+    esp_restart();
+}
+
+static uint32_t until(uint32_t period, uint32_t elapsed)
+{
+    return elapsed >= period ? 1 : period - elapsed;
+}
+
+/* keep this image once it has run a while and heard another badge */
+static void confirm_image(void)
+{
+    esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Confirming the image failed: %s", esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGW(TAG, "First boot of %s confirmed, rollback cancelled", s_running->label);
+}
+
+uint32_t ota_tick(pairing_ctx_t *ctx)
+{
+    uint32_t now = get_time_ms();
+    uint32_t wait = OTA_ADVERT_MS;
+
+    if (s_confirm_pending && s_heard_peer && now >= OTA_CONFIRM_UPTIME_MS) {
+        confirm_image();
+        s_confirm_pending = false;
+    }
+
+    /* a source that advertised a version and never delivered it, or vanished:
+     * give the version up so any other newer one can be fetched */
+    if (s_dl.active && now - s_dl.last_progress >= OTA_STALL_MS) {
+        fail_download(ESP_ERR_TIMEOUT, now);
+    }
+
+    if (s_dl.active && s_dl.has_source) {
+        if (now - s_dl.last_activity >= OTA_REQUEST_TIMEOUT_MS) {
+            s_stats.timeouts++;
+            s_stats_dirty = true;
+            if (++s_dl.timeouts >= OTA_SOURCE_TIMEOUTS) {
+                ESP_LOGW(TAG, "Lost " MACSTR " at %lu/%lu, waiting for another holder",
+                         MAC2STR(s_dl.source), (unsigned long)s_dl.next, (unsigned long)s_dl.size);
+                memcpy(s_bad_source, s_dl.source, ESP_NOW_ETH_ALEN);
+                s_bad_source_at = now;
+                s_dl.has_source = false;
+            } else {
+                send_request(ctx, now);
+            }
+        }
+        if (s_dl.has_source) {
+            uint32_t t = until(OTA_REQUEST_TIMEOUT_MS, now - s_dl.last_activity);
+            if (t < wait) wait = t;
+        }
+    }
+
+    if (s_client.active && now - s_client.last_request >= OTA_CLIENT_IDLE_MS) {
+        s_client.active = false;
+    }
+    /* a proposal round trip is worth more than one chunk's airtime */
+    if (s_client.active && s_client.next < s_client.end && ctx->current_state != PROPOSING) {
+        /* a chunk split for a v1 client is that many frames on air */
+        const uint32_t interval = 1000 / OTA_CHUNK_RATE *
+            frag_frames_for(s_client.mac, sizeof(broadcast_header_t) + sizeof(ota_chunk_t) + OTA_CHUNK_SIZE);
+        if (now - s_client.last_sent >= interval) {
+            send_chunk(ctx);
+            s_client.last_sent = now;
+        }
+        uint32_t t = until(interval, now - s_client.last_sent);
+        if (t < wait) wait = t;
+    }
+
+    /* SEARCHING badges carry the version in their HELLOs */
+    bool hello_covers = pairing_is_ready(ctx) && ctx->current_state == SEARCHING;
+    if (s_stats.serving_version > 0 && !hello_covers) {
+        if (now - s_last_advert >= OTA_ADVERT_MS) {
+            uint32_t version = s_stats.serving_version;
+            pairing_send_payload(ctx, espnow_broadcast_mac, MSG_OTA_ADVERT, &version, sizeof(version));
+            s_last_advert = now;
+        }
+        uint32_t t = until(OTA_ADVERT_MS, now - s_last_advert);
+        if (t < wait) wait = t;
+    }
+
+    if (s_apply_pending) {
+        bool busy = s_dl.active || s_client.active || ctx->current_state != SEARCHING;
+        if (!busy || now - s_ready_at >= OTA_APPLY_DEFER_MS) {
+            apply_update();
+        }
+    }
+
+    if (s_stats_dirty) {
+        SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+        s_stats_dirty = false;
+    }
+    return wait;
+}
+
+void ota_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    if (ctx == NULL || mac_addr == NULL || data == NULL || len < (int)sizeof(broadcast_header_t)) return;
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+    const uint8_t *payload = data + sizeof(broadcast_header_t);
+    size_t payload_len = len - sizeof(broadcast_header_t);
+
+    switch (hdr->msg_type) {
+        case MSG_HELLO:
+        case MSG_OTA_ADVERT:
+        {
+            uint32_t version;
+            if (s_confirm_pending && !s_heard_peer && hdr->msg_type == MSG_HELLO) {
+                s_heard_peer = pairing_frame_tag_valid(ctx, mac_addr, data, len);
+            }
+            if (pairing_frame_version(data, len, &version)) {
+                on_version(ctx, mac_addr, version, data, len);
+            }
+            break;
+        }
+        case MSG_OTA_REQUEST:
+            if (payload_len >= sizeof(ota_request_t)) {
+                on_request(mac_addr, (const ota_request_t *)payload);
+            }
+            break;
+        case MSG_OTA_CHUNK:
+            if (payload_len >= sizeof(ota_chunk_t)) {
+                on_chunk(ctx, mac_addr, (const ota_chunk_t *)payload, payload_len - sizeof(ota_chunk_t));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+esp_err_t ota_init(void)
+{
+    s_running = esp_ota_get_running_partition();
+    if (s_running == NULL) {
+        ESP_LOGE(TAG, "No running partition");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const esp_app_desc_t *desc = esp_app_get_description();
+    s_stats.running_version = parse_version(desc->version);
+    s_running_size = image_size(s_running);
+
+    if (s_stats.running_version > 0 && s_running_size > 0) {
+        s_serve_part = s_running;
+        s_serve_size = s_running_size;
+        s_stats.serving_version = s_stats.running_version;
+    } else {
+        ESP_LOGW(TAG, "Version \"%s\" is not a number or the image is unreadable, not serving", desc->version);
+    }
+
+    s_update = esp_ota_get_next_update_partition(NULL);
+#if !CONFIG_SECURE_SIGNED_ON_UPDATE && !CONFIG_ESPNOW_OTA_ALLOW_UNSIGNED
+    if (s_update != NULL) {
+        ESP_LOGW(TAG, "Signed apps are off, not accepting images from other badges");
+        s_update = NULL;
+    }
+#endif
+
+    esp_ota_img_states_t state;
+    s_confirm_pending = esp_ota_get_state_partition(s_running, &state) == ESP_OK &&
+                        state == ESP_OTA_IMG_PENDING_VERIFY;
+    if (s_confirm_pending) {
+        ESP_LOGW(TAG, "First boot of %s: confirmed after %d s and a HELLO, a reset before rolls back",
+                 s_running->label, OTA_CONFIRM_UPTIME_MS / 1000);
+    }
+
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+
+    ESP_LOGI(TAG, "Running version %lu from %s (%lu bytes), updates into %s",
+             (unsigned long)s_stats.running_version, s_running->label, (unsigned long)s_running_size,
+             s_update != NULL ? s_update->label : "nothing");
+    return ESP_OK;
+}
+
+uint32_t ota_serving_version(void)
+{
+    return s_stats.serving_version;
+}
+
+void ota_get_stats(ota_stats_t *out)
+{
+    SNAPSHOT_READ(s_stats_snap, out);
+}
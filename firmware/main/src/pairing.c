@@ -6,15 +6,33 @@
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_now.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_random.h"
+#include "mbedtls/md.h"
+#include "mbedtls/ecdh.h"
 #include "pairing.h"
 #include "espnow.h"
+#include "frag.h"
 #include "ble_task.h"
+#include "mem.h"
 
 #define PAIRING_DEFAULT_SIMILARITY_THRESHOLD 50
 #define PAIRING_MIN_RSSI_PROPOSING RSSI_ZONE_MEDIUM
 
+#ifdef CONFIG_ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM
+#define PAIRING_MAX_ENCRYPT_PEERS CONFIG_ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM
+#else
+#define PAIRING_MAX_ENCRYPT_PEERS 7
+#endif
+
 static const char *TAG = "pairing";
 
+/* keyed once in pairing_set_group_key(), only hmac_reset() per HELLO */
+static mbedtls_md_context_t s_hello_hmac;    /* keyed with the group key */
+static bool s_hello_hmac_ready;
+static bool s_hmac_setup;
+
 #define HEADER_SIZE (sizeof(broadcast_header_t))
 
 static void propose_pairing(pairing_ctx_t *ctx, const uint8_t *target_mac);
@@ -24,9 +42,24 @@ static void send_hello(pairing_ctx_t *ctx);
 static void send_heartbeat(pairing_ctx_t *ctx);
 static void handle_heartbeat(pairing_ctx_t *ctx, const uint8_t *mac_addr, const broadcast_header_t *pkt, int8_t rssi);
 static void fill_packet_header(pairing_ctx_t *ctx, broadcast_header_t *pkt);
+static int8_t select_tx_power(pairing_ctx_t *ctx, uint8_t msg_type);
+static void adjust_partner_power(pairing_ctx_t *ctx, int8_t partner_heard);
 static void register_peer(const uint8_t *mac);
+static void unregister_peer(const uint8_t *mac);
+static bool evict_idle_peer(const uint8_t *keep_mac);
 static uint32_t get_time_ms(void);
 static void send_key_exchange(pairing_ctx_t *ctx);
+static void key_exchange_tick(pairing_ctx_t *ctx, uint32_t now);
+static esp_err_t set_partner_encryption(pairing_ctx_t *ctx, bool encrypt);
+static esp_err_t make_share(pairing_ctx_t *ctx);
+static esp_err_t derive_link_key(pairing_ctx_t *ctx, const uint8_t *peer_share);
+static bool hello_tag(const uint8_t *data, size_t len, uint8_t *out_tag);
+static bool hello_tag_valid(const uint8_t *data, int len, size_t signed_len);
+static void suspend_pairing(pairing_ctx_t *ctx, uint32_t now);
+static void resume_pairing(pairing_ctx_t *ctx, int8_t rssi);
+static void send_resume(pairing_ctx_t *ctx);
+static void handle_resume(pairing_ctx_t *ctx, const broadcast_header_t *pkt, const uint8_t *data, int len, int8_t rssi);
+static bool session_ticket(const pairing_ctx_t *ctx, const uint8_t *sender_mac, uint32_t seq_num, uint8_t *out_ticket);
 static void send_relay_url(pairing_ctx_t *ctx);
 
 static size_t build_packet_with_bitmask(pairing_ctx_t *ctx, uint8_t *buf, size_t buf_size, 
@@ -37,6 +70,54 @@ static bool parse_incoming_packet(const uint8_t *data, int len,
 static uint8_t calculate_bitmask_similarity(const uint8_t *a, uint16_t a_len,
                                             const uint8_t *b, uint16_t b_len);
 
+/*
+ * mbedtls_md_setup() allocates the HMAC state; starts/update/finish on a
+ * set-up context do not. The HELLO context is set up once, from
+ * pairing_init(), so tagging every HELLO stays off the heap.
+ */
+static esp_err_t hmac_setup(void)
+{
+    if (s_hmac_setup) return ESP_OK;
+
+    mbedtls_md_init(&s_hello_hmac);
+    int ret = mbedtls_md_setup(&s_hello_hmac, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "HMAC setup failed: -0x%04x", -ret);
+        mbedtls_md_free(&s_hello_hmac);
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_hmac_setup = true;
+    return ESP_OK;
+}
+
+/*
+ * HMAC-SHA256 over @p parts, keyed per exchange. a context of its own per
+ * call, so two exchanges never share one; it runs at pairing and on RESUME,
+ * next to scalar multiplications that reach mbedtls' heap anyway
+ */
+static int link_hmac(const uint8_t *key, size_t key_len, const uint8_t *const *parts, const size_t *lens,
+                     int count, uint8_t *digest)
+{
+    mbedtls_md_context_t md;
+
+    mbedtls_md_init(&md);
+    int ret = mbedtls_md_setup(&md, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    if (ret == 0) ret = mbedtls_md_hmac_starts(&md, key, key_len);
+    for (int i = 0; ret == 0 && i < count; i++) {
+        ret = mbedtls_md_hmac_update(&md, parts[i], lens[i]);
+    }
+    if (ret == 0) ret = mbedtls_md_hmac_finish(&md, digest);
+    mbedtls_md_free(&md);
+    return ret;
+}
+
+static int share_rng(void *arg, unsigned char *out, size_t len)
+{
+    esp_fill_random(out, len);
+    return 0;
+}
+
 esp_err_t pairing_init(pairing_ctx_t *ctx)
 {
     if (ctx == NULL) {
@@ -59,6 +140,16 @@ esp_err_t pairing_init(pairing_ctx_t *ctx)
     memset(ctx->partner_public_key, 0, PAIRING_KEY_MAX_LEN);
 
     ctx->similarity_threshold = PAIRING_DEFAULT_SIMILARITY_THRESHOLD;
+    ctx->hello_interval_ms = PAIRING_REBROADCAST_MS;
+
+    /* wifi_init() has run: this is the PHY's configured maximum */
+    if (esp_wifi_get_max_tx_power(&ctx->tx_max_q) != ESP_OK) {
+        ctx->tx_max_q = PAIRING_TX_REF_Q;
+    }
+    ctx->tx_power_q = ctx->tx_max_q;
+    ctx->tx_power_req_q = ctx->tx_max_q;
+    ctx->tx_cap_q = ctx->tx_max_q;
+    ctx->partner_tx_q = ctx->tx_max_q;
 
     memset(&ctx->kex, 0, sizeof(key_exchange_ctx_t));
 
@@ -68,6 +159,9 @@ esp_err_t pairing_init(pairing_ctx_t *ctx)
         return ret;
     }
 
+    ret = hmac_setup();
+    if (ret != ESP_OK) return ret;
+
     ESP_LOGI(TAG, "Pairing initialized. Waiting for bitmask and pubkey via BLE...");
     return ESP_OK;
 }
@@ -93,10 +187,10 @@ void pairing_set_bitmask(pairing_ctx_t *ctx, const uint8_t *data, uint16_t len)
     if (ctx == NULL || data == NULL || len == 0 || len > PAIRING_BITMASK_MAX_LEN) return;
 
     if (ctx->bitmask != NULL) {
-        free(ctx->bitmask);
+        mem_free(ctx->bitmask);
     }
     
-    ctx->bitmask = malloc(len);
+    ctx->bitmask = mem_malloc(MEM_TAG_PAIRING, len);
     if (ctx->bitmask == NULL) {
         ESP_LOGE(TAG, "Failed to allocate bitmask");
         return;
@@ -119,6 +213,19 @@ bool pairing_is_ready(const pairing_ctx_t *ctx)
     return ctx != NULL && ctx->has_bitmask && ctx->has_pubkey;
 }
 
+bool pairing_handshake_active(const pairing_ctx_t *ctx)
+{
+    switch (ctx->current_state) {
+        case PROPOSING:
+        case SUSPENDED:
+            return true;
+        case PAIRED:
+            return ctx->kex.active && !ctx->kex.key_confirmed;
+        default:
+            return false;
+    }
+}
+
 void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
                          const uint8_t *data, int len, int8_t rssi)
 {
@@ -158,8 +265,13 @@ void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
      * 
      * PAIRED: connected, exchanging heartbeats
      *   - on heartbeat: update rssi, reset timeout
+     *   - on resume from a suspended partner: answer so it can come back
      *   - on proposal from others: reject (already paired)
      * 
+     * SUSPENDED: heartbeats lapsed, session kept for the grace period
+     *   - on resume with a valid ticket: back to PAIRED, no key exchange
+     *   - on proposal from others: reject (still spoken for)
+     * 
      * the idea: filter by interests first (bitmask), then by proximity (rssi).
      * bitmask similarity is symmetric so we only check on hello, not on proposal.
      */
@@ -181,11 +293,24 @@ void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
                     break;
                 }
                 
+                size_t caps_at = HEADER_SIZE + recv_bitmask_len + sizeof(uint32_t);
+                if (memcmp(pkt->sender_mac, mac_addr, ESP_NOW_ETH_ALEN) != 0) {
+                    ESP_LOGD(TAG, "Ignoring HELLO from " MACSTR " (sender MAC mismatch)", MAC2STR(mac_addr));
+                    break;
+                }
+                if (ctx->has_group_key &&
+                    ((size_t)len < caps_at + 1 + PAIRING_HELLO_TAG_LEN ||
+                     !hello_tag_valid(data, len, len - PAIRING_HELLO_TAG_LEN))) {
+                    ESP_LOGD(TAG, "Ignoring HELLO from " MACSTR " (bad group tag)", MAC2STR(mac_addr));
+                    break;
+                }
+                frag_set_peer_caps(mac_addr, (size_t)len > caps_at ? data[caps_at] : 0);
+                
                 ESP_LOGI(TAG, "HELLO from " MACSTR " similarity=%d%%, proposing...", 
                          MAC2STR(mac_addr), similarity);
                 
-                if (ctx->partner_bitmask != NULL) free(ctx->partner_bitmask);
-                ctx->partner_bitmask = malloc(recv_bitmask_len);
+                if (ctx->partner_bitmask != NULL) mem_free(ctx->partner_bitmask);
+                ctx->partner_bitmask = mem_malloc(MEM_TAG_PAIRING, recv_bitmask_len);
                 if (ctx->partner_bitmask != NULL) {
                     memcpy(ctx->partner_bitmask, recv_bitmask, recv_bitmask_len);
                     ctx->partner_bitmask_len = recv_bitmask_len;
@@ -205,8 +330,8 @@ void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
                 strncpy(ctx->partner_public_key, recv_pubkey, PAIRING_KEY_MAX_LEN - 1);
                 ctx->partner_public_key[PAIRING_KEY_MAX_LEN - 1] = '\0';
                 
-                if (ctx->partner_bitmask != NULL) free(ctx->partner_bitmask);
-                ctx->partner_bitmask = malloc(recv_bitmask_len);
+                if (ctx->partner_bitmask != NULL) mem_free(ctx->partner_bitmask);
+                ctx->partner_bitmask = mem_malloc(MEM_TAG_PAIRING, recv_bitmask_len);
                 if (ctx->partner_bitmask != NULL) {
                     memcpy(ctx->partner_bitmask, recv_bitmask, recv_bitmask_len);
                     ctx->partner_bitmask_len = recv_bitmask_len;
@@ -234,8 +359,8 @@ void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
                     ctx->partner_public_key[PAIRING_KEY_MAX_LEN - 1] = '\0';
                     
                     if (recv_bitmask != NULL && recv_bitmask_len > 0) {
-                        if (ctx->partner_bitmask != NULL) free(ctx->partner_bitmask);
-                        ctx->partner_bitmask = malloc(recv_bitmask_len);
+                        if (ctx->partner_bitmask != NULL) mem_free(ctx->partner_bitmask);
+                        ctx->partner_bitmask = mem_malloc(MEM_TAG_PAIRING, recv_bitmask_len);
                         if (ctx->partner_bitmask != NULL) {
                             memcpy(ctx->partner_bitmask, recv_bitmask, recv_bitmask_len);
                             ctx->partner_bitmask_len = recv_bitmask_len;
@@ -250,6 +375,7 @@ void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
                     ctx->partner_seq = 0;
                     ctx->missed_heartbeats = 0;
                     ctx->partner_rssi = rssi;
+                    ctx->partner_tx_q = ctx->tx_max_q;
                     
                     memset(&ctx->kex, 0, sizeof(key_exchange_ctx_t));
                     ctx->kex.active = true;
@@ -292,8 +418,8 @@ void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
                 strncpy(ctx->partner_public_key, recv_pubkey, PAIRING_KEY_MAX_LEN - 1);
                 ctx->partner_public_key[PAIRING_KEY_MAX_LEN - 1] = '\0';
                 
-                if (ctx->partner_bitmask != NULL) free(ctx->partner_bitmask);
-                ctx->partner_bitmask = malloc(recv_bitmask_len);
+                if (ctx->partner_bitmask != NULL) mem_free(ctx->partner_bitmask);
+                ctx->partner_bitmask = mem_malloc(MEM_TAG_PAIRING, recv_bitmask_len);
                 if (ctx->partner_bitmask != NULL) {
                     memcpy(ctx->partner_bitmask, recv_bitmask, recv_bitmask_len);
                     ctx->partner_bitmask_len = recv_bitmask_len;
@@ -310,8 +436,28 @@ void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
                     handle_heartbeat(ctx, mac_addr, pkt, rssi);
                 }
                 else if (pkt->msg_type == MSG_KEY_EXCHANGE) {
-                    ctx->kex.key_confirmed = true;
-                    ESP_LOGI(TAG, "Key exchange confirmed from " MACSTR, MAC2STR(mac_addr));
+                    /* the share follows the echoed public key */
+                    const uint8_t *share = NULL;
+                    if (recv_pubkey != NULL) {
+                        size_t at = (size_t)((const uint8_t *)recv_pubkey - data) + strlen(recv_pubkey) + 1;
+                        if ((size_t)len >= at + PAIRING_SHARE_LEN) share = data + at;
+                    }
+                    if (share == NULL) {
+                        ESP_LOGW(TAG, "KEY_EXCHANGE from " MACSTR " without a share", MAC2STR(mac_addr));
+                        break;
+                    }
+                    /* the partner resends until we confirm, so a failed derivation gets retried */
+                    if (!ctx->kex.keyed && derive_link_key(ctx, share) != ESP_OK) {
+                        break;
+                    }
+                    if (!ctx->kex.key_confirmed) {
+                        ctx->kex.key_confirmed = true;
+                        ctx->kex.sent_after_confirm = false;
+                        ctx->handshake_ms = get_time_ms() - ctx->handshake_started;
+                        ctx->handshakes++;
+                        ESP_LOGI(TAG, "Key exchange confirmed from " MACSTR " (%lu ms)", MAC2STR(mac_addr),
+                                 (unsigned long)ctx->handshake_ms);
+                    }
                 }
                 else if (pkt->msg_type == MSG_RELAY_URL) {
                     if (recv_pubkey != NULL) {
@@ -321,6 +467,20 @@ void pairing_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac_addr,
                         ESP_LOGI(TAG, "Received relay URL from " MACSTR, MAC2STR(mac_addr));
                     }
                 }
+                else if (pkt->msg_type == MSG_RESUME) {
+                    handle_resume(ctx, pkt, data, len, rssi);
+                }
+            }
+            else if (pkt->msg_type == MSG_PROPOSAL) {
+                send_reject(ctx, mac_addr);
+            }
+            break;
+
+        case SUSPENDED:
+            if (memcmp(ctx->partner_mac, mac_addr, ESP_NOW_ETH_ALEN) == 0) {
+                if (pkt->msg_type == MSG_RESUME) {
+                    handle_resume(ctx, pkt, data, len, rssi);
+                }
             }
             else if (pkt->msg_type == MSG_PROPOSAL) {
                 send_reject(ctx, mac_addr);
@@ -338,7 +498,7 @@ void pairing_tick(pairing_ctx_t *ctx)
 
     switch (ctx->current_state) {
         case SEARCHING:
-            if (now - ctx->last_action_time > PAIRING_REBROADCAST_MS) {
+            if (now - ctx->last_action_time > ctx->hello_interval_ms) {
                 send_hello(ctx);
                 ctx->last_action_time = now;
             }
@@ -357,18 +517,19 @@ void pairing_tick(pairing_ctx_t *ctx)
                 send_heartbeat(ctx);
                 ctx->last_heartbeat_sent = now;
             }
+            /* partner gone quiet: stop saving power before the link is lost */
+            if (now - ctx->last_heartbeat_recv > PAIRING_HEARTBEAT_MS * 2) {
+                ctx->partner_tx_q = ctx->tx_max_q;
+            }
             if (now - ctx->last_heartbeat_recv > PAIRING_HEARTBEAT_MS * PAIRING_HEARTBEAT_MISS_MAX) {
                 ESP_LOGW(TAG, "Lost connection to partner");
-                pairing_reset(ctx);
+                suspend_pairing(ctx, now);
                 break;
             }
             
             if (ctx->kex.active) {
-                if (!ctx->kex.key_sent) {
-                    send_key_exchange(ctx);
-                    ctx->kex.key_sent = true;
-                }
-                
+                key_exchange_tick(ctx, now);
+
                 if (ctx->kex.key_confirmed && !ctx->kex.notified_phone) {
                     char msg[PAIRING_KEY_MAX_LEN + 16];
                     snprintf(msg, sizeof(msg), "PARTNER:%s" BLE_MESSAGE_DELIMITER_STR, ctx->partner_public_key);
@@ -377,7 +538,9 @@ void pairing_tick(pairing_ctx_t *ctx)
                     ESP_LOGI(TAG, "Notified phone of partner pubkey");
                 }
                 
-                if (ctx->kex.has_outgoing_url && !ctx->kex.outgoing_url_sent) {
+                /* hold the url until the partner link is sealed, unless it can't be */
+                bool link_ready = ctx->kex.link_verified || ctx->kex.link_unavailable;
+                if (ctx->kex.has_outgoing_url && !ctx->kex.outgoing_url_sent && link_ready) {
                     send_relay_url(ctx);
                     ctx->kex.outgoing_url_sent = true;
                 }
@@ -391,18 +554,36 @@ void pairing_tick(pairing_ctx_t *ctx)
                 }
             }
             break;
+
+        case SUSPENDED:
+            if (now - ctx->suspended_at > PAIRING_RESUME_GRACE_MS) {
+                ESP_LOGW(TAG, "Partner " MACSTR " did not come back, resetting", MAC2STR(ctx->partner_mac));
+                pairing_reset(ctx);
+                break;
+            }
+            if (now - ctx->last_resume_sent >= PAIRING_RESUME_RETRY_MS) {
+                send_resume(ctx);
+                ctx->last_resume_sent = now;
+            }
+            break;
     }
 }
 
 void pairing_reset(pairing_ctx_t *ctx)
 {
     if (ctx == NULL) return;
+
+    static const uint8_t zero_mac[ESP_NOW_ETH_ALEN] = {0};
+    if (memcmp(ctx->partner_mac, zero_mac, ESP_NOW_ETH_ALEN) != 0) {
+        unregister_peer(ctx->partner_mac);
+    }
+
     ctx->current_state = SEARCHING;
     memset(ctx->partner_mac, 0, ESP_NOW_ETH_ALEN);
     memset(ctx->partner_public_key, 0, PAIRING_KEY_MAX_LEN);
     
     if (ctx->partner_bitmask != NULL) {
-        free(ctx->partner_bitmask);
+        mem_free(ctx->partner_bitmask);
         ctx->partner_bitmask = NULL;
     }
     ctx->partner_bitmask_len = 0;
@@ -486,8 +667,9 @@ static bool parse_incoming_packet(const uint8_t *data, int len,
         *out_bitmask_len = 0;
     }
     
+    /* a v1 receiver keeps the first 250 bytes of a longer frame: no terminator, no key */
     size_t remaining = len - HEADER_SIZE - bitmask_len;
-    if (remaining > 0) {
+    if (remaining > 0 && memchr(payload, '\0', remaining) != NULL) {
         *out_pubkey = (const char *)payload;
     } else {
         *out_pubkey = NULL;
@@ -503,16 +685,227 @@ static void fill_packet_header(pairing_ctx_t *ctx, broadcast_header_t *pkt)
     pkt->state = ctx->current_state;
     pkt->uptime_ms = get_time_ms();
     pkt->last_rssi = ctx->partner_rssi;
+    pkt->tx_power_q = select_tx_power(ctx, pkt->msg_type);
+    pkt->seq_num = ++ctx->tx_seq;
+}
+
+/*
+ * runs from fill_packet_header(), right before the frame is handed to
+ * esp_now_send(). the driver applies a new limit to whatever it transmits
+ * next, so a frame still queued from just before a switch goes out at the
+ * new power but stamped with the old one; that skews one RSSI sample at
+ * its receiver. switches happen on state changes and at most once per
+ * heartbeat otherwise.
+ */
+static int8_t select_tx_power(pairing_ctx_t *ctx, uint8_t msg_type)
+{
+    int8_t want = ctx->tx_max_q;
+
+#if CONFIG_ESPNOW_TX_POWER_CONTROL
+    if (msg_type == MSG_HELLO) {
+        want = PAIRING_TX_HELLO_Q;
+    } else if (msg_type == MSG_HEARTBEAT || msg_type == MSG_KEY_EXCHANGE || msg_type == MSG_RELAY_URL) {
+        want = ctx->partner_tx_q;
+    }
+#endif
+
+    if (want > ctx->tx_cap_q) want = ctx->tx_cap_q;
+    if (want < PAIRING_TX_MIN_Q) want = PAIRING_TX_MIN_Q;
+    if (want == ctx->tx_power_req_q) return ctx->tx_power_q;
+
+    /* the radio rounds to its own steps, stamp what it actually uses */
+    esp_err_t ret = esp_wifi_set_max_tx_power(want);
+    if (ret == ESP_OK) ret = esp_wifi_get_max_tx_power(&ctx->tx_power_q);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "TX power %d failed: %s", want, esp_err_to_name(ret));
+        return ctx->tx_power_q;
+    }
+
+    ctx->tx_power_req_q = want;
+    ctx->tx_power_changes++;
+    ESP_LOGD(TAG, "TX power %d.%02d dBm for type %d", ctx->tx_power_q / 4, (ctx->tx_power_q % 4) * 25, msg_type);
+    return ctx->tx_power_q;
+}
+
+/*
+ * partner_heard is the partner's last_rssi: our frames as it heard them,
+ * scaled to PAIRING_TX_REF_Q. at power p it hears partner_heard +
+ * (p - ref) / 4 dB, so ref + 4 * (target - partner_heard) puts it at the
+ * target. up at once, down in steps, and not at all for small wobble.
+ */
+static void adjust_partner_power(pairing_ctx_t *ctx, int8_t partner_heard)
+{
+#if !CONFIG_ESPNOW_TX_POWER_CONTROL
+    return;
+#endif
+    if (partner_heard >= 0) return;     /* 0: partner hasn't heard a heartbeat yet */
+
+    int want = PAIRING_TX_REF_Q + 4 * (PAIRING_TX_TARGET_RSSI - partner_heard);
+    if (want > ctx->tx_max_q) want = ctx->tx_max_q;
+    if (want < PAIRING_TX_MIN_Q) want = PAIRING_TX_MIN_Q;
+
+    int cur = ctx->partner_tx_q;
+    if (want > cur && (want - cur >= PAIRING_TX_DEADBAND_Q || want == ctx->tx_max_q)) {
+        ctx->partner_tx_q = (int8_t)want;
+    } else if (cur - want >= PAIRING_TX_DEADBAND_Q) {
+        ctx->partner_tx_q = (int8_t)(cur - want > PAIRING_TX_STEP_DOWN_Q ? cur - PAIRING_TX_STEP_DOWN_Q : want);
+    }
+}
+
+int8_t pairing_rssi_at_ref(const broadcast_header_t *hdr, int8_t rssi)
+{
+    int8_t tx = hdr->tx_power_q;
+    if (tx < PAIRING_TX_MIN_Q || tx > PAIRING_TX_MAX_Q) return rssi;     /* not a power we'd send at */
+
+    int scaled = rssi + (PAIRING_TX_REF_Q - tx) / 4;
+    return (int8_t)(scaled > -1 ? -1 : scaled);
 }
 
 static void send_hello(pairing_ctx_t *ctx)
 {
-    uint8_t buf[HEADER_SIZE + PAIRING_BITMASK_MAX_LEN];
-    size_t pkt_size = build_packet_with_bitmask(ctx, buf, sizeof(buf), MSG_HELLO, NULL);
+    uint8_t buf[HEADER_SIZE + PAIRING_BITMASK_MAX_LEN + sizeof(uint32_t) + 1 + PAIRING_HELLO_TAG_LEN];
+    size_t pkt_size = build_packet_with_bitmask(ctx, buf, sizeof(buf) - sizeof(uint32_t) - 1 - PAIRING_HELLO_TAG_LEN,
+                                                MSG_HELLO, NULL);
     
-    if (pkt_size > 0) {
-        esp_now_send(espnow_broadcast_mac, buf, pkt_size);
+    if (pkt_size == 0) return;
+
+    memcpy(buf + pkt_size, &ctx->fw_version, sizeof(uint32_t));
+    pkt_size += sizeof(uint32_t);
+    buf[pkt_size++] = frag_local_caps();
+
+    if (ctx->has_group_key) {
+        if (!hello_tag(buf, pkt_size, buf + pkt_size)) return;
+        pkt_size += PAIRING_HELLO_TAG_LEN;
+    }
+
+    frag_send(ctx, espnow_broadcast_mac, buf, pkt_size);
+}
+
+/* HMAC-SHA256 over the frame, truncated to PAIRING_HELLO_TAG_LEN */
+static bool hello_tag(const uint8_t *data, size_t len, uint8_t *out_tag)
+{
+    uint8_t digest[32];
+
+    if (!s_hello_hmac_ready) return false;
+
+    int ret = mbedtls_md_hmac_reset(&s_hello_hmac);
+    if (ret == 0) ret = mbedtls_md_hmac_update(&s_hello_hmac, data, len);
+    if (ret == 0) ret = mbedtls_md_hmac_finish(&s_hello_hmac, digest);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "HELLO tag failed: -0x%04x", -ret);
+        return false;
+    }
+
+    memcpy(out_tag, digest, PAIRING_HELLO_TAG_LEN);
+    return true;
+}
+
+static bool hello_tag_valid(const uint8_t *data, int len, size_t signed_len)
+{
+    uint8_t expected[PAIRING_HELLO_TAG_LEN];
+
+    if ((size_t)len != signed_len + PAIRING_HELLO_TAG_LEN) return false;
+
+    int64_t start = esp_timer_get_time();
+    if (!hello_tag(data, signed_len, expected)) return false;
+    ESP_LOGV(TAG, "HELLO tag verify %lld us", (long long)(esp_timer_get_time() - start));
+
+    /* constant time, the tag is what an attacker is guessing */
+    uint8_t diff = 0;
+    for (int i = 0; i < PAIRING_HELLO_TAG_LEN; i++) {
+        diff |= expected[i] ^ data[signed_len + i];
+    }
+    return diff == 0;
+}
+
+void pairing_set_group_key(pairing_ctx_t *ctx, const uint8_t *key, uint8_t len)
+{
+    if (ctx == NULL || key == NULL || len == 0 || len > PAIRING_GROUP_KEY_MAX_LEN) return;
+
+    s_hello_hmac_ready = false;
+
+    memcpy(ctx->group_key, key, len);
+    ctx->group_key_len = len;
+    ctx->has_group_key = false;
+
+    if (hmac_setup() != ESP_OK) return;
+    int ret = mbedtls_md_hmac_starts(&s_hello_hmac, ctx->group_key, ctx->group_key_len);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Group key setup failed: -0x%04x", -ret);
+        return;
+    }
+
+    s_hello_hmac_ready = true;
+    ctx->has_group_key = true;
+    ESP_LOGI(TAG, "Group key set (%d bytes), HELLOs are now authenticated", len);
+}
+
+void pairing_set_fw_version(pairing_ctx_t *ctx, uint32_t version)
+{
+    if (ctx == NULL) return;
+    ctx->fw_version = version;
+}
+
+bool pairing_frame_version(const uint8_t *data, int len, uint32_t *out_version)
+{
+    if (data == NULL || len < HEADER_SIZE) return false;
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+    if (hdr->msg_type != MSG_HELLO && hdr->msg_type != MSG_OTA_ADVERT) return false;
+    if (hdr->bitmask_len > PAIRING_BITMASK_MAX_LEN) return false;
+    if (HEADER_SIZE + hdr->bitmask_len + sizeof(uint32_t) > (size_t)len) return false;
+
+    memcpy(out_version, data + HEADER_SIZE + hdr->bitmask_len, sizeof(uint32_t));
+    return true;
+}
+
+bool pairing_frame_tag_valid(const pairing_ctx_t *ctx, const uint8_t *mac, const uint8_t *data, int len)
+{
+    if (len < HEADER_SIZE) return false;
+
+    /* the tag covers the header, so a frame replayed from another radio still passes it */
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+    if (memcmp(hdr->sender_mac, mac, ESP_NOW_ETH_ALEN) != 0) return false;
+
+    if (!ctx->has_group_key) return true;
+    if (len < HEADER_SIZE + PAIRING_HELLO_TAG_LEN) return false;
+
+    if (hdr->msg_type == MSG_HELLO) {
+        size_t caps_at = HEADER_SIZE + hdr->bitmask_len + sizeof(uint32_t);
+        return (size_t)len >= caps_at + 1 + PAIRING_HELLO_TAG_LEN &&
+               hello_tag_valid(data, len, len - PAIRING_HELLO_TAG_LEN);
+    }
+    if (hdr->msg_type == MSG_OTA_ADVERT) {
+        return hello_tag_valid(data, len, HEADER_SIZE + sizeof(uint32_t));
+    }
+    /* TIMESYNC: the tag closes the frame */
+    return hello_tag_valid(data, len, len - PAIRING_HELLO_TAG_LEN);
+}
+
+esp_err_t pairing_send_payload(pairing_ctx_t *ctx, const uint8_t *mac, uint8_t msg_type,
+                               const void *payload, size_t len)
+{
+    uint8_t buf[HEADER_SIZE + PAIRING_PAYLOAD_MAX + PAIRING_HELLO_TAG_LEN];
+    if (len > PAIRING_PAYLOAD_MAX) return ESP_ERR_INVALID_SIZE;
+
+    broadcast_header_t *pkt = (broadcast_header_t *)buf;
+    memset(pkt, 0, HEADER_SIZE);
+    pkt->protocol_id = PAIRING_PROTOCOL_ID;
+    pkt->msg_type = msg_type;
+    pkt->bitmask_len = 0;
+    fill_packet_header(ctx, pkt);
+    memcpy(buf + HEADER_SIZE, payload, len);
+    size_t pkt_size = HEADER_SIZE + len;
+
+    if ((msg_type == MSG_OTA_ADVERT || msg_type == MSG_TIMESYNC) && ctx->has_group_key) {
+        if (!hello_tag(buf, pkt_size, buf + pkt_size)) return ESP_FAIL;
+        pkt_size += PAIRING_HELLO_TAG_LEN;
+    }
+
+    if (!IS_BROADCAST_ADDR(mac)) {
+        register_peer(mac);
     }
+    return frag_send(ctx, mac, buf, pkt_size);
 }
 
 static void send_heartbeat(pairing_ctx_t *ctx)
@@ -520,11 +913,11 @@ static void send_heartbeat(pairing_ctx_t *ctx)
     broadcast_header_t pkt = {0};
     pkt.protocol_id = PAIRING_PROTOCOL_ID;
     pkt.msg_type = MSG_HEARTBEAT;
-    pkt.seq_num = ctx->heartbeat_seq++;
     pkt.bitmask_len = 0;
     fill_packet_header(ctx, &pkt);
+    ctx->heartbeat_seq++;
 
-    esp_now_send(ctx->partner_mac, (uint8_t *)&pkt, HEADER_SIZE);
+    frag_send(ctx, ctx->partner_mac, (uint8_t *)&pkt, HEADER_SIZE);
 }
 
 static void propose_pairing(pairing_ctx_t *ctx, const uint8_t *target_mac)
@@ -532,6 +925,7 @@ static void propose_pairing(pairing_ctx_t *ctx, const uint8_t *target_mac)
     memcpy(ctx->partner_mac, target_mac, ESP_NOW_ETH_ALEN);
     ctx->current_state = PROPOSING;
     ctx->last_action_time = get_time_ms();
+    ctx->handshake_started = ctx->last_action_time;
 
     register_peer(target_mac);
 
@@ -539,7 +933,7 @@ static void propose_pairing(pairing_ctx_t *ctx, const uint8_t *target_mac)
     size_t pkt_size = build_packet_with_bitmask(ctx, buf, sizeof(buf), MSG_PROPOSAL, ctx->my_public_key);
     
     if (pkt_size > 0) {
-        esp_err_t ret = esp_now_send(target_mac, buf, pkt_size);
+        esp_err_t ret = frag_send(ctx, target_mac, buf, pkt_size);
         if (ret == ESP_OK) {
             ESP_LOGI(TAG, "--> Sent PROPOSAL to " MACSTR, MAC2STR(target_mac));
         } else {
@@ -558,6 +952,9 @@ static void accept_pairing(pairing_ctx_t *ctx, const uint8_t *target_mac)
     ctx->last_heartbeat_sent = now;
     ctx->last_heartbeat_recv = now;
     ctx->heartbeat_seq = 0;
+    ctx->partner_rssi = 0;
+    ctx->partner_tx_q = ctx->tx_max_q;
+    ctx->handshake_started = now;
     
     memset(&ctx->kex, 0, sizeof(key_exchange_ctx_t));
     ctx->kex.active = true;
@@ -568,7 +965,7 @@ static void accept_pairing(pairing_ctx_t *ctx, const uint8_t *target_mac)
     size_t pkt_size = build_packet_with_bitmask(ctx, buf, sizeof(buf), MSG_ACCEPT, ctx->my_public_key);
     
     if (pkt_size > 0) {
-        esp_err_t ret = esp_now_send(target_mac, buf, pkt_size);
+        esp_err_t ret = frag_send(ctx, target_mac, buf, pkt_size);
         if (ret == ESP_OK) {
             ESP_LOGI(TAG, ">>> Sent ACCEPT to " MACSTR, MAC2STR(target_mac));
         } else {
@@ -587,7 +984,7 @@ static void send_reject(pairing_ctx_t *ctx, const uint8_t *target_mac)
     pkt.bitmask_len = 0;
     fill_packet_header(ctx, &pkt);
 
-    esp_now_send(target_mac, (uint8_t *)&pkt, HEADER_SIZE);
+    frag_send(ctx, target_mac, (uint8_t *)&pkt, HEADER_SIZE);
     ESP_LOGI(TAG, "<<< Sent REJECT to " MACSTR, MAC2STR(target_mac));
 }
 
@@ -597,6 +994,13 @@ static void handle_heartbeat(pairing_ctx_t *ctx, const uint8_t *mac_addr, const
     ctx->missed_heartbeats = 0;
     ctx->partner_seq = pkt->seq_num;
     ctx->partner_rssi = rssi;
+    adjust_partner_power(ctx, pkt->last_rssi);
+
+    /* a heartbeat that made it through CCMP proves both sides hold the LMK */
+    if (ctx->kex.link_encrypted && !ctx->kex.link_verified) {
+        ctx->kex.link_verified = true;
+        ESP_LOGI(TAG, "Encrypted link to " MACSTR " verified", MAC2STR(mac_addr));
+    }
 }
 
 static void register_peer(const uint8_t *mac)
@@ -609,7 +1013,219 @@ static void register_peer(const uint8_t *mac)
         .encrypt = false,
     };
     memcpy(peer_info.peer_addr, mac, ESP_NOW_ETH_ALEN);
-    esp_now_add_peer(&peer_info);
+
+    esp_err_t ret = esp_now_add_peer(&peer_info);
+    if (ret == ESP_ERR_ESPNOW_FULL && evict_idle_peer(mac)) {
+        ret = esp_now_add_peer(&peer_info);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to add peer " MACSTR ": %s", MAC2STR(mac), esp_err_to_name(ret));
+    }
+}
+
+static void unregister_peer(const uint8_t *mac)
+{
+    if (!esp_now_is_peer_exist(mac)) return;
+    esp_now_del_peer(mac);
+}
+
+/*
+ * the peer list only grows as we propose/reject people around us. when it
+ * fills up, drop the first plaintext unicast peer that isn't the one we're
+ * about to talk to; the encrypted partner and the broadcast peer stay.
+ */
+static bool evict_idle_peer(const uint8_t *keep_mac)
+{
+    esp_now_peer_info_t peer;
+    bool from_head = true;
+
+    while (esp_now_fetch_peer(from_head, &peer) == ESP_OK) {
+        from_head = false;
+        if (peer.encrypt) continue;
+        if (memcmp(peer.peer_addr, keep_mac, ESP_NOW_ETH_ALEN) == 0) continue;
+        if (memcmp(peer.peer_addr, espnow_broadcast_mac, ESP_NOW_ETH_ALEN) == 0) continue;
+
+        ESP_LOGD(TAG, "Peer list full, evicting " MACSTR, MAC2STR(peer.peer_addr));
+        return esp_now_del_peer(peer.peer_addr) == ESP_OK;
+    }
+    return false;
+}
+
+/* a fresh X25519 key pair for this pairing; the public half goes out in KEY_EXCHANGE */
+static esp_err_t make_share(pairing_ctx_t *ctx)
+{
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_point q;
+    mbedtls_mpi d;
+    size_t olen = 0;
+
+    mbedtls_ecp_group_init(&grp);
+    mbedtls_ecp_point_init(&q);
+    mbedtls_mpi_init(&d);
+    int ret = mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_CURVE25519);
+    if (ret == 0) ret = mbedtls_ecdh_gen_public(&grp, &d, &q, share_rng, NULL);
+    if (ret == 0) {
+        ret = mbedtls_ecp_point_write_binary(&grp, &q, MBEDTLS_ECP_PF_UNCOMPRESSED, &olen,
+                                             ctx->kex.share, PAIRING_SHARE_LEN);
+    }
+    if (ret == 0) ret = mbedtls_mpi_write_binary_le(&d, ctx->kex.secret, PAIRING_SHARE_LEN);
+    mbedtls_mpi_free(&d);
+    mbedtls_ecp_point_free(&q);
+    mbedtls_ecp_group_free(&grp);
+
+    if (ret != 0 || olen != PAIRING_SHARE_LEN) {
+        ESP_LOGE(TAG, "X25519 key generation failed: -0x%04x", -ret);
+        return ESP_FAIL;
+    }
+    ctx->kex.has_share = true;
+    return ESP_OK;
+}
+
+/*
+ * secret = X25519(our secret, partner's share)
+ * LMK = HMAC-SHA256(secret, "wayside-lmk" | mac_lo | mac_hi | share_lo | share_hi | key_lo | key_hi)[:16]
+ *
+ * lo/hi order by MAC so both badges feed the same bytes. the shares are
+ * made per pairing and both halves live in ctx->kex, so a stale LMK from
+ * an earlier pairing with the same badge can't be reused, and our secret
+ * half is wiped once the LMK is derived. the curve, each scalar
+ * multiplication and the HMAC allocate from mbedtls' heap; there are two
+ * of each per pairing.
+ */
+static esp_err_t derive_link_key(pairing_ctx_t *ctx, const uint8_t *peer_share)
+{
+    static const char label[] = "wayside-lmk";
+    uint8_t secret[PAIRING_SHARE_LEN] = {0};
+    uint8_t digest[32];
+    mbedtls_ecp_group grp;
+    mbedtls_ecp_point peer;
+    mbedtls_mpi d, z;
+
+    if (!ctx->kex.has_share && make_share(ctx) != ESP_OK) return ESP_FAIL;
+
+    mbedtls_ecp_group_init(&grp);
+    mbedtls_ecp_point_init(&peer);
+    mbedtls_mpi_init(&d);
+    mbedtls_mpi_init(&z);
+    int ret = mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_CURVE25519);
+    if (ret == 0) ret = mbedtls_mpi_read_binary_le(&d, ctx->kex.secret, PAIRING_SHARE_LEN);
+    if (ret == 0) ret = mbedtls_ecp_point_read_binary(&grp, &peer, peer_share, PAIRING_SHARE_LEN);
+    if (ret == 0) ret = mbedtls_ecdh_compute_shared(&grp, &z, &peer, &d, share_rng, NULL);
+    if (ret == 0) ret = mbedtls_mpi_write_binary_le(&z, secret, sizeof(secret));
+    mbedtls_ecp_point_free(&peer);
+    mbedtls_mpi_free(&d);
+    mbedtls_mpi_free(&z);
+    mbedtls_ecp_group_free(&grp);
+
+    /* a low order share makes the secret zero, which anyone can compute */
+    uint8_t any = 0;
+    for (size_t i = 0; i < sizeof(secret); i++) any |= secret[i];
+    if (ret == 0 && any == 0) ret = MBEDTLS_ERR_ECP_INVALID_KEY;
+
+    bool mine_first = memcmp(ctx->my_mac, ctx->partner_mac, ESP_NOW_ETH_ALEN) < 0;
+    const uint8_t *mac_lo = mine_first ? ctx->my_mac : ctx->partner_mac;
+    const uint8_t *mac_hi = mine_first ? ctx->partner_mac : ctx->my_mac;
+    const uint8_t *share_lo = mine_first ? ctx->kex.share : peer_share;
+    const uint8_t *share_hi = mine_first ? peer_share : ctx->kex.share;
+    const char *key_lo = mine_first ? ctx->my_public_key : ctx->partner_public_key;
+    const char *key_hi = mine_first ? ctx->partner_public_key : ctx->my_public_key;
+
+    const uint8_t *parts[] = {
+        (const uint8_t *)label, mac_lo, mac_hi, share_lo, share_hi, (const uint8_t *)key_lo, (const uint8_t *)key_hi,
+    };
+    const size_t lens[] = {
+        sizeof(label) - 1, ESP_NOW_ETH_ALEN, ESP_NOW_ETH_ALEN, PAIRING_SHARE_LEN, PAIRING_SHARE_LEN,
+        strlen(key_lo) + 1, strlen(key_hi) + 1,
+    };
+    if (ret == 0) ret = link_hmac(secret, sizeof(secret), parts, lens, 7, digest);
+    memset(secret, 0, sizeof(secret));
+
+    if (ret != 0) {
+        ESP_LOGE(TAG, "LMK derivation failed: -0x%04x", -ret);
+        return ESP_FAIL;
+    }
+
+    memcpy(ctx->kex.lmk, digest, PAIRING_LMK_LEN);
+    memset(digest, 0, sizeof(digest));
+    memset(ctx->kex.secret, 0, PAIRING_SHARE_LEN);
+    ctx->kex.keyed = true;
+    return ESP_OK;
+}
+
+static esp_err_t set_partner_encryption(pairing_ctx_t *ctx, bool encrypt)
+{
+    esp_now_peer_info_t peer_info = {
+        .channel = 0,
+        .ifidx = ESPNOW_WIFI_IF,
+        .encrypt = encrypt,
+    };
+    memcpy(peer_info.peer_addr, ctx->partner_mac, ESP_NOW_ETH_ALEN);
+
+    if (encrypt) {
+        esp_now_peer_num_t num;
+        if (esp_now_get_peer_num(&num) == ESP_OK && num.encrypt_num >= PAIRING_MAX_ENCRYPT_PEERS) {
+            return ESP_ERR_ESPNOW_FULL;
+        }
+
+        if (!ctx->kex.keyed) return ESP_ERR_INVALID_STATE;
+        memcpy(peer_info.lmk, ctx->kex.lmk, ESP_NOW_KEY_LEN);
+    }
+
+    if (esp_now_is_peer_exist(ctx->partner_mac)) {
+        return esp_now_mod_peer(&peer_info);
+    }
+    return esp_now_add_peer(&peer_info);
+}
+
+/*
+ * resend KEY_EXCHANGE every heartbeat until the partner's arrives, then once
+ * more so they are guaranteed to have ours, then switch the peer to CCMP.
+ * the first heartbeat decrypted after the switch verifies the link; if none
+ * arrives we assume the partner didn't switch and start over in plaintext.
+ * the shares stay the same for the whole pairing, so the LMK is kept.
+ */
+static void key_exchange_tick(pairing_ctx_t *ctx, uint32_t now)
+{
+    key_exchange_ctx_t *kex = &ctx->kex;
+
+    if (kex->link_encrypted) {
+        if (!kex->link_verified && now - kex->encrypted_at > PAIRING_LINK_VERIFY_MS) {
+            ESP_LOGW(TAG, "Encrypted link to " MACSTR " not verified, falling back to plaintext",
+                     MAC2STR(ctx->partner_mac));
+            set_partner_encryption(ctx, false);
+            kex->link_encrypted = false;
+            kex->key_sent = false;
+            kex->key_confirmed = false;
+            kex->sent_after_confirm = false;
+        }
+        return;
+    }
+
+    if (kex->key_confirmed && kex->sent_after_confirm) {
+        if (kex->link_unavailable) return;
+
+        esp_err_t ret = set_partner_encryption(ctx, true);
+        if (ret == ESP_OK) {
+            kex->link_encrypted = true;
+            kex->link_verified = false;
+            kex->encrypted_at = now;
+            ESP_LOGI(TAG, "Partner link " MACSTR " switched to CCMP", MAC2STR(ctx->partner_mac));
+        } else {
+            kex->link_unavailable = true;
+            ESP_LOGW(TAG, "Cannot encrypt partner link (%s), staying plaintext", esp_err_to_name(ret));
+        }
+        return;
+    }
+
+    bool resend = !kex->key_sent ||
+                  (kex->key_confirmed && !kex->sent_after_confirm) ||
+                  now - kex->last_key_sent > PAIRING_HEARTBEAT_MS;
+    if (resend) {
+        send_key_exchange(ctx);
+        kex->key_sent = true;
+        kex->last_key_sent = now;
+        if (kex->key_confirmed) kex->sent_after_confirm = true;
+    }
 }
 
 static uint32_t get_time_ms(void)
@@ -657,13 +1273,34 @@ void pairing_set_similarity_threshold(pairing_ctx_t *ctx, uint8_t threshold)
     ESP_LOGI(TAG, "Similarity threshold set to %d%%", ctx->similarity_threshold);
 }
 
+void pairing_set_hello_interval(pairing_ctx_t *ctx, uint32_t interval_ms)
+{
+    if (ctx == NULL) return;
+    ctx->hello_interval_ms = interval_ms < PAIRING_REBROADCAST_MS ? PAIRING_REBROADCAST_MS : interval_ms;
+    ESP_LOGI(TAG, "HELLO interval set to %lu ms", (unsigned long)ctx->hello_interval_ms);
+}
+
+void pairing_set_tx_power_cap(pairing_ctx_t *ctx, int8_t cap_q)
+{
+    if (ctx == NULL) return;
+    if (cap_q <= 0 || cap_q > ctx->tx_max_q) cap_q = ctx->tx_max_q;
+    if (cap_q < PAIRING_TX_MIN_Q) cap_q = PAIRING_TX_MIN_Q;
+    ctx->tx_cap_q = cap_q;
+    ESP_LOGI(TAG, "TX power capped at %d.%02d dBm", cap_q / 4, (cap_q % 4) * 25);
+}
+
 static void send_key_exchange(pairing_ctx_t *ctx)
 {
-    uint8_t buf[HEADER_SIZE + PAIRING_KEY_MAX_LEN];
-    size_t pkt_size = build_packet_with_bitmask(ctx, buf, sizeof(buf), MSG_KEY_EXCHANGE, ctx->partner_public_key);
+    uint8_t buf[HEADER_SIZE + PAIRING_BITMASK_MAX_LEN + PAIRING_KEY_MAX_LEN + PAIRING_SHARE_LEN];
+
+    if (!ctx->kex.has_share && make_share(ctx) != ESP_OK) return;
+    size_t pkt_size = build_packet_with_bitmask(ctx, buf, sizeof(buf) - PAIRING_SHARE_LEN, MSG_KEY_EXCHANGE,
+                                                ctx->partner_public_key);
     
     if (pkt_size > 0) {
-        esp_err_t ret = esp_now_send(ctx->partner_mac, buf, pkt_size);
+        memcpy(buf + pkt_size, ctx->kex.share, PAIRING_SHARE_LEN);
+        pkt_size += PAIRING_SHARE_LEN;
+        esp_err_t ret = frag_send(ctx, ctx->partner_mac, buf, pkt_size);
         if (ret == ESP_OK) {
             ESP_LOGI(TAG, "--> Sent KEY_EXCHANGE to " MACSTR, MAC2STR(ctx->partner_mac));
         } else {
@@ -674,11 +1311,11 @@ static void send_key_exchange(pairing_ctx_t *ctx)
 
 static void send_relay_url(pairing_ctx_t *ctx)
 {
-    uint8_t buf[HEADER_SIZE + KEY_EXCHANGE_URL_MAX_LEN];
+    uint8_t buf[HEADER_SIZE + PAIRING_BITMASK_MAX_LEN + KEY_EXCHANGE_URL_MAX_LEN];
     size_t pkt_size = build_packet_with_bitmask(ctx, buf, sizeof(buf), MSG_RELAY_URL, ctx->kex.outgoing_url);
     
     if (pkt_size > 0) {
-        esp_err_t ret = esp_now_send(ctx->partner_mac, buf, pkt_size);
+        esp_err_t ret = frag_send(ctx, ctx->partner_mac, buf, pkt_size);
         if (ret == ESP_OK) {
             ESP_LOGI(TAG, "--> Sent RELAY_URL to " MACSTR, MAC2STR(ctx->partner_mac));
         } else {
@@ -687,6 +1324,122 @@ static void send_relay_url(pairing_ctx_t *ctx)
     }
 }
 
+/*
+ * only sessions that finished key exchange are worth keeping: anything
+ * earlier is cheaper to redo than to resume. without an LMK there is no
+ * ticket to resume with either.
+ */
+static void suspend_pairing(pairing_ctx_t *ctx, uint32_t now)
+{
+    if (PAIRING_RESUME_GRACE_MS == 0 || !ctx->kex.key_confirmed || !ctx->kex.keyed) {
+        pairing_reset(ctx);
+        return;
+    }
+
+    ctx->current_state = SUSPENDED;
+    ctx->suspended_at = now;
+    ctx->last_resume_sent = now - PAIRING_RESUME_RETRY_MS;
+    ESP_LOGI(TAG, "Session with " MACSTR " suspended, holding for %d ms",
+             MAC2STR(ctx->partner_mac), PAIRING_RESUME_GRACE_MS);
+}
+
+static void resume_pairing(pairing_ctx_t *ctx, int8_t rssi)
+{
+    uint32_t now = get_time_ms();
+
+    ctx->current_state = PAIRED;
+    ctx->last_heartbeat_sent = now;
+    ctx->last_heartbeat_recv = now;
+    ctx->missed_heartbeats = 0;
+    ctx->partner_rssi = rssi;
+    ctx->partner_tx_q = ctx->tx_max_q;
+
+    /* restart the verify window so a pending CCMP switch isn't undone */
+    if (ctx->kex.link_encrypted && !ctx->kex.link_verified) {
+        ctx->kex.encrypted_at = now;
+    }
+
+    ctx->resume_count++;
+    ctx->last_outage_ms = now - ctx->suspended_at;
+    ESP_LOGI(TAG, ">>> Resumed session with " MACSTR " after %lu ms (rssi=%d)",
+             MAC2STR(ctx->partner_mac), (unsigned long)ctx->last_outage_ms, rssi);
+}
+
+static bool session_ticket(const pairing_ctx_t *ctx, const uint8_t *sender_mac, uint32_t seq_num, uint8_t *out_ticket)
+{
+    static const char label[] = "wayside-resume";
+    uint8_t msg[sizeof(label) - 1 + ESP_NOW_ETH_ALEN + sizeof(seq_num)];
+    uint8_t digest[32];
+
+    if (!ctx->kex.keyed) return false;
+
+    memcpy(msg, label, sizeof(label) - 1);
+    memcpy(msg + sizeof(label) - 1, sender_mac, ESP_NOW_ETH_ALEN);
+    memcpy(msg + sizeof(label) - 1 + ESP_NOW_ETH_ALEN, &seq_num, sizeof(seq_num));
+
+    const uint8_t *parts[] = { msg };
+    const size_t lens[] = { sizeof(msg) };
+    int ret = link_hmac(ctx->kex.lmk, PAIRING_LMK_LEN, parts, lens, 1, digest);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Resume ticket failed: -0x%04x", -ret);
+        return false;
+    }
+
+    memcpy(out_ticket, digest, PAIRING_RESUME_TICKET_LEN);
+    return true;
+}
+
+static void send_resume(pairing_ctx_t *ctx)
+{
+    uint8_t buf[HEADER_SIZE + PAIRING_RESUME_TICKET_LEN];
+    broadcast_header_t *pkt = (broadcast_header_t *)buf;
+
+    memset(buf, 0, sizeof(buf));
+    pkt->protocol_id = PAIRING_PROTOCOL_ID;
+    pkt->msg_type = MSG_RESUME;
+    pkt->bitmask_len = 0;
+    fill_packet_header(ctx, pkt);
+
+    if (!session_ticket(ctx, ctx->my_mac, pkt->seq_num, buf + HEADER_SIZE)) return;
+
+    esp_err_t ret = frag_send(ctx, ctx->partner_mac, buf, sizeof(buf));
+    if (ret == ESP_OK) {
+        ESP_LOGD(TAG, "--> Sent RESUME to " MACSTR, MAC2STR(ctx->partner_mac));
+    } else {
+        ESP_LOGE(TAG, "Failed to send RESUME: %s", esp_err_to_name(ret));
+    }
+}
+
+static void handle_resume(pairing_ctx_t *ctx, const broadcast_header_t *pkt, const uint8_t *data, int len, int8_t rssi)
+{
+    uint8_t expected[PAIRING_RESUME_TICKET_LEN];
+
+    if (len != HEADER_SIZE + PAIRING_RESUME_TICKET_LEN) return;
+    if (!session_ticket(ctx, ctx->partner_mac, pkt->seq_num, expected)) return;
+
+    uint8_t diff = 0;
+    for (int i = 0; i < PAIRING_RESUME_TICKET_LEN; i++) {
+        diff |= expected[i] ^ data[HEADER_SIZE + i];
+    }
+    if (diff != 0) {
+        ESP_LOGW(TAG, "RESUME from " MACSTR " with stale ticket, ignoring", MAC2STR(ctx->partner_mac));
+        return;
+    }
+
+    if (ctx->current_state == SUSPENDED) {
+        resume_pairing(ctx, rssi);
+    } else {
+        ctx->last_heartbeat_recv = get_time_ms();
+        ctx->missed_heartbeats = 0;
+        ctx->partner_rssi = rssi;
+    }
+
+    /* the sender is still waiting for proof we kept the session */
+    if (pkt->state == SUSPENDED) {
+        send_resume(ctx);
+    }
+}
+
 void pairing_set_relay_url(pairing_ctx_t *ctx, const char *url)
 {
     if (ctx == NULL || url == NULL) return;
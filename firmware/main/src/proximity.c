@@ -1,28 +1,23 @@
 #include "proximity.h"
 #include "buzzer.h"
 #include "hnr26_badge.h"
+#include "reactor.h"
+#include "bus.h"
+#include "snapshot.h"
+#include "assets.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
-#include "freertos/semphr.h"
 #include "esp_log.h"
 #include <string.h>
 
 static const char *TAG = "proximity";
 
-#define PROXIMITY_TASK_STACK_SIZE   3072
-#define PROXIMITY_TASK_PRIORITY     4
-#define PROXIMITY_TASK_NAME         "proximity"
-#define PROXIMITY_QUEUE_SIZE        10
-#define PROXIMITY_LOOP_PERIOD_MS    20
 #define PROXIMITY_MAX_LEDS          10
 
-typedef struct {
-    uint8_t led_count;
-    uint32_t blink_period_ms;
-} zone_params_t;
+#define PROXIMITY_ZONE_COUNT        (PROXIMITY_ZONE_EDGE + 1)
 
-static const zone_params_t ZONE_PARAMS[] = {
+/* built in; the "zones" asset replaces it when there is one */
+static const asset_zone_t ZONE_PARAMS[PROXIMITY_ZONE_COUNT] = {
     [PROXIMITY_ZONE_UNKNOWN]    = { .led_count = 0,  .blink_period_ms = 0    },
     [PROXIMITY_ZONE_VERY_CLOSE] = { .led_count = 10, .blink_period_ms = 50   },
     [PROXIMITY_ZONE_CLOSE]      = { .led_count = 7,  .blink_period_ms = 100  },
@@ -31,18 +26,22 @@ static const zone_params_t ZONE_PARAMS[] = {
     [PROXIMITY_ZONE_EDGE]       = { .led_count = 1,  .blink_period_ms = 800  },
 };
 
-typedef struct {
-    int8_t rssi;
-} proximity_event_t;
-
+/*
+ * Everything below runs on the reactor task. Other tasks only post events
+ * (proximity_update, proximity_enable), so the state needs no lock. What
+ * the getters report is copied to s_status after each change.
+ *
+ * blink_timer toggles the LEDs (and beeps on the "on" half) every
+ * blink_period_ms of the current zone. timeout_timer is pushed back by every
+ * RSSI sample and drops the zone to UNKNOWN when it fires.
+ */
 typedef struct {
     bool initialized;
     bool enabled;
     proximity_config_t config;
 
-    TaskHandle_t task_handle;
-    QueueHandle_t queue;
-    SemaphoreHandle_t mutex;
+    reactor_timer_t blink_timer;
+    reactor_timer_t timeout_timer;
 
     int8_t rssi_samples[PROXIMITY_RSSI_SAMPLES];
     uint8_t rssi_index;
@@ -51,15 +50,20 @@ typedef struct {
 
     proximity_zone_t current_zone;
     int8_t current_rssi;
-    TickType_t last_rssi_time;
 
     bool led_state;
-    TickType_t last_toggle_time;
+
+    const asset_zone_t *zones;  /* ZONE_PARAMS, or the asset in flash */
 } proximity_state_t;
 
 static proximity_state_t s_state = {0};
 
-static void proximity_task(void *pvParameter);
+/* written by the reactor (and by proximity_init before it has events) */
+SNAPSHOT_DEFINE(s_status, proximity_status_t);
+
+/* RSSI of every frame espnow_task handles, drained on the reactor */
+BUS_SUB_DEFINE(s_rssi_sub, 16);
+
 static proximity_zone_t rssi_to_zone(int8_t rssi);
 static void update_rssi_average(int8_t rssi);
 static void set_leds(uint8_t count, bool on);
@@ -96,6 +100,16 @@ static void update_rssi_average(int8_t rssi)
     s_state.current_rssi = (int8_t)(s_state.rssi_sum / s_state.rssi_count);
 }
 
+static void publish_status(void)
+{
+    proximity_status_t status = {
+        .zone = s_state.current_zone,
+        .rssi = s_state.current_rssi,
+        .enabled = s_state.enabled,
+    };
+    SNAPSHOT_WRITE(s_status, &status);
+}
+
 static void set_leds(uint8_t count, bool on)
 {
     aw9523_pin_data_digital_t state = on ? 1 : 0;
@@ -116,66 +130,83 @@ static void all_leds_off(void)
     }
 }
 
-static void proximity_task(void *pvParameter)
+static void on_blink(void *arg, uint32_t data)
 {
-    ESP_LOGI(TAG, "Proximity task started");
-
-    proximity_event_t evt;
-    TickType_t now;
-
-    while (1) {
-        now = xTaskGetTickCount();
-        hnr26_badge_update_virtual_pins_state();
-        if (xQueueReceive(s_state.queue, &evt, pdMS_TO_TICKS(PROXIMITY_LOOP_PERIOD_MS)) == pdTRUE) {
-            if (xSemaphoreTake(s_state.mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-                update_rssi_average(evt.rssi);
-                s_state.last_rssi_time = now;
-                s_state.current_zone = rssi_to_zone(s_state.current_rssi);
-                xSemaphoreGive(s_state.mutex);
-
-                ESP_LOGD(TAG, "RSSI: %d dBm (avg: %d), zone: %d",
-                         evt.rssi, s_state.current_rssi, s_state.current_zone);
-            }
-        }
+    const asset_zone_t *params = &s_state.zones[s_state.current_zone];
 
-        if (!s_state.enabled) {
-            all_leds_off();
-            vTaskDelay(pdMS_TO_TICKS(100));
-            continue;
-        }
+    if (!s_state.enabled || params->led_count == 0 || params->blink_period_ms == 0) {
+        return;
+    }
 
-        if ((now - s_state.last_rssi_time) > pdMS_TO_TICKS(PROXIMITY_TIMEOUT_MS)) {
-            if (s_state.current_zone != PROXIMITY_ZONE_UNKNOWN) {
-                ESP_LOGD(TAG, "RSSI timeout, entering UNKNOWN zone");
-                s_state.current_zone = PROXIMITY_ZONE_UNKNOWN;
-                all_leds_off();
-                buzzer_stop();
-            }
-            continue;
-        }
+    s_state.led_state = !s_state.led_state;
 
-        const zone_params_t *params = &ZONE_PARAMS[s_state.current_zone];
+    if (s_state.config.enable_leds) {
+        set_leds(params->led_count, s_state.led_state);
+    }
 
-        if (params->led_count == 0 || params->blink_period_ms == 0) {
-            continue;
-        }
+    if (s_state.led_state && s_state.config.enable_buzzer) {
+        buzzer_beep(params->blink_period_ms / 2, 0, 1);
+    }
+
+    reactor_timer_start(&s_state.blink_timer, params->blink_period_ms);
+}
+
+static void on_timeout(void *arg, uint32_t data)
+{
+    if (s_state.current_zone == PROXIMITY_ZONE_UNKNOWN) {
+        return;
+    }
+
+    ESP_LOGD(TAG, "RSSI timeout, entering UNKNOWN zone");
+    s_state.current_zone = PROXIMITY_ZONE_UNKNOWN;
+    publish_status();
+    reactor_timer_stop(&s_state.blink_timer);
+    all_leds_off();
+    buzzer_stop();
+}
+
+static void on_rssi(void *arg, uint32_t data)
+{
+    int8_t rssi = (int8_t)data;
 
-        TickType_t toggle_period = pdMS_TO_TICKS(params->blink_period_ms);
-        if ((now - s_state.last_toggle_time) >= toggle_period) {
-            s_state.led_state = !s_state.led_state;
-            s_state.last_toggle_time = now;
+    update_rssi_average(rssi);
+    s_state.current_zone = rssi_to_zone(s_state.current_rssi);
+    publish_status();
+    reactor_timer_start(&s_state.timeout_timer, PROXIMITY_TIMEOUT_MS);
 
-            if (s_state.config.enable_leds) {
-                set_leds(params->led_count, s_state.led_state);
-            }
+    ESP_LOGD(TAG, "RSSI: %d dBm (avg: %d), zone: %d",
+             rssi, s_state.current_rssi, s_state.current_zone);
 
-            if (s_state.led_state && s_state.config.enable_buzzer) {
-                buzzer_beep(params->blink_period_ms / 2, 0, 1);
-            }
+    /* a zone change takes effect on the next toggle, like the old poll loop */
+    if (s_state.enabled && !reactor_timer_active(&s_state.blink_timer)) {
+        on_blink(NULL, 0);
+    }
+}
+
+static void on_rssi_ready(void *arg, uint32_t data)
+{
+    bus_msg_t msg;
+    while (bus_receive(&s_rssi_sub, &msg)) {
+        if (s_state.initialized) {
+            on_rssi(NULL, (uint8_t)msg.rssi.rssi);
         }
     }
 }
 
+static void on_enable(void *arg, uint32_t data)
+{
+    s_state.enabled = data != 0;
+    publish_status();
+    if (!s_state.enabled) {
+        reactor_timer_stop(&s_state.blink_timer);
+        all_leds_off();
+        buzzer_stop();
+    } else if (s_state.current_zone != PROXIMITY_ZONE_UNKNOWN) {
+        on_blink(NULL, 0);
+    }
+    ESP_LOGI(TAG, "Proximity alerts %s", s_state.enabled ? "enabled" : "disabled");
+}
+
 esp_err_t proximity_init(const proximity_config_t *config)
 {
     if (s_state.initialized) {
@@ -191,85 +222,88 @@ esp_err_t proximity_init(const proximity_config_t *config)
         s_state.config = (proximity_config_t)PROXIMITY_CONFIG_DEFAULT();
     }
 
-    s_state.mutex = xSemaphoreCreateMutex();
-    if (s_state.mutex == NULL) {
-        ESP_LOGE(TAG, "Failed to create mutex");
-        return ESP_ERR_NO_MEM;
+    s_state.zones = assets_table(ASSET_ZONES, sizeof(asset_zone_t), PROXIMITY_ZONE_COUNT);
+    if (s_state.zones == NULL) {
+        s_state.zones = ZONE_PARAMS;
     }
 
-    s_state.queue = xQueueCreate(PROXIMITY_QUEUE_SIZE, sizeof(proximity_event_t));
-    if (s_state.queue == NULL) {
-        ESP_LOGE(TAG, "Failed to create queue");
-        vSemaphoreDelete(s_state.mutex);
-        return ESP_ERR_NO_MEM;
-    }
+    reactor_timer_init(&s_state.blink_timer, on_blink, NULL);
+    reactor_timer_init(&s_state.timeout_timer, on_timeout, NULL);
 
-    BaseType_t ret = xTaskCreate(
-        proximity_task,
-        PROXIMITY_TASK_NAME,
-        PROXIMITY_TASK_STACK_SIZE,
-        NULL,
-        PROXIMITY_TASK_PRIORITY,
-        &s_state.task_handle
-    );
-    if (ret != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create task");
-        vQueueDelete(s_state.queue);
-        vSemaphoreDelete(s_state.mutex);
-        return ESP_ERR_NO_MEM;
+    s_rssi_sub.fn = on_rssi_ready;
+    esp_err_t ret = bus_subscribe(BUS_TOPIC_RSSI, &s_rssi_sub);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to subscribe to RSSI: %s", esp_err_to_name(ret));
+        return ret;
     }
 
     s_state.initialized = true;
     s_state.enabled = true;
     s_state.current_zone = PROXIMITY_ZONE_UNKNOWN;
-    s_state.last_rssi_time = xTaskGetTickCount();
-    s_state.last_toggle_time = xTaskGetTickCount();
+    publish_status();
 
-    ESP_LOGI(TAG, "Initialized (buzzer: %s, LEDs: %s, volume: %d%%)",
+    ESP_LOGI(TAG, "Initialized (buzzer: %s, LEDs: %s, volume: %d%%, %s zones)",
              s_state.config.enable_buzzer ? "on" : "off",
              s_state.config.enable_leds ? "on" : "off",
-             s_state.config.buzzer_volume);
+             s_state.config.buzzer_volume,
+             s_state.zones == ZONE_PARAMS ? "built-in" : "asset");
 
     return ESP_OK;
 }
 
 void proximity_update(int8_t rssi)
 {
-    if (!s_state.initialized || s_state.queue == NULL) {
+    if (!s_state.initialized) {
         return;
     }
 
-    proximity_event_t evt = { .rssi = rssi };
+    reactor_post(on_rssi, NULL, (uint32_t)(uint8_t)rssi);
+}
 
-    xQueueSend(s_state.queue, &evt, 0);
+void proximity_get_status(proximity_status_t *out)
+{
+    SNAPSHOT_READ(s_status, out);
 }
 
 proximity_zone_t proximity_get_zone(void)
 {
-    return s_state.current_zone;
+    proximity_status_t status;
+    SNAPSHOT_READ(s_status, &status);
+    return status.zone;
 }
 
 int8_t proximity_get_rssi(void)
 {
-    return s_state.current_rssi;
+    proximity_status_t status;
+    SNAPSHOT_READ(s_status, &status);
+    return status.rssi;
 }
 
 void proximity_enable(bool enable)
 {
-    if (xSemaphoreTake(s_state.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        s_state.enabled = enable;
-        if (!enable) {
-            all_leds_off();
-            buzzer_stop();
-        }
-        xSemaphoreGive(s_state.mutex);
-        ESP_LOGI(TAG, "Proximity alerts %s", enable ? "enabled" : "disabled");
+    if (!s_state.initialized) {
+        return;
     }
+
+    reactor_post(on_enable, NULL, enable);
 }
 
 bool proximity_is_enabled(void)
 {
-    return s_state.enabled;
+    proximity_status_t status;
+    SNAPSHOT_READ(s_status, &status);
+    return status.enabled;
+}
+
+static void on_deinit(void *arg, uint32_t data)
+{
+    s_state.enabled = false;
+    publish_status();
+
+    reactor_timer_stop(&s_state.blink_timer);
+    reactor_timer_stop(&s_state.timeout_timer);
+    all_leds_off();
+    buzzer_stop();
 }
 
 esp_err_t proximity_deinit(void)
@@ -278,25 +312,8 @@ esp_err_t proximity_deinit(void)
         return ESP_ERR_INVALID_STATE;
     }
 
-    proximity_enable(false);
-    vTaskDelay(pdMS_TO_TICKS(100));
-
-    if (s_state.task_handle) {
-        vTaskDelete(s_state.task_handle);
-        s_state.task_handle = NULL;
-    }
-
-    if (s_state.queue) {
-        vQueueDelete(s_state.queue);
-        s_state.queue = NULL;
-    }
-
-    if (s_state.mutex) {
-        vSemaphoreDelete(s_state.mutex);
-        s_state.mutex = NULL;
-    }
-
     s_state.initialized = false;
+    reactor_post(on_deinit, NULL, 0);
     ESP_LOGI(TAG, "Deinitialized");
 
     return ESP_OK;
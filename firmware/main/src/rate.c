@@ -0,0 +1,315 @@
+/*
+ * rate.c - per-peer unicast rate from ACK statistics
+ *
+ * State, all on espnow_task except s_control:
+ *
+ *   s_peers    one entry per peer we unicast to: probability and last try
+ *              per ladder rate, the rate it is set to and the chosen one,
+ *              and a ring of the rates sends still waiting for a result
+ *              went out at
+ *   s_stats    the counters, published through s_stats_snap after every
+ *              result
+ *
+ * Probabilities are permille. Times are tick milliseconds, compared with
+ * wrapping differences.
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_random.h"
+#include "rate.h"
+#include "espnow.h"
+#include "snapshot.h"
+
+static const char *TAG = "rate";
+
+typedef struct {
+    wifi_phy_mode_t mode;
+    wifi_phy_rate_t rate;
+    const char *name;
+    uint32_t kbps;
+    uint16_t preamble_us;
+} rate_step_t;
+
+/* most robust first */
+static const rate_step_t s_ladder[] = {
+#if CONFIG_ESPNOW_ENABLE_LONG_RANGE
+    { WIFI_PHY_MODE_LR,   WIFI_PHY_RATE_LORA_250K, "LR250K", 250,   192 },
+    { WIFI_PHY_MODE_LR,   WIFI_PHY_RATE_LORA_500K, "LR500K", 500,   192 },
+#endif
+    { WIFI_PHY_MODE_11B,  WIFI_PHY_RATE_1M_L,      "1M",     1000,  192 },
+    { WIFI_PHY_MODE_11B,  WIFI_PHY_RATE_2M_L,      "2M",     2000,  192 },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS0_LGI,  "MCS0",   6500,  36 },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS1_LGI,  "MCS1",   13000, 36 },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS2_LGI,  "MCS2",   19500, 36 },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS3_LGI,  "MCS3",   26000, 36 },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS4_LGI,  "MCS4",   39000, 36 },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS5_LGI,  "MCS5",   52000, 36 },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS6_LGI,  "MCS6",   58500, 36 },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS7_LGI,  "MCS7",   65000, 36 },
+};
+
+#define RATE_COUNT  (sizeof(s_ladder) / sizeof(s_ladder[0]))
+
+/* 1 Mbps, the driver's default */
+#if CONFIG_ESPNOW_ENABLE_LONG_RANGE
+#define RATE_BASE   2
+#else
+#define RATE_BASE   0
+#endif
+
+typedef struct {
+    bool used;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t cur;                /* what the peer is set to */
+    uint8_t best;               /* what it would be set to without sampling */
+    uint8_t since_sample;
+    uint16_t tried;             /* bit per ladder index */
+    int16_t prob[RATE_COUNT];
+    uint32_t last_try_ms[RATE_COUNT];
+    uint32_t last_used_ms;
+    uint32_t frames;
+    uint32_t acked;
+    uint8_t inflight[RATE_INFLIGHT_MAX];
+    uint8_t inflight_head;
+    uint8_t inflight_count;
+} rate_peer_t;
+
+/* espnow_task only */
+static rate_peer_t s_peers[RATE_PEERS_MAX];
+static uint32_t s_airtime_us[RATE_COUNT];   /* for a heartbeat */
+static rate_stats_t s_stats;
+
+static atomic_bool s_control;
+
+SNAPSHOT_DEFINE(s_stats_snap, rate_stats_t);
+
+static uint32_t get_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+static rate_peer_t *find_peer(const uint8_t *mac, uint32_t now)
+{
+    rate_peer_t *lru = &s_peers[0];
+
+    for (int i = 0; i < RATE_PEERS_MAX; i++) {
+        rate_peer_t *p = &s_peers[i];
+        if (p->used && memcmp(p->mac, mac, ESP_NOW_ETH_ALEN) == 0) return p;
+        if (!lru->used) continue;       /* a free entry beats any */
+        if (!p->used || (int32_t)(p->last_used_ms - lru->last_used_ms) < 0) lru = p;
+    }
+
+    if (!lru->used) s_stats.peers++;
+    memset(lru, 0, sizeof(*lru));
+    lru->used = true;
+    memcpy(lru->mac, mac, ESP_NOW_ETH_ALEN);
+    lru->cur = RATE_BASE;
+    lru->best = RATE_BASE;
+    lru->tried = 1u << RATE_BASE;
+    lru->prob[RATE_BASE] = 1000;
+    lru->last_try_ms[RATE_BASE] = now;
+    return lru;
+}
+
+static bool stale(const rate_peer_t *p, int idx, uint32_t now)
+{
+    return !(p->tried & (1u << idx)) || now - p->last_try_ms[idx] >= RATE_STALE_MS;
+}
+
+static uint8_t most_reliable(const rate_peer_t *p)
+{
+    int reliable = RATE_BASE;
+
+    for (int i = 0; i < (int)RATE_COUNT; i++) {
+        if ((p->tried & (1u << i)) && p->prob[i] > p->prob[reliable]) reliable = i;
+    }
+    return (uint8_t)reliable;
+}
+
+/* least airtime above the floor, else the most reliable */
+static uint8_t choose(const rate_peer_t *p)
+{
+    int fast = -1;
+
+    for (int i = 0; i < (int)RATE_COUNT; i++) {
+        if (!(p->tried & (1u << i)) || p->prob[i] < RATE_PROB_MIN) continue;
+        if (fast < 0 || s_airtime_us[i] < s_airtime_us[fast]) fast = i;
+    }
+    return fast >= 0 ? (uint8_t)fast : most_reliable(p);
+}
+
+/* a step or two up that isn't known to be hopeless, or a rate whose numbers are old */
+static int pick_sample(const rate_peer_t *p, uint32_t now)
+{
+    uint8_t candidates[RATE_COUNT];
+    int n = 0;
+
+    for (int i = 0; i < (int)RATE_COUNT && i <= p->best + RATE_SAMPLE_REACH; i++) {
+        if (i == p->best) continue;
+        if (stale(p, i, now) || (i > p->best && p->prob[i] >= RATE_PROB_DEAD)) {
+            candidates[n++] = (uint8_t)i;
+        }
+    }
+    return n > 0 ? candidates[esp_random() % n] : -1;
+}
+
+static bool handshake_with(const pairing_ctx_t *ctx, const uint8_t *mac)
+{
+    return memcmp(mac, ctx->partner_mac, ESP_NOW_ETH_ALEN) == 0 && pairing_handshake_active(ctx);
+}
+
+/* the rate the oldest send still in flight went out at */
+static uint8_t take_inflight(rate_peer_t *p)
+{
+    if (p->inflight_count == 0) return p->cur;
+
+    uint8_t idx = p->inflight[p->inflight_head];
+    p->inflight_head = (p->inflight_head + 1) % RATE_INFLIGHT_MAX;
+    p->inflight_count--;
+    return idx;
+}
+
+static void apply(rate_peer_t *p, uint8_t idx)
+{
+    esp_now_rate_config_t cfg = {
+        .phymode = s_ladder[idx].mode,
+        .rate = s_ladder[idx].rate,
+    };
+
+    /* every time: a peer deleted and added again is back at the default */
+    esp_err_t err = esp_now_set_peer_rate_config(p->mac, &cfg);
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, MACSTR " at %s failed: %s", MAC2STR(p->mac), s_ladder[idx].name, esp_err_to_name(err));
+        return;
+    }
+    p->cur = idx;
+}
+
+static void publish(const pairing_ctx_t *ctx)
+{
+    s_stats.partner_known = false;
+    if (ctx->current_state != SEARCHING) {
+        for (int i = 0; i < RATE_PEERS_MAX; i++) {
+            const rate_peer_t *p = &s_peers[i];
+            if (!p->used || memcmp(p->mac, ctx->partner_mac, ESP_NOW_ETH_ALEN) != 0) continue;
+            s_stats.partner_known = true;
+            s_stats.partner_rate = p->cur;
+            s_stats.partner_prob = (uint16_t)p->prob[p->cur];
+            s_stats.partner_frames = p->frames;
+            s_stats.partner_acked = p->acked;
+            break;
+        }
+    }
+    s_stats.control = atomic_load_explicit(&s_control, memory_order_relaxed);
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+}
+
+void rate_note_send(const uint8_t *mac_addr)
+{
+    if (mac_addr == NULL || IS_BROADCAST_ADDR(mac_addr)) return;
+
+    uint32_t now = get_time_ms();
+    rate_peer_t *p = find_peer(mac_addr, now);
+
+    p->last_used_ms = now;
+    /* more than a frame's parts never wait at once; full means results went missing, oldest first */
+    if (p->inflight_count == RATE_INFLIGHT_MAX) take_inflight(p);
+    p->inflight[(p->inflight_head + p->inflight_count) % RATE_INFLIGHT_MAX] = p->cur;
+    p->inflight_count++;
+}
+
+void rate_handle_send_result(const pairing_ctx_t *ctx, const uint8_t *mac_addr, bool ok)
+{
+    if (ctx == NULL || mac_addr == NULL || IS_BROADCAST_ADDR(mac_addr)) return;
+
+    uint32_t now = get_time_ms();
+    rate_peer_t *p = find_peer(mac_addr, now);
+    uint8_t used = take_inflight(p);
+
+    if (p->tried & (1u << used)) {
+        p->prob[used] += ((ok ? 1000 : 0) - p->prob[used]) / RATE_EWMA_DIV;
+    } else {
+        p->prob[used] = ok ? 1000 : 0;
+        p->tried |= 1u << used;
+    }
+    p->last_try_ms[used] = now;
+    p->last_used_ms = now;
+    p->frames++;
+    if (ok) p->acked++;
+
+    s_stats.frames++;
+    if (ok) s_stats.acked++;
+    s_stats.airtime_us += s_airtime_us[used];
+    s_stats.airtime_1m_us += s_airtime_us[RATE_BASE];
+
+    uint8_t best = choose(p);
+    if (best != p->best) {
+        ESP_LOGD(TAG, MACSTR " %s -> %s", MAC2STR(p->mac), s_ladder[p->best].name, s_ladder[best].name);
+        p->best = best;
+        s_stats.changes++;
+    }
+
+    uint8_t next = best;
+    if (!atomic_load_explicit(&s_control, memory_order_relaxed)) {
+        next = RATE_BASE;
+    } else if (handshake_with(ctx, mac_addr) || (!ok && used == best)) {
+        next = most_reliable(p);
+    } else if (++p->since_sample >= RATE_SAMPLE_EVERY) {
+        int sample = pick_sample(p, now);
+        if (sample >= 0) {
+            next = (uint8_t)sample;
+            s_stats.samples++;
+        }
+        p->since_sample = 0;
+    }
+    apply(p, next);
+    publish(ctx);
+}
+
+void rate_set_control(bool enabled)
+{
+    atomic_store_explicit(&s_control, enabled, memory_order_relaxed);
+    ESP_LOGI(TAG, "Control %s", enabled ? "on" : "off");
+}
+
+esp_err_t rate_init(void)
+{
+    /* a heartbeat: the header inside the action frame */
+    for (int i = 0; i < (int)RATE_COUNT; i++) {
+        s_airtime_us[i] = rate_airtime_us((uint8_t)i, sizeof(broadcast_header_t), false);
+    }
+
+    atomic_init(&s_control, true);
+    s_stats.control = true;
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+
+    ESP_LOGI(TAG, "Initialized (%d rates, %s %lu us to %s %lu us per heartbeat)", (int)RATE_COUNT,
+             s_ladder[0].name, (unsigned long)s_airtime_us[0],
+             s_ladder[RATE_COUNT - 1].name, (unsigned long)s_airtime_us[RATE_COUNT - 1]);
+    return ESP_OK;
+}
+
+void rate_get_stats(rate_stats_t *out)
+{
+    SNAPSHOT_READ(s_stats_snap, out);
+    out->control = atomic_load_explicit(&s_control, memory_order_relaxed);
+}
+
+uint32_t rate_airtime_us(uint8_t idx, size_t len, bool ccmp)
+{
+    if (idx >= RATE_COUNT) return 0;
+
+    uint32_t bits = 8 * (len + RATE_FRAME_OVERHEAD + (ccmp ? RATE_CCMP_OVERHEAD : 0));
+    return s_ladder[idx].preamble_us + (bits * 1000 + s_ladder[idx].kbps - 1) / s_ladder[idx].kbps;
+}
+
+const char *rate_name(uint8_t idx)
+{
+    return idx < RATE_COUNT ? s_ladder[idx].name : "?";
+}
@@ -0,0 +1,232 @@
+/*
+ * reactor.c - one task, one event queue, one timer wheel
+ *
+ * The task blocks on the event queue with a timeout equal to the time left
+ * until the earliest armed timer, so an idle badge with nothing armed does
+ * not wake at all. After each wakeup it runs the posted events (at most a
+ * queue's worth, so a burst cannot starve the timers) and then every timer
+ * whose expiry has passed.
+ *
+ * Wheel slot = expiry tick % REACTOR_WHEEL_SLOTS. A slot may hold timers
+ * for later revolutions, which is why expired timers are picked by
+ * comparing expiry with now rather than by slot alone.
+ */
+
+#include "reactor.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "reactor";
+
+#define REACTOR_TASK_STACK_SIZE     4096
+#define REACTOR_TASK_PRIORITY       5
+#define REACTOR_TASK_NAME           "reactor"
+#define REACTOR_QUEUE_SIZE          16
+
+typedef struct {
+    reactor_fn_t fn;
+    void *arg;
+    uint32_t data;
+} reactor_event_t;
+
+static QueueHandle_t s_queue = NULL;
+static TaskHandle_t s_task = NULL;
+static reactor_timer_t *s_wheel[REACTOR_WHEEL_SLOTS];
+static TickType_t s_wheel_tick;     /* last tick whose slot was scanned */
+static uint32_t s_armed;
+static reactor_stats_t s_stats;
+
+static void wheel_unlink(reactor_timer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+    s_armed--;
+}
+
+/* ticks until the earliest armed timer, portMAX_DELAY with none armed */
+static TickType_t next_timeout(TickType_t now)
+{
+    if (s_armed == 0) return portMAX_DELAY;
+
+    /* every armed timer expires after s_wheel_tick, so walking the slots
+     * from there visits them in expiry order within one revolution */
+    uint32_t best = UINT32_MAX;
+    for (uint32_t d = 1; d <= REACTOR_WHEEL_SLOTS; d++) {
+        for (reactor_timer_t *t = s_wheel[(s_wheel_tick + d) % REACTOR_WHEEL_SLOTS]; t; t = t->next) {
+            uint32_t ahead = t->expiry - s_wheel_tick;
+            if (ahead < best) best = ahead;
+        }
+        if (best <= d) break;
+    }
+    int32_t left = (int32_t)(s_wheel_tick + best - now);
+    return left <= 0 ? 0 : (TickType_t)left;
+}
+
+static void run_timers(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint32_t span = now - s_wheel_tick;
+    if (span >= REACTOR_WHEEL_SLOTS) span = REACTOR_WHEEL_SLOTS - 1;
+
+    reactor_timer_t *due = NULL;
+    reactor_timer_t **due_tail = &due;
+
+    for (uint32_t i = 0; i <= span; i++) {
+        reactor_timer_t *t = s_wheel[(now - span + i) % REACTOR_WHEEL_SLOTS];
+        while (t) {
+            reactor_timer_t *next = t->next;
+            if ((int32_t)(t->expiry - now) <= 0) {
+                wheel_unlink(t);
+                t->state = REACTOR_TIMER_DUE;
+                t->due_next = NULL;
+                *due_tail = t;
+                due_tail = &t->due_next;
+            }
+            t = next;
+        }
+    }
+    s_wheel_tick = now;
+
+    /* a callback may stop or re-arm a timer that is still on this list */
+    while (due) {
+        reactor_timer_t *t = due;
+        due = t->due_next;
+        if (t->state != REACTOR_TIMER_DUE) continue;
+        t->state = REACTOR_TIMER_IDLE;
+        s_stats.timers_fired++;
+        t->fn(t->arg, 0);
+    }
+}
+
+static void reactor_task(void *arg)
+{
+    reactor_event_t evt;
+
+    ESP_LOGI(TAG, "Reactor task started");
+    s_wheel_tick = xTaskGetTickCount();
+
+    while (1) {
+        TickType_t wait = next_timeout(xTaskGetTickCount());
+        BaseType_t got = xQueueReceive(s_queue, &evt, wait);
+        s_stats.wakeups++;
+
+        for (int n = 0; got == pdTRUE; n++) {
+            s_stats.events++;
+            evt.fn(evt.arg, evt.data);
+            if (n + 1 >= REACTOR_QUEUE_SIZE) break;
+            got = xQueueReceive(s_queue, &evt, 0);
+        }
+
+        run_timers();
+    }
+}
+
+esp_err_t reactor_init(void)
+{
+    if (s_queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(s_wheel, 0, sizeof(s_wheel));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_armed = 0;
+
+    s_queue = xQueueCreate(REACTOR_QUEUE_SIZE, sizeof(reactor_event_t));
+    if (s_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(reactor_task, REACTOR_TASK_NAME, REACTOR_TASK_STACK_SIZE, NULL,
+                    REACTOR_TASK_PRIORITY, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task");
+        vQueueDelete(s_queue);
+        s_queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Initialized (%d-slot wheel, queue %d)", REACTOR_WHEEL_SLOTS, REACTOR_QUEUE_SIZE);
+    return ESP_OK;
+}
+
+esp_err_t reactor_post(reactor_fn_t fn, void *arg, uint32_t data)
+{
+    if (s_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    reactor_event_t evt = { .fn = fn, .arg = arg, .data = data };
+    if (xQueueSend(s_queue, &evt, 0) != pdTRUE) {
+        s_stats.dropped++;
+        ESP_LOGW(TAG, "Event queue full");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t reactor_post_from_isr(reactor_fn_t fn, void *arg, uint32_t data, BaseType_t *woken)
+{
+    if (s_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    reactor_event_t evt = { .fn = fn, .arg = arg, .data = data };
+    if (xQueueSendFromISR(s_queue, &evt, woken) != pdTRUE) {
+        s_stats.dropped++;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool reactor_in_context(void)
+{
+    return s_task != NULL && xTaskGetCurrentTaskHandle() == s_task;
+}
+
+void reactor_timer_init(reactor_timer_t *timer, reactor_fn_t fn, void *arg)
+{
+    memset(timer, 0, sizeof(*timer));
+    timer->fn = fn;
+    timer->arg = arg;
+}
+
+void reactor_timer_start(reactor_timer_t *timer, uint32_t delay_ms)
+{
+    reactor_timer_stop(timer);
+
+    TickType_t ticks = pdMS_TO_TICKS(delay_ms);
+    timer->expiry = xTaskGetTickCount() + (ticks > 0 ? ticks : 1);
+
+    reactor_timer_t **slot = &s_wheel[timer->expiry % REACTOR_WHEEL_SLOTS];
+    timer->next = *slot;
+    if (*slot) (*slot)->pprev = &timer->next;
+    timer->pprev = slot;
+    *slot = timer;
+    timer->state = REACTOR_TIMER_ARMED;
+    s_armed++;
+}
+
+void reactor_timer_stop(reactor_timer_t *timer)
+{
+    if (timer->state == REACTOR_TIMER_ARMED) {
+        wheel_unlink(timer);
+    }
+    timer->state = REACTOR_TIMER_IDLE;
+}
+
+bool reactor_timer_active(const reactor_timer_t *timer)
+{
+    return timer->state == REACTOR_TIMER_ARMED;
+}
+
+void reactor_get_stats(reactor_stats_t *out)
+{
+    *out = s_stats;
+    out->uptime_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    out->stack_free = s_task ? uxTaskGetStackHighWaterMark(s_task) : 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * snapshot.c - two-copy seqlock
+ *
+ * A write is
+ *
+ *   seq++ (odd)     readers move to copy 1
+ *   write copy 0
+ *   seq++ (even)    readers move back to copy 0
+ *   write copy 1
+ *
+ * so whichever copy seq points at is complete. A reader loads seq, copies
+ * the copy it names, and accepts the result if seq has not moved since.
+ * If it has, the writer may have started rewriting that very copy, so the
+ * reader goes again.
+ *
+ * The release fences keep each seq store ordered against the copy writes
+ * around it; the acquire fence keeps the reader's copy ahead of its second
+ * load of seq. On the esp32c3 both are a single fence instruction.
+ */
+
+#include "snapshot.h"
+#include <string.h>
+
+void snapshot_write(snapshot_t *snap, void *copies, const void *value, size_t size)
+{
+    uint8_t *copy = copies;
+    unsigned seq = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&snap->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(copy, value, size);
+
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&snap->seq, seq + 2, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(copy + size, value, size);
+}
+
+uint32_t snapshot_read(const snapshot_t *snap, const void *copies, void *out, size_t size)
+{
+    const uint8_t *copy = copies;
+    uint32_t retries = 0;
+
+    while (1) {
+        unsigned seq = atomic_load_explicit(&snap->seq, memory_order_acquire);
+        memcpy(out, copy + (seq & 1) * size, size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&snap->seq, memory_order_relaxed) == seq) {
+            return retries;
+        }
+        retries++;
+    }
+}
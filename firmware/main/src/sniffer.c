@@ -0,0 +1,131 @@
+/*
+ * sniffer.c - listen-only capture of every ESP-NOW frame on the channel
+ *
+ * State: the counters, atomics written by the Wi-Fi task, and s_body, the
+ * payload of the frame being recorded, which only the Wi-Fi task touches.
+ *
+ * sniffer_espnow_body() is also built for CONFIG_ESPNOW_LOADGEN, which
+ * listens the same way for frames to its virtual badges.
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "sniffer.h"
+#include "pairing.h"
+#include "trace.h"
+
+#if CONFIG_ESPNOW_SNIFFER || CONFIG_ESPNOW_LOADGEN
+
+static const uint8_t s_espressif_oui[3] = { SNIFFER_ESPRESSIF_OUI };
+
+int sniffer_espnow_body(const wifi_promiscuous_pkt_t *pkt, const uint8_t **src, const uint8_t **dst,
+                        uint8_t *body, size_t size)
+{
+    const uint8_t *p = pkt->payload;
+    int len = (int)pkt->rx_ctrl.sig_len - SNIFFER_FCS_LEN;
+
+    if (len < SNIFFER_BODY_AT + SNIFFER_ELEMENT_HDR_LEN || p[0] != SNIFFER_FC_ACTION ||
+        p[SNIFFER_MAC_HDR_LEN] != SNIFFER_CATEGORY_VENDOR ||
+        memcmp(p + SNIFFER_MAC_HDR_LEN + 1, s_espressif_oui, sizeof(s_espressif_oui)) != 0) {
+        return 0;
+    }
+
+    int at = SNIFFER_BODY_AT;
+    int elements = 0;
+    int body_len = 0;
+    while (at + SNIFFER_ELEMENT_HDR_LEN <= len && p[at] == SNIFFER_ELEMENT_VENDOR &&
+           memcmp(p + at + 2, s_espressif_oui, sizeof(s_espressif_oui)) == 0 &&
+           p[at + 5] == SNIFFER_ESPNOW_TYPE) {
+        int part = p[at + 1] - (SNIFFER_ELEMENT_HDR_LEN - 2);
+        if (part < 0 || at + 2 + p[at + 1] > len || body_len + part > (int)size) return -1;
+        memcpy(body + body_len, p + at + SNIFFER_ELEMENT_HDR_LEN, part);
+        body_len += part;
+        at += 2 + p[at + 1];
+        elements++;
+    }
+    if (elements == 0) return -1;
+
+    *dst = p + SNIFFER_DST_AT;
+    *src = p + SNIFFER_SRC_AT;
+    return body_len;
+}
+
+#endif /* CONFIG_ESPNOW_SNIFFER || CONFIG_ESPNOW_LOADGEN */
+
+#if CONFIG_ESPNOW_SNIFFER
+
+static const char *TAG = "sniffer";
+
+static atomic_uint s_mgmt;
+static atomic_uint s_espnow;
+static atomic_uint s_ours;
+static atomic_uint s_bad;
+
+/* Wi-Fi task only */
+static uint8_t s_body[ESP_NOW_MAX_DATA_LEN_V2];
+
+static void count(atomic_uint *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static void promiscuous_cb(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+    if (type != WIFI_PKT_MGMT) return;
+    count(&s_mgmt);
+
+    const wifi_promiscuous_pkt_t *pkt = buf;
+    const uint8_t *src, *dst;
+    int body_len = sniffer_espnow_body(pkt, &src, &dst, s_body, sizeof(s_body));
+
+    if (body_len == 0) return;
+    count(&s_espnow);
+    if (body_len < 0) {
+        count(&s_bad);
+        return;
+    }
+    if (s_body[0] == PAIRING_PROTOCOL_ID) count(&s_ours);
+
+    esp_now_recv_info_t info = {
+        .src_addr = (uint8_t *)src,
+        .des_addr = (uint8_t *)dst,
+        .rx_ctrl = (wifi_pkt_rx_ctrl_t *)&pkt->rx_ctrl,
+    };
+    trace_record(&info, s_body, body_len);
+}
+
+esp_err_t sniffer_init(void)
+{
+    esp_err_t err = trace_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Trace writer unavailable: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    wifi_promiscuous_filter_t filter = { .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT };
+    err = esp_wifi_set_promiscuous_filter(&filter);
+    if (err == ESP_OK) err = esp_wifi_set_promiscuous_rx_cb(promiscuous_cb);
+    if (err == ESP_OK) err = esp_wifi_set_promiscuous(true);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Promiscuous mode failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    /* the last line before the stream: trace_start() mutes logging */
+    ESP_LOGI(TAG, "Listening on channel %d, TX off, streaming over USB", CONFIG_ESPNOW_CHANNEL);
+    return trace_start();
+}
+
+void sniffer_get_stats(sniffer_stats_t *out)
+{
+    if (out == NULL) return;
+    out->mgmt = atomic_load_explicit(&s_mgmt, memory_order_relaxed);
+    out->espnow = atomic_load_explicit(&s_espnow, memory_order_relaxed);
+    out->ours = atomic_load_explicit(&s_ours, memory_order_relaxed);
+    out->bad = atomic_load_explicit(&s_bad, memory_order_relaxed);
+}
+
+#endif /* CONFIG_ESPNOW_SNIFFER */
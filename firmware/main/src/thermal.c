@@ -0,0 +1,163 @@
+/*
+ * thermal.c - temperature driven radio throttling
+ *
+ * Runs on the reactor. Each BUS_TOPIC_MONITOR sample goes through
+ * next_level(); on a change the level's policy is applied to the three
+ * knobs (Wi-Fi TX power cap, HELLO interval, BLE advertising interval).
+ * The first two go to espnow_task, which owns the radio's TX power; pairing
+ * keeps choosing a power per frame, just never above the cap. Applying a
+ * policy never blocks: if espnow_task's queue is full both are retried
+ * with the next sample.
+ */
+
+#include "thermal.h"
+#include "bus.h"
+#include "snapshot.h"
+#include "espnow.h"
+#include "pairing.h"
+#include "ble_task.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "thermal";
+
+/* monitor reports -999 when the sensor read fails */
+#define THERMAL_VALID_MIN_C     (-60.0f)
+
+typedef struct {
+    int8_t tx_power_q;          /* cap, 0 for none */
+    uint32_t hello_interval_ms;
+    uint16_t adv_interval_min;
+    uint16_t adv_interval_max;
+} thermal_policy_t;
+
+static const thermal_policy_t POLICY[THERMAL_LEVEL_MAX] = {
+    [THERMAL_NORMAL] = { 0,                        PAIRING_REBROADCAST_MS,     BLE_ADV_INTERVAL_MIN, BLE_ADV_INTERVAL_MAX },
+    [THERMAL_WARM]   = { THERMAL_WARM_TX_DBM * 4,  PAIRING_REBROADCAST_MS * 2, 0xA0,  0x140 },   /* 100-200 ms */
+    [THERMAL_HOT]    = { THERMAL_HOT_TX_DBM * 4,   PAIRING_REBROADCAST_MS * 4, 0x640, 0x800 },   /* 1-1.28 s */
+};
+
+static const char *const LEVEL_NAMES[THERMAL_LEVEL_MAX] = { "NORMAL", "WARM", "HOT" };
+
+/* reactor only */
+static thermal_stats_t s_stats;
+static TickType_t s_last_sample;
+static bool s_espnow_pending;
+
+SNAPSHOT_DEFINE(s_stats_snap, thermal_stats_t);
+BUS_SUB_DEFINE(s_monitor_sub, 4);
+
+static thermal_level_t next_level(thermal_level_t level, float temp_c)
+{
+    if (temp_c >= THERMAL_HOT_C) {
+        return THERMAL_HOT;
+    }
+    if (level == THERMAL_HOT && temp_c > THERMAL_HOT_C - THERMAL_HYSTERESIS_C) {
+        return THERMAL_HOT;
+    }
+    if (temp_c >= THERMAL_WARM_C) {
+        return THERMAL_WARM;
+    }
+    if (level >= THERMAL_WARM && temp_c > THERMAL_WARM_C - THERMAL_HYSTERESIS_C) {
+        return THERMAL_WARM;
+    }
+    return THERMAL_NORMAL;
+}
+
+static void apply_espnow(void)
+{
+    bool ok = espnow_set_tx_power_cap(s_stats.tx_power_q) == ESP_OK;
+    ok = espnow_set_hello_interval(s_stats.hello_interval_ms) == ESP_OK && ok;
+    s_espnow_pending = !ok;
+}
+
+static void apply_policy(thermal_level_t level)
+{
+    const thermal_policy_t *p = &POLICY[level];
+
+    s_stats.tx_power_q = p->tx_power_q;
+    s_stats.hello_interval_ms = p->hello_interval_ms;
+    apply_espnow();
+
+    esp_err_t err = ble_set_adv_interval(p->adv_interval_min, p->adv_interval_max);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Advertising interval failed: %s", esp_err_to_name(err));
+    }
+}
+
+static void on_temperature(float temp_c)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    if (s_stats.samples > 0 && s_stats.level != THERMAL_NORMAL) {
+        s_stats.throttled_ms += (now - s_last_sample) * portTICK_PERIOD_MS;
+    }
+    s_last_sample = now;
+
+    s_stats.samples++;
+    s_stats.temperature_c = temp_c;
+    if (s_stats.samples == 1 || temp_c > s_stats.peak_c) {
+        s_stats.peak_c = temp_c;
+    }
+
+    thermal_level_t level = next_level(s_stats.level, temp_c);
+    if (level != s_stats.level) {
+        if (s_stats.level == THERMAL_NORMAL) {
+            s_stats.throttle_events++;
+        }
+        if (level == THERMAL_HOT) {
+            s_stats.hot_events++;
+        }
+        ESP_LOGW(TAG, "%.1f C: %s -> %s", temp_c,
+                 LEVEL_NAMES[s_stats.level], LEVEL_NAMES[level]);
+        s_stats.level = level;
+        apply_policy(level);
+    } else if (s_espnow_pending) {
+        apply_espnow();
+    }
+
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+}
+
+static void on_samples(void *arg, uint32_t data)
+{
+    bus_msg_t msg;
+    while (bus_receive(&s_monitor_sub, &msg)) {
+        if (msg.monitor.temperature_c > THERMAL_VALID_MIN_C) {
+            on_temperature(msg.monitor.temperature_c);
+        }
+    }
+}
+
+esp_err_t thermal_init(void)
+{
+    _Static_assert(THERMAL_HOT_C > THERMAL_WARM_C, "THERMAL_HOT_C must be above THERMAL_WARM_C");
+
+    s_stats = (thermal_stats_t){
+        .level = THERMAL_NORMAL,
+        .hello_interval_ms = PAIRING_REBROADCAST_MS,
+    };
+    SNAPSHOT_WRITE(s_stats_snap, &s_stats);
+
+    s_monitor_sub.fn = on_samples;
+    esp_err_t ret = bus_subscribe(BUS_TOPIC_MONITOR, &s_monitor_sub);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to subscribe to MONITOR: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Initialized (warm %d C, hot %d C, hysteresis %d C)",
+             THERMAL_WARM_C, THERMAL_HOT_C, THERMAL_HYSTERESIS_C);
+    return ESP_OK;
+}
+
+const char *thermal_level_name(thermal_level_t level)
+{
+    return level < THERMAL_LEVEL_MAX ? LEVEL_NAMES[level] : "?";
+}
+
+void thermal_get_stats(thermal_stats_t *out)
+{
+    SNAPSHOT_READ(s_stats_snap, out);
+}
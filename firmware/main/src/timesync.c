@@ -0,0 +1,289 @@
+/*
+ * timesync.c - FTSP-style shared clock
+ *
+ * State, all on espnow_task:
+ *
+ *   s_table    the last TIMESYNC_TABLE_MAX (local receive time, reference's
+ *              time) pairs for the current root, oldest overwritten first
+ *   s_state    the fitted line and the counters; published through
+ *              s_state_snap after every change, which is all
+ *              timesync_now() looks at
+ *
+ * Local time is esp_timer_get_time(). The fit works on offsets (reference
+ * time minus local time) relative to the newest sample, which keeps the
+ * doubles well inside their 53 bits.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "timesync.h"
+#include "espnow.h"
+#include "snapshot.h"
+
+static const char *TAG = "timesync";
+
+typedef struct {
+    int64_t local_us;
+    int64_t time_us;
+} timesync_sample_t;
+
+/* espnow_task only */
+static uint8_t s_my_mac[ESP_NOW_ETH_ALEN];
+static bool s_has_root;
+static timesync_sample_t s_table[TIMESYNC_TABLE_MAX];
+static int s_count;
+static int s_next;
+static uint8_t s_outliers_in_row;
+static uint32_t s_sample_error_us;      /* reference's bound on its newest sample */
+static uint32_t s_last_round_ms;
+static uint32_t s_next_send_ms;
+
+static timesync_stats_t s_state;
+static bool s_state_dirty;
+
+SNAPSHOT_DEFINE(s_state_snap, timesync_stats_t);
+
+static uint32_t get_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+static int64_t shared_at(const timesync_stats_t *st, int64_t local_us)
+{
+    int64_t dt = local_us - st->base_local_us;
+    return st->base_time_us + dt + (int64_t)((double)dt * st->skew);
+}
+
+static uint32_t error_at(const timesync_stats_t *st, int64_t local_us)
+{
+    int64_t age = local_us - st->base_local_us;
+    if (age < 0) age = 0;
+
+    uint64_t err = st->base_error_us + (uint64_t)age * st->drift_ppm / 1000000;
+    return err > UINT32_MAX ? UINT32_MAX : (uint32_t)err;
+}
+
+/* least squares through the table; the newest sample anchors the line */
+static void fit(void)
+{
+    const timesync_sample_t *ref = &s_table[(s_next + TIMESYNC_TABLE_MAX - 1) % TIMESYNC_TABLE_MAX];
+    int64_t ref_offset = ref->time_us - ref->local_us;
+    double mx = 0, my = 0;
+
+    for (int i = 0; i < s_count; i++) {
+        mx += (double)(s_table[i].local_us - ref->local_us);
+        my += (double)(s_table[i].time_us - s_table[i].local_us - ref_offset);
+    }
+    mx /= s_count;
+    my /= s_count;
+
+    double sxx = 0, sxy = 0;
+    for (int i = 0; i < s_count; i++) {
+        double dx = (double)(s_table[i].local_us - ref->local_us) - mx;
+        double dy = (double)(s_table[i].time_us - s_table[i].local_us - ref_offset) - my;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+
+    double skew = (s_count >= 2 && sxx > 0) ? sxy / sxx : 0;
+    if (skew > TIMESYNC_SKEW_MAX) skew = TIMESYNC_SKEW_MAX;
+    if (skew < -TIMESYNC_SKEW_MAX) skew = -TIMESYNC_SKEW_MAX;
+
+    double worst = 0;
+    for (int i = 0; i < s_count; i++) {
+        double dx = (double)(s_table[i].local_us - ref->local_us) - mx;
+        double dy = (double)(s_table[i].time_us - s_table[i].local_us - ref_offset) - my;
+        double residual = dy - skew * dx;
+        if (residual < 0) residual = -residual;
+        if (residual > worst) worst = residual;
+    }
+
+    s_state.base_local_us = ref->local_us;
+    s_state.base_time_us = ref->time_us + (int64_t)(my - skew * mx);
+    s_state.skew = skew;
+    uint64_t err = (uint64_t)s_sample_error_us + TIMESYNC_HOP_US + (uint64_t)worst;
+    s_state.base_error_us = err > UINT32_MAX ? UINT32_MAX : (uint32_t)err;
+    s_state.drift_ppm = s_count >= TIMESYNC_MIN_ENTRIES ? TIMESYNC_DRIFT_FIT_PPM : TIMESYNC_DRIFT_FREE_PPM;
+    s_state.entries = (uint8_t)s_count;
+    s_state.synced = s_count >= TIMESYNC_MIN_ENTRIES;
+}
+
+static void clear_table(void)
+{
+    s_count = 0;
+    s_next = 0;
+    s_outliers_in_row = 0;
+    s_state.entries = 0;
+    s_state.synced = false;
+}
+
+static void follow_root(const uint8_t *root_mac)
+{
+    memcpy(s_state.root_mac, root_mac, ESP_NOW_ETH_ALEN);
+    s_state.is_root = false;
+    s_state.root_seq = 0;
+    s_state.root_changes++;
+    s_has_root = true;
+    clear_table();
+    ESP_LOGI(TAG, "Following root " MACSTR, MAC2STR(root_mac));
+}
+
+/* carry on from the time we had, so the shared clock doesn't jump */
+static void claim_root(void)
+{
+    int64_t local = esp_timer_get_time();
+
+    s_state.base_time_us = shared_at(&s_state, local);
+    s_state.base_local_us = local;
+    s_state.base_error_us = 0;
+    s_state.drift_ppm = 0;
+    s_state.hops = 0;
+    memcpy(s_state.root_mac, s_my_mac, ESP_NOW_ETH_ALEN);
+    s_state.root_seq = 0;
+    s_state.root_changes++;
+    s_has_root = true;
+    clear_table();
+    s_state.is_root = true;
+    s_state.synced = true;
+    s_state_dirty = true;
+    ESP_LOGW(TAG, "No root heard, taking over");
+}
+
+void timesync_handle_recv(pairing_ctx_t *ctx, const uint8_t *mac, const uint8_t *data, int len, int64_t rx_us)
+{
+    if (ctx == NULL || mac == NULL || data == NULL || len < (int)(sizeof(broadcast_header_t) + sizeof(timesync_msg_t))) return;
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)data;
+    if (hdr->msg_type != MSG_TIMESYNC) return;
+    if (!pairing_frame_tag_valid(ctx, mac, data, len)) return;
+
+    timesync_msg_t m;
+    memcpy(&m, data + sizeof(broadcast_header_t), sizeof(m));
+    if (memcmp(m.root_mac, s_my_mac, ESP_NOW_ETH_ALEN) == 0) return;     /* one of our own rounds */
+
+    if (s_has_root) {
+        int cmp = memcmp(m.root_mac, s_state.root_mac, ESP_NOW_ETH_ALEN);
+        if (cmp > 0) return;            /* they'll come over to our root */
+        if (cmp < 0) {
+            follow_root(m.root_mac);
+        } else if ((int32_t)(m.root_seq - s_state.root_seq) <= 0) {
+            return;                     /* round already used */
+        }
+    } else {
+        follow_root(m.root_mac);
+    }
+
+    s_state.root_seq = m.root_seq;
+    s_last_round_ms = get_time_ms();
+    s_state_dirty = true;
+
+    int64_t ref_us = m.time_us + TIMESYNC_RX_DELAY_US;     /* reference's time now */
+    if (s_count >= TIMESYNC_MIN_ENTRIES && llabs(shared_at(&s_state, rx_us) - ref_us) > TIMESYNC_OUTLIER_US) {
+        s_state.outliers++;
+        if (++s_outliers_in_row < TIMESYNC_OUTLIER_MAX) return;
+        ESP_LOGW(TAG, "Reference moved, starting over");
+        s_state.resets++;
+        clear_table();
+    }
+    s_outliers_in_row = 0;
+
+    s_table[s_next].local_us = rx_us;
+    s_table[s_next].time_us = ref_us;
+    s_next = (s_next + 1) % TIMESYNC_TABLE_MAX;
+    if (s_count < TIMESYNC_TABLE_MAX) s_count++;
+
+    s_sample_error_us = m.error_us;
+    s_state.hops = m.hops + 1;
+    s_state.samples++;
+    fit();
+}
+
+static void send_timesync(pairing_ctx_t *ctx)
+{
+    timesync_msg_t m;
+
+    if (s_state.is_root) s_state.root_seq++;
+    memcpy(m.root_mac, s_state.root_mac, ESP_NOW_ETH_ALEN);
+    m.root_seq = s_state.root_seq;
+    m.hops = s_state.hops;
+
+    int64_t local = esp_timer_get_time();
+    m.time_us = shared_at(&s_state, local);
+    m.error_us = error_at(&s_state, local);
+
+    esp_err_t err = pairing_send_payload(ctx, espnow_broadcast_mac, MSG_TIMESYNC, &m, sizeof(m));
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "TIMESYNC failed: %s", esp_err_to_name(err));
+        return;
+    }
+    s_state.sent++;
+    s_state_dirty = true;
+}
+
+uint32_t timesync_tick(pairing_ctx_t *ctx)
+{
+    uint32_t now = get_time_ms();
+
+    if (!s_state.is_root && (int32_t)(now - s_last_round_ms) >= TIMESYNC_ROOT_TIMEOUT_MS) {
+        claim_root();
+    }
+
+    if ((int32_t)(now - s_next_send_ms) >= 0) {
+        if (s_state.synced) send_timesync(ctx);
+        /* jittered, so neighbours that synced together don't collide forever */
+        s_next_send_ms = now + TIMESYNC_INTERVAL_MS * 3 / 4 + esp_random() % (TIMESYNC_INTERVAL_MS / 2 + 1);
+    }
+
+    if (s_state_dirty) {
+        SNAPSHOT_WRITE(s_state_snap, &s_state);
+        s_state_dirty = false;
+    }
+
+    uint32_t wait = s_next_send_ms - now;
+    if (!s_state.is_root) {
+        uint32_t timeout = s_last_round_ms + TIMESYNC_ROOT_TIMEOUT_MS - now;
+        if (timeout < wait) wait = timeout;
+    }
+    return wait;
+}
+
+esp_err_t timesync_init(const uint8_t *my_mac)
+{
+    if (my_mac == NULL) return ESP_ERR_INVALID_ARG;
+
+    memcpy(s_my_mac, my_mac, ESP_NOW_ETH_ALEN);
+    s_last_round_ms = get_time_ms();
+    s_next_send_ms = s_last_round_ms + esp_random() % TIMESYNC_INTERVAL_MS;
+
+    /* shared = local until a reference is heard */
+    s_state.base_local_us = 0;
+    s_state.base_time_us = 0;
+    s_state.base_error_us = UINT32_MAX;
+    SNAPSHOT_WRITE(s_state_snap, &s_state);
+
+    ESP_LOGI(TAG, "Initialized (TIMESYNC every %d ms, root timeout %d ms)",
+             TIMESYNC_INTERVAL_MS, TIMESYNC_ROOT_TIMEOUT_MS);
+    return ESP_OK;
+}
+
+bool timesync_now(int64_t *out_us, uint32_t *out_error_us)
+{
+    timesync_stats_t st;
+    SNAPSHOT_READ(s_state_snap, &st);
+
+    int64_t local = esp_timer_get_time();
+    if (out_us != NULL) *out_us = shared_at(&st, local);
+    if (out_error_us != NULL) *out_error_us = st.synced ? error_at(&st, local) : UINT32_MAX;
+    return st.synced;
+}
+
+void timesync_get_stats(timesync_stats_t *out)
+{
+    SNAPSHOT_READ(s_state_snap, out);
+}
@@ -0,0 +1,359 @@
+/*
+ * trace.c - received frames into a ring buffer, and a task draining it to the sink
+ *
+ * State: trace_record() runs on the Wi-Fi task and only reserves and fills
+ * ring buffer space. Everything the sink touches (flash position, USB
+ * batch, records and bytes written) belongs to trace_task under
+ * s_sink_lock. dropped is counted from both sides, so it is an atomic.
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/ringbuf.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_rom_crc.h"
+#include "trace.h"
+
+#if CONFIG_ESPNOW_TRACE
+
+#if CONFIG_ESPNOW_TRACE_SINK_USB
+#include "driver/usb_serial_jtag.h"
+#include "driver/usb_serial_jtag_vfs.h"
+#else
+#include "esp_partition.h"
+#endif
+
+static const char *TAG = "trace";
+
+#define TRACE_TASK_STACK_SIZE       3072
+#define TRACE_TASK_PRIORITY         2
+#define TRACE_PARTITION_SUBTYPE     0x40
+#define TRACE_USB_WRITE_TIMEOUT     pdMS_TO_TICKS(100)
+
+static RingbufHandle_t s_ring;
+static SemaphoreHandle_t s_sink_lock;
+static volatile bool s_running;
+static trace_stats_t s_stats;
+static atomic_uint s_dropped;
+static uint8_t s_my_mac[6];
+
+#if CONFIG_ESPNOW_TRACE_SINK_USB
+static uint32_t s_since_meta;
+static uint8_t s_batch[TRACE_USB_BATCH] __attribute__((aligned(4)));
+static size_t s_batch_len;
+static uint32_t s_batch_records;    /* frames in s_batch, META records aside */
+static uint32_t s_batch_bytes;
+#else
+static const esp_partition_t *s_part;
+static uint32_t s_sector_count;
+static uint32_t s_sector;           /* sector being filled */
+static uint32_t s_sector_seq;
+static uint32_t s_offset;           /* write offset in s_sector, 0 = not opened yet */
+#endif
+
+static uint16_t record_crc(const trace_record_t *rec)
+{
+    size_t covered = sizeof(trace_record_t) - offsetof(trace_record_t, len) + rec->len;
+    return esp_rom_crc16_le(0, (const uint8_t *)&rec->len, covered);
+}
+
+static void fill_meta(trace_record_t *meta)
+{
+    memset(meta, 0, sizeof(*meta));
+    meta->sync = TRACE_SYNC;
+    meta->flags = TRACE_FLAG_META;
+    meta->t_ms = (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+    memcpy(meta->src, s_my_mac, sizeof(s_my_mac));
+    meta->crc = record_crc(meta);
+}
+
+#if CONFIG_ESPNOW_TRACE_SINK_USB
+
+static void sink_flush(void)
+{
+    if (s_batch_len == 0) return;
+
+    int written = usb_serial_jtag_write_bytes(s_batch, s_batch_len, TRACE_USB_WRITE_TIMEOUT);
+    s_stats.batches++;
+    if (written != (int)s_batch_len) {
+        /* counted as written when they were packed */
+        s_stats.records -= s_batch_records;
+        s_stats.bytes -= s_batch_bytes;
+        atomic_fetch_add_explicit(&s_dropped, s_batch_records, memory_order_relaxed);
+    }
+    s_batch_len = 0;
+    s_batch_records = 0;
+    s_batch_bytes = 0;
+}
+
+static void batch_add(const void *buf, size_t size)
+{
+    if (s_batch_len + size > sizeof(s_batch)) sink_flush();
+    memcpy(s_batch + s_batch_len, buf, size);
+    s_batch_len += size;
+}
+
+/* a record is at most 20 + 1470 bytes, so one always fits an empty batch */
+static esp_err_t sink_write(const void *buf, size_t size)
+{
+    if (s_since_meta >= TRACE_USB_META_INTERVAL) {
+        trace_record_t meta;
+        fill_meta(&meta);
+        batch_add(&meta, sizeof(meta));
+        s_since_meta = 0;
+    }
+
+    batch_add(buf, size);
+    s_batch_records++;
+    s_batch_bytes += size;
+    s_since_meta += size;
+    return ESP_OK;
+}
+
+/* a partly filled batch goes out once the ring has been quiet this long */
+static TickType_t sink_idle_wait(void)
+{
+    return s_batch_len > 0 ? pdMS_TO_TICKS(TRACE_USB_FLUSH_MS) : portMAX_DELAY;
+}
+
+static esp_err_t sink_init(void)
+{
+    if (!usb_serial_jtag_is_driver_installed()) {
+        usb_serial_jtag_driver_config_t cfg = USB_SERIAL_JTAG_DRIVER_CONFIG_DEFAULT();
+        /* one batch draining from the interrupt while the next is packed */
+        cfg.tx_buffer_size = 2 * TRACE_USB_BATCH;
+        esp_err_t err = usb_serial_jtag_driver_install(&cfg);
+        if (err != ESP_OK) return err;
+    }
+    /* console and trace must share the driver or their bytes interleave mid-write */
+    usb_serial_jtag_vfs_use_driver();
+    return ESP_OK;
+}
+
+#else
+
+/* sector headers tell the newest sector; we continue in the one after it */
+static void find_head(void)
+{
+    bool found = false;
+    uint32_t newest = 0;
+    uint32_t newest_seq = 0;
+
+    for (uint32_t i = 0; i < s_sector_count; i++) {
+        trace_sector_t hdr;
+        if (esp_partition_read(s_part, i * TRACE_SECTOR_SIZE, &hdr, sizeof(hdr)) != ESP_OK) continue;
+        if (hdr.magic != TRACE_SECTOR_MAGIC) continue;
+        if (!found || (int32_t)(hdr.seq - newest_seq) > 0) {
+            found = true;
+            newest = i;
+            newest_seq = hdr.seq;
+        }
+    }
+
+    s_sector = found ? (newest + 1) % s_sector_count : 0;
+    s_sector_seq = found ? newest_seq + 1 : 0;
+    s_offset = 0;
+}
+
+static esp_err_t open_sector(void)
+{
+    uint32_t base = s_sector * TRACE_SECTOR_SIZE;
+    trace_sector_t hdr = { .magic = TRACE_SECTOR_MAGIC, .seq = s_sector_seq };
+    trace_record_t meta;
+
+    esp_err_t err = esp_partition_erase_range(s_part, base, TRACE_SECTOR_SIZE);
+    if (err != ESP_OK) return err;
+    s_stats.sectors++;
+
+    fill_meta(&meta);
+    err = esp_partition_write(s_part, base, &hdr, sizeof(hdr));
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_part, base + sizeof(hdr), &meta, sizeof(meta));
+    }
+    s_offset = sizeof(hdr) + sizeof(meta);
+    return err;
+}
+
+/* records never straddle sectors; the erased tail of a sector reads as 0xFF */
+static esp_err_t sink_write(const void *buf, size_t size)
+{
+    if (s_offset != 0 && s_offset + size > TRACE_SECTOR_SIZE) {
+        s_sector = (s_sector + 1) % s_sector_count;
+        s_sector_seq++;
+        s_offset = 0;
+    }
+
+    if (s_offset == 0) {
+        esp_err_t err = open_sector();
+        if (err != ESP_OK) {
+            s_offset = 0;
+            return err;
+        }
+    }
+
+    esp_err_t err = esp_partition_write(s_part, s_sector * TRACE_SECTOR_SIZE + s_offset, buf, size);
+    s_offset += size;
+    return err;
+}
+
+static void sink_flush(void)
+{
+}
+
+static TickType_t sink_idle_wait(void)
+{
+    return portMAX_DELAY;
+}
+
+static esp_err_t sink_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, TRACE_PARTITION_SUBTYPE, "trace");
+    if (s_part == NULL) {
+        ESP_LOGE(TAG, "No \"trace\" partition");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_sector_count = s_part->size / TRACE_SECTOR_SIZE;
+    find_head();
+    ESP_LOGI(TAG, "Flash ring: %lu sectors, continuing at %lu (seq %lu)",
+             (unsigned long)s_sector_count, (unsigned long)s_sector, (unsigned long)s_sector_seq);
+    return ESP_OK;
+}
+
+#endif
+
+static void trace_task(void *pvParameter)
+{
+    while (1) {
+        size_t size;
+        trace_record_t *rec = xRingbufferReceive(s_ring, &size, sink_idle_wait());
+        if (rec == NULL) {
+            xSemaphoreTake(s_sink_lock, portMAX_DELAY);
+            sink_flush();
+            xSemaphoreGive(s_sink_lock);
+            continue;
+        }
+
+        rec->crc = record_crc(rec);
+
+        xSemaphoreTake(s_sink_lock, portMAX_DELAY);
+        if (sink_write(rec, size) == ESP_OK) {
+            s_stats.records++;
+            s_stats.bytes += size;
+        } else {
+            atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+        }
+        xSemaphoreGive(s_sink_lock);
+
+        vRingbufferReturnItem(s_ring, rec);
+    }
+}
+
+esp_err_t trace_init(void)
+{
+    esp_read_mac(s_my_mac, ESP_MAC_WIFI_STA);
+
+    esp_err_t err = sink_init();
+    if (err != ESP_OK) return err;
+
+    s_sink_lock = xSemaphoreCreateMutex();
+    s_ring = xRingbufferCreate(TRACE_BUFFER_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (s_sink_lock == NULL || s_ring == NULL) {
+        ESP_LOGE(TAG, "Create ring buffer fail");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(trace_task, "trace", TRACE_TASK_STACK_SIZE, NULL, TRACE_TASK_PRIORITY, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t trace_start(void)
+{
+    if (s_ring == NULL) return ESP_ERR_INVALID_STATE;
+    if (s_running) return ESP_OK;
+
+#if CONFIG_ESPNOW_TRACE_SINK_USB
+    esp_log_level_set("*", ESP_LOG_NONE);
+    s_since_meta = 0;
+#endif
+
+    /* every capture starts with our MAC so the replayer knows who listened */
+    trace_record_t meta;
+    fill_meta(&meta);
+    xRingbufferSend(s_ring, &meta, sizeof(meta), portMAX_DELAY);
+
+    s_running = true;
+    return ESP_OK;
+}
+
+void trace_stop(void)
+{
+    s_running = false;
+#if CONFIG_ESPNOW_TRACE_SINK_USB
+    esp_log_level_set("*", CONFIG_LOG_DEFAULT_LEVEL);
+#endif
+}
+
+esp_err_t trace_erase(void)
+{
+#if CONFIG_ESPNOW_TRACE_SINK_USB
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    if (s_part == NULL) return ESP_ERR_INVALID_STATE;
+    if (s_running) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_sink_lock, portMAX_DELAY);
+    esp_err_t err = esp_partition_erase_range(s_part, 0, s_sector_count * TRACE_SECTOR_SIZE);
+    s_sector = 0;
+    s_offset = 0;
+    xSemaphoreGive(s_sink_lock);
+    return err;
+#endif
+}
+
+void trace_record(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    trace_record_t *rec;
+
+    if (!s_running || len <= 0 || len > ESP_NOW_MAX_DATA_LEN_V2) return;
+
+    uint8_t flags = (recv_info->des_addr[0] & 0x01) ? 0 : TRACE_FLAG_UNICAST;
+    if (TRACE_SNAPLEN > 0 && len > TRACE_SNAPLEN) {
+        len = TRACE_SNAPLEN;
+        flags |= TRACE_FLAG_SNAPPED;
+    }
+
+    if (xRingbufferSendAcquire(s_ring, (void **)&rec, sizeof(trace_record_t) + len, 0) != pdTRUE) {
+        atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    rec->sync = TRACE_SYNC;
+    rec->len = (uint16_t)len;
+    rec->flags = flags;
+    rec->rssi = recv_info->rx_ctrl->rssi;
+    rec->noise_floor = recv_info->rx_ctrl->noise_floor;
+    rec->channel = recv_info->rx_ctrl->channel;
+    rec->t_ms = (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+    memcpy(rec->src, recv_info->src_addr, sizeof(rec->src));
+    memcpy(rec->data, data, len);
+
+    xRingbufferSendComplete(s_ring, rec);
+}
+
+void trace_get_stats(trace_stats_t *out)
+{
+    if (out == NULL) return;
+    memcpy(out, &s_stats, sizeof(trace_stats_t));
+    out->dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed);
+    out->running = s_running;
+}
+
+#endif /* CONFIG_ESPNOW_TRACE */
@@ -0,0 +1,30 @@
+# Fails the build if any object in libmain other than mem.c references the
+# heap directly. Run with -DNM=<nm> -DLIB=<libmain.a>.
+
+execute_process(COMMAND ${NM} -A -u ${LIB}
+                OUTPUT_VARIABLE undefined
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "static_mem_check: ${NM} failed on ${LIB}")
+endif()
+
+set(heap_symbols malloc calloc realloc free strdup strndup
+    heap_caps_malloc heap_caps_calloc heap_caps_realloc heap_caps_free)
+
+string(REPLACE "\n" ";" lines "${undefined}")
+set(offenders "")
+foreach(line IN LISTS lines)
+    if(line MATCHES "mem\\.c\\.obj:")
+        continue()
+    endif()
+    foreach(sym IN LISTS heap_symbols)
+        if(line MATCHES "[ \t]U ${sym}$")
+            list(APPEND offenders "${line}")
+        endif()
+    endforeach()
+endforeach()
+
+if(offenders)
+    string(REPLACE ";" "\n  " report "${offenders}")
+    message(FATAL_ERROR "static_mem_check: heap calls outside mem.c:\n  ${report}")
+endif()
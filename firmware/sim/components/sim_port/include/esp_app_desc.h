@@ -0,0 +1,28 @@
+/*
+ * esp_app_desc.h - app description for the Linux simulator
+ *
+ * The version comes from WAYSIDE_SIM_FW_VERSION; see esp_ota_ops.h.
+ */
+
+#ifndef SIM_ESP_APP_DESC_H
+#define SIM_ESP_APP_DESC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t magic_word;
+    char version[32];
+    char project_name[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t *esp_app_get_description(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_ESP_APP_DESC_H */
@@ -0,0 +1,31 @@
+/*
+ * esp_coexist.h - the arbiter preference call coex.c makes, for the Linux
+ * simulator
+ *
+ * sim_radio.c keeps the preference and uses it to decide who wins when a
+ * BLE connection event (sim_radio_ble_event()) overlaps an ESP-NOW frame.
+ */
+
+#ifndef SIM_ESP_COEXIST_H
+#define SIM_ESP_COEXIST_H
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_COEX_PREFER_WIFI = 0,
+    ESP_COEX_PREFER_BT,
+    ESP_COEX_PREFER_BALANCE,
+    ESP_COEX_PREFER_NUM,
+} esp_coex_prefer_t;
+
+esp_err_t esp_coex_preference_set(esp_coex_prefer_t prefer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_ESP_COEXIST_H */
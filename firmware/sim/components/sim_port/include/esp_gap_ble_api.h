@@ -0,0 +1,14 @@
+/*
+ * esp_gap_ble_api.h - Just enough of the Bluedroid GAP types for ble_task.h
+ *
+ * The simulator has no BLE stack; phone commands arrive on stdin.
+ */
+
+#ifndef SIM_ESP_GAP_BLE_API_H
+#define SIM_ESP_GAP_BLE_API_H
+
+#include <stdint.h>
+
+typedef uint8_t esp_ble_gap_phy_t;
+
+#endif /* SIM_ESP_GAP_BLE_API_H */
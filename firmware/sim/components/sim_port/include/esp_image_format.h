@@ -0,0 +1,32 @@
+/*
+ * esp_image_format.h - image metadata for the Linux simulator
+ */
+
+#ifndef SIM_ESP_IMAGE_FORMAT_H
+#define SIM_ESP_IMAGE_FORMAT_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} esp_partition_pos_t;
+
+typedef struct {
+    uint32_t start_addr;
+    uint32_t image_len;
+} esp_image_metadata_t;
+
+/** @brief Length of the image at part->offset, like the real call without validation */
+esp_err_t esp_image_get_metadata(const esp_partition_pos_t *part, esp_image_metadata_t *metadata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_ESP_IMAGE_FORMAT_H */
@@ -0,0 +1,138 @@
+/*
+ * esp_now.h - ESP-NOW API for the Linux simulator
+ *
+ * Same types and calls the firmware uses from the real esp_now.h, backed by
+ * sim_radio.c. Frames go out on a UDP multicast "ether" shared by every
+ * badge process; the receiver derives RSSI from both badges' positions.
+ *
+ * The PHY mode and rate types come from esp_wifi_types.h on the real
+ * thing; only the rates rate.c uses are listed, with their real values.
+ */
+
+#ifndef SIM_ESP_NOW_H
+#define SIM_ESP_NOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_NOW_ETH_ALEN                6
+#define ESP_NOW_KEY_LEN                 16
+#define ESP_NOW_MAX_TOTAL_PEER_NUM      20
+#define ESP_NOW_MAX_ENCRYPT_PEER_NUM    17
+#define ESP_NOW_MAX_DATA_LEN            250
+#define ESP_NOW_MAX_DATA_LEN_V2         1470
+
+#define ESP_ERR_ESPNOW_BASE             (ESP_ERR_WIFI_BASE + 100)
+#define ESP_ERR_ESPNOW_NOT_INIT         (ESP_ERR_ESPNOW_BASE + 1)
+#define ESP_ERR_ESPNOW_ARG              (ESP_ERR_ESPNOW_BASE + 2)
+#define ESP_ERR_ESPNOW_NO_MEM           (ESP_ERR_ESPNOW_BASE + 3)
+#define ESP_ERR_ESPNOW_FULL             (ESP_ERR_ESPNOW_BASE + 4)
+#define ESP_ERR_ESPNOW_NOT_FOUND        (ESP_ERR_ESPNOW_BASE + 5)
+#define ESP_ERR_ESPNOW_INTERNAL         (ESP_ERR_ESPNOW_BASE + 6)
+#define ESP_ERR_ESPNOW_EXIST            (ESP_ERR_ESPNOW_BASE + 7)
+#define ESP_ERR_ESPNOW_IF               (ESP_ERR_ESPNOW_BASE + 8)
+
+typedef enum {
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum {
+    ESP_NOW_SEND_SUCCESS = 0,
+    ESP_NOW_SEND_FAIL,
+} esp_now_send_status_t;
+
+typedef enum {
+    WIFI_PHY_MODE_LR,
+    WIFI_PHY_MODE_11B,
+    WIFI_PHY_MODE_11G,
+    WIFI_PHY_MODE_11A,
+    WIFI_PHY_MODE_HT20,
+    WIFI_PHY_MODE_HT40,
+    WIFI_PHY_MODE_HE20,
+    WIFI_PHY_MODE_VHT20,
+} wifi_phy_mode_t;
+
+typedef enum {
+    WIFI_PHY_RATE_1M_L      = 0x00,
+    WIFI_PHY_RATE_2M_L      = 0x01,
+    WIFI_PHY_RATE_MCS0_LGI  = 0x10,
+    WIFI_PHY_RATE_MCS1_LGI  = 0x11,
+    WIFI_PHY_RATE_MCS2_LGI  = 0x12,
+    WIFI_PHY_RATE_MCS3_LGI  = 0x13,
+    WIFI_PHY_RATE_MCS4_LGI  = 0x14,
+    WIFI_PHY_RATE_MCS5_LGI  = 0x15,
+    WIFI_PHY_RATE_MCS6_LGI  = 0x16,
+    WIFI_PHY_RATE_MCS7_LGI  = 0x17,
+    WIFI_PHY_RATE_LORA_250K = 0x29,
+    WIFI_PHY_RATE_LORA_500K = 0x2A,
+} wifi_phy_rate_t;
+
+typedef struct {
+    wifi_phy_mode_t phymode;
+    wifi_phy_rate_t rate;
+    bool ersu;
+    bool dcm;
+} esp_now_rate_config_t;
+
+typedef struct {
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+    uint8_t lmk[ESP_NOW_KEY_LEN];
+    uint8_t channel;
+    wifi_interface_t ifidx;
+    bool encrypt;
+    void *priv;
+} esp_now_peer_info_t;
+
+typedef struct {
+    int total_num;
+    int encrypt_num;
+} esp_now_peer_num_t;
+
+typedef struct {
+    signed rssi : 8;
+    signed noise_floor : 8;
+    unsigned sig_len : 12;      /* promiscuous frames only, FCS included */
+} wifi_pkt_rx_ctrl_t;
+
+typedef struct {
+    uint8_t *src_addr;
+    uint8_t *des_addr;
+    wifi_pkt_rx_ctrl_t *rx_ctrl;
+} esp_now_recv_info_t;
+
+typedef struct {
+    const uint8_t *src_addr;
+    const uint8_t *des_addr;
+} esp_now_send_info_t;
+
+typedef void (*esp_now_recv_cb_t)(const esp_now_recv_info_t *recv_info, const uint8_t *data, int data_len);
+typedef void (*esp_now_send_cb_t)(const esp_now_send_info_t *tx_info, esp_now_send_status_t status);
+
+esp_err_t esp_now_init(void);
+esp_err_t esp_now_deinit(void);
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr);
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_get_peer(const uint8_t *peer_addr, esp_now_peer_info_t *peer);
+esp_err_t esp_now_fetch_peer(bool from_head, esp_now_peer_info_t *peer);
+bool esp_now_is_peer_exist(const uint8_t *peer_addr);
+esp_err_t esp_now_get_peer_num(esp_now_peer_num_t *num);
+esp_err_t esp_now_set_pmk(const uint8_t *pmk);
+esp_err_t esp_now_set_peer_rate_config(const uint8_t *peer_addr, esp_now_rate_config_t *config);
+esp_err_t esp_now_get_version(uint32_t *version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_ESP_NOW_H */
@@ -0,0 +1,63 @@
+/*
+ * esp_ota_ops.h - OTA slots for the Linux simulator
+ *
+ * A simulated badge runs from "ota_0" and receives into "ota_1", both in
+ * memory. The running image is synthetic: a header with the version from
+ * WAYSIDE_SIM_FW_VERSION (default 1), WAYSIDE_SIM_FW_SIZE bytes in total
+ * (default 256 KiB) taken from the simulator's own executable so it
+ * compresses like code, and a SHA-256 of everything before it as the
+ * trailer. esp_ota_end() checks header and trailer, standing in for the
+ * image and signature checks of the real one.
+ *
+ * esp_ota_set_boot_partition() does not return: it re-executes the
+ * simulator with WAYSIDE_SIM_FW_VERSION set to the new image's version,
+ * as the bootloader would pick the new slot on the next esp_restart().
+ * The process keeps its pid, stdin and stdout, and prints READY again.
+ */
+
+#ifndef SIM_ESP_OTA_OPS_H
+#define SIM_ESP_OTA_OPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_app_desc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_OTA_BASE                0x1500
+#define ESP_ERR_OTA_VALIDATE_FAILED     (ESP_ERR_OTA_BASE + 0x03)
+
+#define OTA_SIZE_UNKNOWN                0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES      0xfffffffe
+
+typedef uint32_t esp_ota_handle_t;
+
+typedef enum {
+    ESP_OTA_IMG_NEW             = 0x0U,
+    ESP_OTA_IMG_PENDING_VERIFY  = 0x1U,
+    ESP_OTA_IMG_VALID           = 0x2U,
+    ESP_OTA_IMG_INVALID         = 0x3U,
+    ESP_OTA_IMG_ABORTED         = 0x4U,
+    ESP_OTA_IMG_UNDEFINED       = 0xFFFFFFFFU,
+} esp_ota_img_states_t;
+
+const esp_partition_t *esp_ota_get_running_partition(void);
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_get_partition_description(const esp_partition_t *partition, esp_app_desc_t *app_desc);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_ESP_OTA_OPS_H */
@@ -0,0 +1,61 @@
+/*
+ * esp_wifi.h - the part of the Wi-Fi API the firmware uses outside
+ * wifi_task.c, for the Linux simulator
+ *
+ * The TX power limit is carried in every frame sim_radio.c sends, and the
+ * receiver lowers its RSSI by the difference to SIM_RADIO_BOOT_TX_POWER_Q.
+ *
+ * Promiscuous mode hands the callback every frame the badge hears, whoever
+ * it is for, as the vendor action frame ESP-NOW puts on the air; only
+ * management frames exist. esp_wifi_80211_tx() takes such a frame, from
+ * any source address, and sends its payload unacknowledged.
+ */
+
+#ifndef SIM_ESP_WIFI_H
+#define SIM_ESP_WIFI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @param power Limit in 0.25 dBm units, 8..84 like the real call */
+esp_err_t esp_wifi_set_max_tx_power(int8_t power);
+esp_err_t esp_wifi_get_max_tx_power(int8_t *power);
+
+typedef enum {
+    WIFI_PKT_MGMT,
+    WIFI_PKT_CTRL,
+    WIFI_PKT_DATA,
+    WIFI_PKT_MISC,
+} wifi_promiscuous_pkt_type_t;
+
+typedef struct {
+    wifi_pkt_rx_ctrl_t rx_ctrl;
+    uint8_t payload[0];         /* MAC header onwards, FCS last */
+} wifi_promiscuous_pkt_t;
+
+#define WIFI_PROMIS_FILTER_MASK_MGMT    (1 << 0)
+
+typedef struct {
+    uint32_t filter_mask;
+} wifi_promiscuous_filter_t;
+
+typedef void (*wifi_promiscuous_cb_t)(void *buf, wifi_promiscuous_pkt_type_t type);
+
+esp_err_t esp_wifi_set_promiscuous(bool en);
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb);
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter);
+
+/** @param en_sys_seq ignored: the sim ether has no sequence control */
+esp_err_t esp_wifi_80211_tx(wifi_interface_t ifx, const void *buffer, int len, bool en_sys_seq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_ESP_WIFI_H */
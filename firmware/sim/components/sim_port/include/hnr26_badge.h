@@ -0,0 +1,35 @@
+/*
+ * hnr26_badge.h - Badge board API for the Linux simulator
+ *
+ * Only the calls proximity.c makes; LEDs are tracked in memory so a run can
+ * report what a badge would have shown.
+ */
+
+#ifndef SIM_HNR26_BADGE_H
+#define SIM_HNR26_BADGE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t hnr26_badge_dice_t;
+typedef uint8_t aw9523_pin_data_digital_t;
+
+esp_err_t hnr26_badge_init();
+esp_err_t hnr26_badge_set_led(const hnr26_badge_dice_t dice_num,
+                              const aw9523_pin_data_digital_t is_on);
+esp_err_t hnr26_badge_update_virtual_pins_state();
+
+/**
+ * @brief Number of dice LEDs currently lit (sim only)
+ */
+uint8_t sim_board_leds_on(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_HNR26_BADGE_H */
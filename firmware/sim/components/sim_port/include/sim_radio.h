@@ -0,0 +1,144 @@
+/**
+ * @file sim_radio.h
+ * @brief Virtual radio bus for running many badges as Linux processes
+ *
+ * Every process joins the same UDP multicast group. A transmitted frame
+ * carries the sender's MAC and position; each receiver computes RSSI with
+ * the same log-distance model espnow.c uses for distance estimation, adds
+ * Gaussian shadowing and drops frames below the receiver sensitivity.
+ *
+ * Frames go out at the rate esp_now_set_peer_rate_config() set for the
+ * peer, 1 Mbps unless told otherwise. SIM_RADIO_SENSITIVITY_DBM is 1 Mbps';
+ * faster rates need more signal, Long Range less, by the esp32c3's
+ * datasheet margins, and take less air time (or more). A unicast is ACKed
+ * over the ether when its receiver takes it; the send callback reports
+ * success on the ACK and failure after SIM_RADIO_ACK_TIMEOUT_MS without
+ * one. Each frame is one attempt: the real driver retries, so on hardware
+ * fewer unicasts fail than here.
+ *
+ * A badge is ESP-NOW v2 unless configured as v1. A v1 badge refuses to
+ * send more than ESP_NOW_MAX_DATA_LEN bytes and keeps only that many of a
+ * longer frame it hears, as the v1 driver does with a v2 frame.
+ *
+ * CCMP is not modelled: frames to encrypted peers go out in the clear and
+ * are delivered as if decryption succeeded.
+ *
+ * The radio is shared with BLE as on the esp32c3: sim_radio_ble_event()
+ * marks a connection event, and a frame whose air time overlaps one is lost
+ * unless the arbiter preference was ESP_COEX_PREFER_WIFI when the event
+ * began. Frames carry their host send time so the overlap does not depend
+ * on when the receiver polls. Only reception is modelled; a BLE event that
+ * loses to Wi-Fi is not retried or delayed.
+ *
+ * In promiscuous mode (esp_wifi.h) the badge also hears frames between
+ * other badges, and frames it sent raw with esp_wifi_80211_tx() under
+ * another source address go out unacknowledged; frames carry the MAC of
+ * the radio that sent them, so a badge never hears its own.
+ *
+ * With group == NULL the radio is detached: nothing is sent or heard, sends
+ * are only counted. sim/replay uses this to drive the stack from a trace.
+ */
+
+#ifndef SIM_RADIO_H
+#define SIM_RADIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_RADIO_DEFAULT_GROUP     "239.42.0.1"
+#define SIM_RADIO_DEFAULT_PORT      4242
+#define SIM_RADIO_TX_POWER_DBM      (-40)   /**< RSSI at 1 m, matches ESPNOW_TX_POWER_DBM */
+#define SIM_RADIO_PATH_LOSS_EXP     2.5f
+#define SIM_RADIO_SENSITIVITY_DBM   (-95)
+#define SIM_RADIO_NOISE_FLOOR_DBM   (-96)
+#define SIM_RADIO_BOOT_TX_POWER_Q   80      /**< 20 dBm, what SIM_RADIO_TX_POWER_DBM was measured at */
+#define SIM_RADIO_BLE_EVENT_MS      8       /**< radio time of one notification's connection event */
+#define SIM_RADIO_ACK_TIMEOUT_MS    50      /**< a unicast not ACKed by then failed */
+#define SIM_RADIO_DIST_BUCKETS      6       /**< 0-2, 2-5, 5-10, 10-20, 20-40 and 40+ m */
+
+/**
+ * @brief Simulated badge configuration
+ */
+typedef struct {
+    uint16_t id;                /**< Badge number, becomes the low bytes of its MAC */
+    const uint8_t *mac;         /**< Use this MAC instead of deriving one from id, or NULL */
+    float x;                    /**< Position in metres */
+    float y;
+    float shadowing_db;         /**< Std deviation of per-frame RSSI noise */
+    const char *group;          /**< Multicast group address, NULL for a detached radio */
+    uint16_t port;              /**< Multicast port */
+    const char *trace_path;     /**< Record every delivered frame here in trace.h format, or NULL */
+    uint8_t espnow_version;     /**< 1 or 2, 0 for 2 */
+    bool no_encrypt_peers;      /**< No encrypted peer slots: every link stays plaintext */
+} sim_radio_config_t;
+
+/**
+ * @brief Radio counters for the end-of-run report
+ */
+typedef struct {
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t rx_frames;         /**< Delivered to the receive callback */
+    uint32_t rx_out_of_range;   /**< Heard on the ether but below sensitivity */
+    uint32_t rx_radio_off;      /**< Dropped while the radio was switched off */
+    uint32_t rx_ble_busy;       /**< Lost to a BLE connection event */
+    uint32_t ble_events;
+    uint32_t rx_truncated;      /**< Longer than a v1 badge takes, cut short */
+    uint32_t rx_ccmp_fail;      /**< Unicasts ACKed but dropped: LMK mismatch, or sealed on one side only */
+    uint32_t tx_unicast;
+    uint32_t tx_unicast_acked;
+    uint64_t tx_airtime_us;     /**< Every frame sent */
+    uint64_t tx_unicast_airtime_us;
+    /** Unicasts addressed to this badge while its radio was on, by distance from the sender */
+    uint32_t uc_heard[SIM_RADIO_DIST_BUCKETS];
+    uint32_t uc_delivered[SIM_RADIO_DIST_BUCKETS];
+    uint64_t uc_airtime_us[SIM_RADIO_DIST_BUCKETS];
+} sim_radio_stats_t;
+
+/**
+ * @brief Join the ether and start the radio task
+ *
+ * Must be called before espnow_init().
+ *
+ * @param config Badge identity, position and ether address
+ * @return ESP_OK on success
+ */
+esp_err_t sim_radio_init(const sim_radio_config_t *config);
+
+/**
+ * @brief Move the badge
+ */
+void sim_radio_set_position(float x, float y);
+
+/**
+ * @brief Switch the radio on or off to simulate outages
+ *
+ * While off, nothing is transmitted and every frame heard is dropped.
+ */
+void sim_radio_set_enabled(bool enabled);
+
+/**
+ * @brief BLE takes the radio for duration_ms from now
+ */
+void sim_radio_ble_event(uint32_t duration_ms);
+
+/**
+ * @brief Copy the radio counters
+ */
+void sim_radio_get_stats(sim_radio_stats_t *out);
+
+/**
+ * @brief MAC address of this badge
+ */
+void sim_radio_get_mac(uint8_t *mac);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_RADIO_H */
@@ -0,0 +1,90 @@
+/*
+ * Board, buzzer and BLE output for the Linux simulator.
+ *
+ * Messages the badge would notify to the phone are written to stdout as
+ * "BLE <uptime_ms> <message>" so the launcher can timestamp pairing events.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "hnr26_badge.h"
+#include "buzzer.h"
+#include "ble_task.h"
+
+#define SIM_BOARD_LEDS  10
+
+static bool s_leds[SIM_BOARD_LEDS + 1];
+
+esp_err_t hnr26_badge_init()
+{
+    memset(s_leds, 0, sizeof(s_leds));
+    return ESP_OK;
+}
+
+esp_err_t hnr26_badge_set_led(const hnr26_badge_dice_t dice_num,
+                              const aw9523_pin_data_digital_t is_on)
+{
+    if (dice_num < 1 || dice_num > SIM_BOARD_LEDS) return ESP_ERR_INVALID_ARG;
+    s_leds[dice_num] = is_on != 0;
+    return ESP_OK;
+}
+
+esp_err_t hnr26_badge_update_virtual_pins_state()
+{
+    return ESP_OK;
+}
+
+uint8_t sim_board_leds_on(void)
+{
+    uint8_t count = 0;
+    for (int i = 1; i <= SIM_BOARD_LEDS; i++) {
+        count += s_leds[i];
+    }
+    return count;
+}
+
+esp_err_t buzzer_start(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t buzzer_stop(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t buzzer_beep(uint32_t on_ms, uint32_t off_ms, uint32_t count)
+{
+    return ESP_OK;
+}
+
+void ble_send_message(const char *message)
+{
+    if (message == NULL) return;
+
+    size_t len = strlen(message);
+    while (len > 0 && message[len - 1] == BLE_MESSAGE_DELIMITER_CHAR) {
+        len--;
+    }
+
+    printf("BLE %lu %.*s\n", (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS), (int)len, message);
+    fflush(stdout);
+}
+
+bool ble_is_connected(void)
+{
+    return true;
+}
+
+bool ble_is_paired(void)
+{
+    return true;
+}
+
+esp_err_t ble_set_adv_interval(uint32_t interval_min, uint32_t interval_max)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,142 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+
+#define SIM_NVS_MAX_NAMESPACES  8
+#define SIM_NVS_MAX_ENTRIES     32
+#define SIM_NVS_NAME_LEN        16
+
+typedef struct {
+    bool used;
+    nvs_handle_t ns;
+    char key[SIM_NVS_NAME_LEN];
+    void *value;
+    size_t len;
+} sim_nvs_entry_t;
+
+static char s_namespaces[SIM_NVS_MAX_NAMESPACES][SIM_NVS_NAME_LEN];
+static sim_nvs_entry_t s_entries[SIM_NVS_MAX_ENTRIES];
+
+static sim_nvs_entry_t *find(nvs_handle_t ns, const char *key)
+{
+    for (int i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        if (s_entries[i].used && s_entries[i].ns == ns && strcmp(s_entries[i].key, key) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* handles are namespace index + 1 */
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (namespace_name == NULL || out_handle == NULL) return ESP_ERR_INVALID_ARG;
+
+    for (int i = 0; i < SIM_NVS_MAX_NAMESPACES; i++) {
+        if (strncmp(s_namespaces[i], namespace_name, SIM_NVS_NAME_LEN) == 0) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+
+    if (open_mode == NVS_READONLY) return ESP_ERR_NVS_NOT_FOUND;
+
+    for (int i = 0; i < SIM_NVS_MAX_NAMESPACES; i++) {
+        if (s_namespaces[i][0] == '\0') {
+            strncpy(s_namespaces[i], namespace_name, SIM_NVS_NAME_LEN - 1);
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (key == NULL || value == NULL) return ESP_ERR_INVALID_ARG;
+
+    sim_nvs_entry_t *e = find(handle, key);
+    if (e == NULL) {
+        for (int i = 0; i < SIM_NVS_MAX_ENTRIES && e == NULL; i++) {
+            if (!s_entries[i].used) e = &s_entries[i];
+        }
+        if (e == NULL) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        memset(e, 0, sizeof(*e));
+        e->ns = handle;
+        strncpy(e->key, key, SIM_NVS_NAME_LEN - 1);
+    }
+
+    void *copy = malloc(length > 0 ? length : 1);
+    if (copy == NULL) return ESP_ERR_NO_MEM;
+    memcpy(copy, value, length);
+
+    free(e->value);
+    e->value = copy;
+    e->len = length;
+    e->used = true;
+    return ESP_OK;
+}
+
+/* same contract as the real one: NULL out_value queries the length */
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    if (key == NULL || length == NULL) return ESP_ERR_INVALID_ARG;
+
+    sim_nvs_entry_t *e = find(handle, key);
+    if (e == NULL) return ESP_ERR_NVS_NOT_FOUND;
+
+    if (out_value == NULL) {
+        *length = e->len;
+        return ESP_OK;
+    }
+    if (*length < e->len) {
+        *length = e->len;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, e->value, e->len);
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    if (value == NULL) return ESP_ERR_INVALID_ARG;
+    return nvs_set_blob(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return nvs_get_blob(handle, key, out_value, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_get_blob(handle, key, out_value, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_get_blob(handle, key, out_value, &len);
+}
@@ -0,0 +1,235 @@
+/*
+ * sim_ota.c - in-memory OTA slots for the Linux simulator (see esp_ota_ops.h)
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_image_format.h"
+#include "mbedtls/md.h"
+
+static const char *TAG = "sim_ota";
+
+#define SIM_OTA_MAGIC           0x57534657  /* "WSFW" */
+#define SIM_OTA_DEFAULT_SIZE    (256 * 1024)
+#define SIM_OTA_SLOT_SIZE       0x1C0000
+#define SIM_OTA_HASH_LEN        32
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              /* whole image, trailer included */
+    uint32_t reserved;
+} sim_image_header_t;
+
+static const esp_partition_t s_slot[2] = {
+    { .type = ESP_PARTITION_TYPE_APP, .subtype = 0x10, .address = 0x10000,  .size = SIM_OTA_SLOT_SIZE, .label = "ota_0" },
+    { .type = ESP_PARTITION_TYPE_APP, .subtype = 0x11, .address = 0x1D0000, .size = SIM_OTA_SLOT_SIZE, .label = "ota_1" },
+};
+
+static esp_app_desc_t s_desc;
+static uint8_t *s_running;
+static uint32_t s_running_len;
+static uint8_t *s_update;
+static uint32_t s_update_len;
+static bool s_update_open;
+static bool s_update_valid;
+
+static void image_hash(const uint8_t *image, uint32_t len, uint8_t *out)
+{
+    mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), image, len - SIM_OTA_HASH_LEN, out);
+}
+
+static bool image_valid(const uint8_t *image, uint32_t len)
+{
+    sim_image_header_t hdr;
+    uint8_t hash[SIM_OTA_HASH_LEN];
+
+    if (len < sizeof(hdr) + SIM_OTA_HASH_LEN) return false;
+    memcpy(&hdr, image, sizeof(hdr));
+    if (hdr.magic != SIM_OTA_MAGIC || hdr.size != len) return false;
+
+    image_hash(image, len, hash);
+    return memcmp(hash, image + len - SIM_OTA_HASH_LEN, SIM_OTA_HASH_LEN) == 0;
+}
+
+/* built on first use: header, the executable's bytes, hash */
+static void build_running_image(void)
+{
+    if (s_running != NULL) return;
+
+    const char *v = getenv("WAYSIDE_SIM_FW_VERSION");
+    const char *size_env = getenv("WAYSIDE_SIM_FW_SIZE");
+    uint32_t len = size_env != NULL ? (uint32_t)strtoul(size_env, NULL, 0) : SIM_OTA_DEFAULT_SIZE;
+    if (len < sizeof(sim_image_header_t) + SIM_OTA_HASH_LEN) len = sizeof(sim_image_header_t) + SIM_OTA_HASH_LEN;
+    if (len > SIM_OTA_SLOT_SIZE) len = SIM_OTA_SLOT_SIZE;
+
+    s_desc.magic_word = 0xABCD5432;
+    snprintf(s_desc.version, sizeof(s_desc.version), "%s", v != NULL && v[0] != '\0' ? v : "1");
+    snprintf(s_desc.project_name, sizeof(s_desc.project_name), "wayside_sim");
+
+    s_running = calloc(1, len);
+    if (s_running == NULL) abort();
+    s_running_len = len;
+
+    sim_image_header_t hdr = {
+        .magic = SIM_OTA_MAGIC,
+        .version = (uint32_t)strtoul(s_desc.version, NULL, 10),
+        .size = len,
+    };
+    memcpy(s_running, &hdr, sizeof(hdr));
+
+    uint32_t body = len - sizeof(hdr) - SIM_OTA_HASH_LEN;
+    FILE *f = fopen("/proc/self/exe", "rb");
+    uint32_t got = 0;
+    while (f != NULL && got < body) {
+        size_t n = fread(s_running + sizeof(hdr) + got, 1, body - got, f);
+        if (n == 0) rewind(f);
+        got += n;
+    }
+    if (f != NULL) fclose(f);
+
+    image_hash(s_running, len, s_running + len - SIM_OTA_HASH_LEN);
+}
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    build_running_image();
+    return &s_desc;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &s_slot[0];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &s_slot[1];
+}
+
+esp_err_t esp_image_get_metadata(const esp_partition_pos_t *part, esp_image_metadata_t *metadata)
+{
+    metadata->start_addr = part->offset;
+    if (part->offset == s_slot[0].address) {
+        build_running_image();
+        metadata->image_len = s_running_len;
+        return ESP_OK;
+    }
+    if (part->offset == s_slot[1].address && s_update_valid) {
+        metadata->image_len = s_update_len;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    const uint8_t *image = NULL;
+    uint32_t len = 0;
+
+    if (partition == &s_slot[0]) {
+        build_running_image();
+        image = s_running;
+        len = s_running_len;
+    } else if (partition == &s_slot[1]) {
+        image = s_update;
+        len = s_update_len;
+    }
+    if (image == NULL || src_offset + size > len) return ESP_ERR_INVALID_SIZE;
+
+    memcpy(dst, image + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    if (partition != &s_slot[1] || s_update_open) return ESP_ERR_INVALID_ARG;
+
+    if (s_update == NULL) {
+        s_update = malloc(SIM_OTA_SLOT_SIZE);
+        if (s_update == NULL) return ESP_ERR_NO_MEM;
+    }
+    s_update_len = 0;
+    s_update_valid = false;
+    s_update_open = true;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (handle != 1 || !s_update_open) return ESP_ERR_INVALID_ARG;
+    if (s_update_len + size > SIM_OTA_SLOT_SIZE) return ESP_ERR_INVALID_SIZE;
+
+    memcpy(s_update + s_update_len, data, size);
+    s_update_len += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if (handle != 1 || !s_update_open) return ESP_ERR_INVALID_ARG;
+
+    s_update_open = false;
+    s_update_valid = image_valid(s_update, s_update_len);
+    return s_update_valid ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    if (handle != 1 || !s_update_open) return ESP_ERR_INVALID_ARG;
+
+    s_update_open = false;
+    s_update_len = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_partition_description(const esp_partition_t *partition, esp_app_desc_t *app_desc)
+{
+    if (partition == &s_slot[0]) {
+        *app_desc = *esp_app_get_description();
+        return ESP_OK;
+    }
+    if (partition != &s_slot[1] || !s_update_valid) return ESP_ERR_NOT_FOUND;
+
+    sim_image_header_t hdr;
+    memcpy(&hdr, s_update, sizeof(hdr));
+    memset(app_desc, 0, sizeof(*app_desc));
+    app_desc->magic_word = s_desc.magic_word;
+    snprintf(app_desc->version, sizeof(app_desc->version), "%lu", (unsigned long)hdr.version);
+    snprintf(app_desc->project_name, sizeof(app_desc->project_name), "wayside_sim");
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    esp_app_desc_t desc;
+
+    if (partition != &s_slot[1] || esp_ota_get_partition_description(partition, &desc) != ESP_OK) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    /* what the bootloader would do on the next reset, right now */
+    setenv("WAYSIDE_SIM_FW_VERSION", desc.version, 1);
+    fflush(stdout);
+    execl("/proc/self/exe", "wayside_sim", (char *)NULL);
+
+    ESP_LOGE(TAG, "Re-exec failed");
+    return ESP_FAIL;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state)
+{
+    *ota_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,76 @@
+/*
+ * sim_partition.c - the "assets" partition for the Linux simulator
+ *
+ * Backed by the file $WAYSIDE_SIM_ASSETS (wayside_assets.py build), read
+ * into a partition-sized buffer the first time it is looked for; the rest
+ * reads as erased flash. Without the variable there is no such partition
+ * and the firmware uses its built-in tables. Mapping hands out the buffer.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "assets.h"
+
+static const char *TAG = "sim_partition";
+
+#define SIM_ASSETS_SIZE     0x10000     /* partitions.csv */
+
+static const esp_partition_t s_assets = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ASSETS_PARTITION_SUBTYPE,
+    .address = 0x3F0000,
+    .size = SIM_ASSETS_SIZE,
+    .label = "assets",
+};
+
+static uint8_t *s_flash;
+
+static bool load(void)
+{
+    const char *path = getenv("WAYSIDE_SIM_ASSETS");
+    if (s_flash != NULL) return true;
+    if (path == NULL || path[0] == '\0') return false;
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Can't open %s", path);
+        return false;
+    }
+
+    s_flash = malloc(SIM_ASSETS_SIZE);
+    if (s_flash == NULL) abort();
+    memset(s_flash, 0xFF, SIM_ASSETS_SIZE);
+
+    size_t n = fread(s_flash, 1, SIM_ASSETS_SIZE, f);
+    if (fgetc(f) != EOF) ESP_LOGW(TAG, "%s is larger than the partition, cut to %d bytes", path, SIM_ASSETS_SIZE);
+    fclose(f);
+    ESP_LOGI(TAG, "assets: %u bytes from %s", (unsigned)n, path);
+    return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, uint8_t subtype, const char *label)
+{
+    if (type != ESP_PARTITION_TYPE_DATA || subtype != s_assets.subtype) return NULL;
+    if (label != NULL && strcmp(label, s_assets.label) != 0) return NULL;
+    return load() ? &s_assets : NULL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle)
+{
+    if (partition != &s_assets || out_ptr == NULL || out_handle == NULL) return ESP_ERR_INVALID_ARG;
+    if (offset > partition->size || size > partition->size - offset) return ESP_ERR_INVALID_SIZE;
+
+    *out_ptr = s_flash + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle)
+{
+}
@@ -0,0 +1,959 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "esp_coexist.h"
+#include "sim_radio.h"
+#include "trace.h"
+
+static const char *TAG = "sim_radio";
+
+#define SIM_ETHER_MAGIC         0x57415953  /* "WAYS" */
+#define SIM_ACK_MAGIC           0x5741434B  /* "WACK" */
+#define SIM_RADIO_TASK_PERIOD   pdMS_TO_TICKS(2)
+#define SIM_SEND_CB_QUEUE       16
+#define SIM_BLE_EVENTS          8       /* recent enough to cover a poll period */
+#define SIM_PENDING_MAX         16      /* unicasts waiting for their ACK */
+#define SIM_AIR_FRAME_BYTES     43      /* action frame around the ESP-NOW payload, FCS included */
+#define SIM_ACTION_HDR_LEN      32      /* MAC header, category, OUI, random */
+#define SIM_ELEMENT_BODY_MAX    250     /* body bytes per vendor element */
+#define SIM_CCMP_BYTES          16      /* CCMP header and MIC around an encrypted payload */
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    uint8_t origin[ESP_NOW_ETH_ALEN];   /* the radio that sent it; src unless raw */
+    float x;
+    float y;
+    int8_t tx_power_q;          /* sender's esp_wifi_set_max_tx_power() */
+    int64_t host_us;            /* CLOCK_MONOTONIC when sent, common to all badges */
+    uint8_t rate;               /* wifi_phy_rate_t */
+    uint32_t tx_id;             /* echoed in the ACK */
+    uint8_t ccmp;               /* sent to an encrypted peer */
+    uint8_t lmk[ESP_NOW_KEY_LEN];   /* the key it was sealed with, for the receiver to match */
+    uint16_t len;
+    uint8_t data[0];
+} sim_frame_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t src[ESP_NOW_ETH_ALEN];      /* the receiver of the unicast */
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    uint32_t tx_id;
+} sim_ack_t;
+
+typedef struct {
+    bool used;
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    uint32_t tx_id;
+    int64_t deadline_us;
+} sim_pending_t;
+
+typedef struct {
+    wifi_phy_rate_t rate;
+    int8_t margin_db;           /* sensitivity against 1 Mbps' */
+    uint32_t kbps;
+    uint16_t preamble_us;
+} sim_rate_t;
+
+typedef struct {
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    esp_now_send_status_t status;
+} sim_send_result_t;
+
+typedef struct {
+    int64_t start_us;
+    int64_t end_us;
+    bool wifi_wins;             /* ESP_COEX_PREFER_WIFI when it began */
+} sim_ble_event_t;
+
+static const uint8_t s_broadcast[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint8_t s_espressif_oui[3] = { 0x18, 0xfe, 0x34 };
+
+/* esp32c3 datasheet receive sensitivities, relative to 1 Mbps' -98 dBm */
+static const sim_rate_t s_rates[] = {
+    { WIFI_PHY_RATE_1M_L,       0, 1000,  192 },  /* first: the default */
+    { WIFI_PHY_RATE_2M_L,       2, 2000,  192 },
+    { WIFI_PHY_RATE_MCS0_LGI,   5, 6500,  36 },
+    { WIFI_PHY_RATE_MCS1_LGI,   8, 13000, 36 },
+    { WIFI_PHY_RATE_MCS2_LGI,  10, 19500, 36 },
+    { WIFI_PHY_RATE_MCS3_LGI,  14, 26000, 36 },
+    { WIFI_PHY_RATE_MCS4_LGI,  17, 39000, 36 },
+    { WIFI_PHY_RATE_MCS5_LGI,  21, 52000, 36 },
+    { WIFI_PHY_RATE_MCS6_LGI,  23, 58500, 36 },
+    { WIFI_PHY_RATE_MCS7_LGI,  25, 65000, 36 },
+    { WIFI_PHY_RATE_LORA_250K, -7, 250,   192 },
+    { WIFI_PHY_RATE_LORA_500K, -4, 500,   192 },
+};
+
+/* upper edges of the distance buckets but the last */
+static const float s_bucket_m[SIM_RADIO_DIST_BUCKETS - 1] = { 2, 5, 10, 20, 40 };
+
+static int s_sock = -1;
+static struct sockaddr_in s_group_addr;
+static uint8_t s_mac[ESP_NOW_ETH_ALEN];
+static float s_x, s_y, s_shadowing_db;
+static volatile int8_t s_tx_power_q = SIM_RADIO_BOOT_TX_POWER_Q;
+static volatile bool s_enabled = true;
+static bool s_espnow_ready;
+static uint8_t s_espnow_version = 2;
+static int s_encrypt_peers = ESP_NOW_MAX_ENCRYPT_PEER_NUM;
+
+static esp_now_recv_cb_t s_recv_cb;
+static wifi_promiscuous_cb_t s_promiscuous_cb;
+static volatile bool s_promiscuous;
+static esp_now_send_cb_t s_send_cb;
+static esp_now_peer_info_t s_peers[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static bool s_peer_used[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static wifi_phy_rate_t s_peer_rate[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static int s_fetch_idx;
+static sim_pending_t s_pending[SIM_PENDING_MAX];
+static uint32_t s_tx_id;
+
+static QueueHandle_t s_send_results;
+static SemaphoreHandle_t s_lock;
+static sim_radio_stats_t s_stats;
+static FILE *s_trace;
+static volatile esp_coex_prefer_t s_coex_pref = ESP_COEX_PREFER_BALANCE;
+static sim_ble_event_t s_ble_events[SIM_BLE_EVENTS];
+static int s_ble_next;
+
+static int64_t host_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static const sim_rate_t *rate_info(uint8_t rate)
+{
+    for (size_t i = 0; i < sizeof(s_rates) / sizeof(s_rates[0]); i++) {
+        if (s_rates[i].rate == rate) return &s_rates[i];
+    }
+    return &s_rates[0];
+}
+
+static int64_t airtime_us(uint8_t rate, size_t len)
+{
+    const sim_rate_t *r = rate_info(rate);
+    return r->preamble_us + ((int64_t)(len + SIM_AIR_FRAME_BYTES) * 8 * 1000 + r->kbps - 1) / r->kbps;
+}
+
+static size_t air_len(const sim_frame_t *frame)
+{
+    return frame->len + (frame->ccmp ? SIM_CCMP_BYTES : 0);
+}
+
+static bool lost_to_ble(const sim_frame_t *frame)
+{
+    int64_t start = frame->host_us;
+    int64_t end = start + airtime_us(frame->rate, air_len(frame));
+    bool lost = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SIM_BLE_EVENTS && !lost; i++) {
+        const sim_ble_event_t *ev = &s_ble_events[i];
+        lost = !ev->wifi_wins && ev->start_us < end && start < ev->end_us;
+    }
+    xSemaphoreGive(s_lock);
+    return lost;
+}
+
+/* Box-Muller, good enough for shadowing */
+static float gaussian(void)
+{
+    float u1 = (rand() + 1.0f) / ((float)RAND_MAX + 2.0f);
+    float u2 = (rand() + 1.0f) / ((float)RAND_MAX + 2.0f);
+    return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+static float distance_to(float x, float y)
+{
+    float d = sqrtf((x - s_x) * (x - s_x) + (y - s_y) * (y - s_y));
+    return d < 0.1f ? 0.1f : d;
+}
+
+static int rssi_from(float d, int8_t tx_power_q)
+{
+    float rssi = SIM_RADIO_TX_POWER_DBM - 10.0f * SIM_RADIO_PATH_LOSS_EXP * log10f(d);
+    rssi += (tx_power_q - SIM_RADIO_BOOT_TX_POWER_Q) / 4.0f;
+    rssi += gaussian() * s_shadowing_db;
+
+    if (rssi > 0) rssi = 0;
+    return (int)lroundf(rssi);
+}
+
+/* esp_rom_crc16_le(0, ...) as used by trace.c */
+static uint16_t crc16_le(const uint8_t *buf, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    return crc ^ 0xFFFF;
+}
+
+/* same record stream a badge built with CONFIG_ESPNOW_TRACE produces */
+static void trace_write(uint8_t flags, const uint8_t *src, int rssi, const uint8_t *data, uint16_t len)
+{
+    trace_record_t rec = {
+        .sync = TRACE_SYNC,
+        .len = len,
+        .flags = flags,
+        .rssi = (int8_t)rssi,
+        .noise_floor = SIM_RADIO_NOISE_FLOOR_DBM,
+        .channel = 1,
+        .t_ms = (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS),
+    };
+    memcpy(rec.src, src, ESP_NOW_ETH_ALEN);
+
+    uint8_t buf[sizeof(trace_record_t) + ESP_NOW_MAX_DATA_LEN_V2];
+    size_t covered = sizeof(rec) - offsetof(trace_record_t, len);
+    memcpy(buf, &rec.len, covered);
+    memcpy(buf + covered, data, len);
+    rec.crc = crc16_le(buf, covered + len);
+
+    fwrite(&rec, sizeof(rec), 1, s_trace);
+    fwrite(data, 1, len, s_trace);
+}
+
+static int find_peer(const uint8_t *mac)
+{
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+        if (s_peer_used[i] && memcmp(s_peers[i].peer_addr, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void send_ack(const sim_frame_t *frame)
+{
+    sim_ack_t ack = {
+        .magic = SIM_ACK_MAGIC,
+        .tx_id = frame->tx_id,
+    };
+    memcpy(ack.src, s_mac, ESP_NOW_ETH_ALEN);
+    memcpy(ack.dst, frame->src, ESP_NOW_ETH_ALEN);
+    sendto(s_sock, &ack, sizeof(ack), 0, (struct sockaddr *)&s_group_addr, sizeof(s_group_addr));
+}
+
+static void post_result(const uint8_t *dst, esp_now_send_status_t status)
+{
+    sim_send_result_t result = { .status = status };
+    memcpy(result.dst, dst, ESP_NOW_ETH_ALEN);
+    xQueueSend(s_send_results, &result, 0);
+}
+
+static void handle_ack(const sim_ack_t *ack, size_t len)
+{
+    if (len < sizeof(sim_ack_t) || memcmp(ack->dst, s_mac, ESP_NOW_ETH_ALEN) != 0) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool found = false;
+    for (int i = 0; i < SIM_PENDING_MAX && !found; i++) {
+        sim_pending_t *p = &s_pending[i];
+        found = p->used && p->tx_id == ack->tx_id && memcmp(p->dst, ack->src, ESP_NOW_ETH_ALEN) == 0;
+        if (found) p->used = false;
+    }
+    if (found) s_stats.tx_unicast_acked++;
+    xSemaphoreGive(s_lock);
+
+    if (found) post_result(ack->src, ESP_NOW_SEND_SUCCESS);
+}
+
+static void expire_pending(void)
+{
+    int64_t now = host_time_us();
+
+    for (int i = 0; i < SIM_PENDING_MAX; i++) {
+        uint8_t dst[ESP_NOW_ETH_ALEN];
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        sim_pending_t *p = &s_pending[i];
+        bool expired = p->used && now > p->deadline_us;
+        if (expired) {
+            p->used = false;
+            memcpy(dst, p->dst, ESP_NOW_ETH_ALEN);
+        }
+        xSemaphoreGive(s_lock);
+        if (expired) post_result(dst, ESP_NOW_SEND_FAIL);
+    }
+}
+
+static int bucket_of(float d)
+{
+    int b = 0;
+    while (b < SIM_RADIO_DIST_BUCKETS - 1 && d >= s_bucket_m[b]) b++;
+    return b;
+}
+
+/* the vendor action frame the ESP-NOW driver would have received, elements of at most 250 bytes */
+static void deliver_promiscuous(const sim_frame_t *frame, int rssi)
+{
+    uint8_t buf[sizeof(wifi_promiscuous_pkt_t) + SIM_ACTION_HDR_LEN +
+                (ESP_NOW_MAX_DATA_LEN_V2 / SIM_ELEMENT_BODY_MAX + 1) * 7 + ESP_NOW_MAX_DATA_LEN_V2 + 4];
+    wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)buf;
+    uint8_t *p = pkt->payload;
+    uint32_t random = (uint32_t)rand();
+
+    memset(p, 0, SIM_ACTION_HDR_LEN);
+    p[0] = 0xd0;                /* management, action */
+    memcpy(p + 4, frame->dst, ESP_NOW_ETH_ALEN);
+    memcpy(p + 10, frame->src, ESP_NOW_ETH_ALEN);
+    memcpy(p + 16, s_broadcast, ESP_NOW_ETH_ALEN);
+    p[24] = 127;                /* vendor specific */
+    memcpy(p + 25, s_espressif_oui, sizeof(s_espressif_oui));
+    memcpy(p + 28, &random, sizeof(random));
+
+    size_t at = SIM_ACTION_HDR_LEN;
+    for (size_t off = 0; off < frame->len; off += SIM_ELEMENT_BODY_MAX) {
+        size_t part = frame->len - off < SIM_ELEMENT_BODY_MAX ? frame->len - off : SIM_ELEMENT_BODY_MAX;
+        p[at++] = 0xdd;
+        p[at++] = (uint8_t)(part + 5);
+        memcpy(p + at, s_espressif_oui, sizeof(s_espressif_oui));
+        at += sizeof(s_espressif_oui);
+        p[at++] = 4;            /* ESP-NOW */
+        p[at++] = s_espnow_version;
+        memcpy(p + at, frame->data + off, part);
+        at += part;
+    }
+    memset(p + at, 0, 4);       /* FCS, never checked */
+    at += 4;
+
+    memset(&pkt->rx_ctrl, 0, sizeof(pkt->rx_ctrl));
+    pkt->rx_ctrl.rssi = rssi;
+    pkt->rx_ctrl.noise_floor = SIM_RADIO_NOISE_FLOOR_DBM;
+    pkt->rx_ctrl.sig_len = at;
+
+    wifi_promiscuous_cb_t cb = s_promiscuous_cb;
+    if (cb != NULL) cb(pkt, WIFI_PKT_MGMT);
+}
+
+/*
+ * CCMP stands in as a key match: a sealed frame needs its sender to be an
+ * encrypted peer here with the same LMK, and once a sender is an encrypted
+ * peer its plaintext unicasts are dropped, as the driver does.
+ */
+static bool ccmp_ok(const sim_frame_t *frame)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find_peer(frame->src);
+    bool encrypted = idx >= 0 && s_peers[idx].encrypt;
+    bool ok = frame->ccmp ? encrypted && memcmp(s_peers[idx].lmk, frame->lmk, ESP_NOW_KEY_LEN) == 0 : !encrypted;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+static void deliver(const sim_frame_t *frame, size_t frame_len)
+{
+    if (frame_len < sizeof(sim_frame_t) || frame->magic != SIM_ETHER_MAGIC) return;
+    if (frame_len < sizeof(sim_frame_t) + frame->len) return;
+
+    /* multicast loopback hands us our own frames too */
+    if (memcmp(frame->origin, s_mac, ESP_NOW_ETH_ALEN) == 0) return;
+    bool for_us = memcmp(frame->dst, s_broadcast, ESP_NOW_ETH_ALEN) == 0 ||
+                  memcmp(frame->dst, s_mac, ESP_NOW_ETH_ALEN) == 0;
+    if (!for_us && !s_promiscuous) return;
+
+    if (!s_enabled) {
+        if (for_us) s_stats.rx_radio_off++;
+        return;
+    }
+
+    bool unicast = memcmp(frame->dst, s_broadcast, ESP_NOW_ETH_ALEN) != 0;
+    float d = distance_to(frame->x, frame->y);
+    int bucket = bucket_of(d);
+    if (unicast && for_us) {
+        s_stats.uc_heard[bucket]++;
+        s_stats.uc_airtime_us[bucket] += airtime_us(frame->rate, air_len(frame));
+    }
+
+    int rssi = rssi_from(d, frame->tx_power_q);
+    if (rssi < SIM_RADIO_SENSITIVITY_DBM + rate_info(frame->rate)->margin_db) {
+        if (for_us) s_stats.rx_out_of_range++;
+        return;
+    }
+
+    if (lost_to_ble(frame)) {
+        if (for_us) s_stats.rx_ble_busy++;
+        return;
+    }
+
+    if (s_promiscuous) deliver_promiscuous(frame, rssi);
+    if (!for_us) return;
+
+    if (unicast) {
+        s_stats.uc_delivered[bucket]++;
+        send_ack(frame);
+        /* the MAC ACKs before CCMP runs, so a frame that fails it still counts as sent */
+        if (!ccmp_ok(frame)) {
+            s_stats.rx_ccmp_fail++;
+            return;
+        }
+    }
+
+    if (s_recv_cb == NULL) return;
+
+    int len = frame->len;
+    if (s_espnow_version < 2 && len > ESP_NOW_MAX_DATA_LEN) {
+        len = ESP_NOW_MAX_DATA_LEN;
+        s_stats.rx_truncated++;
+    }
+
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    wifi_pkt_rx_ctrl_t rx_ctrl = {
+        .rssi = rssi,
+        .noise_floor = SIM_RADIO_NOISE_FLOOR_DBM,
+    };
+    esp_now_recv_info_t info = {
+        .src_addr = src,
+        .des_addr = dst,
+        .rx_ctrl = &rx_ctrl,
+    };
+    memcpy(src, frame->src, ESP_NOW_ETH_ALEN);
+    memcpy(dst, frame->dst, ESP_NOW_ETH_ALEN);
+
+    s_stats.rx_frames++;
+    if (s_trace != NULL) {
+        trace_write(unicast ? TRACE_FLAG_UNICAST : 0, frame->src, rssi, frame->data, len);
+    }
+    s_recv_cb(&info, frame->data, len);
+}
+
+/*
+ * stands in for the WiFi task: callbacks must run on a FreeRTOS task because
+ * espnow.c posts to queues from them, so the socket is polled rather than
+ * read from a plain pthread.
+ */
+static void sim_radio_task(void *pvParameter)
+{
+    uint8_t buf[sizeof(sim_frame_t) + ESP_NOW_MAX_DATA_LEN_V2];
+    sim_send_result_t result;
+
+    while (1) {
+        ssize_t n;
+        while ((n = recv(s_sock, buf, sizeof(buf), 0)) > 0) {
+            if ((size_t)n >= sizeof(uint32_t) && *(const uint32_t *)buf == SIM_ACK_MAGIC) {
+                handle_ack((const sim_ack_t *)buf, (size_t)n);
+            } else {
+                deliver((const sim_frame_t *)buf, (size_t)n);
+            }
+        }
+        expire_pending();
+
+        while (xQueueReceive(s_send_results, &result, 0) == pdTRUE) {
+            if (s_send_cb != NULL) {
+                esp_now_send_info_t info = {
+                    .src_addr = s_mac,
+                    .des_addr = result.dst,
+                };
+                s_send_cb(&info, result.status);
+            }
+        }
+
+        vTaskDelay(SIM_RADIO_TASK_PERIOD);
+    }
+}
+
+esp_err_t sim_radio_init(const sim_radio_config_t *config)
+{
+    if (config == NULL) return ESP_ERR_INVALID_ARG;
+
+    if (config->mac != NULL) {
+        memcpy(s_mac, config->mac, ESP_NOW_ETH_ALEN);
+    } else {
+        s_mac[0] = 0x02;    /* locally administered */
+        s_mac[1] = 0x57;
+        s_mac[2] = 0x41;
+        s_mac[3] = 0x59;
+        s_mac[4] = config->id >> 8;
+        s_mac[5] = config->id & 0xFF;
+    }
+    s_x = config->x;
+    s_y = config->y;
+    s_shadowing_db = config->shadowing_db;
+    s_espnow_version = config->espnow_version == 1 ? 1 : 2;
+    s_encrypt_peers = config->no_encrypt_peers ? 0 : ESP_NOW_MAX_ENCRYPT_PEER_NUM;
+    srand(config->id * 2654435761u);
+
+    s_lock = xSemaphoreCreateMutex();
+    s_send_results = xQueueCreate(SIM_SEND_CB_QUEUE, sizeof(sim_send_result_t));
+    if (s_lock == NULL || s_send_results == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (config->trace_path != NULL) {
+        s_trace = fopen(config->trace_path, "wbe");
+        if (s_trace == NULL) {
+            ESP_LOGE(TAG, "%s: %s", config->trace_path, strerror(errno));
+            return ESP_FAIL;
+        }
+        trace_write(TRACE_FLAG_META, s_mac, 0, NULL, 0);
+    }
+
+    if (config->group == NULL) {
+        ESP_LOGI(TAG, "Badge " MACSTR " detached", MAC2STR(s_mac));
+        return ESP_OK;
+    }
+
+    s_sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (s_sock < 0) {
+        ESP_LOGE(TAG, "socket: %s", strerror(errno));
+        return ESP_FAIL;
+    }
+
+    int one = 1;
+    setsockopt(s_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+    setsockopt(s_sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
+
+    struct sockaddr_in bind_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(config->port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(s_sock, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0) {
+        ESP_LOGE(TAG, "bind: %s", strerror(errno));
+        close(s_sock);
+        return ESP_FAIL;
+    }
+
+    struct ip_mreq mreq = {
+        .imr_interface.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    inet_pton(AF_INET, config->group, &mreq.imr_multiaddr);
+    if (setsockopt(s_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        ESP_LOGE(TAG, "join %s: %s", config->group, strerror(errno));
+        close(s_sock);
+        return ESP_FAIL;
+    }
+
+    struct in_addr iface = { .s_addr = htonl(INADDR_LOOPBACK) };
+    uint8_t loop = 1;
+    uint8_t ttl = 0;
+    setsockopt(s_sock, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface));
+    setsockopt(s_sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    setsockopt(s_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    fcntl(s_sock, F_SETFL, fcntl(s_sock, F_GETFL) | O_NONBLOCK);
+
+    s_group_addr.sin_family = AF_INET;
+    s_group_addr.sin_port = htons(config->port);
+    s_group_addr.sin_addr = mreq.imr_multiaddr;
+
+    xTaskCreate(sim_radio_task, "sim_radio", 8192, NULL, 5, NULL);
+
+    ESP_LOGI(TAG, "Badge %d " MACSTR " at (%.1f, %.1f) on %s:%d",
+             config->id, MAC2STR(s_mac), s_x, s_y, config->group, config->port);
+    return ESP_OK;
+}
+
+void sim_radio_set_position(float x, float y)
+{
+    s_x = x;
+    s_y = y;
+}
+
+esp_err_t esp_wifi_set_max_tx_power(int8_t power)
+{
+    if (power < 8 || power > 84) return ESP_ERR_INVALID_ARG;
+    s_tx_power_q = power;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_max_tx_power(int8_t *power)
+{
+    if (power == NULL) return ESP_ERR_INVALID_ARG;
+    *power = s_tx_power_q;
+    return ESP_OK;
+}
+
+void sim_radio_set_enabled(bool enabled)
+{
+    s_enabled = enabled;
+    ESP_LOGI(TAG, "Radio %s", enabled ? "on" : "off");
+}
+
+void sim_radio_ble_event(uint32_t duration_ms)
+{
+    if (s_lock == NULL) return;     /* never initialized: bench */
+    int64_t now = host_time_us();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_ble_events[s_ble_next] = (sim_ble_event_t) {
+        .start_us = now,
+        .end_us = now + (int64_t)duration_ms * 1000,
+        .wifi_wins = s_coex_pref == ESP_COEX_PREFER_WIFI,
+    };
+    s_ble_next = (s_ble_next + 1) % SIM_BLE_EVENTS;
+    s_stats.ble_events++;
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t esp_coex_preference_set(esp_coex_prefer_t prefer)
+{
+    if (prefer >= ESP_COEX_PREFER_NUM) return ESP_ERR_INVALID_ARG;
+    s_coex_pref = prefer;
+    return ESP_OK;
+}
+
+void sim_radio_get_stats(sim_radio_stats_t *out)
+{
+    if (out == NULL) return;
+    memcpy(out, &s_stats, sizeof(sim_radio_stats_t));
+}
+
+void sim_radio_get_mac(uint8_t *mac)
+{
+    memcpy(mac, s_mac, ESP_NOW_ETH_ALEN);
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    if (mac == NULL) return ESP_ERR_INVALID_ARG;
+    memcpy(mac, s_mac, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+// === ESP-NOW ===
+
+esp_err_t esp_now_init(void)
+{
+    if (s_lock == NULL) return ESP_ERR_ESPNOW_INTERNAL;
+    s_espnow_ready = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void)
+{
+    s_espnow_ready = false;
+    s_recv_cb = NULL;
+    s_send_cb = NULL;
+    memset(s_peer_used, 0, sizeof(s_peer_used));
+    memset(s_pending, 0, sizeof(s_pending));
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    if (!s_espnow_ready) return ESP_ERR_ESPNOW_NOT_INIT;
+    s_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    if (!s_espnow_ready) return ESP_ERR_ESPNOW_NOT_INIT;
+    s_send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_get_version(uint32_t *version)
+{
+    if (version == NULL) return ESP_ERR_ESPNOW_ARG;
+    *version = s_espnow_version;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_set_pmk(const uint8_t *pmk)
+{
+    return pmk != NULL ? ESP_OK : ESP_ERR_ESPNOW_ARG;
+}
+
+/* the result comes with the ACK or the timeout; false if nothing is left to wait with */
+static bool await_ack(const uint8_t *dst, uint32_t tx_id, int64_t sent_us)
+{
+    bool queued = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SIM_PENDING_MAX && !queued; i++) {
+        sim_pending_t *p = &s_pending[i];
+        if (p->used) continue;
+        p->used = true;
+        memcpy(p->dst, dst, ESP_NOW_ETH_ALEN);
+        p->tx_id = tx_id;
+        p->deadline_us = sent_us + SIM_RADIO_ACK_TIMEOUT_MS * 1000;
+        queued = true;
+    }
+    xSemaphoreGive(s_lock);
+    return queued;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    uint8_t buf[sizeof(sim_frame_t) + ESP_NOW_MAX_DATA_LEN_V2];
+    sim_frame_t *frame = (sim_frame_t *)buf;
+
+    if (!s_espnow_ready) return ESP_ERR_ESPNOW_NOT_INIT;
+    size_t max_len = s_espnow_version < 2 ? ESP_NOW_MAX_DATA_LEN : ESP_NOW_MAX_DATA_LEN_V2;
+    if (peer_addr == NULL || data == NULL || len == 0 || len > max_len) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+
+    bool unicast = memcmp(peer_addr, s_broadcast, ESP_NOW_ETH_ALEN) != 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find_peer(peer_addr);
+    wifi_phy_rate_t rate = idx >= 0 ? s_peer_rate[idx] : WIFI_PHY_RATE_1M_L;
+    bool ccmp = idx >= 0 && unicast && s_peers[idx].encrypt;
+    if (ccmp) memcpy(frame->lmk, s_peers[idx].lmk, ESP_NOW_KEY_LEN);
+    xSemaphoreGive(s_lock);
+    if (idx < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+
+    sim_send_result_t result = { .status = ESP_NOW_SEND_SUCCESS };
+    memcpy(result.dst, peer_addr, ESP_NOW_ETH_ALEN);
+
+    if (s_sock < 0) {
+        /* detached: the frame leaves the badge and goes nowhere */
+        s_stats.tx_frames++;
+        s_stats.tx_bytes += len;
+        return ESP_OK;
+    } else if (s_enabled) {
+        frame->magic = SIM_ETHER_MAGIC;
+        memcpy(frame->src, s_mac, ESP_NOW_ETH_ALEN);
+        memcpy(frame->dst, peer_addr, ESP_NOW_ETH_ALEN);
+        memcpy(frame->origin, s_mac, ESP_NOW_ETH_ALEN);
+        frame->x = s_x;
+        frame->y = s_y;
+        frame->tx_power_q = s_tx_power_q;
+        frame->host_us = host_time_us();
+        frame->rate = rate;
+        frame->tx_id = ++s_tx_id;
+        frame->ccmp = ccmp;
+        frame->len = len;
+        memcpy(frame->data, data, len);
+
+        size_t frame_len = sizeof(sim_frame_t) + len;
+        if (sendto(s_sock, buf, frame_len, 0, (struct sockaddr *)&s_group_addr, sizeof(s_group_addr)) < 0) {
+            result.status = ESP_NOW_SEND_FAIL;
+        } else {
+            int64_t air = airtime_us(rate, air_len(frame));
+            s_stats.tx_frames++;
+            s_stats.tx_bytes += len;
+            s_stats.tx_airtime_us += air;
+            if (unicast) {
+                s_stats.tx_unicast++;
+                s_stats.tx_unicast_airtime_us += air;
+                if (await_ack(peer_addr, frame->tx_id, frame->host_us)) return ESP_OK;
+            }
+        }
+    } else {
+        result.status = ESP_NOW_SEND_FAIL;
+    }
+
+    /* real ESP-NOW reports status asynchronously from the WiFi task */
+    xQueueSend(s_send_results, &result, 0);
+    return ESP_OK;
+}
+
+// === Promiscuous mode and raw frames ===
+
+esp_err_t esp_wifi_set_promiscuous(bool en)
+{
+    s_promiscuous = en;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb)
+{
+    s_promiscuous_cb = cb;
+    return ESP_OK;
+}
+
+/* there are only management frames on the sim ether */
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter)
+{
+    return filter != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/* takes a single element ESP-NOW action frame, as the load generator builds them */
+esp_err_t esp_wifi_80211_tx(wifi_interface_t ifx, const void *buffer, int len, bool en_sys_seq)
+{
+    uint8_t buf[sizeof(sim_frame_t) + ESP_NOW_MAX_DATA_LEN];
+    sim_frame_t *frame = (sim_frame_t *)buf;
+    const uint8_t *p = buffer;
+
+    if (buffer == NULL || len < SIM_ACTION_HDR_LEN + 7 || p[0] != 0xd0 || p[24] != 127 ||
+        p[SIM_ACTION_HDR_LEN] != 0xdd || p[SIM_ACTION_HDR_LEN + 5] != 4) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int body_len = p[SIM_ACTION_HDR_LEN + 1] - 5;
+    if (body_len <= 0 || body_len > ESP_NOW_MAX_DATA_LEN || SIM_ACTION_HDR_LEN + 7 + body_len > len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_sock < 0 || !s_enabled) return ESP_OK;
+
+    frame->magic = SIM_ETHER_MAGIC;
+    memcpy(frame->dst, p + 4, ESP_NOW_ETH_ALEN);
+    memcpy(frame->src, p + 10, ESP_NOW_ETH_ALEN);
+    memcpy(frame->origin, s_mac, ESP_NOW_ETH_ALEN);
+    frame->x = s_x;
+    frame->y = s_y;
+    frame->tx_power_q = s_tx_power_q;
+    frame->host_us = host_time_us();
+    frame->rate = WIFI_PHY_RATE_1M_L;
+    frame->tx_id = ++s_tx_id;
+    frame->ccmp = 0;
+    frame->len = (uint16_t)body_len;
+    memcpy(frame->data, p + SIM_ACTION_HDR_LEN + 7, body_len);
+
+    /* nobody waits for an ACK: the receiver sends one to src, which isn't us */
+    if (sendto(s_sock, buf, sizeof(sim_frame_t) + body_len, 0,
+               (struct sockaddr *)&s_group_addr, sizeof(s_group_addr)) < 0) {
+        return ESP_FAIL;
+    }
+    s_stats.tx_frames++;
+    s_stats.tx_bytes += body_len;
+    s_stats.tx_airtime_us += airtime_us(frame->rate, body_len);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    if (peer == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t ret = ESP_ERR_ESPNOW_FULL;
+    int encrypted = 0;
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+        if (s_peer_used[i] && s_peers[i].encrypt) encrypted++;
+    }
+
+    if (find_peer(peer->peer_addr) >= 0) {
+        ret = ESP_ERR_ESPNOW_EXIST;
+    } else if (peer->encrypt && encrypted >= s_encrypt_peers) {
+        ret = ESP_ERR_ESPNOW_FULL;
+    } else {
+        for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+            if (!s_peer_used[i]) {
+                s_peers[i] = *peer;
+                s_peer_used[i] = true;
+                s_peer_rate[i] = WIFI_PHY_RATE_1M_L;
+                ret = ESP_OK;
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return ret;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    if (peer_addr == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find_peer(peer_addr);
+    if (idx >= 0) s_peer_used[idx] = false;
+    xSemaphoreGive(s_lock);
+    return idx >= 0 ? ESP_OK : ESP_ERR_ESPNOW_NOT_FOUND;
+}
+
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer)
+{
+    if (peer == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t ret = ESP_ERR_ESPNOW_NOT_FOUND;
+    int encrypted = 0;
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+        if (s_peer_used[i] && s_peers[i].encrypt) encrypted++;
+    }
+
+    int idx = find_peer(peer->peer_addr);
+    if (idx >= 0 && peer->encrypt && !s_peers[idx].encrypt && encrypted >= s_encrypt_peers) {
+        ret = ESP_ERR_ESPNOW_FULL;
+    } else if (idx >= 0) {
+        s_peers[idx] = *peer;
+        ret = ESP_OK;
+    }
+    xSemaphoreGive(s_lock);
+    return ret;
+}
+
+esp_err_t esp_now_set_peer_rate_config(const uint8_t *peer_addr, esp_now_rate_config_t *config)
+{
+    if (peer_addr == NULL || config == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find_peer(peer_addr);
+    if (idx >= 0) s_peer_rate[idx] = config->rate;
+    xSemaphoreGive(s_lock);
+    return idx >= 0 ? ESP_OK : ESP_ERR_ESPNOW_NOT_FOUND;
+}
+
+esp_err_t esp_now_get_peer(const uint8_t *peer_addr, esp_now_peer_info_t *peer)
+{
+    if (peer_addr == NULL || peer == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find_peer(peer_addr);
+    if (idx >= 0) *peer = s_peers[idx];
+    xSemaphoreGive(s_lock);
+    return idx >= 0 ? ESP_OK : ESP_ERR_ESPNOW_NOT_FOUND;
+}
+
+/* like the real one, skips broadcast/multicast peers */
+esp_err_t esp_now_fetch_peer(bool from_head, esp_now_peer_info_t *peer)
+{
+    if (peer == NULL) return ESP_ERR_ESPNOW_ARG;
+    if (from_head) s_fetch_idx = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t ret = ESP_ERR_ESPNOW_NOT_FOUND;
+    for (; s_fetch_idx < ESP_NOW_MAX_TOTAL_PEER_NUM; s_fetch_idx++) {
+        if (s_peer_used[s_fetch_idx] && !(s_peers[s_fetch_idx].peer_addr[0] & 0x01)) {
+            *peer = s_peers[s_fetch_idx++];
+            ret = ESP_OK;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return ret;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    if (peer_addr == NULL) return false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool exists = find_peer(peer_addr) >= 0;
+    xSemaphoreGive(s_lock);
+    return exists;
+}
+
+esp_err_t esp_now_get_peer_num(esp_now_peer_num_t *num)
+{
+    if (num == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    num->total_num = 0;
+    num->encrypt_num = 0;
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+        if (!s_peer_used[i]) continue;
+        num->total_num++;
+        if (s_peers[i].encrypt) num->encrypt_num++;
+    }
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
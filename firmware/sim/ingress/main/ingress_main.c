@@ -0,0 +1,566 @@
+/*
+ * ingress_main.c - Flood neighbor_admit() and check what gets through
+ *
+ * Each case starts from neighbor_init() and offers frames on a virtual
+ * millisecond clock for INGRESS_DURATION_MS: one stream per sender and
+ * message type, one frame every period_ms. Senders number their frames
+ * and report their uptime as the badge would, so only the limits decide.
+ * Streams are grouped, and every group's admitted count must fall inside
+ * the bounds its limit allows:
+ *
+ *   rate r frames/s with a one second burst, over T seconds:
+ *     at least r * T, at most r * (T + 1)
+ *
+ * Cases:
+ *   flood/<class>     one sender, one frame per ms of a single class:
+ *                     the class rate decides
+ *   share/spammer     one sender flooding every class at once next to
+ *                     three badges pairing normally: the spammer gets its
+ *                     sender share, the others lose nothing
+ *   global/senders    16 senders, each at its CONTROL rate: the global
+ *                     budget decides, nobody is dropped for rate
+ *   global/ota_half   8 senders flooding OTA chunks next to 10 searching
+ *                     badges: every HELLO gets through, OTA takes what is
+ *                     left of the budget but never its bottom half
+ *   split/proposal    one sender flooding PROPOSALs split for a v1 badge,
+ *                     four parts every 10 ms: the PROPOSAL rate decides,
+ *                     not the fragment rate
+ *   split/ota_half    global/ota_half with every chunk in three parts
+ *
+ * A split stream offers all the parts of a frame in the same millisecond,
+ * back to back as frag_send() does, and counts the frame: admitted if
+ * every part was, otherwise the verdict of the first part that wasn't.
+ *
+ * Claims are confirmed straight away and untagged, as espnow_task does
+ * without a group key, and count as admitted.
+ *
+ * The seq window cases are scripts instead: one frame at a time, each with
+ * the verdict it must get. A NEIGHBOR_ADMIT_CLAIM step can be confirmed,
+ * standing for a frame whose group tag checked out, confirmed untagged, as
+ * without a group key, or left alone, for a spoofed one. Each script but
+ * reboot/untagged first gets its sender a confirmed reference:
+ *
+ *   seq/duplicates    retransmits and reordering inside the window, frames
+ *                     behind it
+ *   seq/jump          a spoofed seq_num far ahead: dropped, or a claim that
+ *                     is never confirmed; the real frames carry on
+ *   reboot/spoofed    uptime 0 under the sender's MAC: the window stays
+ *   reboot/real       a reboot after a silence, confirmed: the new seq_nums
+ *                     get through, replays from before the reboot don't
+ *   reboot/replayed   a captured HELLO replayed while the sender is still
+ *                     talking
+ *   reboot/untagged   no group key: a claim far ahead continues the window,
+ *                     a reboot claim doesn't move it, NEIGHBOR_IDLE_MS of
+ *                     silence lets the new seq_nums in
+ *   evict/partner     more senders than the table holds: the partner keeps
+ *                     its window, so its old frames stay duplicates
+ *
+ * The limits come from neighbor.h, so the check follows the Kconfig
+ * options. The result is printed as JSON; the exit code is 1 if a check
+ * failed.
+ *
+ * Configuration comes from the environment:
+ *   WAYSIDE_INGRESS_JSON     also write the result as JSON to this file
+ *   WAYSIDE_SIM_VERBOSE      keep INFO logs (default WARN only)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "pairing.h"
+#include "frag.h"
+#include "neighbor.h"
+
+#define INGRESS_DURATION_MS     10000
+#define INGRESS_START_MS        1000
+#define INGRESS_MAX_STREAMS     32
+#define INGRESS_MAX_GROUPS      4
+#define INGRESS_MAX_CASES       24
+#define INGRESS_MAX_SENDERS     32
+#define INGRESS_MAX_STEPS       32
+#define INGRESS_VERDICTS        (NEIGHBOR_ADMIT_CLAIM + 1)
+#define INGRESS_ALL             UINT32_MAX  /* bound: every frame offered */
+#define INGRESS_BOOT_MS         600000      /* script senders' uptime at t = 0 */
+#define INGRESS_FLOOD_SENDERS   256
+
+typedef enum {
+    STEP_FRAME,
+    STEP_CONFIRM,               /* the last frame's tag checked out */
+    STEP_CONFIRM_UNTAGGED,      /* ...its header MAC did, there is no group key */
+    STEP_PARTNER,               /* the sender is now our partner */
+    STEP_FLOOD,                 /* one HELLO from each of INGRESS_FLOOD_SENDERS new MACs */
+} ingress_op_t;
+
+typedef struct {
+    ingress_op_t op;
+    uint32_t t_ms;
+    uint8_t msg_type;
+    uint32_t seq;
+    uint32_t uptime_ms;
+    neighbor_verdict_t expect;
+} ingress_step_t;
+
+typedef struct {
+    uint8_t sender;
+    uint8_t msg_type;
+    uint8_t parts;              /* > 1: sent as that many MSG_FRAGMENTs */
+    uint8_t group;
+    uint16_t period_ms;
+    uint16_t offset_ms;
+} ingress_stream_t;
+
+typedef struct {
+    const char *name;
+    uint32_t min;
+    uint32_t max;
+    uint32_t forbidden;         /* verdicts that must not occur, bit per verdict */
+} ingress_bound_t;
+
+typedef struct {
+    const char *name;
+    ingress_stream_t streams[INGRESS_MAX_STREAMS];
+    int stream_count;
+    ingress_bound_t bounds[INGRESS_MAX_GROUPS];
+    int group_count;
+    ingress_step_t steps[INGRESS_MAX_STEPS];
+    int step_count;
+} ingress_case_t;
+
+typedef struct {
+    uint32_t offered;
+    uint32_t verdicts[INGRESS_VERDICTS];
+    bool passed;
+} ingress_group_result_t;
+
+typedef struct {
+    int step;
+    neighbor_verdict_t got;
+} ingress_mismatch_t;
+
+typedef struct {
+    const ingress_case_t *c;
+    ingress_group_result_t groups[INGRESS_MAX_GROUPS];
+    ingress_mismatch_t mismatches[INGRESS_MAX_STEPS];
+    int mismatch_count;
+    bool passed;
+} ingress_result_t;
+
+static const char *VERDICT_NAMES[INGRESS_VERDICTS] = {
+    [NEIGHBOR_ADMIT]       = "admitted",
+    [NEIGHBOR_DROP_RATE]   = "drop_rate",
+    [NEIGHBOR_DROP_GLOBAL] = "drop_global",
+    [NEIGHBOR_DROP_DUP]    = "drop_dup",
+    [NEIGHBOR_ADMIT_CLAIM] = "claim",
+};
+
+static ingress_case_t s_cases[INGRESS_MAX_CASES];
+static int s_case_count;
+static ingress_result_t s_results[INGRESS_MAX_CASES];
+static uint32_t s_seq[INGRESS_MAX_SENDERS];
+
+/* frames a limit of @p rate per second lets through in the run */
+static uint32_t at_least(uint32_t rate)
+{
+    return rate * INGRESS_DURATION_MS / 1000;
+}
+
+static uint32_t at_most(uint32_t rate)
+{
+    return rate * (INGRESS_DURATION_MS + 1000) / 1000;
+}
+
+static ingress_case_t *add_case(const char *name)
+{
+    ingress_case_t *c = &s_cases[s_case_count++];
+    c->name = name;
+    return c;
+}
+
+static void add_stream(ingress_case_t *c, int group, int sender, uint8_t msg_type, int period_ms, int offset_ms)
+{
+    c->streams[c->stream_count++] = (ingress_stream_t) {
+        .sender = (uint8_t)sender, .msg_type = msg_type, .parts = 1, .group = (uint8_t)group,
+        .period_ms = (uint16_t)period_ms, .offset_ms = (uint16_t)offset_ms,
+    };
+}
+
+static void add_split_stream(ingress_case_t *c, int group, int sender, uint8_t msg_type, int parts,
+                             int period_ms, int offset_ms)
+{
+    add_stream(c, group, sender, msg_type, period_ms, offset_ms);
+    c->streams[c->stream_count - 1].parts = (uint8_t)parts;
+}
+
+static void add_bound(ingress_case_t *c, const char *name, uint32_t min, uint32_t max, uint32_t forbidden)
+{
+    c->bounds[c->group_count++] = (ingress_bound_t) { .name = name, .min = min, .max = max, .forbidden = forbidden };
+}
+
+static void add_step(ingress_case_t *c, ingress_op_t op, uint32_t t_ms, uint8_t msg_type, uint32_t seq,
+                     uint32_t uptime_ms, neighbor_verdict_t expect)
+{
+    c->steps[c->step_count++] = (ingress_step_t) {
+        .op = op, .t_ms = t_ms, .msg_type = msg_type, .seq = seq, .uptime_ms = uptime_ms, .expect = expect,
+    };
+}
+
+/* a frame sent at t_ms by a sender that booted INGRESS_BOOT_MS before the run */
+static void add_frame(ingress_case_t *c, uint32_t t_ms, uint8_t msg_type, uint32_t seq, neighbor_verdict_t expect)
+{
+    add_step(c, STEP_FRAME, t_ms, msg_type, seq, INGRESS_BOOT_MS + t_ms, expect);
+}
+
+/* first frame, then a HELLO whose tag checks out: seq 100-102 seen, t = 0-200 */
+static ingress_case_t *add_script(const char *name)
+{
+    ingress_case_t *c = add_case(name);
+    add_frame(c, 0, MSG_HELLO, 100, NEIGHBOR_ADMIT);
+    add_frame(c, 100, MSG_HELLO, 101, NEIGHBOR_ADMIT_CLAIM);
+    add_step(c, STEP_CONFIRM, 100, 0, 0, 0, NEIGHBOR_ADMIT);
+    add_frame(c, 200, MSG_HEARTBEAT, 102, NEIGHBOR_ADMIT);
+    return c;
+}
+
+static void build_scripts(void)
+{
+    ingress_case_t *c;
+
+    c = add_script("seq/duplicates");
+    add_frame(c, 210, MSG_HEARTBEAT, 102, NEIGHBOR_DROP_DUP);
+    add_frame(c, 300, MSG_HEARTBEAT, 104, NEIGHBOR_ADMIT);
+    add_frame(c, 301, MSG_HEARTBEAT, 103, NEIGHBOR_ADMIT);
+    add_frame(c, 302, MSG_HEARTBEAT, 103, NEIGHBOR_DROP_DUP);
+    add_frame(c, 303, MSG_HELLO, 101, NEIGHBOR_DROP_DUP);
+    add_frame(c, 400, MSG_HEARTBEAT, 104 + NEIGHBOR_SEQ_WINDOW, NEIGHBOR_ADMIT);
+    add_frame(c, 401, MSG_HEARTBEAT, 105, NEIGHBOR_ADMIT);
+    add_frame(c, 402, MSG_HEARTBEAT, 104, NEIGHBOR_DROP_DUP);
+    add_frame(c, 403, MSG_HEARTBEAT, 103, NEIGHBOR_DROP_DUP);
+
+    c = add_script("seq/jump");
+    add_frame(c, 300, MSG_HEARTBEAT, 4000000000u, NEIGHBOR_DROP_DUP);
+    add_frame(c, 310, MSG_HELLO, 4000000000u, NEIGHBOR_ADMIT_CLAIM);
+    add_step(c, STEP_FRAME, 320, MSG_HELLO, 4000000000u, INGRESS_BOOT_MS + 310, NEIGHBOR_DROP_DUP);
+    add_frame(c, 400, MSG_HEARTBEAT, 103, NEIGHBOR_ADMIT);
+    add_frame(c, 500, MSG_HEARTBEAT, 104, NEIGHBOR_ADMIT);
+    add_frame(c, 600, MSG_HEARTBEAT, 102, NEIGHBOR_DROP_DUP);
+    /* a real gap: a few seconds of frames to others */
+    add_frame(c, 5600, MSG_HEARTBEAT, 104 + 4000, NEIGHBOR_ADMIT);
+
+    c = add_script("reboot/spoofed");
+    add_step(c, STEP_FRAME, 300, MSG_HEARTBEAT, 1, 0, NEIGHBOR_DROP_DUP);
+    add_step(c, STEP_FRAME, 400, MSG_HELLO, 1, 0, NEIGHBOR_ADMIT_CLAIM);
+    add_frame(c, 500, MSG_HEARTBEAT, 102, NEIGHBOR_DROP_DUP);
+    add_frame(c, 510, MSG_HEARTBEAT, 101, NEIGHBOR_DROP_DUP);
+    add_frame(c, 600, MSG_HEARTBEAT, 103, NEIGHBOR_ADMIT);
+
+    c = add_script("reboot/real");
+    add_step(c, STEP_FRAME, 10200, MSG_HELLO, 1, 3000, NEIGHBOR_ADMIT_CLAIM);
+    add_step(c, STEP_CONFIRM, 10200, 0, 0, 0, NEIGHBOR_ADMIT);
+    add_step(c, STEP_FRAME, 10300, MSG_HEARTBEAT, 2, 3100, NEIGHBOR_ADMIT);
+    add_frame(c, 10400, MSG_HEARTBEAT, 102, NEIGHBOR_DROP_DUP);
+    add_frame(c, 10410, MSG_HELLO, 101, NEIGHBOR_DROP_DUP);
+    add_step(c, STEP_FRAME, 10500, MSG_HEARTBEAT, 1, 3000, NEIGHBOR_DROP_DUP);
+    add_step(c, STEP_FRAME, 10600, MSG_HELLO, 3, 3400, NEIGHBOR_ADMIT);
+
+    c = add_script("reboot/replayed");
+    add_frame(c, 5000, MSG_HEARTBEAT, 103, NEIGHBOR_ADMIT);
+    add_step(c, STEP_FRAME, 10000, MSG_HELLO, 101, INGRESS_BOOT_MS + 100, NEIGHBOR_DROP_DUP);
+    add_frame(c, 10100, MSG_HEARTBEAT, 104, NEIGHBOR_ADMIT);
+
+    c = add_case("reboot/untagged");
+    add_frame(c, 0, MSG_HELLO, 100, NEIGHBOR_ADMIT);
+    add_frame(c, 100, MSG_HELLO, 101, NEIGHBOR_ADMIT_CLAIM);
+    add_step(c, STEP_CONFIRM_UNTAGGED, 100, 0, 0, 0, NEIGHBOR_ADMIT);
+    add_frame(c, 200, MSG_HEARTBEAT, 102, NEIGHBOR_ADMIT);
+    add_frame(c, 1000, MSG_HELLO, 602, NEIGHBOR_ADMIT_CLAIM);
+    add_step(c, STEP_CONFIRM_UNTAGGED, 1000, 0, 0, 0, NEIGHBOR_ADMIT);
+    add_frame(c, 1100, MSG_HEARTBEAT, 602, NEIGHBOR_DROP_DUP);
+    add_step(c, STEP_FRAME, 3000, MSG_HELLO, 1, 500, NEIGHBOR_ADMIT_CLAIM);
+    add_step(c, STEP_CONFIRM_UNTAGGED, 3000, 0, 0, 0, NEIGHBOR_ADMIT);
+    add_step(c, STEP_FRAME, 3100, MSG_HEARTBEAT, 2, 600, NEIGHBOR_DROP_DUP);
+    add_frame(c, 3200, MSG_HEARTBEAT, 603, NEIGHBOR_ADMIT);
+    add_step(c, STEP_FRAME, 3200 + NEIGHBOR_IDLE_MS, MSG_HEARTBEAT, 50, 10700, NEIGHBOR_ADMIT);
+    add_step(c, STEP_FRAME, 3300 + NEIGHBOR_IDLE_MS, MSG_HEARTBEAT, 50, 10800, NEIGHBOR_DROP_DUP);
+    add_frame(c, 3400 + NEIGHBOR_IDLE_MS, MSG_HEARTBEAT, 604, NEIGHBOR_DROP_DUP);
+
+    c = add_script("evict/partner");
+    add_step(c, STEP_PARTNER, 200, 0, 0, 0, NEIGHBOR_ADMIT);
+    add_step(c, STEP_FLOOD, 300, 0, 0, 0, NEIGHBOR_ADMIT);
+    add_frame(c, 5000, MSG_HEARTBEAT, 102, NEIGHBOR_DROP_DUP);
+    add_frame(c, 5100, MSG_HEARTBEAT, 103, NEIGHBOR_ADMIT);
+}
+
+static void build_cases(void)
+{
+    static const struct {
+        const char *name;
+        uint8_t msg_type;
+        uint32_t rate;
+    } FLOODS[] = {
+        { "flood/hello",    MSG_HELLO,       NEIGHBOR_HELLO_RATE },
+        { "flood/proposal", MSG_PROPOSAL,    NEIGHBOR_PROPOSAL_RATE },
+        { "flood/control",  MSG_HEARTBEAT,   NEIGHBOR_CONTROL_RATE },
+        { "flood/ota",      MSG_OTA_CHUNK,   NEIGHBOR_OTA_RATE },
+        { "flood/fragment", MSG_FRAGMENT,    NEIGHBOR_FRAGMENT_RATE },
+    };
+    const uint32_t share = NEIGHBOR_GLOBAL_RATE * NEIGHBOR_SENDER_SHARE_PCT / 100;
+    ingress_case_t *c;
+
+    /* a class above the sender share would measure the share instead */
+    for (size_t i = 0; i < sizeof(FLOODS) / sizeof(FLOODS[0]); i++) {
+        uint32_t rate = FLOODS[i].rate < share ? FLOODS[i].rate : share;
+        c = add_case(FLOODS[i].name);
+        add_stream(c, 0, 0, FLOODS[i].msg_type, 1, 0);
+        add_bound(c, "sender", at_least(rate), at_most(rate), 1u << NEIGHBOR_DROP_GLOBAL);
+    }
+
+    c = add_case("share/spammer");
+    for (int i = 0; i < (int)(sizeof(FLOODS) / sizeof(FLOODS[0])); i++) {
+        add_stream(c, 0, 0, FLOODS[i].msg_type, 5, i);
+    }
+    for (int s = 1; s <= 3; s++) {
+        add_stream(c, 1, s, MSG_HELLO, 1000 / NEIGHBOR_HELLO_RATE, s * 7);
+        add_stream(c, 1, s, MSG_HEARTBEAT, 1000, s * 11);
+    }
+    add_bound(c, "spammer", at_least(share), at_most(share), 1u << NEIGHBOR_DROP_GLOBAL);
+    add_bound(c, "others", INGRESS_ALL, INGRESS_ALL, 0);
+
+    /* 16 senders at 10/s offer 160/s, more than the budget, each within its limits */
+    c = add_case("global/senders");
+    for (int s = 0; s < 16; s++) {
+        add_stream(c, 0, s, MSG_HEARTBEAT, 1000 / NEIGHBOR_CONTROL_RATE, s * 1000 / NEIGHBOR_CONTROL_RATE / 16);
+    }
+    add_bound(c, "senders", at_least(NEIGHBOR_GLOBAL_RATE), at_most(NEIGHBOR_GLOBAL_RATE), 1u << NEIGHBOR_DROP_RATE);
+
+    c = add_case("global/ota_half");
+    for (int s = 0; s < 8; s++) {
+        add_stream(c, 0, s, MSG_OTA_CHUNK, 1000 / NEIGHBOR_OTA_RATE, s * 1000 / NEIGHBOR_OTA_RATE / 8);
+    }
+    for (int s = 8; s < 18; s++) {
+        add_stream(c, 1, s, MSG_HELLO, 1000 / NEIGHBOR_HELLO_RATE, s * 13);
+    }
+    uint32_t left = NEIGHBOR_GLOBAL_RATE - 10 * NEIGHBOR_HELLO_RATE;
+    add_bound(c, "ota", at_least(left) - NEIGHBOR_GLOBAL_RATE / 2, at_least(left) + NEIGHBOR_GLOBAL_RATE / 2,
+              1u << NEIGHBOR_DROP_RATE);
+    add_bound(c, "hello", INGRESS_ALL, INGRESS_ALL, 0);
+
+    c = add_case("split/proposal");
+    add_split_stream(c, 0, 0, MSG_PROPOSAL, 4, 10, 0);
+    add_bound(c, "sender", at_least(NEIGHBOR_PROPOSAL_RATE), at_most(NEIGHBOR_PROPOSAL_RATE),
+              1u << NEIGHBOR_DROP_GLOBAL);
+
+    /* three parts a chunk: a third of what is left, in whole chunks */
+    c = add_case("split/ota_half");
+    for (int s = 0; s < 8; s++) {
+        add_split_stream(c, 0, s, MSG_OTA_CHUNK, 3, 1000 / NEIGHBOR_OTA_RATE, s * 1000 / NEIGHBOR_OTA_RATE / 8);
+    }
+    for (int s = 8; s < 18; s++) {
+        add_stream(c, 1, s, MSG_HELLO, 1000 / NEIGHBOR_HELLO_RATE, s * 13);
+    }
+    add_bound(c, "ota", (at_least(left) - NEIGHBOR_GLOBAL_RATE / 2) / 3,
+              (at_least(left) + NEIGHBOR_GLOBAL_RATE / 2) / 3, 0);
+    add_bound(c, "hello", INGRESS_ALL, INGRESS_ALL, 0);
+
+    build_scripts();
+}
+
+static void fill_header(broadcast_header_t *hdr, uint16_t sender, uint8_t msg_type, uint32_t seq, uint32_t uptime_ms)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->protocol_id = PAIRING_PROTOCOL_ID;
+    hdr->msg_type = msg_type;
+    hdr->sender_mac[0] = 0x02;
+    hdr->sender_mac[1] = 0x49;
+    hdr->sender_mac[2] = 0x4e;
+    hdr->sender_mac[4] = (uint8_t)(sender >> 8);
+    hdr->sender_mac[5] = (uint8_t)sender;
+    hdr->uptime_ms = uptime_ms;
+    hdr->seq_num = seq;
+}
+
+static neighbor_verdict_t admit(const broadcast_header_t *hdr, uint32_t now_ms)
+{
+    return neighbor_admit(hdr->sender_mac, (const uint8_t *)hdr, sizeof(*hdr), now_ms);
+}
+
+/* each part: header | frag_hdr_t | the first part starts with the frame's own header */
+static neighbor_verdict_t offer_split(const ingress_stream_t *st, uint32_t now_ms)
+{
+    uint8_t buf[2 * sizeof(broadcast_header_t) + sizeof(frag_hdr_t)];
+    broadcast_header_t *hdr = (broadcast_header_t *)buf;
+    broadcast_header_t *inner = (broadcast_header_t *)(buf + sizeof(*hdr) + sizeof(frag_hdr_t));
+    frag_hdr_t fh = { .count = st->parts };
+    neighbor_verdict_t v = NEIGHBOR_ADMIT;
+
+    fill_header(inner, st->sender, st->msg_type, ++s_seq[st->sender], now_ms);
+    fh.frame_seq = inner->seq_num;
+    for (int i = 0; i < st->parts; i++) {
+        fill_header(hdr, st->sender, MSG_FRAGMENT, ++s_seq[st->sender], now_ms);
+        fh.index = (uint8_t)i;
+        memcpy(buf + sizeof(*hdr), &fh, sizeof(fh));
+        neighbor_verdict_t part = neighbor_admit(hdr->sender_mac, buf,
+                                                 i == 0 ? (int)sizeof(buf) : (int)(sizeof(*hdr) + sizeof(fh)),
+                                                 now_ms);
+        if (v == NEIGHBOR_ADMIT) v = part;
+    }
+    return v;
+}
+
+static neighbor_verdict_t offer(const ingress_stream_t *st, uint32_t now_ms)
+{
+    broadcast_header_t hdr;
+
+    if (st->parts > 1) return offer_split(st, now_ms);
+    fill_header(&hdr, st->sender, st->msg_type, ++s_seq[st->sender], now_ms);
+    neighbor_verdict_t v = admit(&hdr, now_ms);
+    if (v == NEIGHBOR_ADMIT_CLAIM) neighbor_confirm(hdr.sender_mac, &hdr, false);
+    return v;
+}
+
+static void run_script(const ingress_case_t *c, ingress_result_t *r)
+{
+    broadcast_header_t hdr = { 0 };
+
+    for (int i = 0; i < c->step_count; i++) {
+        const ingress_step_t *st = &c->steps[i];
+        uint32_t now_ms = INGRESS_START_MS + st->t_ms;
+        neighbor_verdict_t got = st->expect;
+
+        switch (st->op) {
+            case STEP_FRAME:
+                fill_header(&hdr, 0, st->msg_type, st->seq, st->uptime_ms);
+                got = admit(&hdr, now_ms);
+                break;
+            case STEP_CONFIRM:
+            case STEP_CONFIRM_UNTAGGED:
+                neighbor_confirm(hdr.sender_mac, &hdr, st->op == STEP_CONFIRM);
+                break;
+            case STEP_PARTNER:
+                fill_header(&hdr, 0, 0, 0, 0);
+                neighbor_set_partner(hdr.sender_mac);
+                break;
+            case STEP_FLOOD:
+                for (uint16_t s = 1; s <= INGRESS_FLOOD_SENDERS; s++) {
+                    broadcast_header_t other;
+                    fill_header(&other, s, MSG_HELLO, 1, now_ms);
+                    admit(&other, now_ms);
+                }
+                break;
+        }
+        if (got != st->expect) {
+            r->mismatches[r->mismatch_count++] = (ingress_mismatch_t) { .step = i, .got = got };
+        }
+    }
+    r->passed = r->mismatch_count == 0;
+}
+
+static void run_case(const ingress_case_t *c, ingress_result_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    memset(s_seq, 0, sizeof(s_seq));
+    r->c = c;
+    neighbor_init(INGRESS_START_MS);
+
+    if (c->step_count > 0) {
+        run_script(c, r);
+        return;
+    }
+
+    for (uint32_t t = 0; t < INGRESS_DURATION_MS; t++) {
+        for (int i = 0; i < c->stream_count; i++) {
+            const ingress_stream_t *st = &c->streams[i];
+            if (t % st->period_ms != st->offset_ms % st->period_ms) continue;
+
+            ingress_group_result_t *g = &r->groups[st->group];
+            g->offered++;
+            g->verdicts[offer(st, INGRESS_START_MS + t)]++;
+        }
+    }
+
+    r->passed = true;
+    for (int i = 0; i < c->group_count; i++) {
+        const ingress_bound_t *b = &c->bounds[i];
+        ingress_group_result_t *g = &r->groups[i];
+        uint32_t admitted = g->verdicts[NEIGHBOR_ADMIT] + g->verdicts[NEIGHBOR_ADMIT_CLAIM];
+        uint32_t min = b->min == INGRESS_ALL ? g->offered : b->min;
+        uint32_t max = b->max == INGRESS_ALL ? g->offered : b->max;
+
+        g->passed = admitted >= min && admitted <= max;
+        for (int v = 0; v < INGRESS_VERDICTS; v++) {
+            if ((b->forbidden >> v) & 1 && g->verdicts[v] > 0) g->passed = false;
+        }
+        r->passed &= g->passed;
+    }
+}
+
+static bool passed(void)
+{
+    for (int i = 0; i < s_case_count; i++) {
+        if (!s_results[i].passed) return false;
+    }
+    return true;
+}
+
+static void print_result(FILE *f)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"duration_ms\": %d,\n", INGRESS_DURATION_MS);
+    fprintf(f, "  \"limits\": {\"global\": %d, \"sender_share_pct\": %d, \"hello\": %d, \"proposal\": %d, "
+               "\"control\": %d, \"ota\": %d, \"fragment\": %d},\n",
+            NEIGHBOR_GLOBAL_RATE, NEIGHBOR_SENDER_SHARE_PCT, NEIGHBOR_HELLO_RATE, NEIGHBOR_PROPOSAL_RATE,
+            NEIGHBOR_CONTROL_RATE, NEIGHBOR_OTA_RATE, NEIGHBOR_FRAGMENT_RATE);
+    fprintf(f, "  \"cases\": [\n");
+    for (int i = 0; i < s_case_count; i++) {
+        const ingress_result_t *r = &s_results[i];
+        if (r->c->step_count > 0) {
+            fprintf(f, "    {\"name\": \"%s\", \"steps\": %d, \"mismatches\": [", r->c->name, r->c->step_count);
+            for (int m = 0; m < r->mismatch_count; m++) {
+                const ingress_step_t *st = &r->c->steps[r->mismatches[m].step];
+                fprintf(f, "%s{\"step\": %d, \"t_ms\": %lu, \"seq\": %lu, \"expected\": \"%s\", \"got\": \"%s\"}",
+                        m ? ", " : "", r->mismatches[m].step, (unsigned long)st->t_ms, (unsigned long)st->seq,
+                        VERDICT_NAMES[st->expect], VERDICT_NAMES[r->mismatches[m].got]);
+            }
+            fprintf(f, "], \"passed\": %s}%s\n", r->passed ? "true" : "false", i + 1 < s_case_count ? "," : "");
+            continue;
+        }
+        fprintf(f, "    {\"name\": \"%s\", \"groups\": [", r->c->name);
+        for (int g = 0; g < r->c->group_count; g++) {
+            const ingress_bound_t *b = &r->c->bounds[g];
+            const ingress_group_result_t *gr = &r->groups[g];
+            fprintf(f, "%s{\"name\": \"%s\", \"offered\": %lu", g ? ", " : "", b->name, (unsigned long)gr->offered);
+            for (int v = 0; v < INGRESS_VERDICTS; v++) {
+                fprintf(f, ", \"%s\": %lu", VERDICT_NAMES[v], (unsigned long)gr->verdicts[v]);
+            }
+            fprintf(f, ", \"expected\": [%lu, %lu], \"passed\": %s}",
+                    (unsigned long)(b->min == INGRESS_ALL ? gr->offered : b->min),
+                    (unsigned long)(b->max == INGRESS_ALL ? gr->offered : b->max), gr->passed ? "true" : "false");
+        }
+        fprintf(f, "], \"passed\": %s}%s\n", r->passed ? "true" : "false", i + 1 < s_case_count ? "," : "");
+    }
+    fprintf(f, "  ],\n");
+    fprintf(f, "  \"passed\": %s\n}\n", passed() ? "true" : "false");
+}
+
+void app_main(void)
+{
+    if (getenv("WAYSIDE_SIM_VERBOSE") == NULL) {
+        esp_log_level_set("*", ESP_LOG_WARN);
+    }
+
+    build_cases();
+    for (int i = 0; i < s_case_count; i++) {
+        run_case(&s_cases[i], &s_results[i]);
+    }
+    print_result(stdout);
+
+    const char *json = getenv("WAYSIDE_INGRESS_JSON");
+    if (json != NULL) {
+        FILE *out = fopen(json, "w");
+        if (out != NULL) {
+            print_result(out);
+            fclose(out);
+        }
+    }
+    exit(passed() ? 0 : 1);
+}
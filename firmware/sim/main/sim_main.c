@@ -0,0 +1,329 @@
+/*
+ * sim_main.c - One badge of a multi-badge Linux simulation
+ *
+ * Runs the real espnow.c/pairing.c/neighbor.c/proximity.c stack on the
+ * ESP-IDF Linux target with ESP-NOW mapped onto the sim_radio ether.
+ * sim/tools/wayside_sim.py starts one process per badge.
+ *
+ * Configuration comes from the environment:
+ *   WAYSIDE_SIM_ID         badge number (required, 0-65535)
+ *   WAYSIDE_SIM_X/_Y       position in metres (default 0, 0)
+ *   WAYSIDE_SIM_SHADOWING  per-frame RSSI noise std dev in dB (default 4)
+ *   WAYSIDE_SIM_GROUP      ether multicast group (default 239.42.0.1)
+ *   WAYSIDE_SIM_PORT       ether port (default 4242)
+ *   WAYSIDE_SIM_VERBOSE    set to keep INFO logs (default WARN only)
+ *   WAYSIDE_SIM_TRACE      record every frame heard to this .wtr file
+ *   WAYSIDE_SIM_FW_VERSION firmware version the badge runs (default 1)
+ *   WAYSIDE_SIM_FW_SIZE    size of its image in bytes (default 256 KiB)
+ *   WAYSIDE_SIM_CLOCK_PPM  crystal error of this badge's clock (default 0)
+ *   WAYSIDE_SIM_CLOCK_OFFSET_US  where its clock starts against the host's
+ *   WAYSIDE_SIM_COEX_POLICY      0 to start with the coex policy off (COEX:off)
+ *   WAYSIDE_SIM_RATE_CONTROL     0 to start with rate control off (RATE:off)
+ *   WAYSIDE_SIM_ESPNOW_VERSION   1 for a badge with a v1 ESP-NOW driver (default 2)
+ *   WAYSIDE_SIM_LINK_ENCRYPT     0 for a radio without encrypted peer slots, so
+ *                                partner links stay plaintext
+ *   WAYSIDE_SIM_ASSETS     contents of the "assets" partition (sim_partition.c)
+ *
+ * The host's clock is perfect and every badge's starts near zero, so without
+ * the two CLOCK variables timesync would have little to do. esp_timer_get_time() is
+ * wrapped (CMakeLists.txt) to run each badge's clock off by its own offset
+ * and rate. SIM TIME reports CLOCK_MONOTONIC as the common reference.
+ *
+ * ble_send_message() is wrapped too: sim_board.c prints the message, then
+ * the wrapper goes through the chunks the way ble_task.c does, coex calls
+ * and 20 ms gaps included, and each chunk takes the radio for a BLE
+ * connection event (sim_radio.h). SIM BLEBULK has the phone pull a large
+ * notification, to see what that costs the partner link.
+ *
+ * Applying an update received over the air re-executes the process with
+ * the new WAYSIDE_SIM_FW_VERSION (esp_ota_ops.h). SIM POS updates
+ * WAYSIDE_SIM_X/_Y so the badge comes back where it was; its pairing state
+ * and the launcher's PUBKEY/BITMASK are gone, as after a real restart, and
+ * READY tells the launcher to send them again.
+ *
+ * Each stdin line is a phone command for ble_cmd_handle() (PUBKEY:...,
+ * BITMASK:..., STATS, ...) or a simulator command:
+ *   SIM POS <x> <y>        move the badge
+ *   SIM RADIO on|off       simulate an outage
+ *   SIM TEMP <c>           publish a monitor sample with this die temperature
+ *   SIM TIME               print host and shared time, for timesync
+ *   SIM BLEBULK <bytes>    notify the phone this much, from a task of its own
+ *   SIM REPORT             print radio counters; uc_dist= lists, per
+ *                          distance bucket (sim_radio.h), the unicasts
+ *                          addressed to this badge as heard/delivered/airtime_us
+ *   SIM QUIT               print radio counters and exit
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "espnow.h"
+#include "proximity.h"
+#include "reactor.h"
+#include "bus.h"
+#include "thermal.h"
+#include "ota.h"
+#include "timesync.h"
+#include "coex.h"
+#include "rate.h"
+#include "ble_task.h"
+#include "ble_cmd.h"
+#include "mem.h"
+#include "assets.h"
+#include "hnr26_badge.h"
+#include "sim_radio.h"
+
+static const char *TAG = "sim";
+
+#define SIM_LINE_MAX        2048
+#define SIM_STDIN_PERIOD    pdMS_TO_TICKS(10)
+#define SIM_BLE_MTU         185     /* what phones usually negotiate */
+#define SIM_BULK_MAX        65536
+
+static const char *env_str(const char *name, const char *fallback)
+{
+    const char *v = getenv(name);
+    return (v != NULL && v[0] != '\0') ? v : fallback;
+}
+
+static int64_t s_clock_offset_us;
+static double s_clock_ppm;
+
+int64_t __real_esp_timer_get_time(void);
+
+int64_t __wrap_esp_timer_get_time(void)
+{
+    int64_t t = __real_esp_timer_get_time();
+    return s_clock_offset_us + t + (int64_t)((double)t * s_clock_ppm * 1e-6);
+}
+
+static int64_t host_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void __real_ble_send_message(const char *message);
+
+void __wrap_ble_send_message(const char *message)
+{
+    __real_ble_send_message(message);
+    if (message == NULL) return;
+
+    size_t len = strlen(message);
+    size_t max_chunk = SIM_BLE_MTU - 3;
+    for (size_t offset = 0; offset < len; offset += max_chunk) {
+#if CONFIG_ESPNOW_COEX
+        coex_ble_chunk_begin(len > max_chunk);
+#endif
+        sim_radio_ble_event(SIM_RADIO_BLE_EVENT_MS);
+#if CONFIG_ESPNOW_COEX
+        coex_ble_chunk_end(true);
+#endif
+        if (offset + max_chunk < len) {
+            vTaskDelay(pdMS_TO_TICKS(20));
+        }
+    }
+}
+
+static volatile bool s_bulk_busy;
+
+static void bulk_task(void *pvParameter)
+{
+    static char msg[SIM_BULK_MAX + 8];
+    size_t bytes = (size_t)pvParameter;
+
+    memcpy(msg, "BULK:", 5);
+    memset(msg + 5, 'x', bytes);
+    msg[5 + bytes] = BLE_MESSAGE_DELIMITER_CHAR;
+    msg[6 + bytes] = '\0';
+    ble_send_message(msg);
+
+    s_bulk_busy = false;
+    vTaskDelete(NULL);
+}
+
+static void start_bulk(unsigned long bytes)
+{
+    if (s_bulk_busy || bytes == 0 || bytes > SIM_BULK_MAX) {
+        ESP_LOGW(TAG, "BLEBULK %lu refused", bytes);
+        return;
+    }
+    s_bulk_busy = true;
+    xTaskCreate(bulk_task, "sim_bulk", 4096, (void *)(size_t)bytes, 3, NULL);
+}
+
+/* TIME <host_us> <shared_us> <error_us> <synced> <hops> <root mac> */
+static void print_time(void)
+{
+    timesync_stats_t st;
+    int64_t shared_us;
+    uint32_t err_us;
+    int64_t host_us = host_time_us();
+    bool synced = timesync_now(&shared_us, &err_us);
+    timesync_get_stats(&st);
+
+    printf("TIME %lld %lld %lu %d %d " MACSTR "\n", (long long)host_us, (long long)shared_us,
+           (unsigned long)err_us, synced, st.is_root ? 0 : st.hops, MAC2STR(st.root_mac));
+    fflush(stdout);
+}
+
+static void print_report(void)
+{
+    sim_radio_stats_t st;
+    sim_radio_get_stats(&st);
+
+    char dist[SIM_RADIO_DIST_BUCKETS * 40];
+    size_t off = 0;
+    for (int i = 0; i < SIM_RADIO_DIST_BUCKETS; i++) {
+        off += snprintf(dist + off, sizeof(dist) - off, "%s%lu/%lu/%llu", i ? "," : "",
+                        (unsigned long)st.uc_heard[i], (unsigned long)st.uc_delivered[i],
+                        (unsigned long long)st.uc_airtime_us[i]);
+    }
+
+    printf("SIM %lu tx=%lu tx_bytes=%lu rx=%lu out_of_range=%lu radio_off=%lu ble_busy=%lu ble_events=%lu "
+           "truncated=%lu ccmp_fail=%lu uc_tx=%lu uc_acked=%lu airtime_us=%llu uc_airtime_us=%llu uc_dist=%s leds=%d\n",
+           (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS),
+           (unsigned long)st.tx_frames, (unsigned long)st.tx_bytes,
+           (unsigned long)st.rx_frames, (unsigned long)st.rx_out_of_range,
+           (unsigned long)st.rx_radio_off, (unsigned long)st.rx_ble_busy,
+           (unsigned long)st.ble_events, (unsigned long)st.rx_truncated,
+           (unsigned long)st.rx_ccmp_fail, (unsigned long)st.tx_unicast, (unsigned long)st.tx_unicast_acked,
+           (unsigned long long)st.tx_airtime_us, (unsigned long long)st.tx_unicast_airtime_us,
+           dist, sim_board_leds_on());
+    fflush(stdout);
+}
+
+static void handle_sim_command(const char *cmd)
+{
+    float x, y, temp;
+    unsigned long bytes;
+
+    if (sscanf(cmd, "POS %f %f", &x, &y) == 2) {
+        char v[32];
+        sim_radio_set_position(x, y);
+        snprintf(v, sizeof(v), "%g", x);
+        setenv("WAYSIDE_SIM_X", v, 1);
+        snprintf(v, sizeof(v), "%g", y);
+        setenv("WAYSIDE_SIM_Y", v, 1);
+    } else if (sscanf(cmd, "TEMP %f", &temp) == 1) {
+        bus_msg_t msg = { .monitor = { .voltage_mv = 3700, .temperature_c = temp } };
+        bus_publish(BUS_TOPIC_MONITOR, &msg);
+    } else if (sscanf(cmd, "BLEBULK %lu", &bytes) == 1) {
+        start_bulk(bytes);
+    } else if (strcmp(cmd, "RADIO on") == 0) {
+        sim_radio_set_enabled(true);
+    } else if (strcmp(cmd, "RADIO off") == 0) {
+        sim_radio_set_enabled(false);
+    } else if (strcmp(cmd, "TIME") == 0) {
+        print_time();
+    } else if (strcmp(cmd, "REPORT") == 0) {
+        print_report();
+    } else if (strcmp(cmd, "QUIT") == 0) {
+        print_report();
+        exit(0);
+    } else {
+        ESP_LOGW(TAG, "Unknown sim command: %s", cmd);
+    }
+}
+
+static void stdin_task(void *pvParameter)
+{
+    static char line[SIM_LINE_MAX];
+    int line_len = 0;
+
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+    while (1) {
+        char c;
+        ssize_t n;
+
+        while ((n = read(STDIN_FILENO, &c, 1)) == 1) {
+            if (c == '\n' || c == BLE_MESSAGE_DELIMITER_CHAR) {
+                line[line_len] = '\0';
+                if (strncmp(line, "SIM ", 4) == 0) {
+                    handle_sim_command(line + 4);
+                } else if (line_len > 0) {
+                    ble_cmd_handle(line);
+                }
+                line_len = 0;
+            } else if (line_len < SIM_LINE_MAX - 1) {
+                line[line_len++] = c;
+            }
+        }
+
+        /* launcher went away */
+        if (n == 0) {
+            print_report();
+            exit(0);
+        }
+
+        vTaskDelay(SIM_STDIN_PERIOD);
+    }
+}
+
+void app_main(void)
+{
+    const char *id = getenv("WAYSIDE_SIM_ID");
+    if (id == NULL) {
+        fprintf(stderr, "WAYSIDE_SIM_ID not set\n");
+        exit(2);
+    }
+
+    if (getenv("WAYSIDE_SIM_VERBOSE") == NULL) {
+        esp_log_level_set("*", ESP_LOG_WARN);
+    }
+
+    sim_radio_config_t radio_cfg = {
+        .id = (uint16_t)atoi(id),
+        .x = strtof(env_str("WAYSIDE_SIM_X", "0"), NULL),
+        .y = strtof(env_str("WAYSIDE_SIM_Y", "0"), NULL),
+        .shadowing_db = strtof(env_str("WAYSIDE_SIM_SHADOWING", "4"), NULL),
+        .group = env_str("WAYSIDE_SIM_GROUP", SIM_RADIO_DEFAULT_GROUP),
+        .port = (uint16_t)atoi(env_str("WAYSIDE_SIM_PORT", "4242")),
+        .trace_path = getenv("WAYSIDE_SIM_TRACE"),
+        .espnow_version = (uint8_t)atoi(env_str("WAYSIDE_SIM_ESPNOW_VERSION", "2")),
+        .no_encrypt_peers = strcmp(env_str("WAYSIDE_SIM_LINK_ENCRYPT", "1"), "0") == 0,
+    };
+
+    s_clock_offset_us = strtoll(env_str("WAYSIDE_SIM_CLOCK_OFFSET_US", "0"), NULL, 10);
+    s_clock_ppm = strtod(env_str("WAYSIDE_SIM_CLOCK_PPM", "0"), NULL);
+
+    mem_init();
+    if (sim_radio_init(&radio_cfg) != ESP_OK) {
+        exit(1);
+    }
+
+    assets_init();
+    hnr26_badge_init();
+    reactor_init();
+    proximity_init(NULL);
+    espnow_init();
+    thermal_init();
+#if CONFIG_ESPNOW_COEX
+    if (strcmp(env_str("WAYSIDE_SIM_COEX_POLICY", "1"), "0") == 0) {
+        coex_set_policy(false);
+    }
+#endif
+#if CONFIG_ESPNOW_RATE_CONTROL
+    if (strcmp(env_str("WAYSIDE_SIM_RATE_CONTROL", "1"), "0") == 0) {
+        rate_set_control(false);
+    }
+#endif
+
+    xTaskCreate(stdin_task, "sim_stdin", 8192, NULL, 3, NULL);
+    mem_seal();
+
+    ota_stats_t ota;
+    ota_get_stats(&ota);
+    printf("READY %d fw=%lu\n", radio_cfg.id, (unsigned long)ota.running_version);
+    fflush(stdout);
+}
@@ -0,0 +1,429 @@
+/*
+ * replay_main.c - Feed a captured radio trace through the receive path
+ *
+ * Reads a .wtr file (sim/tools/wayside_trace.py) and, for every frame, makes
+ * the calls espnow_recv_cb and espnow_task make: neighbor_admit(),
+ * frag_handle_recv(), neighbor_confirm() for claims whose tag checks out,
+ * pairing_handle_recv(), proximity_update() and pairing_tick(), plus the
+ * idle pairing_tick() every PAIRING_REBROADCAST_MS.
+ * Time comes from the trace: xTaskGetTickCount is wrapped at link time, so
+ * pairing.c, neighbor.c and proximity.c see the capture's clock and a ten
+ * minute crowd replays in well under a second.
+ *
+ * The badge takes the MAC from the trace's first META record so unicasts
+ * captured for it are accepted. Its own transmissions go nowhere; the trace
+ * already holds whatever the real badge heard back.
+ *
+ * Records cut short by ESPNOW_TRACE_SNAPLEN still have their header, so
+ * they are admitted and move proximity, but their bodies are gone and
+ * pairing never sees them; replay a capture taken with snaplen 0.
+ *
+ * Configuration comes from the environment:
+ *   WAYSIDE_REPLAY_TRACE     .wtr file (required)
+ *   WAYSIDE_REPLAY_JSON      also write the result as JSON to this file
+ *   WAYSIDE_REPLAY_BITMASK   <hex>[:threshold] interests of the listening
+ *                            badge (default 64 bits all set, threshold 0)
+ *   WAYSIDE_REPLAY_GROUPKEY  hex group key, if the event used one
+ *   WAYSIDE_REPLAY_PUBKEY    PUBKEY of the listening badge; only matters
+ *                            for RESUME tickets (default "replay-pk")
+ *   WAYSIDE_SIM_VERBOSE      keep INFO logs (default WARN only)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "espnow.h"
+#include "pairing.h"
+#include "neighbor.h"
+#include "frag.h"
+#include "proximity.h"
+#include "reactor.h"
+#include "trace.h"
+#include "sim_radio.h"
+
+static const char *TAG = "replay";
+
+#define REPLAY_MAX_SENDERS      1024
+#define REPLAY_MAX_TRANSITIONS  64
+
+typedef struct {
+    uint32_t *ns;
+    size_t count;
+    size_t cap;
+} timing_t;
+
+typedef struct {
+    uint32_t t_ms;
+    BROADCAST_STATE state;
+} transition_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t by_type[MSG_RESUME + 1];
+    uint32_t foreign;
+    uint32_t admitted;
+    uint32_t snapped;           /* admitted, body cut short in the capture */
+    uint32_t drop_rate;
+    uint32_t drop_global;
+    uint32_t drop_dup;
+    uint32_t drop_claim;        /* admitted on a claim whose tag failed */
+    uint32_t time_backwards;
+    uint32_t zone_changes;
+
+    uint8_t senders[REPLAY_MAX_SENDERS][6];
+    uint32_t sender_count;
+
+    transition_t transitions[REPLAY_MAX_TRANSITIONS];
+    uint32_t transition_count;
+
+    timing_t admit;
+    timing_t handle_recv;
+    timing_t tick;
+} replay_result_t;
+
+static const char *STATE_NAMES[] = { "SEARCHING", "PROPOSING", "PAIRED", "SUSPENDED" };
+static const char *MSG_NAMES[] = {
+    "0", "HELLO", "PROPOSAL", "ACCEPT", "REJECT", "HEARTBEAT", "KEY_EXCHANGE", "RELAY_URL", "RESUME"
+};
+
+/* normally defined by espnow.c, which replay replaces */
+const uint8_t espnow_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static volatile uint32_t s_now_ms;
+static uint32_t s_first_ms;
+static uint32_t s_last_tick_ms;
+static pairing_ctx_t s_ctx;
+static replay_result_t s_result;
+
+TickType_t __wrap_xTaskGetTickCount(void)
+{
+    return s_now_ms / portTICK_PERIOD_MS;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void timing_add(timing_t *t, uint64_t ns)
+{
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 4096;
+        uint32_t *ns_new = realloc(t->ns, cap * sizeof(uint32_t));
+        if (ns_new == NULL) return;
+        t->ns = ns_new;
+        t->cap = cap;
+    }
+    t->ns[t->count++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void timing_print(FILE *f, const char *name, timing_t *t, bool last)
+{
+    uint64_t sum = 0;
+    qsort(t->ns, t->count, sizeof(uint32_t), cmp_u32);
+    for (size_t i = 0; i < t->count; i++) sum += t->ns[i];
+
+    fprintf(f, "    \"%s\": {\"n\": %zu, \"mean_ns\": %llu, \"p50_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu}%s\n",
+            name, t->count, t->count ? (unsigned long long)(sum / t->count) : 0ull,
+            t->count ? (unsigned long)t->ns[t->count / 2] : 0ul,
+            t->count ? (unsigned long)t->ns[(t->count * 99) / 100] : 0ul,
+            t->count ? (unsigned long)t->ns[t->count - 1] : 0ul,
+            last ? "" : ",");
+}
+
+static void note_sender(const uint8_t *mac)
+{
+    for (uint32_t i = 0; i < s_result.sender_count; i++) {
+        if (memcmp(s_result.senders[i], mac, 6) == 0) return;
+    }
+    if (s_result.sender_count < REPLAY_MAX_SENDERS) {
+        memcpy(s_result.senders[s_result.sender_count++], mac, 6);
+    }
+}
+
+static void note_state(void)
+{
+    uint32_t n = s_result.transition_count;
+    if (n > 0 && s_result.transitions[n - 1].state == s_ctx.current_state) return;
+    if (n == 0 && s_ctx.current_state == SEARCHING) return;
+    if (n < REPLAY_MAX_TRANSITIONS) {
+        s_result.transitions[n].t_ms = s_now_ms - s_first_ms;
+        s_result.transitions[n].state = s_ctx.current_state;
+        s_result.transition_count++;
+    }
+}
+
+static void timed_tick(void)
+{
+    uint64_t start = now_ns();
+    pairing_tick(&s_ctx);
+    timing_add(&s_result.tick, now_ns() - start);
+    s_last_tick_ms = s_now_ms;
+    note_state();
+}
+
+/* espnow_task ticks after every event and after PAIRING_REBROADCAST_MS idle */
+static void advance_to(uint32_t t_ms)
+{
+    if ((int32_t)(t_ms - s_now_ms) < 0) {
+        s_result.time_backwards++;
+        return;
+    }
+    while ((int32_t)(t_ms - (s_last_tick_ms + PAIRING_REBROADCAST_MS)) >= 0) {
+        s_now_ms = s_last_tick_ms + PAIRING_REBROADCAST_MS;
+        timed_tick();
+    }
+    s_now_ms = t_ms;
+}
+
+static void replay_frame(const trace_record_t *rec)
+{
+    advance_to(rec->t_ms);
+    s_result.frames++;
+    note_sender(rec->src);
+
+    if (rec->len < sizeof(broadcast_header_t) || rec->data[0] != PAIRING_PROTOCOL_ID) {
+        s_result.foreign++;
+        return;
+    }
+
+    const broadcast_header_t *hdr = (const broadcast_header_t *)rec->data;
+    if (hdr->msg_type <= MSG_RESUME) s_result.by_type[hdr->msg_type]++;
+
+    uint64_t start = now_ns();
+    neighbor_verdict_t verdict = neighbor_admit(rec->src, rec->data, (int)rec->len, s_now_ms);
+    timing_add(&s_result.admit, now_ns() - start);
+
+    switch (verdict) {
+        case NEIGHBOR_DROP_RATE:
+            s_result.drop_rate++;
+            return;
+        case NEIGHBOR_DROP_GLOBAL:
+            s_result.drop_global++;
+            return;
+        case NEIGHBOR_DROP_DUP:
+            s_result.drop_dup++;
+            return;
+        default:
+            break;
+    }
+    s_result.admitted++;
+
+    int8_t rssi = pairing_rssi_at_ref(hdr, rec->rssi);
+
+    /* a fragment completing a frame stands in for it from here on */
+    const uint8_t *data = rec->data;
+    int len = rec->len;
+    if (rec->flags & TRACE_FLAG_SNAPPED) {
+        s_result.snapped++;
+    } else {
+        if (!frag_handle_recv(rec->src, &data, &len)) return;
+
+        if (verdict == NEIGHBOR_ADMIT_CLAIM) {
+            if (!pairing_frame_tag_valid(&s_ctx, rec->src, data, len)) {
+                s_result.drop_claim++;
+                return;
+            }
+            neighbor_confirm(rec->src, (const broadcast_header_t *)data, s_ctx.has_group_key);
+        }
+
+        start = now_ns();
+        pairing_handle_recv(&s_ctx, rec->src, data, len, rssi);
+        timing_add(&s_result.handle_recv, now_ns() - start);
+    }
+
+    proximity_zone_t zone = proximity_get_zone();
+    proximity_update(rssi);
+    if (proximity_get_zone() != zone) s_result.zone_changes++;
+
+    timed_tick();
+}
+
+static int hex_to_bytes(const char *hex, uint8_t *out, int max_len)
+{
+    int byte_len = 0;
+    while (hex[0] != '\0' && hex[0] != ':' && hex[1] != '\0') {
+        unsigned int v;
+        if (byte_len == max_len || sscanf(hex, "%2x", &v) != 1) return -1;
+        out[byte_len++] = (uint8_t)v;
+        hex += 2;
+    }
+    return byte_len;
+}
+
+static void configure_badge(void)
+{
+    uint8_t bitmask[PAIRING_BITMASK_MAX_LEN];
+    int bitmask_len = 8;
+    int threshold = 0;
+    const char *arg;
+
+    memset(bitmask, 0xFF, sizeof(bitmask));
+    arg = getenv("WAYSIDE_REPLAY_BITMASK");
+    if (arg != NULL) {
+        bitmask_len = hex_to_bytes(arg, bitmask, sizeof(bitmask));
+        const char *colon = strchr(arg, ':');
+        if (colon != NULL) threshold = atoi(colon + 1);
+        if (bitmask_len <= 0) {
+            ESP_LOGE(TAG, "Bad WAYSIDE_REPLAY_BITMASK");
+            exit(2);
+        }
+    }
+
+    arg = getenv("WAYSIDE_REPLAY_PUBKEY");
+    pairing_set_pubkey(&s_ctx, arg != NULL ? arg : "replay-pk");
+    pairing_set_bitmask(&s_ctx, bitmask, (uint16_t)bitmask_len);
+    pairing_set_similarity_threshold(&s_ctx, (uint8_t)threshold);
+
+    arg = getenv("WAYSIDE_REPLAY_GROUPKEY");
+    if (arg != NULL) {
+        uint8_t key[PAIRING_GROUP_KEY_MAX_LEN];
+        int key_len = hex_to_bytes(arg, key, sizeof(key));
+        if (key_len <= 0) {
+            ESP_LOGE(TAG, "Bad WAYSIDE_REPLAY_GROUPKEY");
+            exit(2);
+        }
+        pairing_set_group_key(&s_ctx, key, (uint8_t)key_len);
+    }
+}
+
+static void start_badge(const trace_record_t *meta)
+{
+    sim_radio_config_t radio_cfg = {
+        .mac = meta->src,
+        .group = NULL,
+    };
+    esp_now_peer_info_t peer = {
+        .channel = CONFIG_ESPNOW_CHANNEL,
+        .ifidx = ESPNOW_WIFI_IF,
+    };
+
+    memcpy(peer.peer_addr, espnow_broadcast_mac, ESP_NOW_ETH_ALEN);
+    s_now_ms = meta->t_ms;
+    s_first_ms = meta->t_ms;
+    s_last_tick_ms = meta->t_ms;
+
+    if (sim_radio_init(&radio_cfg) != ESP_OK || esp_now_init() != ESP_OK ||
+        esp_now_add_peer(&peer) != ESP_OK) {
+        exit(1);
+    }
+    neighbor_init(s_now_ms);
+    reactor_init();
+    proximity_init(NULL);
+    if (pairing_init(&s_ctx) != ESP_OK) exit(1);
+    configure_badge();
+}
+
+static void print_result(FILE *f, const char *trace_path, double wall_s)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"trace\": \"%s\",\n", trace_path);
+    fprintf(f, "  \"mac\": \"" MACSTR "\",\n", MAC2STR(s_ctx.my_mac));
+    fprintf(f, "  \"duration_ms\": %lu,\n", (unsigned long)(s_now_ms - s_first_ms));
+    fprintf(f, "  \"wall_s\": %.3f,\n", wall_s);
+    fprintf(f, "  \"frames\": %lu,\n", (unsigned long)s_result.frames);
+    fprintf(f, "  \"senders\": %lu,\n", (unsigned long)s_result.sender_count);
+    fprintf(f, "  \"by_type\": {");
+    for (int i = MSG_HELLO; i <= MSG_RESUME; i++) {
+        fprintf(f, "\"%s\": %lu%s", MSG_NAMES[i], (unsigned long)s_result.by_type[i], i < MSG_RESUME ? ", " : "");
+    }
+    fprintf(f, "},\n");
+    fprintf(f, "  \"admitted\": %lu,\n", (unsigned long)s_result.admitted);
+    fprintf(f, "  \"snapped\": %lu,\n", (unsigned long)s_result.snapped);
+    fprintf(f, "  \"dropped\": {\"foreign\": %lu, \"rate\": %lu, \"global\": %lu, \"dup\": %lu, \"claim\": %lu},\n",
+            (unsigned long)s_result.foreign, (unsigned long)s_result.drop_rate,
+            (unsigned long)s_result.drop_global, (unsigned long)s_result.drop_dup,
+            (unsigned long)s_result.drop_claim);
+    fprintf(f, "  \"time_backwards\": %lu,\n", (unsigned long)s_result.time_backwards);
+    fprintf(f, "  \"zone_changes\": %lu,\n", (unsigned long)s_result.zone_changes);
+    fprintf(f, "  \"final_state\": \"%s\",\n", STATE_NAMES[s_ctx.current_state]);
+    fprintf(f, "  \"resumed\": %lu,\n", (unsigned long)s_ctx.resume_count);
+    fprintf(f, "  \"transitions\": [");
+    for (uint32_t i = 0; i < s_result.transition_count; i++) {
+        fprintf(f, "%s{\"t_ms\": %lu, \"state\": \"%s\"}", i ? ", " : "",
+                (unsigned long)s_result.transitions[i].t_ms, STATE_NAMES[s_result.transitions[i].state]);
+    }
+    fprintf(f, "],\n");
+    fprintf(f, "  \"cpu\": {\n");
+    timing_print(f, "neighbor_admit", &s_result.admit, false);
+    timing_print(f, "pairing_handle_recv", &s_result.handle_recv, false);
+    timing_print(f, "pairing_tick", &s_result.tick, true);
+    fprintf(f, "  }\n}\n");
+}
+
+void app_main(void)
+{
+    const char *path = getenv("WAYSIDE_REPLAY_TRACE");
+    if (path == NULL) {
+        fprintf(stderr, "WAYSIDE_REPLAY_TRACE not set\n");
+        exit(2);
+    }
+
+    if (getenv("WAYSIDE_SIM_VERBOSE") == NULL) {
+        esp_log_level_set("*", ESP_LOG_WARN);
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+
+    static uint8_t buf[sizeof(trace_record_t) + ESP_NOW_MAX_DATA_LEN_V2];
+    trace_record_t *rec = (trace_record_t *)buf;
+    bool started = false;
+    uint64_t wall_start = now_ns();
+
+    while (fread(rec, sizeof(trace_record_t), 1, f) == 1) {
+        if (rec->sync != TRACE_SYNC || rec->len > ESP_NOW_MAX_DATA_LEN_V2 ||
+            fread(rec->data, 1, rec->len, f) != rec->len) {
+            ESP_LOGE(TAG, "Corrupt record after %lu frames", (unsigned long)s_result.frames);
+            break;
+        }
+
+        if (rec->flags & TRACE_FLAG_META) {
+            if (!started) {
+                start_badge(rec);
+                started = true;
+            } else if (memcmp(rec->src, s_ctx.my_mac, 6) != 0) {
+                ESP_LOGW(TAG, "Trace switches to badge " MACSTR ", still replaying as " MACSTR,
+                         MAC2STR(rec->src), MAC2STR(s_ctx.my_mac));
+            }
+            continue;
+        }
+
+        if (!started) {
+            ESP_LOGE(TAG, "Trace does not start with a META record");
+            exit(2);
+        }
+        replay_frame(rec);
+    }
+    fclose(f);
+
+    double wall_s = (now_ns() - wall_start) / 1e9;
+    print_result(stdout, path, wall_s);
+
+    const char *json = getenv("WAYSIDE_REPLAY_JSON");
+    if (json != NULL) {
+        FILE *out = fopen(json, "w");
+        if (out != NULL) {
+            print_result(out, path, wall_s);
+            fclose(out);
+        }
+    }
+    exit(0);
+}
@@ -0,0 +1,648 @@
+/*
+ * soak_main.c - Hours of pairing churn on a virtual clock, checked for leaks
+ *
+ * Runs N pairing contexts in one process. The ESP-NOW calls pairing.c
+ * makes are wrapped at link time so every badge has its own peer table, and
+ * every frame a badge sends is queued and, SOAK_DELIVERY_MS later, handed
+ * to pairing_handle_recv() of every badge that hears it (same log-distance
+ * RSSI model and sensitivity as sim_radio).
+ * Each badge gets the calls espnow_task makes: pairing_tick() after every
+ * frame and every PAIRING_REBROADCAST_MS when idle.
+ *
+ * To keep allocations churning, badges drop off the air for a while
+ * (mostly shorter than PAIRING_RESUME_GRACE_MS, so sessions suspend and
+ * resume; the longer outages reset them) and the phone re-sends BITMASK
+ * now and then. xTaskGetTickCount is wrapped, so six hours take seconds.
+ * For every outage a paired badge comes back from, the time until it is
+ * PAIRED again is reported, split by whether the session resumed or had
+ * to pair from scratch.
+ *
+ * Every virtual minute the mem.h counters are checked:
+ *   - live MEM_TAG_PAIRING allocations and bytes must equal exactly what
+ *     the contexts still point at (bitmask, partner_bitmask)
+ *   - bytes in use on the host heap after warmup must not creep up: the
+ *     last half of the run may not exceed the first half by more than
+ *     SOAK_HEAP_SLACK
+ * and the run must have paired at least once. The result is printed as
+ * JSON; the exit code is 1 if a check failed.
+ *
+ * espnow.c, neighbor.c and proximity.c are not in the loop; their
+ * allocations (ESPNOW_RX, ESPNOW_CFG) are freed in the event that made
+ * them and are covered by the sim's MEM command instead.
+ *
+ * Configuration comes from the environment:
+ *   WAYSIDE_SOAK_HOURS       virtual hours to run (default 6)
+ *   WAYSIDE_SOAK_BADGES      number of badges, 2-16 (default 8)
+ *   WAYSIDE_SOAK_SEED        RNG seed (default 1)
+ *   WAYSIDE_SOAK_JSON        also write the result as JSON to this file
+ *   WAYSIDE_SIM_VERBOSE      keep INFO logs (default WARN only)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "espnow.h"
+#include "pairing.h"
+#include "mem.h"
+#include "sim_radio.h"
+
+static const char *TAG = "soak";
+
+#define SOAK_MAX_BADGES         16
+#define SOAK_QUEUE_LEN          1024
+#define SOAK_STEP_MS            10
+#define SOAK_DELIVERY_MS        2
+#define SOAK_SAMPLE_MS          60000
+#define SOAK_REPORT_MS          (60 * 60 * 1000)
+#define SOAK_WARMUP_MS          (30 * 60 * 1000)
+#define SOAK_HEAP_SLACK         4096
+#define SOAK_AREA_M             5.0f
+#define SOAK_SHADOWING_DB       3.0f
+#define SOAK_BITMASK_LEN        8
+#define SOAK_ONLINE_MEAN_MS     (10 * 60 * 1000)
+#define SOAK_OFFLINE_MIN_MS     5000
+#define SOAK_OFFLINE_MAX_MS     (PAIRING_RESUME_GRACE_MS * 3)
+#define SOAK_BITMASK_MEAN_MS    (45 * 60 * 1000)
+#define SOAK_MAX_REPORTS        64
+#define SOAK_MAX_RECOVERIES     4096
+#define SOAK_MAC_PREFIX         "\x02\x57\x53\x4b"
+
+typedef struct {
+    esp_now_peer_info_t peers[ESP_NOW_MAX_TOTAL_PEER_NUM];
+    bool used[ESP_NOW_MAX_TOTAL_PEER_NUM];
+    int fetch_idx;
+} soak_peers_t;
+
+typedef struct {
+    pairing_ctx_t ctx;
+    soak_peers_t peers;
+    float x;
+    float y;
+    bool online;
+    uint32_t next_toggle_ms;
+    uint32_t next_tick_ms;
+    uint32_t next_bitmask_ms;
+    uint32_t partner_msgs;
+    bool was_paired;                    /* paired when the last outage began */
+    bool recovering;                    /* ...back on air, not paired again yet */
+    uint32_t back_ms;
+    uint32_t resumes_before;
+} soak_badge_t;
+
+typedef struct {
+    uint32_t at_ms;
+    uint8_t src;
+    uint8_t dst;
+    int8_t rssi;
+    uint16_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN_V2];
+} soak_frame_t;
+
+typedef struct {
+    uint32_t t_ms;
+    uint32_t pairing_live;
+    uint32_t pairing_bytes;
+    uint32_t paired;
+    size_t heap_in_use;
+} soak_report_t;
+
+typedef struct {
+    uint32_t ms[SOAK_MAX_RECOVERIES];
+    uint32_t count;
+} soak_recovery_t;
+
+typedef struct {
+    uint32_t frames_sent;
+    uint32_t frames_delivered;
+    uint32_t frames_out_of_range;
+    uint32_t queue_full;
+    uint32_t outages;
+    uint32_t bitmask_changes;
+    uint32_t partner_msgs;
+
+    uint32_t mismatches;
+    uint32_t first_mismatch_ms;
+    size_t heap_first_half_max;
+    size_t heap_last_half_max;
+
+    soak_report_t reports[SOAK_MAX_REPORTS];
+    uint32_t report_count;
+
+    soak_recovery_t resumed;            /* outage end to PAIRED, by RESUME */
+    soak_recovery_t repaired;           /* ...by a new PROPOSAL/ACCEPT/KEY_EXCHANGE */
+    uint32_t unrecovered;               /* off the air again, or the run ended, first */
+} soak_result_t;
+
+/* normally defined by espnow.c, which soak replaces */
+const uint8_t espnow_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static volatile uint32_t s_now_ms;
+static uint32_t s_end_ms;
+static uint32_t s_rng;
+static soak_badge_t s_badges[SOAK_MAX_BADGES];
+static int s_badge_count;
+static int s_current;                   /* badge whose code is running */
+static soak_frame_t s_queue[SOAK_QUEUE_LEN];
+static uint32_t s_queue_head;
+static uint32_t s_queue_tail;
+static soak_result_t s_result;
+
+TickType_t __wrap_xTaskGetTickCount(void)
+{
+    return s_now_ms / portTICK_PERIOD_MS;
+}
+
+/* the phone side: count PARTNER notifications, drop the rest */
+void __wrap_ble_send_message(const char *message)
+{
+    if (strncmp(message, "PARTNER:", 8) == 0) {
+        s_badges[s_current].partner_msgs++;
+        s_result.partner_msgs++;
+    }
+}
+
+static uint32_t rng_next(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static float rng_unit(void)
+{
+    return (rng_next() >> 8) / 16777216.0f;
+}
+
+static uint32_t rng_exp_ms(uint32_t mean_ms)
+{
+    return (uint32_t)(-logf(1.0f - rng_unit()) * mean_ms) + 1;
+}
+
+static float gaussian(void)
+{
+    float u1 = rng_unit() + 1e-7f;
+    float u2 = rng_unit();
+    return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+}
+
+static int rssi_between(const soak_badge_t *a, const soak_badge_t *b)
+{
+    float dx = a->x - b->x;
+    float dy = a->y - b->y;
+    float d = sqrtf(dx * dx + dy * dy);
+    if (d < 0.1f) d = 0.1f;
+    float rssi = SIM_RADIO_TX_POWER_DBM - 10.0f * SIM_RADIO_PATH_LOSS_EXP * log10f(d) + SOAK_SHADOWING_DB * gaussian();
+    return (int)lroundf(rssi);
+}
+
+/*
+ * Per-badge ESP-NOW peer tables. pairing.c always runs on behalf of
+ * s_current, so that is the table every call works on. Limits and error
+ * codes follow sim_radio.c.
+ */
+static int find_peer(const soak_peers_t *p, const uint8_t *mac)
+{
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+        if (p->used[i] && memcmp(p->peers[i].peer_addr, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t __wrap_esp_now_get_peer_num(esp_now_peer_num_t *num);
+
+esp_err_t __wrap_esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    soak_peers_t *p = &s_badges[s_current].peers;
+    esp_now_peer_num_t num;
+
+    if (peer == NULL) return ESP_ERR_ESPNOW_ARG;
+    if (find_peer(p, peer->peer_addr) >= 0) return ESP_ERR_ESPNOW_EXIST;
+    __wrap_esp_now_get_peer_num(&num);
+    if (peer->encrypt && num.encrypt_num >= ESP_NOW_MAX_ENCRYPT_PEER_NUM) return ESP_ERR_ESPNOW_FULL;
+
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+        if (!p->used[i]) {
+            p->peers[i] = *peer;
+            p->used[i] = true;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_ESPNOW_FULL;
+}
+
+esp_err_t __wrap_esp_now_del_peer(const uint8_t *peer_addr)
+{
+    soak_peers_t *p = &s_badges[s_current].peers;
+    if (peer_addr == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    int idx = find_peer(p, peer_addr);
+    if (idx < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+    p->used[idx] = false;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_esp_now_mod_peer(const esp_now_peer_info_t *peer)
+{
+    soak_peers_t *p = &s_badges[s_current].peers;
+    if (peer == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    int idx = find_peer(p, peer->peer_addr);
+    if (idx < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+    p->peers[idx] = *peer;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_esp_now_fetch_peer(bool from_head, esp_now_peer_info_t *peer)
+{
+    soak_peers_t *p = &s_badges[s_current].peers;
+    if (peer == NULL) return ESP_ERR_ESPNOW_ARG;
+    if (from_head) p->fetch_idx = 0;
+
+    for (; p->fetch_idx < ESP_NOW_MAX_TOTAL_PEER_NUM; p->fetch_idx++) {
+        if (p->used[p->fetch_idx] && !(p->peers[p->fetch_idx].peer_addr[0] & 0x01)) {
+            *peer = p->peers[p->fetch_idx++];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_ESPNOW_NOT_FOUND;
+}
+
+bool __wrap_esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    return peer_addr != NULL && find_peer(&s_badges[s_current].peers, peer_addr) >= 0;
+}
+
+esp_err_t __wrap_esp_now_get_peer_num(esp_now_peer_num_t *num)
+{
+    const soak_peers_t *p = &s_badges[s_current].peers;
+    if (num == NULL) return ESP_ERR_ESPNOW_ARG;
+
+    num->total_num = 0;
+    num->encrypt_num = 0;
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+        if (!p->used[i]) continue;
+        num->total_num++;
+        if (p->peers[i].encrypt) num->encrypt_num++;
+    }
+    return ESP_OK;
+}
+
+/* queues only, never re-enters pairing.c: the receiver runs on a later step */
+esp_err_t __wrap_esp_now_send(const uint8_t *dest_mac, const uint8_t *data, size_t len)
+{
+    const soak_badge_t *src = &s_badges[s_current];
+
+    if (dest_mac == NULL || data == NULL || len == 0 || len > ESP_NOW_MAX_DATA_LEN_V2) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (find_peer(&src->peers, dest_mac) < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+    /* an outage is silence on the air, the sender can't tell */
+    if (!src->online) return ESP_OK;
+    s_result.frames_sent++;
+
+    bool broadcast = memcmp(dest_mac, espnow_broadcast_mac, ESP_NOW_ETH_ALEN) == 0;
+
+    for (int i = 0; i < s_badge_count; i++) {
+        const soak_badge_t *dst = &s_badges[i];
+        if (i == s_current || !dst->online) continue;
+        if (!broadcast && memcmp(dest_mac, dst->ctx.my_mac, ESP_NOW_ETH_ALEN) != 0) continue;
+
+        int rssi = rssi_between(src, dst);
+        if (rssi < SIM_RADIO_SENSITIVITY_DBM) {
+            s_result.frames_out_of_range++;
+            continue;
+        }
+        if (s_queue_tail - s_queue_head == SOAK_QUEUE_LEN) {
+            s_result.queue_full++;
+            continue;
+        }
+
+        soak_frame_t *frame = &s_queue[s_queue_tail % SOAK_QUEUE_LEN];
+        frame->at_ms = s_now_ms + SOAK_DELIVERY_MS;
+        frame->src = (uint8_t)s_current;
+        frame->dst = (uint8_t)i;
+        frame->rssi = (int8_t)(rssi > 0 ? 0 : rssi);
+        frame->len = (uint16_t)len;
+        memcpy(frame->data, data, len);
+        s_queue_tail++;
+    }
+    return ESP_OK;
+}
+
+static void tick(int idx)
+{
+    s_current = idx;
+    pairing_tick(&s_badges[idx].ctx);
+    s_badges[idx].next_tick_ms = s_now_ms + PAIRING_REBROADCAST_MS;
+}
+
+static void deliver_due(void)
+{
+    while (s_queue_head != s_queue_tail) {
+        static soak_frame_t frame;
+        if ((int32_t)(s_queue[s_queue_head % SOAK_QUEUE_LEN].at_ms - s_now_ms) > 0) break;
+        /* the receiver may transmit and reuse this slot while handling it */
+        frame = s_queue[s_queue_head % SOAK_QUEUE_LEN];
+        s_queue_head++;
+
+        soak_badge_t *dst = &s_badges[frame.dst];
+        if (!dst->online) continue;
+
+        s_result.frames_delivered++;
+        s_current = frame.dst;
+        pairing_handle_recv(&dst->ctx, s_badges[frame.src].ctx.my_mac, frame.data, frame.len, frame.rssi);
+        tick(frame.dst);
+    }
+}
+
+static void random_bitmask(uint8_t *out)
+{
+    for (int i = 0; i < SOAK_BITMASK_LEN; i++) {
+        out[i] = (uint8_t)rng_next();
+    }
+}
+
+static void record_recovery(soak_badge_t *b)
+{
+    soak_recovery_t *r = b->ctx.resume_count != b->resumes_before ? &s_result.resumed : &s_result.repaired;
+
+    if (r->count < SOAK_MAX_RECOVERIES) r->ms[r->count++] = s_now_ms - b->back_ms;
+    b->recovering = false;
+}
+
+static void drive_badge(int idx)
+{
+    soak_badge_t *b = &s_badges[idx];
+
+    if (b->recovering && b->ctx.current_state == PAIRED) {
+        record_recovery(b);
+    }
+
+    if ((int32_t)(s_now_ms - b->next_toggle_ms) >= 0) {
+        b->online = !b->online;
+        if (b->online) {
+            b->next_toggle_ms = s_now_ms + rng_exp_ms(SOAK_ONLINE_MEAN_MS);
+            b->recovering = b->was_paired;
+            b->back_ms = s_now_ms;
+            b->resumes_before = b->ctx.resume_count;
+        } else {
+            s_result.outages++;
+            if (b->recovering) s_result.unrecovered++;
+            b->recovering = false;
+            b->was_paired = b->ctx.current_state == PAIRED;
+            b->next_toggle_ms = s_now_ms + SOAK_OFFLINE_MIN_MS +
+                                rng_next() % (SOAK_OFFLINE_MAX_MS - SOAK_OFFLINE_MIN_MS);
+        }
+    }
+
+    if ((int32_t)(s_now_ms - b->next_bitmask_ms) >= 0) {
+        uint8_t bitmask[SOAK_BITMASK_LEN];
+        random_bitmask(bitmask);
+        s_current = idx;
+        pairing_set_bitmask(&b->ctx, bitmask, sizeof(bitmask));
+        s_result.bitmask_changes++;
+        b->next_bitmask_ms = s_now_ms + rng_exp_ms(SOAK_BITMASK_MEAN_MS);
+    }
+
+    if ((int32_t)(s_now_ms - b->next_tick_ms) >= 0) {
+        tick(idx);
+    }
+}
+
+static size_t heap_in_use(void)
+{
+#ifdef __GLIBC__
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks;
+#else
+    return 0;
+#endif
+}
+
+/* everything MEM_TAG_PAIRING holds must still be reachable from a context */
+static void check_sample(void)
+{
+    uint32_t expect_live = 0;
+    uint32_t expect_bytes = 0;
+    uint32_t paired = 0;
+    mem_tag_stats_t stats;
+
+    for (int i = 0; i < s_badge_count; i++) {
+        const pairing_ctx_t *ctx = &s_badges[i].ctx;
+        if (ctx->bitmask != NULL) {
+            expect_live++;
+            expect_bytes += ctx->bitmask_len;
+        }
+        if (ctx->partner_bitmask != NULL) {
+            expect_live++;
+            expect_bytes += ctx->partner_bitmask_len;
+        }
+        if (ctx->current_state == PAIRED) paired++;
+    }
+
+    mem_get_tag_stats(MEM_TAG_PAIRING, &stats);
+    if (stats.live != expect_live || stats.bytes != expect_bytes) {
+        if (s_result.mismatches == 0) {
+            s_result.first_mismatch_ms = s_now_ms;
+            ESP_LOGE(TAG, "At %lu s: pairing holds %lu allocs / %lu bytes, contexts reach %lu / %lu",
+                     (unsigned long)(s_now_ms / 1000), (unsigned long)stats.live, (unsigned long)stats.bytes,
+                     (unsigned long)expect_live, (unsigned long)expect_bytes);
+        }
+        s_result.mismatches++;
+    }
+
+    size_t in_use = heap_in_use();
+    if (s_now_ms >= SOAK_WARMUP_MS) {
+        size_t *max = s_now_ms < SOAK_WARMUP_MS + (s_end_ms - SOAK_WARMUP_MS) / 2 ?
+                      &s_result.heap_first_half_max : &s_result.heap_last_half_max;
+        if (in_use > *max) *max = in_use;
+    }
+
+    if (s_now_ms % SOAK_REPORT_MS == 0 && s_result.report_count < SOAK_MAX_REPORTS) {
+        soak_report_t *r = &s_result.reports[s_result.report_count++];
+        r->t_ms = s_now_ms;
+        r->pairing_live = stats.live;
+        r->pairing_bytes = stats.bytes;
+        r->paired = paired;
+        r->heap_in_use = in_use;
+    }
+}
+
+static void start_badges(uint32_t seed)
+{
+    esp_now_peer_info_t peer = {
+        .channel = CONFIG_ESPNOW_CHANNEL,
+        .ifidx = ESPNOW_WIFI_IF,
+    };
+
+    memcpy(peer.peer_addr, espnow_broadcast_mac, ESP_NOW_ETH_ALEN);
+    s_rng = seed ? seed : 1;
+    for (int i = 0; i < s_badge_count; i++) {
+        soak_badge_t *b = &s_badges[i];
+        uint8_t bitmask[SOAK_BITMASK_LEN];
+        char pubkey[32];
+
+        s_current = i;
+        if (__wrap_esp_now_add_peer(&peer) != ESP_OK || pairing_init(&b->ctx) != ESP_OK) exit(1);
+        /* pairing_init() read the host's one MAC; each badge needs its own */
+        memcpy(b->ctx.my_mac, SOAK_MAC_PREFIX, 4);
+        b->ctx.my_mac[4] = (uint8_t)(i >> 8);
+        b->ctx.my_mac[5] = (uint8_t)i;
+
+        snprintf(pubkey, sizeof(pubkey), "soak-pk-%d", i);
+        random_bitmask(bitmask);
+        pairing_set_pubkey(&b->ctx, pubkey);
+        pairing_set_bitmask(&b->ctx, bitmask, sizeof(bitmask));
+        pairing_set_similarity_threshold(&b->ctx, 0);
+
+        b->x = rng_unit() * SOAK_AREA_M;
+        b->y = rng_unit() * SOAK_AREA_M;
+        b->online = true;
+        b->next_toggle_ms = rng_exp_ms(SOAK_ONLINE_MEAN_MS);
+        b->next_bitmask_ms = rng_exp_ms(SOAK_BITMASK_MEAN_MS);
+        /* spread the idle ticks so badges don't transmit in lockstep */
+        b->next_tick_ms = rng_next() % PAIRING_REBROADCAST_MS;
+    }
+}
+
+static bool passed(void)
+{
+    return s_result.mismatches == 0 && s_result.partner_msgs > 0 &&
+           s_result.heap_last_half_max <= s_result.heap_first_half_max + SOAK_HEAP_SLACK;
+}
+
+static int compare_ms(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_recovery(FILE *f, const char *name, soak_recovery_t *r)
+{
+    uint64_t total = 0;
+
+    qsort(r->ms, r->count, sizeof(r->ms[0]), compare_ms);
+    for (uint32_t i = 0; i < r->count; i++) total += r->ms[i];
+    fprintf(f, "\"%s\": {\"n\": %lu, \"mean_ms\": %lu, \"p50_ms\": %lu, \"p90_ms\": %lu, \"max_ms\": %lu}",
+            name, (unsigned long)r->count, (unsigned long)(r->count ? total / r->count : 0),
+            (unsigned long)(r->count ? r->ms[r->count / 2] : 0),
+            (unsigned long)(r->count ? r->ms[r->count * 9 / 10] : 0),
+            (unsigned long)(r->count ? r->ms[r->count - 1] : 0));
+}
+
+static void print_result(FILE *f, double wall_s)
+{
+    uint32_t resumed = 0;
+    for (int i = 0; i < s_badge_count; i++) resumed += s_badges[i].ctx.resume_count;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"badges\": %d,\n", s_badge_count);
+    fprintf(f, "  \"virtual_s\": %lu,\n", (unsigned long)(s_now_ms / 1000));
+    fprintf(f, "  \"wall_s\": %.3f,\n", wall_s);
+    fprintf(f, "  \"frames\": {\"sent\": %lu, \"delivered\": %lu, \"out_of_range\": %lu, \"queue_full\": %lu},\n",
+            (unsigned long)s_result.frames_sent, (unsigned long)s_result.frames_delivered,
+            (unsigned long)s_result.frames_out_of_range, (unsigned long)s_result.queue_full);
+    fprintf(f, "  \"outages\": %lu,\n", (unsigned long)s_result.outages);
+    fprintf(f, "  \"bitmask_changes\": %lu,\n", (unsigned long)s_result.bitmask_changes);
+    fprintf(f, "  \"partner_msgs\": %lu,\n", (unsigned long)s_result.partner_msgs);
+    fprintf(f, "  \"resumed\": %lu,\n", (unsigned long)resumed);
+    fprintf(f, "  \"recovery\": {");
+    print_recovery(f, "resumed", &s_result.resumed);
+    fprintf(f, ", ");
+    print_recovery(f, "repaired", &s_result.repaired);
+    fprintf(f, ", \"unrecovered\": %lu},\n", (unsigned long)s_result.unrecovered);
+    fprintf(f, "  \"tags\": {");
+    for (int t = 0; t < MEM_TAG_MAX; t++) {
+        mem_tag_stats_t stats;
+        mem_get_tag_stats((mem_tag_t)t, &stats);
+        fprintf(f, "%s\"%s\": {\"live\": %lu, \"bytes\": %lu, \"peak_bytes\": %lu, \"total\": %lu, \"failed\": %lu}",
+                t ? ", " : "", mem_tag_name((mem_tag_t)t), (unsigned long)stats.live, (unsigned long)stats.bytes,
+                (unsigned long)stats.peak_bytes, (unsigned long)stats.total, (unsigned long)stats.failed);
+    }
+    fprintf(f, "},\n");
+    fprintf(f, "  \"hourly\": [");
+    for (uint32_t i = 0; i < s_result.report_count; i++) {
+        const soak_report_t *r = &s_result.reports[i];
+        fprintf(f, "%s{\"t_s\": %lu, \"paired\": %lu, \"pairing_live\": %lu, \"pairing_bytes\": %lu, \"heap_in_use\": %zu}",
+                i ? ", " : "", (unsigned long)(r->t_ms / 1000), (unsigned long)r->paired,
+                (unsigned long)r->pairing_live, (unsigned long)r->pairing_bytes, r->heap_in_use);
+    }
+    fprintf(f, "],\n");
+    fprintf(f, "  \"checks\": {\"unreachable_samples\": %lu, \"first_unreachable_s\": %lu, "
+               "\"heap_first_half_max\": %zu, \"heap_last_half_max\": %zu},\n",
+            (unsigned long)s_result.mismatches, (unsigned long)(s_result.first_mismatch_ms / 1000),
+            s_result.heap_first_half_max, s_result.heap_last_half_max);
+    fprintf(f, "  \"passed\": %s\n}\n", passed() ? "true" : "false");
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const char *env_str(const char *name, const char *def)
+{
+    const char *v = getenv(name);
+    return v != NULL ? v : def;
+}
+
+void app_main(void)
+{
+    double hours = strtod(env_str("WAYSIDE_SOAK_HOURS", "6"), NULL);
+    s_badge_count = atoi(env_str("WAYSIDE_SOAK_BADGES", "8"));
+    if (hours <= 0 || hours > 1000 || s_badge_count < 2 || s_badge_count > SOAK_MAX_BADGES) {
+        fprintf(stderr, "WAYSIDE_SOAK_HOURS must be in (0, 1000], WAYSIDE_SOAK_BADGES in [2, %d]\n", SOAK_MAX_BADGES);
+        exit(2);
+    }
+    s_end_ms = (uint32_t)(hours * 3600.0 * 1000.0);
+
+    if (getenv("WAYSIDE_SIM_VERBOSE") == NULL) {
+        esp_log_level_set("*", ESP_LOG_WARN);
+    }
+
+    mem_init();
+    start_badges((uint32_t)strtoul(env_str("WAYSIDE_SOAK_SEED", "1"), NULL, 0));
+
+    uint64_t wall_start = now_ns();
+    for (s_now_ms = 0; s_now_ms < s_end_ms; s_now_ms += SOAK_STEP_MS) {
+        deliver_due();
+        for (int i = 0; i < s_badge_count; i++) {
+            drive_badge(i);
+        }
+        if (s_now_ms % SOAK_SAMPLE_MS == 0) {
+            check_sample();
+        }
+    }
+    check_sample();
+    for (int i = 0; i < s_badge_count; i++) {
+        if (s_badges[i].recovering) s_result.unrecovered++;
+    }
+
+    double wall_s = (now_ns() - wall_start) / 1e9;
+    print_result(stdout, wall_s);
+
+    const char *json = getenv("WAYSIDE_SOAK_JSON");
+    if (json != NULL) {
+        FILE *out = fopen(json, "w");
+        if (out != NULL) {
+            print_result(out, wall_s);
+            fclose(out);
+        }
+    }
+    exit(passed() ? 0 : 1);
+}
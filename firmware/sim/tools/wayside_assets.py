@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+wayside_assets.py - build and inspect the "assets" partition (main/lib/assets.h)
+
+  build  pack a manifest into a container image
+           tools/wayside_assets.py build ../assets.json -o assets.bin
+           parttool.py write_partition --partition-name assets --input assets.bin
+  info   check an image (or a partition dump) and list what is in it,
+         --dump prints the known tables record by record
+           parttool.py read_partition --partition-name assets --output assets.bin
+           tools/wayside_assets.py info assets.bin --dump
+
+The manifest is JSON. The tables the firmware knows are lists of records,
+one per enum value, in the order of asset_zone_t and asset_buzz_t, or for
+the name words any number of asset_word_t:
+
+  "zones"      [led_count, blink_period_ms], PROXIMITY_ZONE_UNKNOWN first
+  "buzz"       [on_ms, off_ms, count], ANNOUNCE_BUZZ_NONE first
+  "name_adj"   "word", at most 8 bytes: the first half of a friendly name
+  "name_noun"  "word", the second half
+  "files"  {"name": "path"}: anything else, as raw bytes; paths are
+           relative to the manifest
+
+The simulator reads an image from $WAYSIDE_SIM_ASSETS.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+import zlib
+
+HEADER = struct.Struct("<IHHII")    # assets_header_t
+ENTRY = struct.Struct("<12sII")     # assets_entry_t
+MAGIC = 0x54534157                  # "WAST"
+VERSION = 1
+NAME_LEN = 12
+ALIGN = 4
+PARTITION_SIZE = 0x10000            # partitions.csv
+
+TABLES = {
+    "zones": (struct.Struct("<BxH"), ("led_count", "blink_period_ms")),
+    "buzz": (struct.Struct("<HHBx"), ("on_ms", "off_ms", "count")),
+    "name_adj": (struct.Struct("<8s"), ("word",)),
+    "name_noun": (struct.Struct("<8s"), ("word",)),
+}
+
+
+def pack_record(rec, r):
+    """a record is a list of fields, or a single string for a word table"""
+    fields = [r] if isinstance(r, str) else r
+    fields = [f.encode() if isinstance(f, str) else f for f in fields]
+    if rec.format.endswith("s") and not 0 < len(fields[0]) <= rec.size:
+        raise struct.error("%r: words are 1 to %d bytes" % (r, rec.size))
+    return rec.pack(*fields)
+
+
+def pack_table(name, records):
+    rec, _ = TABLES[name]
+    try:
+        return b"".join(pack_record(rec, r) for r in records)
+    except struct.error as e:
+        sys.exit("%s: %s" % (name, e))
+
+
+def show(value):
+    return value.rstrip(b"\0").decode(errors="replace") if isinstance(value, bytes) else "%d" % value
+
+
+def build(assets):
+    """assets: [(name, bytes)] -> container image"""
+    data_at = HEADER.size + len(assets) * ENTRY.size
+    index, data = b"", b""
+    for name, blob in assets:
+        if len(name.encode()) >= NAME_LEN:
+            sys.exit("%s: names are at most %d bytes" % (name, NAME_LEN - 1))
+        data += b"\0" * (-(data_at + len(data)) % ALIGN)
+        index += ENTRY.pack(name.encode(), data_at + len(data), len(blob))
+        data += blob
+    body = index + data
+    return HEADER.pack(MAGIC, VERSION, len(assets), HEADER.size + len(body), zlib.crc32(body)) + body
+
+
+def parse(image):
+    """-> [(name, bytes)], or exit with what is wrong"""
+    if len(image) < HEADER.size:
+        sys.exit("too short for a header")
+    magic, version, count, size, crc = HEADER.unpack_from(image)
+    if magic != MAGIC:
+        sys.exit("no container (magic %08x)" % magic)
+    if version != VERSION:
+        sys.exit("version %d, this tool reads %d" % (version, VERSION))
+    if size > len(image) or size < HEADER.size + count * ENTRY.size:
+        sys.exit("size %d doesn't fit" % size)
+    if zlib.crc32(image[HEADER.size:size]) != crc:
+        sys.exit("CRC mismatch")
+
+    assets = []
+    for i in range(count):
+        raw, offset, length = ENTRY.unpack_from(image, HEADER.size + i * ENTRY.size)
+        if offset % ALIGN or offset + length > size:
+            sys.exit("entry %d out of bounds" % i)
+        assets.append((raw.split(b"\0", 1)[0].decode(errors="replace"), image[offset:offset + length]))
+    return size, assets
+
+
+def cmd_build(args):
+    with open(args.manifest) as f:
+        manifest = json.load(f)
+    base = os.path.dirname(os.path.abspath(args.manifest))
+
+    assets = [(name, pack_table(name, manifest[name])) for name in TABLES if name in manifest]
+    for name, path in sorted(manifest.get("files", {}).items()):
+        if name in TABLES:
+            sys.exit("%s: a table name, not a file" % name)
+        with open(os.path.join(base, path), "rb") as f:
+            assets.append((name, f.read()))
+    unknown = set(manifest) - set(TABLES) - {"files"}
+    if unknown:
+        sys.exit("unknown keys: %s" % ", ".join(sorted(unknown)))
+
+    image = build(assets)
+    if len(image) > PARTITION_SIZE:
+        sys.exit("%d bytes, the partition holds %d" % (len(image), PARTITION_SIZE))
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print("%s: %d assets, %d bytes" % (args.output, len(assets), len(image)))
+
+
+def cmd_info(args):
+    with open(args.image, "rb") as f:
+        image = f.read()
+    size, assets = parse(image)
+    print("%d assets, %d bytes of %d" % (len(assets), size, PARTITION_SIZE))
+    for name, blob in assets:
+        print("  %-12s %6d bytes" % (name, len(blob)))
+        if not args.dump or name not in TABLES:
+            continue
+        rec, fields = TABLES[name]
+        if len(blob) % rec.size:
+            print("    not a whole number of %d byte records" % rec.size)
+            continue
+        for i, values in enumerate(rec.iter_unpack(blob)):
+            print("    %d: %s" % (i, " ".join("%s=%s" % (k, show(v)) for k, v in zip(fields, values))))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("build", help="pack a manifest into a container image")
+    p.add_argument("manifest")
+    p.add_argument("-o", "--output", required=True)
+    p.set_defaults(func=cmd_build)
+
+    p = sub.add_parser("info", help="check an image and list its assets")
+    p.add_argument("image")
+    p.add_argument("--dump", action="store_true", help="print the known tables")
+    p.set_defaults(func=cmd_info)
+
+    args = ap.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,960 @@
+#!/usr/bin/env python3
+"""
+wayside_sim.py - run N simulated badges over the sim_radio ether
+
+Starts one firmware/sim process per badge, configures each one the way the
+phone app would (PUBKEY, BITMASK, optional GROUPKEY), replays the scenario's
+timed events and aggregates what the badges report:
+
+  - fraction of badges that reached PARTNER (key exchange confirmed)
+  - time-to-pair p50 / p90 / max
+  - ESP-NOW frames sent and received per badge per second
+  - session resumes
+  - thermal throttling episodes, when the scenario drives the temperature
+  - announcement flooding, when the scenario sends any: coverage, delivery
+    latency p50 / p90 / max, the share of receivers that relayed and the
+    copies each badge heard per announcement delivered
+  - firmware update spread, when the scenario seeds a new version: fraction
+    of badges holding it, time from start p50 / p90 / max, restarts into it
+  - shared clock, when the scenario gives the badges crystal errors: time
+    until every badge is within 1 ms of its root, error p50 / p90 / max
+    after that, and how often the error exceeded the bound badges report
+  - radio sharing, when the scenario has badges notify the phone in bulk:
+    partner heartbeats missed overall and while a bulk transfer ran, frames
+    lost to BLE connection events, BLE chunks held back for heartbeats
+  - PHY rates, when the scenario sets rate: unicast airtime per pairing
+    made, the share of unicasts ACKed, the rates partners settled on, and
+    per distance bucket the unicasts delivered and their mean airtime
+  - frame sizes, when the scenario sets espnow: handshake time (PROPOSAL or
+    ACCEPT to key confirmed) between two v2 badges and where a v1 badge is
+    involved, frames sent whole and split, fragments joined and given up on
+  - load, when the scenario runs a load generator: what its identities
+    sent and heard, what the target dropped and why, and how the other
+    badges paired around it
+  - crowd estimates, when the scenario sets density: each badge's count of
+    badges and searching badges around, and of people per interest bit,
+    against the scenario's own bitmasks
+  - partner links, when the scenario sets link: pairs on CCMP, relay URL
+    latency p50 / p90 / max from ENC_URL to the partner's RECV_URL, and air
+    time per unicast
+
+Usage:
+  tools/wayside_sim.py scenarios/hall.json [--binary build/wayside_sim.elf]
+                       [--json out.json] [--trace DIR] [--verbose]
+                       [--sweep 8,16,32] [--coex-policy on|off]
+                       [--rate-control on|off] [--espnow-v1 all|none]
+                       [--link-encrypt on|off]
+
+--sweep runs the scenario once per badge count, same area, and ends with a
+table of badge density against announcement coverage and redundancy.
+Events for badges past the count are skipped.
+
+--coex-policy and --rate-control override the scenario's coex policy and
+rate control, to compare runs. --espnow-v1 makes every badge, or none, an
+ESP-NOW v1 one. --link-encrypt off gives every badge a radio without
+encrypted peer slots, so partner links stay plaintext.
+
+--trace makes every badge record what it hears to DIR/badge-<id>.wtr, the
+same format a CONFIG_ESPNOW_TRACE badge captures, for sim/replay.
+
+Scenario format (JSON):
+  name           free text
+  duration_s     how long to run after the last badge is configured
+  badges         number of processes
+  area_m         [w, h] badges are placed uniformly at random inside
+  bitmask_bits   interest bitmask length
+  interests      number of interests set per badge
+  similarity     BITMASK threshold (0-100)
+  shadowing_db   RSSI noise std dev, passed to every badge
+  seed           RNG seed for placement and interests
+  group_key      optional hex GROUPKEY sent to every badge
+  ota            optional {"version": v, "seeds": [i, ...], "image_kb": k}:
+                 the seed badges start on version v, all others on 1, every
+                 image is k KiB (default 256)
+  timesync       optional {"ppm": p, "offset_ms": o, "poll_s": s}: each
+                 badge's clock runs off by up to +-p ppm and starts up to o
+                 ms apart from the others; SIM TIME polls them every s
+  coex           optional {"policy": true|false}: start with the Wi-Fi/BLE
+                 coexistence policy on (default) or off
+  rate           optional {"control": true|false}: start with per-peer
+                 unicast rate control on (default) or off, and report rates
+  espnow         optional {"v1": [i, ...] | "all"}: these badges run an
+                 ESP-NOW v1 driver (250 byte frames), the rest v2
+  loadgen        optional {"badge": i, "target": j, "args": "n=32,rate=200"}:
+                 badge i starts LOAD:start with args once every badge is
+                 configured, aimed at badge j (broadcast without one); it
+                 and its target are left out of the pairing figures
+  link           optional {"encrypt": true|false, "url_len": n}: each badge
+                 sends ENC_URL with n characters as soon as it reports
+                 PARTNER; without encrypt no badge has an encrypted peer slot
+  density        optional {"bits": [b, ...]}: at the end every badge is
+                 asked CROWD:<bits> (CROWD, its busiest bits, without);
+                 the truth is every other badge, so keep the area small
+                 enough that all hear all
+  pubkey_len     optional PUBKEY length; sim-pk-<id> is padded to it, as
+                 an RSA key would be (default unpadded)
+  events         [{"at_s": t, "badge": i | "all",
+                   "move_to": [x, y] | "radio": "on"|"off" | "temp": c |
+                   "send": "<cmd>" | "announce": "<text>", "buzz": 0-3 |
+                   "ble_bulk": bytes}]
+
+Announcements are signed with a P-256 organizer key made for the run with
+the openssl command line tool; every badge gets its public half (ORGKEY)
+and the event's badge broadcasts the announcement as an organizer's phone
+would have it do (ANNOUNCE:<hex>).
+"""
+
+import argparse
+import json
+import os
+import random
+import select
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+DEFAULT_BINARY = os.path.join(os.path.dirname(__file__), "..", "build", "wayside_sim.elf")
+
+
+class Badge:
+    def __init__(self, idx, binary, x, y, env, trace_dir=None):
+        self.idx = idx
+        self.x = x
+        self.y = y
+        self.partner_ms = None
+        self.stats = {}
+        self.thermal = {}
+        self.ota = {}
+        self.announce = {}
+        self.coex = {}
+        self.rate = {}
+        self.frag = {}
+        self.load = {}              # LOAD status, or LOAD_DONE when the run ended first
+        self.crowd = {}             # CROWD reply; "bits" is {bit: people}
+        self.mask = b""             # the BITMASK it was given
+        self.v1 = env.get("WAYSIDE_SIM_ESPNOW_VERSION") == "1"
+        self.partner = None         # badge index from PARTNER
+        self.url = None             # ENC_URL to send on PARTNER
+        self.url_sent_at = None     # time.monotonic() of that
+        self.url_recv_at = None     # and of the partner's RECV_URL
+        self.announced = {}         # id -> time.monotonic() of ANNOUNCEMENT
+        self.times = []             # SIM TIME replies, oldest first
+        self.radio = {}
+        self.ready = False
+        self.fw = None
+        self.ota_ready_at = None    # time.monotonic() of OTA_READY
+        self.restarts = 0
+        self.start_ms = 0           # uptime at the scenario's t0
+        self.t0 = None
+        self.config = []            # phone commands, sent again after a restart
+        self._buf = b""
+
+        proc_env = dict(os.environ)
+        proc_env.update(env)
+        proc_env["WAYSIDE_SIM_ID"] = str(idx)
+        proc_env["WAYSIDE_SIM_X"] = "%.2f" % x
+        proc_env["WAYSIDE_SIM_Y"] = "%.2f" % y
+        if trace_dir:
+            proc_env["WAYSIDE_SIM_TRACE"] = os.path.join(trace_dir, "badge-%d.wtr" % idx)
+        self.proc = subprocess.Popen([binary], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT, env=proc_env, bufsize=0)
+        os.set_blocking(self.proc.stdout.fileno(), False)
+
+    def configure(self, lines):
+        self.config = lines
+        for line in lines:
+            self.send(line)
+
+    def send(self, line):
+        try:
+            self.proc.stdin.write((line + "\n").encode())
+            self.proc.stdin.flush()
+        except BrokenPipeError:
+            pass
+
+    def pump(self, verbose):
+        try:
+            chunk = self.proc.stdout.read()
+        except BlockingIOError:
+            return
+        if not chunk:
+            return
+        self._buf += chunk
+        *lines, self._buf = self._buf.split(b"\n")
+        for raw in lines:
+            self._parse(raw.decode(errors="replace").rstrip("\r"), verbose)
+
+    def _parse(self, line, verbose):
+        if verbose:
+            print("[%3d] %s" % (self.idx, line))
+        parts = line.split(" ", 2)
+        if parts[0] == "READY":
+            fw = next((p[3:] for p in parts[1:] if p.startswith("fw=")), None)
+            if self.ready:
+                # restarted into an update: uptime and radio counters start
+                # over, so the scenario's t0 is now that long before uptime 0
+                self.restarts += 1
+                if self.t0 is not None:
+                    self.start_ms = -int((time.monotonic() - self.t0) * 1000)
+                self.configure(self.config)
+            self.ready = True
+            self.fw = int(fw.split()[0]) if fw else None
+        elif parts[0] == "BLE" and len(parts) == 3:
+            msg = parts[2]
+            if msg.startswith("PARTNER:sim-pk-") and self.partner_ms is None:
+                self.partner_ms = int(parts[1])
+                self.partner = int(msg[8:].split("-")[2])
+                if self.url:
+                    self.send("ENC_URL:" + self.url)
+                    self.url_sent_at = time.monotonic()
+            elif msg.startswith("RECV_URL:") and self.url_recv_at is None:
+                self.url_recv_at = time.monotonic()
+            elif msg.startswith("STATS:"):
+                self.stats = dict(kv.split("=", 1) for kv in msg[6:].split(","))
+            elif msg.startswith("THERMAL:"):
+                self.thermal = dict(kv.split("=", 1) for kv in msg[8:].split(","))
+            elif msg.startswith("OTA_READY:") and self.ota_ready_at is None:
+                self.ota_ready_at = time.monotonic()
+            elif msg.startswith("ANNOUNCEMENT:"):
+                self.announced.setdefault(int(msg.split(":")[1]), time.monotonic())
+            elif msg.startswith("ANNOUNCE:"):
+                self.announce = dict(kv.split("=", 1) for kv in msg[9:].split(","))
+            elif msg.startswith("ANNOUNCE_ERR:"):
+                print("[%3d] %s" % (self.idx, msg), file=sys.stderr)
+            elif msg.startswith("COEX:"):
+                self.coex = dict(kv.split("=", 1) for kv in msg[5:].split(","))
+            elif msg.startswith("RATE:"):
+                self.rate = dict(kv.split("=", 1) for kv in msg[5:].split(","))
+            elif msg.startswith("LOAD:") or (msg.startswith("LOAD_DONE:") and not self.load):
+                self.load = dict(kv.split("=", 1) for kv in msg.split(":", 1)[1].split(","))
+            elif msg.startswith("LOAD_ERR:"):
+                print("[%3d] %s" % (self.idx, msg), file=sys.stderr)
+            elif msg.startswith("CROWD:"):
+                self.crowd = dict(kv.split("=", 1) for kv in msg[6:].split(","))
+                self.crowd["bits"] = {int(b): int(p) for b, p in
+                                      (cell.split(":") for cell in self.crowd.get("bits", "").split("/") if cell)}
+            elif msg.startswith("FRAG:"):
+                self.frag = dict(kv.split("=", 1) for kv in msg[5:].split(","))
+            elif msg.startswith("OTA:"):
+                self.ota = dict(kv.split("=", 1) for kv in msg[4:].split(","))
+        elif parts[0] == "TIME":
+            host, shared, err, synced, hops, root = line.split()[1:7]
+            self.times.append({"host_us": int(host), "shared_us": int(shared), "error_us": int(err),
+                               "synced": synced == "1", "hops": int(hops), "root": root})
+        elif parts[0] == "SIM" and len(parts) == 3:
+            self.radio = dict(kv.split("=", 1) for kv in parts[2].split())
+            self.radio["uptime_ms"] = parts[1]
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+class OrganizerKey:
+    """P-256 key pair in a temporary directory, driven through openssl"""
+
+    def __init__(self):
+        self._dir = tempfile.TemporaryDirectory(prefix="wayside-org-")
+        self.pem = os.path.join(self._dir.name, "org.pem")
+        subprocess.run(["openssl", "ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", self.pem],
+                       check=True, capture_output=True)
+        self.der = subprocess.run(["openssl", "pkey", "-in", self.pem, "-pubout", "-outform", "DER"],
+                                  check=True, capture_output=True).stdout
+
+    def announcement(self, ann_id, buzz, text):
+        """announce_t (announce.h) with hops 0, as the organizer's phone sends it"""
+        body = text.encode()
+        signed = struct.pack("<IBB", ann_id, buzz, len(body)) + body
+        sig = subprocess.run(["openssl", "dgst", "-sha256", "-sign", self.pem],
+                             input=signed, check=True, capture_output=True).stdout
+        return struct.pack("<BH", 0, len(sig)) + signed + sig
+
+
+def random_bitmask(rng, bits, interests):
+    mask = bytearray((bits + 7) // 8)
+    for b in rng.sample(range(bits), min(interests, bits)):
+        mask[b // 8] |= 1 << (b % 8)
+    return mask
+
+
+def run(scenario, binary, verbose, trace_dir=None):
+    rng = random.Random(scenario.get("seed", 1))
+    n = scenario["badges"]
+    w, h = scenario.get("area_m", [20, 20])
+    bits = scenario.get("bitmask_bits", 64)
+    env = {"WAYSIDE_SIM_SHADOWING": str(scenario.get("shadowing_db", 4))}
+    if "group" in scenario:
+        env["WAYSIDE_SIM_GROUP"] = scenario["group"]
+    if "port" in scenario:
+        env["WAYSIDE_SIM_PORT"] = str(scenario["port"])
+    if verbose:
+        env["WAYSIDE_SIM_VERBOSE"] = "1"
+
+    announcing = any("announce" in ev for ev in scenario.get("events", []))
+    org = OrganizerKey() if announcing else None
+    sent = {}                   # announcement id -> (badge, time.monotonic())
+
+    ota = scenario.get("ota")
+    if ota:
+        env["WAYSIDE_SIM_FW_SIZE"] = str(ota.get("image_kb", 256) * 1024)
+
+    timesync = scenario.get("timesync")
+    coex = scenario.get("coex")
+    if coex is not None and not coex.get("policy", True):
+        env["WAYSIDE_SIM_COEX_POLICY"] = "0"
+    bulk = any("ble_bulk" in ev for ev in scenario.get("events", []))
+    rate = scenario.get("rate")
+    if rate is not None and not rate.get("control", True):
+        env["WAYSIDE_SIM_RATE_CONTROL"] = "0"
+    espnow = scenario.get("espnow")
+    v1 = (espnow or {}).get("v1", [])
+    loadgen = scenario.get("loadgen")
+    density = scenario.get("density")
+    link = scenario.get("link")
+    if link is not None and not link.get("encrypt", True):
+        env["WAYSIDE_SIM_LINK_ENCRYPT"] = "0"
+
+    def badge_env(i):
+        e = dict(env)
+        if v1 == "all" or i in v1:
+            e["WAYSIDE_SIM_ESPNOW_VERSION"] = "1"
+        if timesync:
+            e["WAYSIDE_SIM_CLOCK_PPM"] = "%.3f" % rng.uniform(-timesync.get("ppm", 20), timesync.get("ppm", 20))
+            e["WAYSIDE_SIM_CLOCK_OFFSET_US"] = str(rng.randrange(0, timesync.get("offset_ms", 10000) * 1000 + 1))
+        if ota:
+            e["WAYSIDE_SIM_FW_VERSION"] = str(ota["version"] if i in ota.get("seeds", []) else 1)
+        return e
+
+    if trace_dir:
+        os.makedirs(trace_dir, exist_ok=True)
+    badges = [Badge(i, binary, rng.uniform(0, w), rng.uniform(0, h), badge_env(i), trace_dir)
+              for i in range(n)]
+
+    def pump_all(timeout):
+        end = time.monotonic() + timeout
+        while True:
+            fds = [b.proc.stdout for b in badges if b.proc.poll() is None]
+            left = end - time.monotonic()
+            if not fds or left <= 0:
+                break
+            select.select(fds, [], [], left)
+            for b in badges:
+                b.pump(verbose)
+
+    deadline = time.monotonic() + 10
+    while not all(b.ready for b in badges) and time.monotonic() < deadline:
+        pump_all(0.1)
+
+    for b in badges:
+        pubkey = "sim-pk-%d" % b.idx
+        if scenario.get("pubkey_len", 0) > len(pubkey) + 1:
+            pubkey += "-" + "x" * (scenario["pubkey_len"] - len(pubkey) - 1)
+        b.mask = random_bitmask(rng, bits, scenario.get("interests", 8))
+        if link is not None:
+            b.url = ("sim-url-%d-" % b.idx).ljust(link.get("url_len", 64), "u")
+        config = ["PUBKEY:%s" % pubkey,
+                  "BITMASK:%d:%s:%d" % (bits, b.mask.hex(), scenario.get("similarity", 0))]
+        if scenario.get("group_key"):
+            config.append("GROUPKEY:%s" % scenario["group_key"])
+        if org:
+            config.append("ORGKEY:%s" % org.der.hex())
+        b.configure(config)
+
+    pump_all(0.2)
+    for b in badges:
+        b.send("SIM REPORT")
+    pump_all(0.5)
+    t0 = time.monotonic()
+    for b in badges:
+        b.start_ms = int(b.radio.get("uptime_ms", 0))
+        b.t0 = t0
+        b.radio = {}
+    if loadgen:
+        cmd = "LOAD:start"
+        if loadgen.get("args"):
+            cmd += "," + loadgen["args"]
+        if loadgen.get("target") is not None:
+            cmd += ",target=%s" % sim_mac(loadgen["target"])
+        badges[loadgen["badge"]].send(cmd)
+
+    events = sorted(scenario.get("events", []), key=lambda e: e["at_s"])
+    duration = scenario.get("duration_s", 30)
+    polls = []                  # scenario time of each SIM TIME round
+    while True:
+        now = time.monotonic() - t0
+        if timesync and (not polls or now - polls[-1] >= timesync.get("poll_s", 2)):
+            polls.append(now)
+            for b in badges:
+                b.send("SIM TIME")
+        while events and events[0]["at_s"] <= now:
+            ev = events.pop(0)
+            if ev.get("badge", "all") == "all":
+                targets = badges
+            else:
+                targets = [badges[ev["badge"]]] if ev["badge"] < n else []
+            for b in targets:
+                if "move_to" in ev:
+                    b.x, b.y = ev["move_to"]
+                    b.send("SIM POS %.2f %.2f" % (b.x, b.y))
+                if "radio" in ev:
+                    b.send("SIM RADIO %s" % ev["radio"])
+                if "temp" in ev:
+                    b.send("SIM TEMP %.1f" % ev["temp"])
+                if "send" in ev:
+                    b.send(ev["send"])
+                if "ble_bulk" in ev:
+                    b.send("SIM BLEBULK %d" % ev["ble_bulk"])
+                if "announce" in ev:
+                    ann_id = len(sent) + 1
+                    b.send("ANNOUNCE:%s" % org.announcement(ann_id, ev.get("buzz", 0), ev["announce"]).hex())
+                    sent[ann_id] = (b.idx, time.monotonic())
+        if now >= duration:
+            break
+        pump_all(min(0.1, duration - now))
+
+    if density is not None:
+        # answered from espnow_task, so give the replies time before SIM QUIT
+        for b in badges:
+            b.send("CROWD:" + ",".join(str(x) for x in density["bits"]) if density.get("bits") else "CROWD")
+        pump_all(0.5)
+    for b in badges:
+        b.send("STATS")
+        b.send("THERMAL")
+        if ota:
+            b.send("OTA")
+        if org:
+            b.send("ANNOUNCE")
+        if bulk:
+            b.send("COEX")
+        if rate is not None:
+            b.send("RATE")
+        if espnow is not None:
+            b.send("FRAG")
+        if loadgen and b.idx == loadgen["badge"]:
+            b.send("LOAD")
+        b.send("SIM QUIT")
+    deadline = time.monotonic() + 5
+    while any(b.proc.poll() is None for b in badges) and time.monotonic() < deadline:
+        pump_all(0.1)
+    for b in badges:
+        b.pump(verbose)
+        if b.proc.poll() is None:
+            b.proc.kill()
+
+    pair_times = [b.partner_ms - b.start_ms for b in badges if b.partner_ms is not None]
+    per_badge = []
+    for b in badges:
+        # after a restart the radio counters only cover the new image
+        up_s = max(1e-3, (int(b.radio.get("uptime_ms", 0)) - b.start_ms) / 1000.0)
+        per_badge.append({
+            "id": b.idx,
+            "pos": [round(b.x, 2), round(b.y, 2)],
+            "paired_ms": None if b.partner_ms is None else b.partner_ms - b.start_ms,
+            "tx_fps": int(b.radio.get("tx", 0)) / up_s,
+            "rx_fps": int(b.radio.get("rx", 0)) / up_s,
+            "stats": b.stats,
+            "thermal": b.thermal,
+            "fw": b.fw,
+            "ota_ready_ms": None if b.ota_ready_at is None else int((b.ota_ready_at - t0) * 1000),
+            "restarts": b.restarts,
+            "ota": b.ota,
+            "announce": b.announce,
+            "coex": b.coex,
+            "rate": b.rate,
+            "frag": b.frag,
+            "espnow": 1 if b.v1 else 2,
+        })
+
+    result = {
+        "name": scenario.get("name", ""),
+        "badges": n,
+        "paired_fraction": len(pair_times) / float(n) if n else 0.0,
+        "time_to_pair_ms": {
+            "p50": percentile(pair_times, 50),
+            "p90": percentile(pair_times, 90),
+            "max": max(pair_times) if pair_times else None,
+        },
+        "tx_fps_mean": statistics.mean(p["tx_fps"] for p in per_badge) if per_badge else 0.0,
+        "rx_fps_mean": statistics.mean(p["rx_fps"] for p in per_badge) if per_badge else 0.0,
+        "resumed": sum(int(b.stats.get("resumed", 0)) for b in badges),
+        "throttles": sum(int(b.thermal.get("throttles", 0)) for b in badges),
+        "per_badge": per_badge,
+    }
+    if org:
+        latencies = []
+        reached = 0
+        for ann_id, (origin, at) in sent.items():
+            got = [b.announced[ann_id] - at for b in badges if b.idx != origin and ann_id in b.announced]
+            reached += len(got)
+            latencies += [int(t * 1000) for t in got]
+        receivers = len(sent) * (n - 1)
+        delivered = sum(int(b.announce.get("delivered", 0)) for b in badges)
+        copies = sum(int(b.announce.get("dups", 0)) for b in badges) + delivered
+        result["announce"] = {
+            "sent": len(sent),
+            "coverage": reached / float(receivers) if receivers else 0.0,
+            "latency_ms": {
+                "p50": percentile(latencies, 50),
+                "p90": percentile(latencies, 90),
+                "max": max(latencies) if latencies else None,
+            },
+            "relayed": sum(int(b.announce.get("relayed", 0)) for b in badges),
+            "suppressed": sum(int(b.announce.get("suppressed", 0)) for b in badges),
+            "relay_ratio": sum(int(b.announce.get("relayed", 0)) for b in badges) / float(delivered)
+                           if delivered else 0.0,
+            "copies_per_delivery": copies / float(delivered) if delivered else 0.0,
+        }
+    if timesync:
+        result["timesync"] = timesync_result(badges, polls)
+    if bulk:
+        def total(key, src="coex"):
+            return sum(int(getattr(b, src).get(key, 0)) for b in badges)
+        hb = total("hb") + total("hb_missed")
+        bulk_hb = total("bulk_hb") + total("bulk_missed")
+        result["coex"] = {
+            "policy": all(b.coex.get("policy") == "1" for b in badges),
+            "hb_loss": total("hb_missed") / float(hb) if hb else 0.0,
+            "bulk_hb_loss": total("bulk_missed") / float(bulk_hb) if bulk_hb else 0.0,
+            "bulk_hb": bulk_hb,
+            "lost_to_ble": total("ble_busy", "radio"),
+            "rx": total("rx", "radio"),
+            "tx_failed": total("tx_failed"),
+            "ble_chunks": total("ble_chunks"),
+            "deferred": total("deferred"),
+            "deferred_ms": total("deferred_ms"),
+            "bulks": total("bulks"),
+        }
+    if rate is not None:
+        result["rate"] = rate_result(badges, len(pair_times))
+    if espnow is not None:
+        result["frames"] = frames_result(badges)
+    if loadgen:
+        result["load"] = load_result(badges, loadgen)
+    if density is not None:
+        result["density"] = density_result(badges)
+    if link is not None:
+        result["link"] = link_result(badges, link)
+    if ota:
+        seeds = set(ota.get("seeds", []))
+        times = [p["ota_ready_ms"] for p in per_badge
+                 if p["id"] not in seeds and p["ota_ready_ms"] is not None]
+        others = n - len(seeds)
+        result["ota"] = {
+            "version": ota["version"],
+            "image_kb": ota.get("image_kb", 256),
+            "updated_fraction": len(times) / float(others) if others else 0.0,
+            "time_to_update_ms": {
+                "p50": percentile(times, 50),
+                "p90": percentile(times, 90),
+                "max": max(times) if times else None,
+            },
+            "applied": sum(1 for b in badges if b.idx not in seeds and b.fw == ota["version"]),
+            "failures": sum(int(b.ota.get("failures", 0)) for b in badges),
+            "sent_kb": sum(int(b.ota.get("sent_bytes", 0)) for b in badges) // 1024,
+            "served_kb": sum(int(b.ota.get("served_bytes", 0)) for b in badges) // 1024,
+        }
+    return result
+
+
+DIST_BUCKETS = ["0-2", "2-5", "5-10", "10-20", "20-40", "40+"]     # sim_radio.h, metres
+
+
+def rate_result(badges, paired):
+    """
+    Airtime and delivery come from the receivers' radio counters, which see
+    every unicast addressed to them, delivered or not, with the distance it
+    came from; the rates from what the badges report with RATE.
+    """
+    heard = [0] * len(DIST_BUCKETS)
+    delivered = [0] * len(DIST_BUCKETS)
+    air = [0] * len(DIST_BUCKETS)
+    for b in badges:
+        for i, cell in enumerate(b.radio.get("uc_dist", "").split(",")[:len(DIST_BUCKETS)]):
+            if cell:
+                h, d, a = (int(v) for v in cell.split("/"))
+                heard[i] += h
+                delivered[i] += d
+                air[i] += a
+
+    def total(key, src="radio"):
+        return sum(int(getattr(b, src).get(key, 0)) for b in badges)
+
+    partner_rates = {}
+    for b in badges:
+        r = b.rate.get("partner", "-")
+        if b.partner_ms is not None and r != "-":
+            partner_rates[r] = partner_rates.get(r, 0) + 1
+    pairs = paired / 2.0
+    return {
+        "control": all(b.rate.get("control") == "1" for b in badges),
+        "unicast_airtime_ms": total("uc_airtime_us") / 1000.0,
+        "airtime_ms_per_pairing": total("uc_airtime_us") / 1000.0 / pairs if pairs else None,
+        "acked": total("uc_acked") / float(total("uc_tx")) if total("uc_tx") else 0.0,
+        "partner_rates": partner_rates,
+        "airtime_vs_1m": total("airtime_ms", "rate") / float(total("airtime_1m_ms", "rate"))
+                         if total("airtime_1m_ms", "rate") else None,
+        "samples": total("samples", "rate"),
+        "by_distance": [{"m": DIST_BUCKETS[i], "unicasts": heard[i],
+                         "delivered": delivered[i] / float(heard[i]) if heard[i] else None,
+                         "airtime_us": air[i] / float(heard[i]) if heard[i] else None}
+                        for i in range(len(DIST_BUCKETS))],
+    }
+
+
+def sim_mac(idx):
+    """the MAC sim_radio.c gives badge idx, as hex"""
+    return "02574159%02x%02x" % (idx >> 8, idx & 0xFF)
+
+
+def load_result(badges, loadgen):
+    gen = badges[loadgen["badge"]]
+    target = badges[loadgen["target"]] if loadgen.get("target") is not None else None
+    others = [b for b in badges if b is not gen and b is not target]
+
+    def count(key, src):
+        return int(src.get(key, 0))
+
+    load = gen.load
+    result = {
+        "identities": count("n", load),
+        "rate": count("rate", load),
+        "tx": {k: count(k, load) for k in ("hello", "proposal", "heartbeat", "accept", "reject")},
+        "tx_failed": count("tx_failed", load),
+        "rx": {k: count("rx_" + k, load) for k in ("proposal", "accept", "reject", "heartbeat", "kex")},
+        "rx_dropped": count("rx_dropped", load),
+        "paired": count("paired", load),
+        "lost": count("lost", load),
+        "accept_ms": count("accept_ms", load),
+        "others": len(others),
+        "others_paired_fraction": sum(1 for b in others if b.partner_ms is not None) / float(len(others))
+                                  if others else 0.0,
+    }
+    if target is not None:
+        result["target"] = {k: count(k, target.stats)
+                            for k in ("rx", "foreign", "rate", "global", "dup", "claim", "queue", "nomem")}
+    return result
+
+
+def density_result(badges):
+    """
+    Truth for each badge is every other one; searching are those that never
+    paired, with their share of each bit. Errors are per badge, per bit
+    reported; relative ones only where the truth is nonzero.
+    """
+    def has_bit(b, bit):
+        return bit // 8 < len(b.mask) and b.mask[bit // 8] >> (bit % 8) & 1
+
+    badges_err, searching_err, bit_err, bit_rel = [], [], [], []
+    reported = 0
+    for b in badges:
+        if not b.crowd:
+            continue
+        reported += 1
+        others = [o for o in badges if o is not b]
+        searching = [o for o in others if o.partner_ms is None]
+        badges_err.append((int(b.crowd["badges"]) - len(others)) / float(len(others)))
+        if searching:
+            searching_err.append((int(b.crowd["searching"]) - len(searching)) / float(len(searching)))
+        for bit, people in b.crowd["bits"].items():
+            truth = sum(1 for o in searching if has_bit(o, bit))
+            bit_err.append(abs(people - truth))
+            if truth:
+                bit_rel.append(abs(people - truth) / float(truth))
+
+    def spread(values):
+        values = [abs(v) for v in values]
+        return {"mean": statistics.mean(values) if values else None,
+                "p90": percentile(values, 90),
+                "max": max(values) if values else None}
+
+    return {
+        "reported": reported,
+        "badges_rel_err": spread(badges_err),
+        "badges_bias": statistics.mean(badges_err) if badges_err else None,
+        "searching_rel_err": spread(searching_err),
+        "bits": len(bit_err),
+        "bit_people_err": spread(bit_err),
+        "bit_rel_err": spread(bit_rel),
+    }
+
+
+def link_result(badges, link):
+    """
+    Latency is per direction: from the badge's ENC_URL to its partner's
+    RECV_URL, which waits for the link to be verified (or found plaintext)
+    first. Air time per unicast is over every unicast sent, partner or not.
+    """
+    latencies = []
+    for b in badges:
+        if b.url_sent_at is None or b.partner is None or b.partner >= len(badges):
+            continue
+        p = badges[b.partner]
+        if p.url_recv_at is not None and p.partner == b.idx:
+            latencies.append(int((p.url_recv_at - b.url_sent_at) * 1000))
+
+    def total(key, src="radio"):
+        return sum(int(getattr(b, src).get(key, 0)) for b in badges)
+
+    sent = sum(1 for b in badges if b.url_sent_at is not None)
+    return {
+        "encrypt": link.get("encrypt", True),
+        "paired": sum(1 for b in badges if b.partner_ms is not None),
+        "ccmp": sum(1 for b in badges if b.stats.get("link") == "2"),
+        "urls_sent": sent,
+        "urls_relayed": len(latencies),
+        "url_latency_ms": {
+            "p50": percentile(latencies, 50),
+            "p90": percentile(latencies, 90),
+            "max": max(latencies) if latencies else None,
+        },
+        "airtime_us_per_unicast": total("uc_airtime_us") / float(total("uc_tx")) if total("uc_tx") else None,
+        "ccmp_fail": total("ccmp_fail"),
+    }
+
+
+def frames_result(badges):
+    """
+    Handshake times are each paired badge's own, from STATS: the initiator's
+    run from PROPOSAL, the other's from ACCEPT. A pair counts as v1 if
+    either side is.
+    """
+    v2_v2 = []
+    with_v1 = []
+    for b in badges:
+        hs_ms = int(b.stats.get("hs_ms", 0))
+        if b.partner is None or not hs_ms or b.partner >= len(badges):
+            continue
+        (with_v1 if b.v1 or badges[b.partner].v1 else v2_v2).append(hs_ms)
+
+    def total(key):
+        return sum(int(b.frag.get(key, 0)) for b in badges)
+
+    return {
+        "v1_badges": sum(1 for b in badges if b.v1),
+        "handshake_ms": {
+            name: {"n": len(times), "p50": percentile(times, 50), "p90": percentile(times, 90),
+                   "max": max(times) if times else None}
+            for name, times in (("v2_v2", v2_v2), ("with_v1", with_v1))
+        },
+        "tx_whole": total("tx_whole"),
+        "tx_split": total("tx_split"),
+        "tx_parts": total("tx_parts"),
+        "rx_joined": total("rx_joined"),
+        "rx_expired": total("rx_expired"),
+        "rx_bad": total("rx_bad"),
+    }
+
+
+def timesync_result(badges, polls):
+    """
+    Per poll round, each badge's shared time against the host clock, taken
+    relative to its root's in the same round; host time is common to all
+    badges, so that difference is the badge's error against its root.
+    """
+    rounds = min(len(b.times) for b in badges)
+    converged_s = None
+    errors = []                 # (round, |error| us, bound us)
+    for k in range(rounds):
+        roots = {}
+        for b in badges:
+            t = b.times[k]
+            if t["synced"] and t["hops"] == 0:
+                roots[t["root"]] = t["shared_us"] - t["host_us"]
+        round_errors = []
+        for b in badges:
+            t = b.times[k]
+            if not t["synced"] or t["root"] not in roots:
+                round_errors = None
+                break
+            round_errors.append((abs(t["shared_us"] - t["host_us"] - roots[t["root"]]), t["error_us"]))
+        if round_errors is None:
+            continue
+        if converged_s is None and max(e for e, _ in round_errors) < 1000:
+            converged_s = polls[k] if k < len(polls) else None
+        if converged_s is not None:
+            errors += round_errors
+
+    first_sync = [next((polls[k] for k, t in enumerate(b.times[:len(polls)]) if t["synced"]), None)
+                  for b in badges]
+    first_sync = [t for t in first_sync if t is not None]
+    last = [b.times[rounds - 1] for b in badges] if rounds else []
+    values = [e for e, _ in errors]
+    return {
+        "converged_s": None if converged_s is None else round(converged_s, 1),
+        "synced_fraction": sum(1 for t in last if t["synced"]) / float(len(badges)) if badges else 0.0,
+        "first_sync_s": {
+            "p50": percentile(first_sync, 50),
+            "p90": percentile(first_sync, 90),
+        },
+        "roots": len(set(t["root"] for t in last if t["synced"])),
+        "max_hops": max((t["hops"] for t in last), default=0),
+        "error_us": {
+            "p50": percentile(values, 50),
+            "p90": percentile(values, 90),
+            "max": max(values) if values else None,
+        },
+        "bound_us_mean": statistics.mean(b for _, b in errors) if errors else None,
+        "bound_exceeded": sum(1 for e, b in errors if e > b) / float(len(errors)) if errors else 0.0,
+    }
+
+
+def print_summary(result):
+    ttp = result["time_to_pair_ms"]
+    print("%s: %d badges, %.0f%% paired, time-to-pair p50=%s p90=%s max=%s ms, "
+          "tx %.1f/s rx %.1f/s per badge, %d resumes, %d throttles" % (
+              result["name"], result["badges"], 100 * result["paired_fraction"],
+              ttp["p50"], ttp["p90"], ttp["max"],
+              result["tx_fps_mean"], result["rx_fps_mean"], result["resumed"],
+              result["throttles"]))
+    if "announce" in result:
+        a = result["announce"]
+        t = a["latency_ms"]
+        print("announce: %d sent, %.0f%% coverage, latency p50=%s p90=%s max=%s ms, %.0f%% of receivers "
+              "relayed (%d suppressed), %.2f copies heard per delivery" % (
+                  a["sent"], 100 * a["coverage"], t["p50"], t["p90"], t["max"],
+                  100 * a["relay_ratio"], a["suppressed"], a["copies_per_delivery"]))
+    if "timesync" in result:
+        t = result["timesync"]
+        e = t["error_us"]
+        print("timesync: %.0f%% synced to %d root(s), up to %d hops, first sync p50=%s p90=%s s, "
+              "within 1 ms of the root after %s s, error p50=%s p90=%s max=%s us, "
+              "bound %.0f us mean, exceeded %.1f%%" % (
+                  100 * t["synced_fraction"], t["roots"], t["max_hops"],
+                  None if t["first_sync_s"]["p50"] is None else round(t["first_sync_s"]["p50"], 1),
+                  None if t["first_sync_s"]["p90"] is None else round(t["first_sync_s"]["p90"], 1),
+                  t["converged_s"], e["p50"], e["p90"], e["max"],
+                  t["bound_us_mean"] or 0, 100 * t["bound_exceeded"]))
+    if "coex" in result:
+        c = result["coex"]
+        print("coex: policy %s, partner heartbeats missed %.1f%% overall, %.1f%% of %d during bulk transfers, "
+              "%d frames lost to BLE (of %d heard), %d of %d BLE chunks held back %d ms in all" % (
+                  "on" if c["policy"] else "off", 100 * c["hb_loss"], 100 * c["bulk_hb_loss"], c["bulk_hb"],
+                  c["lost_to_ble"], c["rx"] + c["lost_to_ble"], c["deferred"], c["ble_chunks"],
+                  c["deferred_ms"]))
+    if "rate" in result:
+        r = result["rate"]
+        print("rate: control %s, unicast airtime %.0f ms in all, %s ms per pairing, %.1f%% of unicasts ACKed, "
+              "partners at %s, %d samples" % (
+                  "on" if r["control"] else "off", r["unicast_airtime_ms"],
+                  None if r["airtime_ms_per_pairing"] is None else round(r["airtime_ms_per_pairing"], 1),
+                  100 * r["acked"],
+                  " ".join("%s x%d" % kv for kv in sorted(r["partner_rates"].items())) or "-",
+                  r["samples"]))
+        print("%8s %10s %10s %12s" % ("m", "unicasts", "delivered", "us/frame"))
+        for d in r["by_distance"]:
+            if d["unicasts"]:
+                print("%8s %10d %9.1f%% %12.0f" % (d["m"], d["unicasts"], 100 * d["delivered"], d["airtime_us"]))
+    if "frames" in result:
+        f = result["frames"]
+        print("frames: %d v1 badges, %d sent whole over 250 bytes, %d split into %d fragments, %d joined, "
+              "%d given up on, %d bad" % (
+                  f["v1_badges"], f["tx_whole"], f["tx_split"], f["tx_parts"], f["rx_joined"],
+                  f["rx_expired"], f["rx_bad"]))
+        for name, t in sorted(f["handshake_ms"].items()):
+            if t["n"]:
+                print("  handshake %-8s n=%d p50=%s p90=%s max=%s ms" % (name, t["n"], t["p50"], t["p90"], t["max"]))
+    if "load" in result:
+        l = result["load"]
+        print("load: %d identities at %d frames/s sent %s, %d refused; heard %s, %d dropped; "
+              "%d pairings (%d lost), ACCEPT after %d ms mean; %.0f%% of the other %d badges paired" % (
+                  l["identities"], l["rate"], " ".join("%s=%d" % kv for kv in l["tx"].items()),
+                  l["tx_failed"], " ".join("%s=%d" % kv for kv in l["rx"].items()), l["rx_dropped"],
+                  l["paired"], l["lost"], l["accept_ms"], 100 * l["others_paired_fraction"], l["others"]))
+        if "target" in l:
+            t = l["target"]
+            print("  target: %d frames in, dropped %d rate, %d global, %d dup, %d claim, %d queue, %d nomem, %d foreign" % (
+                t["rx"], t["rate"], t["global"], t["dup"], t["claim"], t["queue"], t["nomem"], t["foreign"]))
+    if "density" in result:
+        d = result["density"]
+
+        def pct(v):
+            return "-" if v is None else "%.1f%%" % (100 * v)
+
+        def fmt(v):
+            return "-" if v is None else "%.2f" % v
+        print("density: %d badges reported; badge count off by %s mean (bias %s), searching by %s mean; "
+              "%d bits, people off by %s mean p90=%s max=%s, %s relative mean" % (
+                  d["reported"], pct(d["badges_rel_err"]["mean"]), pct(d["badges_bias"]),
+                  pct(d["searching_rel_err"]["mean"]), d["bits"], fmt(d["bit_people_err"]["mean"]),
+                  fmt(d["bit_people_err"]["p90"]), fmt(d["bit_people_err"]["max"]),
+                  pct(d["bit_rel_err"]["mean"])))
+    if "link" in result:
+        k = result["link"]
+        t = k["url_latency_ms"]
+        print("link: encrypt %s, %d of %d paired badges on verified CCMP, URL relayed %d of %d times, "
+              "latency p50=%s p90=%s max=%s ms, %s us air per unicast, %d unicasts failed CCMP" % (
+                  "on" if k["encrypt"] else "off", k["ccmp"], k["paired"], k["urls_relayed"], k["urls_sent"],
+                  t["p50"], t["p90"], t["max"],
+                  None if k["airtime_us_per_unicast"] is None else round(k["airtime_us_per_unicast"]),
+                  k["ccmp_fail"]))
+    if "ota" in result:
+        o = result["ota"]
+        t = o["time_to_update_ms"]
+        print("ota: version %d (%d KiB), %.0f%% updated, time-to-update p50=%s p90=%s max=%s ms, "
+              "%d applied, %d failures, %d KiB on air for %d KiB served" % (
+                  o["version"], o["image_kb"], 100 * o["updated_fraction"], t["p50"], t["p90"], t["max"],
+                  o["applied"], o["failures"], o["sent_kb"], o["served_kb"]))
+
+
+def print_sweep(scenario, results):
+    w, h = scenario.get("area_m", [20, 20])
+    print("%7s %12s %9s %12s %9s %12s" % ("badges", "per 100 m2", "coverage", "p90 ms", "relayed", "copies/dlv"))
+    for r in results:
+        a = r.get("announce")
+        if a is None:
+            continue
+        print("%7d %12.3f %8.0f%% %12s %8.0f%% %12.2f" % (
+            r["badges"], 100.0 * r["badges"] / (w * h), 100 * a["coverage"],
+            a["latency_ms"]["p90"], 100 * a["relay_ratio"], a["copies_per_delivery"]))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    ap.add_argument("scenario")
+    ap.add_argument("--binary", default=DEFAULT_BINARY)
+    ap.add_argument("--json", help="write the full result here")
+    ap.add_argument("--trace", metavar="DIR", help="record a .wtr per badge here")
+    ap.add_argument("--verbose", action="store_true", help="echo badge output")
+    ap.add_argument("--sweep", metavar="N,N,...", help="run once per badge count")
+    ap.add_argument("--coex-policy", choices=["on", "off"], help="override the scenario's coex policy")
+    ap.add_argument("--rate-control", choices=["on", "off"], help="override the scenario's rate control")
+    ap.add_argument("--link-encrypt", choices=["on", "off"], help="override the scenario's link encryption")
+    ap.add_argument("--espnow-v1", choices=["all", "none"], help="override which badges run ESP-NOW v1")
+    args = ap.parse_args()
+
+    with open(args.scenario) as f:
+        scenario = json.load(f)
+    if args.coex_policy:
+        scenario["coex"] = dict(scenario.get("coex", {}), policy=args.coex_policy == "on")
+    if args.rate_control:
+        scenario["rate"] = dict(scenario.get("rate", {}), control=args.rate_control == "on")
+    if args.link_encrypt:
+        scenario["link"] = dict(scenario.get("link", {}), encrypt=args.link_encrypt == "on")
+    if args.espnow_v1:
+        scenario["espnow"] = dict(scenario.get("espnow", {}), v1="all" if args.espnow_v1 == "all" else [])
+
+    if args.sweep:
+        results = []
+        for count in (int(c) for c in args.sweep.split(",")):
+            results.append(run(dict(scenario, badges=count), args.binary, args.verbose, args.trace))
+            print_summary(results[-1])
+        print_sweep(scenario, results)
+        result = results
+    else:
+        result = run(scenario, args.binary, args.verbose, args.trace)
+        print_summary(result)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(result, f, indent=2)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
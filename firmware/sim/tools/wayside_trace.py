@@ -0,0 +1,346 @@
+#!/usr/bin/env python3
+"""
+wayside_trace.py - collect and inspect radio traces (CONFIG_ESPNOW_TRACE)
+
+  extract  decode a dump of the "trace" flash partition
+             parttool.py read_partition --partition-name trace --output trace.bin
+             tools/wayside_trace.py extract trace.bin -o hall.wtr
+  capture  read the USB Serial/JTAG stream until Ctrl-C (needs pyserial)
+             tools/wayside_trace.py capture /dev/ttyACM0 -o hall.wtr
+  live     decode the stream as it arrives and print channel statistics
+           every second: frames/s by type, badges heard and their states,
+           frames missed going by each sender's seq_num (needs pyserial
+           for a port; a file is followed as it grows)
+             tools/wayside_trace.py live /dev/ttyACM0 [-o hall.wtr]
+  info     summarise a .wtr file, --dump prints every record
+
+A .wtr file is the record stream described in main/lib/trace.h, starting
+with a META record, in capture order. Feed it to sim/replay:
+  WAYSIDE_REPLAY_TRACE=hall.wtr build/wayside_replay.elf
+
+A flash dump can hold several captures across reboots; extract writes one
+file per capture (hall-1.wtr, hall-2.wtr, ...) when it finds more than one.
+
+live is meant for a CONFIG_ESPNOW_SNIFFER badge, which streams every
+ESP-NOW frame on the channel from boot, but decodes any USB trace.
+"""
+
+import argparse
+import collections
+import os
+import struct
+import sys
+import time
+
+RECORD = struct.Struct("<HHHBbbBI6s")
+SECTOR = struct.Struct("<II")
+SYNC = 0x5457
+SYNC_BYTES = struct.pack("<H", SYNC)
+SECTOR_MAGIC = 0x53525457
+SECTOR_SIZE = 4096
+MAX_DATA = 1470
+FLAG_META = 0x01
+FLAG_UNICAST = 0x02
+FLAG_SNAPPED = 0x04
+
+PROTOCOL_ID = 0x43              # PAIRING_PROTOCOL_ID
+HEADER = struct.Struct("<BB6s6sIBbbIH")     # broadcast_header_t
+MSG_NAMES = {1: "HELLO", 2: "PROPOSAL", 3: "ACCEPT", 4: "REJECT", 5: "HEARTBEAT",
+             6: "KEY_EXCHANGE", 7: "RELAY_URL", 8: "RESUME", 9: "OTA_ADVERT", 10: "OTA_REQUEST",
+             11: "OTA_CHUNK", 12: "ANNOUNCE", 13: "TIMESYNC", 14: "FRAGMENT"}
+STATE_NAMES = {0: "SEARCHING", 1: "PROPOSING", 2: "PAIRED", 3: "SUSPENDED"}
+
+
+def crc16_le(data):
+    """esp_rom_crc16_le(0, data, len)"""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc ^ 0xFFFF
+
+
+class Record:
+    __slots__ = ("flags", "rssi", "noise_floor", "channel", "t_ms", "src", "data", "raw")
+
+    def __init__(self, raw):
+        _, _, length, self.flags, self.rssi, self.noise_floor, self.channel, self.t_ms, self.src = \
+            RECORD.unpack_from(raw)
+        self.data = raw[RECORD.size:RECORD.size + length]
+        self.raw = raw
+
+    @property
+    def meta(self):
+        return bool(self.flags & FLAG_META)
+
+    @property
+    def kind(self):
+        if len(self.data) < 2 or self.data[0] != PROTOCOL_ID:
+            return "foreign"
+        return MSG_NAMES.get(self.data[1], "?")
+
+    def header(self):
+        """(state, seq_num) from broadcast_header_t, or None"""
+        if len(self.data) < HEADER.size or self.data[0] != PROTOCOL_ID:
+            return None
+        fields = HEADER.unpack_from(self.data)
+        return fields[5], fields[8]
+
+
+def parse_stream(buf):
+    """Return (records, bytes consumed); skips anything that fails sync or CRC."""
+    pos = 0
+    records = []
+    while True:
+        pos = buf.find(SYNC_BYTES, pos)
+        if pos < 0 or len(buf) - pos < RECORD.size:
+            return records, (len(buf) if pos < 0 else pos)
+        _, crc, length = struct.unpack_from("<HHH", buf, pos)
+        if length > MAX_DATA:
+            pos += 1
+            continue
+        end = pos + RECORD.size + length
+        if end > len(buf):
+            return records, pos
+        if crc16_le(buf[pos + 4:end]) != crc:
+            pos += 1
+            continue
+        records.append(Record(bytes(buf[pos:end])))
+        pos = end
+
+
+def split_captures(records):
+    """A META record whose time went backwards starts a new capture (reboot)."""
+    captures = []
+    last_t = None
+    for rec in records:
+        if rec.meta and (not captures or last_t is None or rec.t_ms < last_t):
+            captures.append([])
+        if captures:
+            captures[-1].append(rec)
+            last_t = rec.t_ms
+    return captures
+
+
+def write_wtr(path, records):
+    with open(path, "wb") as f:
+        for rec in records:
+            f.write(rec.raw)
+    print("%s: %d records" % (path, len(records)))
+
+
+def cmd_extract(args):
+    with open(args.dump, "rb") as f:
+        image = f.read()
+
+    sectors = []
+    for off in range(0, len(image) - SECTOR.size + 1, SECTOR_SIZE):
+        magic, seq = SECTOR.unpack_from(image, off)
+        if magic == SECTOR_MAGIC:
+            sectors.append((seq, off))
+    if not sectors:
+        sys.exit("no trace sectors found in %s" % args.dump)
+
+    # oldest first; seq only ever increases
+    sectors.sort()
+    records = []
+    for _, off in sectors:
+        recs, _ = parse_stream(image[off + SECTOR.size:off + SECTOR_SIZE])
+        records.extend(recs)
+
+    captures = split_captures(records)
+    base, ext = os.path.splitext(args.output)
+    if len(captures) == 1:
+        write_wtr(args.output, captures[0])
+    else:
+        for i, cap in enumerate(captures, 1):
+            write_wtr("%s-%d%s" % (base, i, ext or ".wtr"), cap)
+
+
+def cmd_capture(args):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("capture needs pyserial (pip install pyserial)")
+
+    port = serial.Serial(args.port, 115200, timeout=0.2)
+    buf = bytearray()
+    seen_meta = False
+    count = 0
+    start = time.monotonic()
+    print("capturing from %s, send TRACE:on from the app; Ctrl-C to stop" % args.port)
+    with open(args.output, "wb") as out:
+        try:
+            while args.seconds is None or time.monotonic() - start < args.seconds:
+                buf += port.read(4096)
+                records, used = parse_stream(buf)
+                del buf[:used]
+                for rec in records:
+                    # the replayer needs the listener's MAC before the first frame
+                    seen_meta = seen_meta or rec.meta
+                    if seen_meta:
+                        out.write(rec.raw)
+                        count += 1
+        except KeyboardInterrupt:
+            pass
+    print("%s: %d records" % (args.output, count))
+
+
+def mac_str(mac):
+    return ":".join("%02x" % b for b in mac)
+
+
+def cmd_info(args):
+    with open(args.trace, "rb") as f:
+        records, _ = parse_stream(f.read())
+    frames = [r for r in records if not r.meta]
+    metas = [r for r in records if r.meta]
+    if not frames:
+        print("%s: no frames" % args.trace)
+        return
+
+    if args.dump:
+        for r in records:
+            if r.meta:
+                print("%10d META %s" % (r.t_ms, mac_str(r.src)))
+                continue
+            print("%10d %s %4d dBm nf %4d ch %2d %s %-12s %s%s" % (
+                r.t_ms, mac_str(r.src), r.rssi, r.noise_floor, r.channel,
+                "U" if r.flags & FLAG_UNICAST else "B", r.kind, r.data.hex(),
+                "..." if r.flags & FLAG_SNAPPED else ""))
+
+    duration_s = max(1e-3, (frames[-1].t_ms - frames[0].t_ms) / 1000.0)
+    per_second = collections.Counter(r.t_ms // 1000 for r in frames)
+    types = collections.Counter(r.kind for r in frames)
+    senders = collections.Counter(r.src for r in frames)
+    rssi_bins = collections.Counter(min(0, r.rssi // 10 * 10) for r in frames)
+
+    print("%s: listener %s, %d captures" % (args.trace, mac_str(metas[0].src) if metas else "?", len(metas)))
+    print("  %d frames over %.1f s, %.1f/s mean, %d/s peak, %d senders" % (
+        len(frames), duration_s, len(frames) / duration_s, max(per_second.values()), len(senders)))
+    print("  types: " + ", ".join("%s=%d" % kv for kv in types.most_common()))
+    print("  rssi:  " + ", ".join("%d..%d=%d" % (b, b + 9, n) for b, n in sorted(rssi_bins.items())))
+    print("  busiest senders: " + ", ".join("%s=%d" % (mac_str(m), n) for m, n in senders.most_common(5)))
+
+
+class ChannelStats:
+    """Running view of the channel, from records in arrival order"""
+
+    def __init__(self):
+        self.senders = {}       # mac -> [last state, last seq_num]
+        self.missed = 0
+        self.total = 0
+        self.window = []        # records since the last line
+
+    def add(self, rec):
+        if rec.meta:
+            return
+        self.total += 1
+        self.window.append(rec)
+        hdr = rec.header()
+        if hdr is None:
+            return
+        state, seq = hdr
+        last = self.senders.get(rec.src)
+        # fragments and every other frame a badge sends take the next seq_num
+        if last is not None and 0 < seq - last[1] < 1000:
+            self.missed += seq - last[1] - 1
+        if last is None or seq > last[1] or last[1] - seq > 1000:
+            self.senders[rec.src] = [state, seq]
+
+    def line(self, elapsed_s, interval_s):
+        frames = self.window
+        self.window = []
+        types = collections.Counter(r.kind for r in frames)
+        heard = set(r.src for r in frames)
+        states = collections.Counter(STATE_NAMES.get(v[0], "?") for m, v in self.senders.items() if m in heard)
+        unicast = sum(1 for r in frames if r.flags & FLAG_UNICAST)
+        rssi = sorted(r.rssi for r in frames)
+        return "%7.1f s %6.1f fr/s  %s | %d badges (%d seen) %s | %d%% unicast, rssi p50 %s, %d missed" % (
+            elapsed_s, len(frames) / interval_s,
+            " ".join("%s %d" % kv for kv in types.most_common()) or "-",
+            len(heard), len(self.senders),
+            " ".join("%s %d" % kv for kv in sorted(states.items())) or "-",
+            100 * unicast // len(frames) if frames else 0,
+            rssi[len(rssi) // 2] if rssi else "-", self.missed)
+
+
+def open_stream(path):
+    """A serial port, or a file read as it grows; returns read(n) -> bytes"""
+    if os.path.isfile(path):
+        f = open(path, "rb")
+
+        def read(n):
+            data = f.read(n)
+            if not data:
+                time.sleep(0.05)
+            return data
+        return read
+    try:
+        import serial
+    except ImportError:
+        sys.exit("live needs pyserial for a port (pip install pyserial)")
+    return serial.Serial(path, 115200, timeout=0.05).read
+
+
+def cmd_live(args):
+    read = open_stream(args.port)
+    out = open(args.output, "wb") if args.output else None
+    stats = ChannelStats()
+    buf = bytearray()
+    start = time.monotonic()
+    last = start
+    try:
+        while args.seconds is None or time.monotonic() - start < args.seconds:
+            buf += read(4096)
+            records, used = parse_stream(buf)
+            del buf[:used]
+            for rec in records:
+                stats.add(rec)
+                if out:
+                    out.write(rec.raw)
+            now = time.monotonic()
+            if now - last >= args.interval:
+                print(stats.line(now - start, now - last), flush=True)
+                last = now
+    except KeyboardInterrupt:
+        pass
+    if out:
+        out.close()
+    print("%d frames from %d badges, %d missed" % (stats.total, len(stats.senders), stats.missed))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("extract", help="decode a trace partition dump")
+    p.add_argument("dump")
+    p.add_argument("-o", "--output", required=True)
+    p.set_defaults(func=cmd_extract)
+
+    p = sub.add_parser("capture", help="record the USB Serial/JTAG stream")
+    p.add_argument("port")
+    p.add_argument("-o", "--output", required=True)
+    p.add_argument("--seconds", type=float, help="stop after this long")
+    p.set_defaults(func=cmd_capture)
+
+    p = sub.add_parser("live", help="print channel statistics from the USB stream")
+    p.add_argument("port", help="serial port, or a .wtr being written")
+    p.add_argument("-o", "--output", help="also record a .wtr here")
+    p.add_argument("--interval", type=float, default=1.0, help="seconds per line")
+    p.add_argument("--seconds", type=float, help="stop after this long")
+    p.set_defaults(func=cmd_live)
+
+    p = sub.add_parser("info", help="summarise a .wtr file")
+    p.add_argument("trace")
+    p.add_argument("--dump", action="store_true", help="print every record")
+    p.set_defaults(func=cmd_info)
+
+    args = ap.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())